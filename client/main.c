@@ -4,17 +4,26 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/socket.h>
-#include <netinet/in.h>
-#include <netdb.h>
 #include <sys/epoll.h>
 #include <errno.h>
 #include <unistd.h>
 
+#include "address.h"
+#include "clock.h"
 #include "codec.h"
 #include "twiit_list.h"
 
 #define EPOLL_MAX_EVENTS 16
 #define CMD_BUFFER_SIZE 1000
+// Trames lues au plus par appel à recv(), et appels au plus par réveil
+#define RECEIVE_BUFFER_FRAMES 256
+#define RECEIVE_MAX_READS 16
+// Taille du tampon de la sortie standard, écrit une fois par réveil
+#define STDOUT_BUFFER_SIZE (64 * 1024)
+// Intervalle minimal entre deux affichages des twiiiiits reçus (20 images par seconde)
+#define RENDER_INTERVAL_US 50000
+// Twiiiiits affichés au plus par image : au-delà, les plus anciens sont seulement comptés
+#define RENDER_MAX_TWIIIIITS 20
 
 typedef struct {
     int client_socket;
@@ -24,52 +33,67 @@ typedef struct {
     size_t cmd_offset;
     char send_buffer[IO_BUFFER_SIZE];
     size_t send_buffer_len;
-    char receive_buffer[IO_BUFFER_SIZE];
-    size_t receive_buffer_len;
 } client_state;
 
 void handle_event(client_state* client, struct epoll_event* event);
+bool receive_frames(client_state* client);
+void render_twiiiiits(const twiiiiit_list* list);
 int send_msg(client_state client);
-void receive_msg(client_state client, message_s2c msg);
+void receive_msg(client_state* client, message_s2c msg);
 void publish(client_state client);
 void subscribe(client_state client, bool unsub);
 void sub_list (client_state client);
+void pong(client_state client);
+void ack(client_state client);
+void search(client_state client, bool next_page);
+void trending(client_state client);
+void fetch_timeline(client_state client, bool older);
+void channel(client_state client, bool leave);
+void channel_publish(client_state client);
+
+// Dernière recherche, pour demander la page suivante
+static char search_query[MESSAGE_MAX_LENGTH];
+static uint32_t search_next_cursor = 0;
+static uint64_t search_snapshot = 0;
+
+// Nombre de twiiiiits par page du fil d'actualité, et twiiiiit (date et numéro de séquence) avant lequel commence la
+// page suivante
+#define TIMELINE_PAGE_SIZE 10
+static int64_t timeline_next_before = 0;
+static uint64_t timeline_next_before_seq = 0;
+
+// Noms du dernier lot d'abonnements envoyé, pour afficher le résultat de chacun
+static user_name batch_names[SUBSCRIBE_BATCH_MAX];
+
+// Twiiiiits reçus mais pas encore affichés (les derniers de la liste), et date du dernier affichage
+static size_t unrendered = 0;
+static int64_t last_render = 0;
+
+// Nom de connexion, pour ne pas acquitter ses propres twiiiiits, et dernier twiiiiit reçu de ses abonnements, acquitté
+// une fois par réveil (c.f. MESSAGE_C2S_ACK)
+static user_name self_name;
+static uint64_t received_seq = 0;
+static uint64_t acked_seq = 0;
 
 int main(int argc, char** argv) {
-    uint16_t port;
-
     if (argc != 2) {
-        printf("Usage: %s IP:PORT\n       %s IP\n", argv[0], argv[0]);
+        printf("Usage: %s ADDRESS\n  ADDRESS: HOST[:PORT], [IPv6][:PORT] or unix:/path\n", argv[0]);
         exit(1);
     }
 
-    char* host = argv[1];
-    char* colon = strrchr(host, ':');
-    if (colon != NULL) {
-        *colon = 0;
-        port = strtoul(colon + 1, NULL, 10);
-    } else {
-        port = DEFAULT_PORT;
-    }
-
-    struct hostent* ip = gethostbyname(host);
-    int client_socket = socket(AF_INET, SOCK_STREAM, 0);
-    assert(client_socket != 0);
-
-    struct sockaddr_in address = {
-        .sin_family = AF_INET,
-        .sin_addr = {
-            .s_addr = *((in_addr_t*) ip->h_addr),
-        },
-        .sin_port = htons(port),
-        .sin_zero = { 0 },
-    };
+    // La sortie n'est écrite qu'une fois par tour de boucle, plutôt qu'à chaque ligne
+    setvbuf(stdout, NULL, _IOFBF, STDOUT_BUFFER_SIZE);
 
-    assert(connect(client_socket, (struct sockaddr*) &address, sizeof(address)) == 0);
+    int client_socket = address_connect(argv[1], DEFAULT_PORT);
+    if (client_socket < 0) {
+        printf("[ERROR] Can't connect to %s: %s\n", argv[1], errno ? strerror(errno) : "unknown host");
+        exit(1);
+    }
     printf("[INFO] Connected\n");
 
     char user[MAX_USERNAME_LENGTH];
     printf("USER ID:");
+    fflush(stdout);
     scanf("%s", user);
 
     message_c2s message = {
@@ -81,10 +105,10 @@ int main(int argc, char** argv) {
             .twiiiiit_list = twiit_list_new(),
             .cmd_offset = 0,
             .send_buffer_len = 0,
-            .receive_buffer_len = 0,
     };
 
     memcpy(&message.join_as, user, strnlen(user, MAX_USERNAME_LENGTH));
+    memcpy(self_name, message.join_as, sizeof self_name);
     memset(&client.send_buffer, 0, MESSAGE_MAX_LENGTH);
     encode_c2s(&message, client.send_buffer);
     while(client.send_buffer_len != IO_BUFFER_SIZE){
@@ -113,17 +137,30 @@ int main(int argc, char** argv) {
 
     struct epoll_event events[EPOLL_MAX_EVENTS];
     while (true) {
+        fflush(stdout);
+
+        // Des twiiiiits attendent l'image suivante
+        int timeout = -1;
+        if (unrendered > 0) {
+            int64_t until_render = last_render + RENDER_INTERVAL_US - monotonic_now();
+            timeout = until_render > 0 ? (until_render + 999) / 1000 : 0;
+        }
+
         int remaining_events;
         do {
-            remaining_events = epoll_wait(epoll, events, EPOLL_MAX_EVENTS, -1);
+            remaining_events = epoll_wait(epoll, events, EPOLL_MAX_EVENTS, timeout);
         } while (remaining_events == -1 && errno == EINTR); // Obligatoire pour que GDB fonctionne
-        assert(remaining_events > 0);
+        assert(remaining_events >= 0);
 
         for (int i = 0; i < remaining_events; i++) {
             struct epoll_event *event = &events[i];
 
             handle_event(&client, event);
         }
+
+        if (unrendered > 0 && monotonic_now() - last_render >= RENDER_INTERVAL_US) {
+            render_twiiiiits(client.twiiiiit_list);
+        }
     }
 }
 
@@ -147,23 +184,7 @@ void handle_event(client_state* client, struct epoll_event* event) {
 
             }
         } else if (event->data.fd == client->client_socket) {
-            // TODO if client.received... full
-            ssize_t already_read = client->receive_buffer_len;
-            ssize_t bytes_read = read(client->client_socket, client->receive_buffer + already_read, IO_BUFFER_SIZE - already_read);
-            if (bytes_read > 0) {
-                client->receive_buffer_len += bytes_read;
-                if (client->receive_buffer_len == IO_BUFFER_SIZE) {
-                    client->receive_buffer_len = 0;
-                    message_s2c message;
-                    if (decode_s2c(client->receive_buffer, &message)) {
-                        receive_msg(*client, message);
-                    } else {
-                        printf("[WARNING] Invalid message sent by server\n");
-                    }
-                }
-            } else {
-                close(client->client_socket);
-            }
+            if (!receive_frames(client)) close(client->client_socket);
         } else {
             printf("[ERROR] Unhandled\n"); // TODO
         }
@@ -172,6 +193,61 @@ void handle_event(client_state* client, struct epoll_event* event) {
     }
 }
 
+/**
+ * Lit et traite toutes les trames déjà arrivées, plutôt qu'une par réveil. Renvoie false si la connexion est fermée.
+ */
+bool receive_frames(client_state* client) {
+    // Une trame coupée entre deux lectures reste au début du tampon
+    static char receive_buffer[RECEIVE_BUFFER_FRAMES * IO_BUFFER_SIZE];
+    static size_t receive_buffer_len = 0;
+
+    for (int reads = 0; reads < RECEIVE_MAX_READS; reads++) {
+        size_t available = sizeof receive_buffer - receive_buffer_len;
+        ssize_t bytes_read = recv(client->client_socket, receive_buffer + receive_buffer_len, available, MSG_DONTWAIT);
+        if (bytes_read == 0) return false;
+        if (bytes_read < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        receive_buffer_len += bytes_read;
+
+        size_t offset = 0;
+        for (; receive_buffer_len - offset >= IO_BUFFER_SIZE; offset += IO_BUFFER_SIZE) {
+            message_s2c message;
+            if (decode_s2c(receive_buffer + offset, &message)) {
+                receive_msg(client, message);
+            } else {
+                printf("[WARNING] Invalid message sent by server\n");
+            }
+        }
+        memmove(receive_buffer, receive_buffer + offset, receive_buffer_len - offset);
+        receive_buffer_len -= offset;
+
+        if ((size_t) bytes_read < available) break; // Plus rien à lire pour l'instant
+    }
+
+    if (received_seq > acked_seq) ack(*client);
+    return true;
+}
+
+/**
+ * Affiche les twiiiiits reçus depuis la dernière image. Si le client a pris du retard, les plus anciens sont résumés
+ * par leur nombre (ils restent dans la liste).
+ */
+void render_twiiiiits(const twiiiiit_list* list) {
+    size_t shown = unrendered < RENDER_MAX_TWIIIIITS ? unrendered : RENDER_MAX_TWIIIIITS;
+    if (unrendered > shown) printf("[TWIIIIIT] %zu new twiiiiits\n", unrendered - shown);
+
+    struct twiiiiit_list_node* node = list->tail;
+    for (size_t i = 1; i < shown && node != NULL && node->prev != NULL; i++) node = node->prev;
+    for (; node != NULL; node = node->next) {
+        printf(
+            "[TWIIIIIT] @%.*s - %.*s\n",
+            MAX_USERNAME_LENGTH, node->twiiiiit.author, MESSAGE_MAX_LENGTH, node->twiiiiit.message
+        );
+    }
+
+    unrendered = 0;
+    last_render = monotonic_now();
+}
+
 int send_msg(client_state client) {
     switch (*client.cmd) {
         case 'P' :
@@ -186,15 +262,39 @@ int send_msg(client_state client) {
         case 'L':
             sub_list(client);
             return 1;
+        case 'F':
+            search(client, false);
+            return 1;
+        case 'N':
+            search(client, true);
+            return 1;
+        case 'T':
+            trending(client);
+            return 1;
+        case 'R':
+            fetch_timeline(client, false);
+            return 1;
+        case 'O':
+            fetch_timeline(client, true);
+            return 1;
+        case 'J':
+            channel(client, false);
+            return 1;
+        case 'Q':
+            channel(client, true);
+            return 1;
+        case 'C':
+            channel_publish(client);
+            return 1;
         case 'H':
-            printf("Publish : P <message>\nSubscribe : S <user>\nUnsubscribe : U <user>\nAll subscriptions : L\nHelp : H\n");
+            printf("Publish : P <message>\nSubscribe : S <user> [user...]\nUnsubscribe : U <user> [user...]\nAll subscriptions : L\nSearch : F <words>\nNext search results : N\nTrending : T\nRead timeline : R\nOlder twiiiiits : O\nJoin channel : J <channel>\nQuit channel : Q <channel>\nPublish in channel : C <channel> <message>\nHelp : H\n");
             return 1;
         default :
             return 0;
     }
 }
 
-void receive_msg(client_state client, message_s2c msg){
+void receive_msg(client_state* client, message_s2c msg){
     switch (msg.tag) {
         case MESSAGE_S2C_LOGIN_STATUS:
             printf("[SERVER]");
@@ -212,8 +312,12 @@ void receive_msg(client_state client, message_s2c msg){
             break;
 
         case MESSAGE_S2C_RECEIVED_MESSAGE:
-            twiiiiit_append(client.twiiiiit_list,msg.received_message);
-            printf("[TWIIIIIT] @%s - %s\n", msg.received_message.author, msg.received_message.message);
+            // Affiché à la prochaine image, c.f. render_twiiiiits()
+            twiiiiit_append(client->twiiiiit_list, msg.received_message);
+            unrendered++;
+            if (strncmp(msg.received_message.author, self_name, MAX_USERNAME_LENGTH) != 0) {
+                if (msg.received_message.seq > received_seq) received_seq = msg.received_message.seq;
+            }
             break;
 
         case MESSAGE_S2C_SUBSCRIBE_RESULT:
@@ -244,9 +348,65 @@ void receive_msg(client_state client, message_s2c msg){
                 case KICK_REASON_PROTOCOL_ERROR :
                     printf("Kicked : protocol error.\n");
                     break;
+                case KICK_REASON_TIMEOUT :
+                    printf("Kicked : connection timed out.\n");
+                    break;
 
             }
             break;
+        case MESSAGE_S2C_PING:
+            pong(*client);
+            break;
+        case MESSAGE_S2C_THROTTLED:
+            printf("[SERVER] Too many requests, retry in %u ms.\n", msg.throttled.retry_after_ms);
+            break;
+        case MESSAGE_S2C_SEARCH_RESULT:
+            printf("[FOUND] @%s - %s\n", msg.search_result.author, msg.search_result.message);
+            break;
+        case MESSAGE_S2C_SEARCH_END:
+            search_next_cursor = msg.search_end.cursor;
+            search_snapshot = msg.search_end.snapshot;
+            if (search_next_cursor != 0) printf("[SERVER] More results : N\n");
+            else printf("[SERVER] End of the results.\n");
+            break;
+        case MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT:
+            for (uint32_t i = 0; i < msg.subscribe_batch_result.count && i < SUBSCRIBE_BATCH_MAX; i++) {
+                printf("[SERVER] %s : ", batch_names[i]);
+                switch (SUBSCRIBE_BATCH_RESULT_GET(msg.subscribe_batch_result.results, i)) {
+                    case SUBSCRIBE_RESULT_OK :
+                        printf("Sub/Unsub OK\n");
+                        break;
+                    case SUBSCRIBE_RESULT_NOT_FOUND :
+                        printf("User not found.\n");
+                        break;
+                    default :
+                        printf("Already done.\n");
+                        break;
+                }
+            }
+            break;
+        case MESSAGE_S2C_TIMELINE_ENTRY:
+            printf("[TIMELINE] @%s - %s\n", msg.timeline_entry.author, msg.timeline_entry.message);
+            break;
+        case MESSAGE_S2C_TIMELINE_END:
+            timeline_next_before = msg.timeline_end.before;
+            timeline_next_before_seq = msg.timeline_end.before_seq;
+            if (timeline_next_before != 0) printf("[SERVER] Older twiiiiits : O\n");
+            else printf("[SERVER] End of the timeline.\n");
+            break;
+        case MESSAGE_S2C_TRENDING_ENTRY:
+            if (msg.trending_entry.tag[0] != 0) {
+                printf("[TRENDING] %.*s (%u)\n", MESSAGE_MAX_LENGTH, msg.trending_entry.tag, msg.trending_entry.count);
+            }
+            break;
+        case MESSAGE_S2C_CHANNEL_MESSAGE:
+            printf(
+                "[%.*s] @%.*s - %.*s\n",
+                MAX_USERNAME_LENGTH, msg.channel_message.channel,
+                MAX_USERNAME_LENGTH, msg.channel_message.author,
+                MESSAGE_MAX_LENGTH, msg.channel_message.message
+            );
+            break;
     }
 }
 
@@ -270,7 +430,19 @@ void publish(client_state client){
 
 void subscribe(client_state client, bool unsub){
     message_c2s message;
-    if (unsub){
+
+    // Plusieurs noms séparés par des espaces : un seul message pour tous
+    if (strchr(client.cmd + 2, ' ') != NULL) {
+        message.tag = unsub ? MESSAGE_C2S_UNSUBSCRIBE_BATCH : MESSAGE_C2S_SUBSCRIBE_BATCH;
+        memset(message.subscribe_batch, 0, sizeof message.subscribe_batch);
+        size_t count = 0;
+        char* name = strtok(client.cmd + 2, " ");
+        while (name != NULL && count < SUBSCRIBE_BATCH_MAX) {
+            strncpy(message.subscribe_batch[count++], name, MAX_USERNAME_LENGTH);
+            name = strtok(NULL, " ");
+        }
+        memcpy(batch_names, message.subscribe_batch, sizeof batch_names);
+    } else if (unsub){
         message.tag = MESSAGE_C2S_UNSUBSCRIBE_TO;
         memset(&message.subscribe_to, 0, MAX_USERNAME_LENGTH);
         memcpy(&message.subscribe_to, client.cmd+2, strnlen(client.cmd+2, MAX_USERNAME_LENGTH));
@@ -303,4 +475,171 @@ void sub_list (client_state client){
 
     }
     client.send_buffer_len = 0;
-}
\ No newline at end of file
+}
+
+void pong(client_state client){
+    message_c2s message;
+    message.tag = MESSAGE_C2S_PONG;
+
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible de répondre au ping du serveur.");
+            break;
+        }
+    }
+    client.send_buffer_len = 0;
+}
+
+void ack(client_state client){
+    message_c2s message;
+    message.tag = MESSAGE_C2S_ACK;
+    message.ack = received_seq;
+
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible d'acquitter les twiiiiits reçus.");
+            return;
+        }
+    }
+    client.send_buffer_len = 0;
+    acked_seq = received_seq;
+}
+
+void search(client_state client, bool next_page){
+    message_c2s message;
+    message.tag = MESSAGE_C2S_SEARCH;
+
+    if (next_page) {
+        if (search_next_cursor == 0) {
+            printf("[INFO] No more results.\n");
+            return;
+        }
+        message.search.cursor = search_next_cursor;
+        message.search.snapshot = search_snapshot;
+    } else {
+        memset(search_query, 0, MESSAGE_MAX_LENGTH);
+        memcpy(search_query, client.cmd+2, strnlen(client.cmd+2, MESSAGE_MAX_LENGTH));
+        message.search.cursor = 0;
+        message.search.snapshot = 0;
+    }
+    memcpy(message.search.query, search_query, MESSAGE_MAX_LENGTH);
+
+    memset(client.send_buffer, 0, IO_BUFFER_SIZE);
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible d'envoyer la recherche au serveur.");
+            break;
+        }
+    }
+    client.send_buffer_len = 0;
+}
+
+void trending(client_state client){
+    message_c2s message;
+    message.tag = MESSAGE_C2S_TRENDING;
+
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible d'envoyer au serveur.");
+            break;
+        }
+    }
+    client.send_buffer_len = 0;
+}
+
+void fetch_timeline(client_state client, bool older){
+    message_c2s message;
+    message.tag = MESSAGE_C2S_FETCH_TIMELINE;
+    message.fetch_timeline.limit = TIMELINE_PAGE_SIZE;
+
+    if (older) {
+        if (timeline_next_before == 0) {
+            printf("[INFO] No older twiiiiits.\n");
+            return;
+        }
+        message.fetch_timeline.before = timeline_next_before;
+        message.fetch_timeline.before_seq = timeline_next_before_seq;
+    } else {
+        message.fetch_timeline.before = 0;
+        message.fetch_timeline.before_seq = 0;
+    }
+
+    memset(client.send_buffer, 0, IO_BUFFER_SIZE);
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible d'envoyer au serveur.");
+            break;
+        }
+    }
+    client.send_buffer_len = 0;
+}
+
+void channel(client_state client, bool leave){
+    message_c2s message;
+    message.tag = leave ? MESSAGE_C2S_LEAVE_CHANNEL : MESSAGE_C2S_JOIN_CHANNEL;
+    memset(message.join_channel, 0, sizeof message.join_channel);
+    memcpy(message.join_channel, client.cmd+2, strnlen(client.cmd+2, MAX_USERNAME_LENGTH));
+
+    memset(client.send_buffer, 0, IO_BUFFER_SIZE);
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible d'envoyer au serveur.");
+            break;
+        }
+    }
+    client.send_buffer_len = 0;
+}
+
+void channel_publish(client_state client){
+    message_c2s message;
+    message.tag = MESSAGE_C2S_PUBLISH_CHANNEL;
+    memset(&message.publish_channel, 0, sizeof message.publish_channel);
+
+    // "C <canal> <message>"
+    const char* name = client.cmd+2;
+    const char* text = strchr(name, ' ');
+    if (text == NULL) {
+        printf("[INFO] Usage : C <channel> <message>\n");
+        return;
+    }
+    size_t name_len = text - name;
+    memcpy(message.publish_channel.channel, name, name_len < MAX_USERNAME_LENGTH ? name_len : MAX_USERNAME_LENGTH);
+    memcpy(message.publish_channel.message, text+1, strnlen(text+1, MESSAGE_MAX_LENGTH));
+
+    memset(client.send_buffer, 0, IO_BUFFER_SIZE);
+    encode_c2s(&message, client.send_buffer);
+
+    while(client.send_buffer_len != IO_BUFFER_SIZE){
+        ssize_t temp = send(client.client_socket, client.send_buffer , IO_BUFFER_SIZE, 0);
+        if (temp >= 0) client.send_buffer_len += temp;
+        else {
+            printf("Impossible d'envoyer au serveur.");
+            break;
+        }
+    }
+    client.send_buffer_len = 0;
+}
@@ -0,0 +1,83 @@
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "address.h"
+
+#define UNIX_PREFIX "unix:"
+
+static int address_connect_unix(const char* path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof address.sun_path) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*) &address, sizeof address) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int address_connect(const char* address, uint16_t default_port) {
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+        return address_connect_unix(address + strlen(UNIX_PREFIX));
+    }
+
+    char host[256];
+    char port[8];
+    snprintf(port, sizeof port, "%u", default_port);
+
+    const char* port_start = NULL;
+    if (address[0] == '[') {
+        // IPv6 littérale, éventuellement suivie d'un port
+        const char* end = strchr(address, ']');
+        if (end == NULL || (end[1] != 0 && end[1] != ':')) {
+            errno = EINVAL;
+            return -1;
+        }
+        snprintf(host, sizeof host, "%.*s", (int) (end - address - 1), address + 1);
+        if (end[1] == ':') port_start = end + 2;
+    } else {
+        // Avec un seul ":", c'est un port ; avec plusieurs, une IPv6 sans crochets et donc sans port
+        const char* colon = strchr(address, ':');
+        if (colon != NULL && strchr(colon + 1, ':') == NULL) {
+            snprintf(host, sizeof host, "%.*s", (int) (colon - address), address);
+            port_start = colon + 1;
+        } else {
+            snprintf(host, sizeof host, "%s", address);
+        }
+    }
+    if (port_start != NULL) snprintf(port, sizeof port, "%s", port_start);
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* addresses;
+    if (getaddrinfo(host, port, &hints, &addresses) != 0) {
+        errno = 0;
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* candidate = addresses; candidate != NULL && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_CLOEXEC, candidate->ai_protocol);
+        if (fd >= 0 && connect(fd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    return fd;
+}
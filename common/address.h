@@ -0,0 +1,15 @@
+#ifndef _ADDRESS_H_
+#define _ADDRESS_H_
+
+#include <stdint.h>
+
+/**
+ * Ouvre une connexion vers `address`, et renvoie son descripteur, ou -1 en cas d'échec (errno est alors positionné, ou
+ * vaut 0 si le nom n'a pas pu être résolu)
+ *
+ * `address` est de la forme "unix:/chemin" pour un socket Unix, ou "HÔTE", "HÔTE:PORT", "[IPv6]" ou "[IPv6]:PORT" pour
+ * TCP, l'hôte étant résolu par getaddrinfo() en IPv4 comme en IPv6. Sans port, c'est `default_port` qui est utilisé.
+ */
+int address_connect(const char* address, uint16_t default_port);
+
+#endif
@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "capture.h"
+
+static void capture_write_varint(FILE* file, uint64_t value) {
+    while (value >= 0x80) {
+        putc((int) (value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    putc((int) value, file);
+}
+
+static bool capture_read_varint(FILE* file, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = getc(file);
+        if (byte == EOF) return false;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool capture_create(capture_file* capture, const char* path, int64_t started) {
+    *capture = (capture_file) { .file = fopen(path, "w") };
+    if (capture->file == NULL) return false;
+
+    capture_file_header header = { .magic = CAPTURE_FILE_MAGIC, .started = started };
+    return fwrite(&header, sizeof header, 1, capture->file) == 1;
+}
+
+bool capture_write(capture_file* capture, const capture_record* record) {
+    putc(record->kind, capture->file);
+    capture_write_varint(capture->file, record->time_us - capture->time_us);
+    capture_write_varint(capture->file, record->connection);
+    capture->time_us = record->time_us;
+
+    if (record->kind == CAPTURE_FRAME) {
+        size_t len = IO_BUFFER_SIZE;
+        while (len > 0 && record->frame[len - 1] == 0) len--;
+        putc((int) len, capture->file);
+        fwrite(record->frame, 1, len, capture->file);
+    }
+    return !ferror(capture->file);
+}
+
+bool capture_open(capture_file* capture, const char* path, capture_file_header* header) {
+    *capture = (capture_file) { .file = fopen(path, "r") };
+    if (capture->file == NULL) return false;
+
+    if (fread(header, sizeof *header, 1, capture->file) != 1
+        || memcmp(header->magic, CAPTURE_FILE_MAGIC, sizeof header->magic) != 0) {
+        fclose(capture->file);
+        capture->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool capture_read(capture_file* capture, capture_record* record) {
+    int kind = getc(capture->file);
+    if (kind == EOF) return false;
+
+    uint64_t delta_us;
+    capture->corrupted = kind > CAPTURE_CLOSE
+        || !capture_read_varint(capture->file, &delta_us)
+        || !capture_read_varint(capture->file, &record->connection);
+    if (capture->corrupted) return false;
+    record->kind = kind;
+    record->time_us = capture->time_us += delta_us;
+
+    if (kind == CAPTURE_FRAME) {
+        int len = getc(capture->file);
+        capture->corrupted = len == EOF || len > IO_BUFFER_SIZE
+            || fread(record->frame, 1, len, capture->file) != (size_t) len;
+        if (capture->corrupted) return false;
+        memset(record->frame + len, 0, IO_BUFFER_SIZE - len);
+    }
+    return true;
+}
+
+bool capture_close(capture_file* capture) {
+    bool closed = fclose(capture->file) == 0;
+    capture->file = NULL;
+    return closed;
+}
@@ -0,0 +1,73 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "codec.h"
+
+/**
+ * Fichiers de capture : les trames reçues des clients par un serveur lancé avec TWIIIIITER_RECORD_FILE (c.f.
+ * "/server/record.h"), rejouées par twiiiiiter-replay
+ *
+ * Le fichier commence par un capture_file_header, suivi des enregistrements dans l'ordre de réception. Chacun commence
+ * par son type sur un octet, puis en varints (7 bits par octet, le bit de poids fort indiquant une suite) le temps
+ * écoulé depuis l'enregistrement précédent, en microsecondes, et l'identifiant de la connexion. Une trame (au format de
+ * decode_c2s()) suit sur un octet de longueur et autant d'octets, sans ses zéros finaux : la plupart des requêtes
+ * tiennent ainsi en une quinzaine d'octets au lieu de IO_BUFFER_SIZE.
+ */
+
+#define CAPTURE_FILE_MAGIC "TWCAPTR1"
+
+typedef struct {
+    char magic[8];
+    int64_t started; // Début de l'enregistrement, c.f. ts_now()
+} capture_file_header;
+
+typedef struct {
+    enum {
+        CAPTURE_OPEN, // Connexion acceptée, directement ou au travers d'une passerelle
+        CAPTURE_FRAME, // Trame reçue de la connexion
+        CAPTURE_CLOSE, // Fin de la connexion, qu'elle ait été fermée par le client ou par le serveur
+    } kind;
+    uint64_t time_us; // Depuis le début de l'enregistrement
+    uint64_t connection; // Unique dans la capture
+    char frame[IO_BUFFER_SIZE]; // Seulement pour CAPTURE_FRAME
+} capture_record;
+
+typedef struct {
+    FILE* file;
+    uint64_t time_us; // Du dernier enregistrement écrit ou lu
+    bool corrupted; // Après un capture_read() qui a échoué au milieu d'un enregistrement
+} capture_file;
+
+/**
+ * Crée (ou vide) le fichier `path` et y écrit l'en-tête. Renvoie false, errno indiquant l'erreur, s'il n'a pas pu
+ * être ouvert.
+ */
+bool capture_create(capture_file* capture, const char* path, int64_t started);
+
+/**
+ * Ajoute un enregistrement, dont le temps ne doit pas être antérieur au précédent. Renvoie false en cas d'erreur
+ * d'écriture.
+ */
+bool capture_write(capture_file* capture, const capture_record* record);
+
+/**
+ * Ouvre le fichier `path` et en lit l'en-tête. Renvoie false si le fichier n'a pas pu être ouvert ou n'est pas une
+ * capture.
+ */
+bool capture_open(capture_file* capture, const char* path, capture_file_header* header);
+
+/**
+ * Lit l'enregistrement suivant. Renvoie false à la fin du fichier, ou s'il est tronqué (`capture->corrupted`).
+ */
+bool capture_read(capture_file* capture, capture_record* record);
+
+/**
+ * Ferme le fichier, après avoir écrit ce qui restait en tampon. Renvoie false en cas d'erreur d'écriture.
+ */
+bool capture_close(capture_file* capture);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Horloge monotone en microsecondes, pour mesurer des durées (contrairement à ts_now() qui date les twiiiiits)
+ */
+static inline int64_t monotonic_now() {
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return tv.tv_sec * (int64_t) 1000000 + tv.tv_nsec / 1000;
+}
+
+#endif
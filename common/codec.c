@@ -12,6 +12,8 @@
 #include <string.h>
 
 #include "codec.h"
+#include "log.h"
+#include "trace.h"
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 #define htonll(value) bswap_64(value)
@@ -20,6 +22,7 @@
 #endif
 
 void encode_s2c(const message_s2c* msg, char* restrict frame) {
+    TRACE_SCOPE(encode_s2c);
     uint32_t n_tag = htonl(msg->tag);
     memcpy(frame, &n_tag, sizeof n_tag);
     frame += sizeof(uint32_t);
@@ -31,24 +34,76 @@ void encode_s2c(const message_s2c* msg, char* restrict frame) {
             n_tag = htonl(msg->login_status);
             memcpy(frame, &n_tag, sizeof n_tag);
             return;
-        case MESSAGE_S2C_RECEIVED_MESSAGE:;
+        case MESSAGE_S2C_RECEIVED_MESSAGE:
+        case MESSAGE_S2C_SEARCH_RESULT:
+        case MESSAGE_S2C_TIMELINE_ENTRY:;
             int64_t time = htonll(msg->received_message.date);
             memcpy(frame, &time, sizeof time);
             frame += sizeof time;
             memcpy(frame, &msg->received_message.author, MAX_USERNAME_LENGTH);
             frame += MAX_USERNAME_LENGTH;
             memcpy(frame, &msg->received_message.message, MESSAGE_MAX_LENGTH);
+            frame += MESSAGE_MAX_LENGTH;
+            uint64_t seq = htonll(msg->received_message.seq);
+            memcpy(frame, &seq, sizeof seq);
             return;
         case MESSAGE_S2C_SUBSCRIPTION_ENTRY:
             memcpy(frame, msg->subscription_entry, MAX_USERNAME_LENGTH);
             return;
+        case MESSAGE_S2C_PING:
+            return;
+        case MESSAGE_S2C_THROTTLED:
+            n_tag = htonl(msg->throttled.request);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            frame += sizeof n_tag;
+            n_tag = htonl(msg->throttled.retry_after_ms);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            return;
+        case MESSAGE_S2C_SEARCH_END:
+            n_tag = htonl(msg->search_end.cursor);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            frame += sizeof n_tag;
+            uint64_t snapshot = htonll(msg->search_end.snapshot);
+            memcpy(frame, &snapshot, sizeof snapshot);
+            return;
+        case MESSAGE_S2C_TRENDING_ENTRY:
+            memcpy(frame, msg->trending_entry.tag, MESSAGE_MAX_LENGTH);
+            frame += MESSAGE_MAX_LENGTH;
+            n_tag = htonl(msg->trending_entry.count);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            return;
+        case MESSAGE_S2C_TIMELINE_END:;
+            int64_t before = htonll(msg->timeline_end.before);
+            memcpy(frame, &before, sizeof before);
+            frame += sizeof before;
+            uint64_t before_seq = htonll(msg->timeline_end.before_seq);
+            memcpy(frame, &before_seq, sizeof before_seq);
+            return;
+        case MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT:
+            n_tag = htonl(msg->subscribe_batch_result.count);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            frame += sizeof n_tag;
+            n_tag = htonl(msg->subscribe_batch_result.results);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            return;
+        case MESSAGE_S2C_CHANNEL_MESSAGE:;
+            int64_t date = htonll(msg->channel_message.date);
+            memcpy(frame, &date, sizeof date);
+            frame += sizeof date;
+            memcpy(frame, msg->channel_message.channel, MAX_USERNAME_LENGTH);
+            frame += MAX_USERNAME_LENGTH;
+            memcpy(frame, msg->channel_message.author, MAX_USERNAME_LENGTH);
+            frame += MAX_USERNAME_LENGTH;
+            memcpy(frame, msg->channel_message.message, MESSAGE_MAX_LENGTH);
+            return;
     }
 }
 
 bool decode_s2c(const char* frame, message_s2c* restrict msg) {
+    TRACE_SCOPE(decode_s2c);
     uint32_t tag = ntohl(*((uint32_t*) frame));
-    if (tag > MESSAGE_S2C_KICK) {
-        printf("[ERROR] Tag S2C invalide %d\n", tag);
+    if (tag > MESSAGE_S2C_CHANNEL_MESSAGE) {
+        log_limited(LOG_LEVEL_ERROR, "Tag S2C invalide %d", tag);
         return false;
     }
     frame += sizeof tag;
@@ -57,15 +112,17 @@ bool decode_s2c(const char* frame, message_s2c* restrict msg) {
         case MESSAGE_S2C_LOGIN_STATUS:
         case MESSAGE_S2C_SUBSCRIBE_RESULT:
         case MESSAGE_S2C_KICK:;
-            int enum_len = msg->tag == MESSAGE_S2C_KICK ? 2 : 3;
+            int enum_len = 3; // Les trois énumérations ont autant de valeurs
             tag = ntohl(*((uint32_t*) frame));
             if (tag >= enum_len) {
-                printf("[ERROR] Tag S2C interne invalide %d (>= %d)\n", tag, enum_len);
+                log_limited(LOG_LEVEL_ERROR, "Tag S2C interne invalide %d (>= %d)", tag, enum_len);
                 return false;
             }
             msg->login_status = tag;
             return true;
         case MESSAGE_S2C_RECEIVED_MESSAGE:
+        case MESSAGE_S2C_SEARCH_RESULT:
+        case MESSAGE_S2C_TIMELINE_ENTRY:
             memcpy(&msg->received_message.date, frame, sizeof(int64_t));
             msg->received_message.date = htonll(msg->received_message.date);
             frame += sizeof(int64_t);
@@ -73,14 +130,62 @@ bool decode_s2c(const char* frame, message_s2c* restrict msg) {
             strncpy(msg->received_message.author, frame, MAX_USERNAME_LENGTH);
             frame += MAX_USERNAME_LENGTH;
             strncpy(msg->received_message.message, frame, MESSAGE_MAX_LENGTH);
+            frame += MESSAGE_MAX_LENGTH;
+            memcpy(&msg->received_message.seq, frame, sizeof(uint64_t));
+            msg->received_message.seq = htonll(msg->received_message.seq);
             return true;
         case MESSAGE_S2C_SUBSCRIPTION_ENTRY:
             memcpy(msg->subscription_entry, frame, MESSAGE_MAX_LENGTH);
             return true;
+        case MESSAGE_S2C_PING:
+            return true;
+        case MESSAGE_S2C_THROTTLED:
+            msg->throttled.request = ntohl(*((uint32_t*) frame));
+            msg->throttled.retry_after_ms = ntohl(*((uint32_t*) frame + 1));
+            return true;
+        case MESSAGE_S2C_SEARCH_END:
+            msg->search_end.cursor = ntohl(*((uint32_t*) frame));
+            frame += sizeof(uint32_t);
+            memcpy(&msg->search_end.snapshot, frame, sizeof(uint64_t));
+            msg->search_end.snapshot = htonll(msg->search_end.snapshot);
+            return true;
+        case MESSAGE_S2C_TRENDING_ENTRY:
+            memset(msg->trending_entry.tag, 0, MESSAGE_MAX_LENGTH);
+            strncpy(msg->trending_entry.tag, frame, MESSAGE_MAX_LENGTH);
+            frame += MESSAGE_MAX_LENGTH;
+            uint32_t count;
+            memcpy(&count, frame, sizeof count);
+            msg->trending_entry.count = ntohl(count);
+            return true;
+        case MESSAGE_S2C_TIMELINE_END:
+            memcpy(&msg->timeline_end.before, frame, sizeof(int64_t));
+            msg->timeline_end.before = htonll(msg->timeline_end.before);
+            frame += sizeof(int64_t);
+            memcpy(&msg->timeline_end.before_seq, frame, sizeof(uint64_t));
+            msg->timeline_end.before_seq = htonll(msg->timeline_end.before_seq);
+            return true;
+        case MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT:
+            msg->subscribe_batch_result.count = ntohl(*((uint32_t*) frame));
+            msg->subscribe_batch_result.results = ntohl(*((uint32_t*) frame + 1));
+            return true;
+        case MESSAGE_S2C_CHANNEL_MESSAGE:
+            memcpy(&msg->channel_message.date, frame, sizeof(int64_t));
+            msg->channel_message.date = htonll(msg->channel_message.date);
+            frame += sizeof(int64_t);
+            memset(msg->channel_message.channel, 0, sizeof(user_name));
+            strncpy(msg->channel_message.channel, frame, MAX_USERNAME_LENGTH);
+            frame += MAX_USERNAME_LENGTH;
+            memset(msg->channel_message.author, 0, sizeof(user_name));
+            strncpy(msg->channel_message.author, frame, MAX_USERNAME_LENGTH);
+            frame += MAX_USERNAME_LENGTH;
+            memset(msg->channel_message.message, 0, MESSAGE_MAX_LENGTH);
+            strncpy(msg->channel_message.message, frame, MESSAGE_MAX_LENGTH);
+            return true;
     }
 }
 
 void encode_c2s(const message_c2s* msg, char* restrict frame) {
+    TRACE_SCOPE(encode_c2s);
     uint32_t n_tag = htonl(msg->tag);
     memcpy(frame, &n_tag, sizeof n_tag);
     frame += sizeof(uint32_t);
@@ -89,19 +194,60 @@ void encode_c2s(const message_c2s* msg, char* restrict frame) {
         case MESSAGE_C2S_JOIN_AS:
         case MESSAGE_C2S_SUBSCRIBE_TO:
         case MESSAGE_C2S_UNSUBSCRIBE_TO:
+        case MESSAGE_C2S_JOIN_CHANNEL:
+        case MESSAGE_C2S_LEAVE_CHANNEL:
             memcpy(frame, msg->join_as, MAX_USERNAME_LENGTH);
             return;
         case MESSAGE_C2S_LIST_SUBSCRIPTIONS:
+        case MESSAGE_C2S_PONG:
+        case MESSAGE_C2S_TRENDING:
             return;
         case MESSAGE_C2S_PUBLISH:
             memcpy(frame, msg->publish, MESSAGE_MAX_LENGTH);
+            return;
+        case MESSAGE_C2S_SEARCH:
+            memcpy(frame, msg->search.query, MESSAGE_MAX_LENGTH);
+            frame += MESSAGE_MAX_LENGTH;
+            n_tag = htonl(msg->search.cursor);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            frame += sizeof n_tag;
+            uint64_t snapshot = htonll(msg->search.snapshot);
+            memcpy(frame, &snapshot, sizeof snapshot);
+            return;
+        case MESSAGE_C2S_FETCH_TIMELINE:;
+            int64_t before = htonll(msg->fetch_timeline.before);
+            memcpy(frame, &before, sizeof before);
+            frame += sizeof before;
+            n_tag = htonl(msg->fetch_timeline.limit);
+            memcpy(frame, &n_tag, sizeof n_tag);
+            frame += sizeof n_tag;
+            uint64_t before_seq = htonll(msg->fetch_timeline.before_seq);
+            memcpy(frame, &before_seq, sizeof before_seq);
+            return;
+        case MESSAGE_C2S_SUBSCRIBE_BATCH:
+        case MESSAGE_C2S_UNSUBSCRIBE_BATCH:
+            for (size_t i = 0; i < SUBSCRIBE_BATCH_MAX; i++) {
+                memcpy(frame, msg->subscribe_batch[i], MAX_USERNAME_LENGTH);
+                frame += MAX_USERNAME_LENGTH;
+            }
+            return;
+        case MESSAGE_C2S_ACK:;
+            uint64_t ack = htonll(msg->ack);
+            memcpy(frame, &ack, sizeof ack);
+            return;
+        case MESSAGE_C2S_PUBLISH_CHANNEL:
+            memcpy(frame, msg->publish_channel.channel, MAX_USERNAME_LENGTH);
+            frame += MAX_USERNAME_LENGTH;
+            memcpy(frame, msg->publish_channel.message, MESSAGE_MAX_LENGTH);
+            return;
     }
 }
 
 bool decode_c2s(const char* frame, message_c2s* restrict msg) {
+    TRACE_SCOPE(decode_c2s);
     uint32_t tag = ntohl(*((uint32_t*) frame));
-    if (tag > MESSAGE_C2S_PUBLISH) {
-        printf("[ERROR] Tag C2S invalide %d\n", tag);
+    if (tag > MESSAGE_C2S_PUBLISH_CHANNEL) {
+        log_limited(LOG_LEVEL_ERROR, "Tag C2S invalide %d", tag);
         return false;
     }
     frame += sizeof tag;
@@ -110,15 +256,59 @@ bool decode_c2s(const char* frame, message_c2s* restrict msg) {
         case MESSAGE_C2S_JOIN_AS:
         case MESSAGE_C2S_SUBSCRIBE_TO:
         case MESSAGE_C2S_UNSUBSCRIBE_TO:
+        case MESSAGE_C2S_JOIN_CHANNEL:
+        case MESSAGE_C2S_LEAVE_CHANNEL:
             // memset pas forcément nécessaire, mais plus prudent
             memset(msg->join_as, 0, MAX_USERNAME_LENGTH);
             strncpy(msg->join_as, frame, MAX_USERNAME_LENGTH);
             return true;
         case MESSAGE_C2S_LIST_SUBSCRIPTIONS:
+        case MESSAGE_C2S_PONG:
+        case MESSAGE_C2S_TRENDING:
             return true;
         case MESSAGE_C2S_PUBLISH:
             memset(msg->publish, 0, MESSAGE_MAX_LENGTH);
             strncpy(msg->publish, frame, MESSAGE_MAX_LENGTH);
             return true;
+        case MESSAGE_C2S_SEARCH:
+            memset(msg->search.query, 0, MESSAGE_MAX_LENGTH);
+            strncpy(msg->search.query, frame, MESSAGE_MAX_LENGTH);
+            frame += MESSAGE_MAX_LENGTH;
+            uint32_t cursor;
+            memcpy(&cursor, frame, sizeof cursor);
+            msg->search.cursor = ntohl(cursor);
+            frame += sizeof cursor;
+            memcpy(&msg->search.snapshot, frame, sizeof(uint64_t));
+            msg->search.snapshot = htonll(msg->search.snapshot);
+            return true;
+        case MESSAGE_C2S_FETCH_TIMELINE:
+            memcpy(&msg->fetch_timeline.before, frame, sizeof(int64_t));
+            msg->fetch_timeline.before = htonll(msg->fetch_timeline.before);
+            frame += sizeof(int64_t);
+            uint32_t limit;
+            memcpy(&limit, frame, sizeof limit);
+            msg->fetch_timeline.limit = ntohl(limit);
+            frame += sizeof limit;
+            memcpy(&msg->fetch_timeline.before_seq, frame, sizeof(uint64_t));
+            msg->fetch_timeline.before_seq = htonll(msg->fetch_timeline.before_seq);
+            return true;
+        case MESSAGE_C2S_SUBSCRIBE_BATCH:
+        case MESSAGE_C2S_UNSUBSCRIBE_BATCH:
+            for (size_t i = 0; i < SUBSCRIBE_BATCH_MAX; i++) {
+                memset(msg->subscribe_batch[i], 0, sizeof(user_name));
+                strncpy(msg->subscribe_batch[i], frame, MAX_USERNAME_LENGTH);
+                frame += MAX_USERNAME_LENGTH;
+            }
+            return true;
+        case MESSAGE_C2S_ACK:
+            memcpy(&msg->ack, frame, sizeof(uint64_t));
+            msg->ack = htonll(msg->ack);
+            return true;
+        case MESSAGE_C2S_PUBLISH_CHANNEL:
+            memset(&msg->publish_channel, 0, sizeof msg->publish_channel);
+            strncpy(msg->publish_channel.channel, frame, MAX_USERNAME_LENGTH);
+            frame += MAX_USERNAME_LENGTH;
+            strncpy(msg->publish_channel.message, frame, MESSAGE_MAX_LENGTH);
+            return true;
     }
 }
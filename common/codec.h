@@ -8,10 +8,18 @@
 
 #define IO_BUFFER_SIZE 48
 
+// Nombre maximal de noms dans un MESSAGE_C2S_SUBSCRIBE_BATCH ou MESSAGE_C2S_UNSUBSCRIBE_BATCH
+#define SUBSCRIBE_BATCH_MAX 7
+
+// Résultat (enum subscribe_result) de l'entrée `i` d'un MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT, sur 2 bits
+#define SUBSCRIBE_BATCH_RESULT_GET(results, i) (((results) >> (2 * (i))) & 3)
+#define SUBSCRIBE_BATCH_RESULT_SET(results, i, result) ((results) |= (uint32_t) (result) << (2 * (i)))
+
 typedef struct {
     int64_t date;
     user_name author;
     char message[MESSAGE_MAX_LENGTH];
+    uint64_t seq; // Numéro de séquence, croissant dans l'ordre de publication, c.f. MESSAGE_C2S_ACK
 } received_message;
 
 /**
@@ -24,24 +32,66 @@ typedef struct {
         MESSAGE_S2C_SUBSCRIBE_RESULT, // réponse à MESSAGE_C2S_SUBSCRIBE_TO et MESSAGE_C2S_UNSUBSCRIBE_TO
         MESSAGE_S2C_SUBSCRIPTION_ENTRY, // réponses multiples à MESSAGE_C2S_LIST_SUBSCRIPTIONS
         MESSAGE_S2C_KICK,
+        MESSAGE_S2C_PING, // Le client doit répondre par MESSAGE_C2S_PONG, sans quoi il est déconnecté
+        MESSAGE_S2C_THROTTLED, // La requête a été refusée car le client en envoie trop
+        MESSAGE_S2C_SEARCH_RESULT, // réponses multiples à MESSAGE_C2S_SEARCH, par pertinence décroissante
+        MESSAGE_S2C_SEARCH_END, // termine les réponses à MESSAGE_C2S_SEARCH
+        MESSAGE_S2C_TRENDING_ENTRY, // réponses multiples à MESSAGE_C2S_TRENDING, par fréquence décroissante
+        MESSAGE_S2C_TIMELINE_ENTRY, // réponses multiples à MESSAGE_C2S_FETCH_TIMELINE, du plus récent au plus ancien
+        MESSAGE_S2C_TIMELINE_END, // termine les réponses à MESSAGE_C2S_FETCH_TIMELINE
+        MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT, // réponse à MESSAGE_C2S_SUBSCRIBE_BATCH et MESSAGE_C2S_UNSUBSCRIBE_BATCH
+        MESSAGE_S2C_CHANNEL_MESSAGE, // publié dans un canal dont le client est membre, c.f. MESSAGE_C2S_PUBLISH_CHANNEL
     } tag;
     union {
         enum {
             LOGIN_STATUS_OK,
-            LOGIN_STATUS_ALREADY_USED,
+            LOGIN_STATUS_ALREADY_USED, // Toutes les sessions du nom sont ouvertes, ou il est connecté à un autre nœud
             LOGIN_STATUS_ILLEGAL_NAME,
         } login_status;
         received_message received_message;
         enum subscribe_result {
             SUBSCRIBE_RESULT_OK,
             SUBSCRIBE_RESULT_NOT_FOUND,
-            SUBSCRIBE_RESULT_UNCHANGED, // Si on suit déjà (resp. déjà désabonné)
+            SUBSCRIBE_RESULT_UNCHANGED, // Si on suit déjà (resp. déjà désabonné), ou si on est déjà membre du canal
         } subscribe_result;
         user_name subscription_entry; // Contient que des 0 à la fin de l'énumération
         enum {
             KICK_REASON_CLOSING,
             KICK_REASON_PROTOCOL_ERROR,
+            KICK_REASON_TIMEOUT,
         } kick;
+        struct {
+            uint32_t request; // Tag MESSAGE_C2S_* de la requête refusée
+            uint32_t retry_after_ms;
+        } throttled;
+        received_message search_result;
+        // Curseur de la page suivante (`cursor` à 0 s'il n'y en a pas), à renvoyer dans MESSAGE_C2S_SEARCH. Les pages
+        // suivantes ne classent que les twiiiiits publiés jusqu'à `snapshot`, fixé par la première : ceux publiés
+        // entre-temps ne décalent pas les résultats. Le classement par pertinence peut encore légèrement varier, la
+        // fréquence des mots changeant avec les nouveaux twiiiiits.
+        struct {
+            uint32_t cursor;
+            uint64_t snapshot;
+        } search_end;
+        struct {
+            char tag[MESSAGE_MAX_LENGTH]; // "#sujet" ou "@nom", que des 0 à la fin de l'énumération
+            uint32_t count; // Occurrences estimées sur la fenêtre
+        } trending_entry;
+        received_message timeline_entry;
+        struct {
+            int64_t before; // `before` de la page suivante, 0 s'il n'y en a pas
+            uint64_t before_seq; // Et son `before_seq`
+        } timeline_end;
+        struct {
+            uint32_t count; // Nombre de noms de la requête
+            uint32_t results; // c.f. SUBSCRIBE_BATCH_RESULT_GET()
+        } subscribe_batch_result;
+        struct {
+            int64_t date;
+            user_name channel;
+            user_name author;
+            char message[MESSAGE_MAX_LENGTH];
+        } channel_message;
     };
 } message_s2c;
 
@@ -55,12 +105,49 @@ typedef struct {
         MESSAGE_C2S_UNSUBSCRIBE_TO,
         MESSAGE_C2S_LIST_SUBSCRIPTIONS,
         MESSAGE_C2S_PUBLISH,
+        MESSAGE_C2S_PONG, // réponse à MESSAGE_S2C_PING
+        MESSAGE_C2S_SEARCH,
+        MESSAGE_C2S_TRENDING,
+        MESSAGE_C2S_FETCH_TIMELINE,
+        MESSAGE_C2S_SUBSCRIBE_BATCH,
+        MESSAGE_C2S_UNSUBSCRIBE_BATCH,
+        // Le client a bien reçu tous les twiiiiits de ses abonnements jusqu'au numéro `ack` inclus, sans réponse. Les
+        // siens, qui lui sont renvoyés dès leur publication, ne doivent pas être acquittés.
+        MESSAGE_C2S_ACK,
+        // Rejoindre (resp. quitter) un canal, réponse MESSAGE_S2C_SUBSCRIBE_RESULT. Un canal existe tant qu'il a des
+        // membres, NOT_FOUND n'est renvoyé que pour un nom vide.
+        MESSAGE_C2S_JOIN_CHANNEL,
+        MESSAGE_C2S_LEAVE_CHANNEL,
+        // Publie dans un canal, sans réponse : les membres connecté·es reçoivent un MESSAGE_S2C_CHANNEL_MESSAGE, y
+        // compris l'auteur·ice si iel en est membre. Ces messages ne sont ni enregistrés ni rattrapés.
+        MESSAGE_C2S_PUBLISH_CHANNEL,
     } tag;
     union {
         user_name join_as;
         user_name subscribe_to;
         user_name unsubscribe_to;
         char publish[MESSAGE_MAX_LENGTH];
+        struct {
+            char query[MESSAGE_MAX_LENGTH]; // Mots à chercher, séparés par des espaces
+            // 0 et 0 pour la première page, puis les valeurs de MESSAGE_S2C_SEARCH_END
+            uint32_t cursor;
+            uint64_t snapshot;
+        } search;
+        struct {
+            int64_t before; // Date exclue, 0 pour les plus récents, puis la valeur de MESSAGE_S2C_TIMELINE_END
+            uint32_t limit;
+            // Les twiiiiits datés de `before` sont inclus s'ils précèdent ce numéro de séquence (0 : aucun), pour
+            // qu'une page puisse s'arrêter entre deux twiiiiits de même date
+            uint64_t before_seq;
+        } fetch_timeline;
+        user_name subscribe_batch[SUBSCRIBE_BATCH_MAX]; // Les noms vides en fin de liste sont ignorés
+        uint64_t ack;
+        user_name join_channel;
+        user_name leave_channel;
+        struct {
+            user_name channel;
+            char message[MESSAGE_MAX_LENGTH];
+        } publish_channel;
     };
 } message_c2s;
 
@@ -0,0 +1,188 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "listener.h"
+#include "log.h"
+
+#define UNIX_PREFIX "unix:"
+
+static void listener_fail(const char* spec, const char* reason) {
+    log_error("Can't listen on %s: %s", spec, reason);
+    exit(1);
+}
+
+/**
+ * Crée un socket, l'attache à `address` et le met en écoute. Renvoie -1 (errno positionné) en cas d'échec.
+ */
+static int listener_bind(int family, const struct sockaddr* address, socklen_t address_len) {
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    if (family != AF_UNIX) {
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof enable);
+    }
+    if (family == AF_INET6) {
+        // Sans IPV6_V6ONLY, le socket accepte aussi les connexions IPv4 (en ::ffff:a.b.c.d)
+        int v6_only = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof v6_only);
+    }
+
+    if (bind(fd, address, address_len) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static void listener_open_unix(const char* spec, listener* out) {
+    const char* path = spec + strlen(UNIX_PREFIX);
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) == 0 || strlen(path) >= sizeof address.sun_path) listener_fail(spec, "invalid path");
+    strcpy(address.sun_path, path);
+
+    // Un socket laissé par une exécution précédente empêcherait bind(), mais on ne supprime rien d'autre
+    struct stat existing;
+    if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(path);
+
+    out->fd = listener_bind(AF_UNIX, (struct sockaddr*) &address, sizeof address);
+    if (out->fd < 0) listener_fail(spec, strerror(errno));
+    strcpy(out->unix_path, path);
+}
+
+static void listener_open_wildcard(const char* spec, const char* port, listener* out) {
+    char* end;
+    unsigned long port_number = strtoul(port, &end, 10);
+    if (*port == 0 || *end != 0 || port_number > UINT16_MAX) listener_fail(spec, "invalid port");
+
+    struct sockaddr_in6 address6 = {
+        .sin6_family = AF_INET6,
+        .sin6_addr = in6addr_any,
+        .sin6_port = htons(port_number),
+    };
+    out->fd = listener_bind(AF_INET6, (struct sockaddr*) &address6, sizeof address6);
+    if (out->fd < 0 && errno == EAFNOSUPPORT) {
+        struct sockaddr_in address = {
+            .sin_family = AF_INET,
+            .sin_addr = { .s_addr = INADDR_ANY },
+            .sin_port = htons(port_number),
+        };
+        out->fd = listener_bind(AF_INET, (struct sockaddr*) &address, sizeof address);
+    }
+    if (out->fd < 0) listener_fail(spec, strerror(errno));
+    out->wildcard = true;
+}
+
+static void listener_open_host(const char* spec, const char* host, const char* port, listener* out) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+    struct addrinfo* addresses;
+    int error = getaddrinfo(host, port, &hints, &addresses);
+    if (error != 0) listener_fail(spec, gai_strerror(error));
+
+    out->fd = -1;
+    for (struct addrinfo* address = addresses; address != NULL && out->fd < 0; address = address->ai_next) {
+        out->fd = listener_bind(address->ai_family, address->ai_addr, address->ai_addrlen);
+    }
+    freeaddrinfo(addresses);
+    if (out->fd < 0) listener_fail(spec, strerror(errno));
+}
+
+static void listener_open(listener_set* set, const char* spec) {
+    if (set->len == MAX_LISTENERS) listener_fail(spec, "too many listeners");
+    listener* out = &set->listeners[set->len];
+    memset(out, 0, sizeof *out);
+
+    char host[256];
+    const char* colon = strrchr(spec, ':');
+    if (strncmp(spec, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+        listener_open_unix(spec, out);
+    } else if (colon == NULL) {
+        listener_open_wildcard(spec, spec, out);
+    } else if (colon - spec == 1 && spec[0] == '*') {
+        listener_open_wildcard(spec, colon + 1, out);
+    } else {
+        // Les crochets d'une IPv6 ne font pas partie de l'adresse
+        bool bracketed = spec[0] == '[' && colon[-1] == ']';
+        int host_len = (int) (colon - spec) - (bracketed ? 2 : 0);
+        snprintf(host, sizeof host, "%.*s", host_len, spec + (bracketed ? 1 : 0));
+        listener_open_host(spec, host, colon + 1, out);
+    }
+
+    set->len++;
+}
+
+void listeners_open(listener_set* set, const char* specs) {
+    set->len = 0;
+    char* specs_copy = strdup(specs);
+    if (specs_copy == NULL) listener_fail(specs, strerror(errno));
+    char* saveptr;
+    for (char* spec = strtok_r(specs_copy, ",", &saveptr); spec != NULL; spec = strtok_r(NULL, ",", &saveptr)) {
+        listener_open(set, spec);
+    }
+    free(specs_copy);
+
+    if (set->len == 0) listener_fail(specs, "no address given");
+}
+
+void listeners_register(listener_set* set, int epoll, const char* label) {
+    for (size_t i = 0; i < set->len; i++) {
+        listener* listener = &set->listeners[i];
+        // EPOLLIN sur un socket d'écoute correspond à une connexion entrante
+        struct epoll_event listener_epollin = { .events = EPOLLIN, .data.fd = listener->fd };
+        if (epoll_ctl(epoll, EPOLL_CTL_ADD, listener->fd, &listener_epollin) != 0) {
+            log_error("Can't watch listener %d: %s", listener->fd, strerror(errno));
+            exit(1);
+        }
+
+        if (listener->unix_path[0] != 0) {
+            log_info("%s on unix:%s", label, listener->unix_path);
+            continue;
+        }
+
+        struct sockaddr_storage address;
+        socklen_t address_len = sizeof address;
+        getsockname(listener->fd, (struct sockaddr*) &address, &address_len);
+        char host[INET6_ADDRSTRLEN];
+        uint16_t port;
+        if (address.ss_family == AF_INET6) {
+            struct sockaddr_in6* address6 = (struct sockaddr_in6*) &address;
+            inet_ntop(AF_INET6, &address6->sin6_addr, host, sizeof host);
+            port = ntohs(address6->sin6_port);
+        } else {
+            struct sockaddr_in* address4 = (struct sockaddr_in*) &address;
+            inet_ntop(AF_INET, &address4->sin_addr, host, sizeof host);
+            port = ntohs(address4->sin_port);
+        }
+
+        if (listener->wildcard) log_info("%s on *:%u", label, port);
+        else if (address.ss_family == AF_INET6) log_info("%s on [%s]:%u", label, host, port);
+        else log_info("%s on %s:%u", label, host, port);
+    }
+}
+
+bool listeners_contains(const listener_set* set, int fd) {
+    for (size_t i = 0; i < set->len; i++) {
+        if (set->listeners[i].fd == fd) return true;
+    }
+    return false;
+}
+
+void listeners_close(listener_set* set) {
+    for (size_t i = 0; i < set->len; i++) {
+        close(set->listeners[i].fd);
+        if (set->listeners[i].unix_path[0] != 0) unlink(set->listeners[i].unix_path);
+    }
+    set->len = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef _LISTENER_H_
+#define _LISTENER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/un.h>
+
+// Nombre maximal de sockets d'écoute par ensemble
+#define MAX_LISTENERS 8
+
+typedef struct {
+    int fd;
+    bool wildcard; // Annoncé comme "*:PORT", ce que cherchent les tests d'intégration
+    char unix_path[sizeof(((struct sockaddr_un*) NULL)->sun_path)]; // Vide pour TCP
+} listener;
+
+/**
+ * Un ensemble de sockets d'écoute, ouverts à partir d'une même liste d'adresses (les clients du serveur, ses
+ * passerelles, ...)
+ */
+typedef struct {
+    listener listeners[MAX_LISTENERS];
+    size_t len;
+} listener_set;
+
+/**
+ * Ouvre les sockets d'écoute de `specs`, une liste séparée par des virgules, dont chaque élément est :
+ * - "PORT" ou "*:PORT" : TCP sur toutes les interfaces, en IPv6 et en IPv4 sur un même socket (ou en IPv4 seulement
+ *   si le système n'a pas d'IPv6) ;
+ * - "HÔTE:PORT" ou "[IPv6]:PORT" : TCP sur une adresse donnée, résolue par getaddrinfo() ;
+ * - "unix:/chemin" : socket Unix, qui évite la pile TCP aux processus de la même machine. Un fichier restant d'une
+ *   exécution précédente est remplacé, et le fichier est supprimé à l'arrêt.
+ *
+ * Les sockets sont ouverts et attachés ici, mais ne sont annoncés qu'avec listeners_register(). Le programme s'arrête
+ * si l'un d'eux ne peut pas être ouvert.
+ */
+void listeners_open(listener_set* set, const char* specs);
+
+/**
+ * Ajoute les sockets d'écoute à `epoll` et annonce leurs adresses ("`label` on ...", par exemple "Listening on *:7878")
+ */
+void listeners_register(listener_set* set, int epoll, const char* label);
+
+/**
+ * Indique si `fd` est un socket d'écoute de l'ensemble
+ */
+bool listeners_contains(const listener_set* set, int fd);
+
+/**
+ * Ferme les sockets d'écoute et supprime les fichiers des sockets Unix
+ */
+void listeners_close(listener_set* set);
+
+#endif
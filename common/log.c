@@ -0,0 +1,253 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "log.h"
+
+// Taille d'une case, les lignes plus longues sont tronquées
+#define LOG_RECORD_SIZE 256
+// Nombre de cases (puissance de 2)
+#define LOG_RING_CAPACITY 4096
+// Taille maximale d'un lot écrit en un seul appel système
+#define LOG_BATCH_SIZE (64 * 1024)
+
+/**
+ * Une case du tampon circulaire. Son numéro de séquence indique à qui elle appartient (c.f. la file bornée de
+ * Dmitry Vyukov) : égal à la position d'écriture, elle est libre ; égal à la position + 1, elle contient une ligne
+ * prête à être lue.
+ */
+typedef struct {
+    atomic_size_t sequence;
+    uint16_t length;
+    char text[LOG_RECORD_SIZE - sizeof(atomic_size_t) - sizeof(uint16_t)];
+} log_record;
+
+static log_record ring[LOG_RING_CAPACITY];
+static atomic_size_t enqueue_position = 0;
+static size_t dequeue_position = 0; // Seul le thread d'écriture y touche
+
+static atomic_ulong dropped = 0;
+
+static enum log_level min_level = LOG_LEVEL_INFO;
+
+static atomic_bool running = false;
+static atomic_bool flusher_sleeping = false;
+static int wakeup_fd = -1;
+static pthread_t flusher;
+
+static const char* const level_prefixes[] = {
+    [LOG_LEVEL_DEBUG] = "[DEBUG] ",
+    [LOG_LEVEL_INFO] = "[INFO] ",
+    [LOG_LEVEL_WARNING] = "[WARNING] ",
+    [LOG_LEVEL_ERROR] = "[ERROR] ",
+    [LOG_LEVEL_STATS] = "[STATS] ",
+};
+
+static const char* const level_names[] = {
+    [LOG_LEVEL_DEBUG] = "debug",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_WARNING] = "warning",
+    [LOG_LEVEL_ERROR] = "error",
+};
+
+static void write_all(const char* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, buffer, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return; // Rien de mieux à faire que d'abandonner ces lignes
+        }
+        buffer += written;
+        length -= written;
+    }
+}
+
+/**
+ * Recopie les lignes prêtes dans le lot, et retourne sa longueur
+ */
+static size_t log_drain(char* batch) {
+    size_t length = 0;
+
+    unsigned long lost = atomic_exchange(&dropped, 0);
+    if (lost > 0) {
+        length += snprintf(batch, LOG_BATCH_SIZE, "%s%lu log lines dropped\n", level_prefixes[LOG_LEVEL_WARNING], lost);
+    }
+
+    while (length + LOG_RECORD_SIZE <= LOG_BATCH_SIZE) {
+        log_record* record = &ring[dequeue_position & (LOG_RING_CAPACITY - 1)];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != dequeue_position + 1) break;
+
+        memcpy(batch + length, record->text, record->length);
+        length += record->length;
+
+        atomic_store_explicit(&record->sequence, dequeue_position + LOG_RING_CAPACITY, memory_order_release);
+        dequeue_position++;
+    }
+
+    return length;
+}
+
+static bool log_ring_empty() {
+    log_record* record = &ring[dequeue_position & (LOG_RING_CAPACITY - 1)];
+    return atomic_load(&record->sequence) != dequeue_position + 1 && atomic_load(&dropped) == 0;
+}
+
+static void* log_flusher(void* arg) {
+    (void) arg;
+    static char batch[LOG_BATCH_SIZE];
+
+    for (;;) {
+        size_t length = log_drain(batch);
+        if (length > 0) {
+            write_all(batch, length);
+            continue;
+        }
+
+        if (!atomic_load(&running)) return NULL;
+
+        // On annonce qu'on s'endort avant de vérifier une dernière fois, pour ne pas manquer une ligne écrite entre-temps
+        atomic_store(&flusher_sleeping, true);
+        if (!log_ring_empty() || !atomic_load(&running)) {
+            atomic_store(&flusher_sleeping, false);
+            continue;
+        }
+
+        uint64_t value;
+        while (read(wakeup_fd, &value, sizeof value) < 0 && errno == EINTR);
+    }
+}
+
+static void log_wake_flusher() {
+    if (atomic_exchange(&flusher_sleeping, false)) {
+        uint64_t one = 1;
+        while (write(wakeup_fd, &one, sizeof one) < 0 && errno == EINTR);
+    }
+}
+
+void log_initialize() {
+    const char* level = getenv("TWIIIIITER_LOG_LEVEL");
+    if (level != NULL) {
+        bool found = false;
+        for (size_t i = 0; i < sizeof level_names / sizeof *level_names; i++) {
+            if (strcmp(level, level_names[i]) == 0) {
+                min_level = i;
+                found = true;
+            }
+        }
+        if (!found) log_warning("Unknown log level \"%s\", using info", level);
+    }
+
+    for (size_t i = 0; i < LOG_RING_CAPACITY; i++) atomic_init(&ring[i].sequence, i);
+
+    // Ce qui a déjà été écrit avec stdio doit apparaître avant les lignes du thread
+    fflush(stdout);
+
+    wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd < 0) return;
+    atomic_store(&running, true);
+
+    // Les signaux sont pour le thread principal (c.f. son signalfd), le thread d'écriture les bloque tous
+    sigset_t all_signals, previous_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous_signals);
+    int created = pthread_create(&flusher, NULL, log_flusher, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+    if (created != 0) {
+        atomic_store(&running, false);
+        close(wakeup_fd);
+        return;
+    }
+
+    atexit(log_shutdown);
+}
+
+void log_shutdown() {
+    if (!atomic_exchange(&running, false)) return;
+
+    atomic_store(&flusher_sleeping, true);
+    log_wake_flusher();
+    pthread_join(flusher, NULL);
+    close(wakeup_fd);
+}
+
+void log_write(enum log_level level, const char* format, ...) {
+    if (level < min_level) return;
+
+    va_list args;
+    va_start(args, format);
+
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) {
+        fputs(level_prefixes[level], stdout);
+        vprintf(format, args);
+        putchar('\n');
+        va_end(args);
+        return;
+    }
+
+    // Réservation d'une case libre
+    log_record* record;
+    size_t position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+    for (;;) {
+        record = &ring[position & (LOG_RING_CAPACITY - 1)];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                &enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed
+            )) break;
+        } else if (difference < 0) { // Plein
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            va_end(args);
+            log_wake_flusher();
+            return;
+        } else {
+            position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    size_t capacity = sizeof record->text;
+    size_t length = strlen(level_prefixes[level]);
+    memcpy(record->text, level_prefixes[level], length);
+    int formatted = vsnprintf(record->text + length, capacity - length, format, args);
+    va_end(args);
+    if (formatted > 0) length += formatted;
+    if (length > capacity - 1) length = capacity - 1;
+    record->text[length++] = '\n';
+    record->length = length;
+
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    log_wake_flusher();
+}
+
+bool log_limiter_allow(log_limiter* limiter, enum log_level level) {
+    if (level < min_level) return false;
+
+    int64_t now = monotonic_now();
+    if (now - limiter->window_start >= LOG_LIMIT_WINDOW_US) {
+        if (limiter->suppressed > 0) {
+            log_write(level, "%u similar lines suppressed", limiter->suppressed);
+        }
+        limiter->window_start = now;
+        limiter->count = 0;
+        limiter->suppressed = 0;
+    }
+
+    if (limiter->count < LOG_LIMIT_BURST) {
+        limiter->count++;
+        return true;
+    }
+
+    limiter->suppressed++;
+    return false;
+}
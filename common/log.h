@@ -0,0 +1,70 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Journalisation asynchrone
+ *
+ * Chaque appel formate sa ligne ("[NIVEAU] message\n") directement dans une case d'un tampon circulaire sans verrou, et
+ * un thread dédié la recopie sur la sortie standard par lots. Une sortie lente (journald, tube plein, ...) ne bloque
+ * donc jamais la boucle d'évènements : si le tampon est plein, les lignes sont perdues et leur nombre est signalé dès
+ * que possible.
+ *
+ * Tant que log_initialize() n'a pas été appelé (et dans le client), les lignes sont écrites directement avec stdio.
+ */
+
+enum log_level {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_STATS, // Réponse à une demande explicite (SIGUSR1), toujours affichée
+};
+
+/**
+ * Démarre le thread d'écriture. Le niveau minimal est lu dans TWIIIIITER_LOG_LEVEL (debug, info, warning ou error ;
+ * info par défaut). Les lignes restantes sont écrites à la sortie du programme.
+ */
+void log_initialize();
+
+/**
+ * Écrit les lignes en attente et arrête le thread d'écriture
+ */
+void log_shutdown();
+
+void log_write(enum log_level level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#define log_debug(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warning(...) log_write(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define log_error(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_stats(...) log_write(LOG_LEVEL_STATS, __VA_ARGS__)
+
+// Nombre de lignes autorisées par point d'appel et par fenêtre, pour les messages limités
+#define LOG_LIMIT_BURST 10
+#define LOG_LIMIT_WINDOW_US 1000000
+
+typedef struct {
+    int64_t window_start;
+    uint32_t count;
+    uint32_t suppressed;
+} log_limiter;
+
+/**
+ * Indique si une nouvelle ligne peut être écrite, et signale le nombre de lignes supprimées pendant la fenêtre
+ * précédente. Pas de synchronisation : un limiteur ne doit servir qu'à un seul thread.
+ */
+bool log_limiter_allow(log_limiter* limiter, enum log_level level);
+
+/**
+ * Comme log_write(), mais limité à LOG_LIMIT_BURST lignes par seconde pour ce point d'appel. À utiliser pour les
+ * messages qu'un client peut provoquer à volonté.
+ */
+#define log_limited(level, ...) do { \
+    static log_limiter log_limiter_ = { 0 }; \
+    if (log_limiter_allow(&log_limiter_, level)) log_write(level, __VA_ARGS__); \
+} while (0)
+
+#endif
@@ -0,0 +1,27 @@
+#include <netinet/in.h>
+#include <string.h>
+
+#include "log.h"
+#include "mux.h"
+
+void mux_encode(const mux_frame* restrict msg, char* restrict frame) {
+    uint32_t header[2] = { htonl(msg->kind), htonl(msg->session) };
+    memcpy(frame, header, sizeof header);
+    if (msg->kind == MUX_DATA) memcpy(frame + sizeof header, msg->payload, IO_BUFFER_SIZE);
+    else memset(frame + sizeof header, 0, IO_BUFFER_SIZE);
+}
+
+bool mux_decode(const char* restrict frame, mux_frame* restrict msg) {
+    uint32_t header[2];
+    memcpy(header, frame, sizeof header);
+    uint32_t kind = ntohl(header[0]);
+    if (kind > MUX_CLOSE) {
+        log_limited(LOG_LEVEL_ERROR, "Invalid multiplexing kind %u", kind);
+        return false;
+    }
+
+    msg->kind = kind;
+    msg->session = ntohl(header[1]);
+    if (kind == MUX_DATA) memcpy(msg->payload, frame + sizeof header, IO_BUFFER_SIZE);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _MUX_H_
+#define _MUX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "codec.h"
+
+/**
+ * Multiplexage des sessions d'une passerelle (c.f. "/gateway/main.c") sur ses connexions au serveur
+ *
+ * Chaque trame porte une trame du protocole client (IO_BUFFER_SIZE octets) précédée de l'identifiant de la session à
+ * laquelle elle appartient. Les identifiants sont choisis par la passerelle, et ne sont réutilisés qu'une fois la
+ * fermeture confirmée par le serveur :
+ * - la passerelle envoie MUX_OPEN à l'arrivée d'un client, puis ses trames dans des MUX_DATA ;
+ * - le serveur répond par des MUX_DATA ;
+ * - quand le client se déconnecte, la passerelle envoie MUX_CLOSE, auquel le serveur répond par MUX_CLOSE ;
+ * - quand le serveur déconnecte la session, il envoie MUX_CLOSE, sans attendre de réponse.
+ */
+
+#define MUX_FRAME_SIZE (2 * sizeof(uint32_t) + IO_BUFFER_SIZE)
+
+typedef struct {
+    enum {
+        MUX_OPEN,
+        MUX_DATA,
+        MUX_CLOSE,
+    } kind;
+    uint32_t session;
+    char payload[IO_BUFFER_SIZE]; // Seulement pour MUX_DATA
+} mux_frame;
+
+/**
+ * Encode `msg` dans `frame`, qui **doit** faire au minimum MUX_FRAME_SIZE octets
+ */
+void mux_encode(const mux_frame* restrict msg, char* restrict frame);
+
+bool mux_decode(const char* restrict frame, mux_frame* restrict msg);
+
+#endif
@@ -0,0 +1,133 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "trace.h"
+
+#ifdef TWIIIIITER_TRACING
+
+// Nombre d'enregistrements conservés par thread (puissance de 2)
+#define TRACE_RING_CAPACITY (1 << 16)
+
+typedef struct trace_ring_s {
+    uint32_t thread_id;
+    uint64_t head; // Nombre total d'enregistrements écrits
+    trace_record records[TRACE_RING_CAPACITY];
+
+    struct trace_ring_s* next;
+} trace_ring;
+
+bool trace_enabled = false;
+
+static double ticks_per_us = 1;
+
+// Tous les tampons, pour trace_dump()
+static trace_ring* rings = NULL;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread trace_ring* thread_ring = NULL;
+
+static const char* const span_names[TRACE_SPAN_COUNT] = {
+#define TRACE_SPAN_NAME(name) [TRACE_SPAN_##name] = #name,
+    TRACE_SPANS(TRACE_SPAN_NAME)
+#undef TRACE_SPAN_NAME
+};
+
+static trace_ring* trace_ring_new() {
+    trace_ring* ring = calloc(1, sizeof(trace_ring));
+    if (ring == NULL) return NULL;
+    ring->thread_id = syscall(SYS_gettid);
+
+    pthread_mutex_lock(&rings_mutex);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_mutex);
+    return ring;
+}
+
+void trace_append(uint16_t span, uint8_t phase) {
+    if (__builtin_expect(thread_ring == NULL, 0)) {
+        thread_ring = trace_ring_new();
+        if (thread_ring == NULL) return;
+    }
+
+    trace_record* record = &thread_ring->records[thread_ring->head & (TRACE_RING_CAPACITY - 1)];
+    record->timestamp = trace_timestamp();
+    record->span = span;
+    record->phase = phase;
+    // Publié après l'écriture, pour qu'un trace_dump() concurrent ne lise pas d'enregistrement incomplet
+    __atomic_store_n(&thread_ring->head, thread_ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Mesure la fréquence du compteur utilisé par trace_timestamp()
+ */
+static void trace_calibrate() {
+    struct timespec start, end, pause = { .tv_sec = 0, .tv_nsec = 20000000 };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_ticks = trace_timestamp();
+    nanosleep(&pause, NULL);
+    uint64_t end_ticks = trace_timestamp();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+    ticks_per_us = (double) (end_ticks - start_ticks) / elapsed_us;
+}
+
+void trace_initialize() {
+    const char* enabled = getenv("TWIIIIITER_TRACE");
+    if (enabled == NULL || strcmp(enabled, "1") != 0) return;
+
+    trace_calibrate();
+    log_info("Tracing enabled (%.0f ticks/us)", ticks_per_us);
+    trace_enabled = true;
+}
+
+void trace_dump() {
+    if (!trace_enabled) return;
+
+    const char* path = getenv("TWIIIIITER_TRACE_FILE") ?: "twiiiiiter.trace";
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        log_warning("Can't write the trace to %s", path);
+        return;
+    }
+
+    pthread_mutex_lock(&rings_mutex);
+
+    trace_file_header header = {
+        .magic = TRACE_FILE_MAGIC,
+        .ticks_per_us = ticks_per_us,
+        .span_count = TRACE_SPAN_COUNT,
+        .thread_count = 0,
+    };
+    for (trace_ring* ring = rings; ring != NULL; ring = ring->next) header.thread_count++;
+    fwrite(&header, sizeof header, 1, file);
+
+    for (int i = 0; i < TRACE_SPAN_COUNT; i++) {
+        char name[TRACE_NAME_LENGTH] = { 0 };
+        strncpy(name, span_names[i], TRACE_NAME_LENGTH - 1);
+        fwrite(name, TRACE_NAME_LENGTH, 1, file);
+    }
+
+    for (trace_ring* ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t first = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+        trace_file_thread thread = { .thread_id = ring->thread_id, .record_count = head - first };
+        fwrite(&thread, sizeof thread, 1, file);
+        for (uint64_t i = first; i < head; i++) {
+            fwrite(&ring->records[i & (TRACE_RING_CAPACITY - 1)], sizeof(trace_record), 1, file);
+        }
+    }
+
+    pthread_mutex_unlock(&rings_mutex);
+    fclose(file);
+    log_info("Trace written to %s", path);
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Points de trace sur le chemin critique
+ *
+ * Compilés seulement avec l'option CMake TWIIIIITER_TRACING, ils ne coûtent alors rien tant que la trace n'est pas
+ * activée à l'exécution (TWIIIIITER_TRACE=1) : un test de booléen à l'entrée et à la sortie de chaque portée. Une fois
+ * activés, ils enregistrent le début et la fin de chaque portée dans un tampon circulaire propre au thread, horodaté
+ * avec le compteur de cycles du processeur. Les sondes USDT "twiiiiiter:span__begin" et "twiiiiiter:span__end" sont
+ * également émises si <sys/sdt.h> est disponible ; ce ne sont que des instructions nop tant qu'aucun outil ne s'y
+ * attache.
+ *
+ * Le contenu des tampons est écrit dans TWIIIIITER_TRACE_FILE par trace_dump(), et l'outil twiiiiiter-trace-dump le
+ * convertit au format Chrome (chrome://tracing, Perfetto) ou en piles repliées pour flamegraph.pl.
+ */
+
+#define TRACE_SPANS(X) \
+    X(handle_event) \
+    X(process_message) \
+    X(fanout_run) \
+    X(catchup_run) \
+    X(catchup_read) \
+    X(read_pool_complete) \
+    X(encode_s2c) \
+    X(decode_s2c) \
+    X(encode_c2s) \
+    X(decode_c2s) \
+    X(database_update_user) \
+    X(database_cursor) \
+    X(database_save_cursor) \
+    X(database_follow) \
+    X(database_unfollow) \
+    X(database_follow_batch) \
+    X(database_list_followee) \
+    X(database_list_followers) \
+    X(database_users_next) \
+    X(database_join_channel) \
+    X(database_leave_channel) \
+    X(database_list_channels) \
+    X(database_list_channel_members) \
+    X(database_save_twiiiiit) \
+    X(database_last_seq) \
+    X(database_list_missed_twiiiiits) \
+    X(database_index_search) \
+    X(database_search_twiiiiits) \
+    X(database_list_author_twiiiiits) \
+    X(database_twiiiiits_next) \
+    X(database_twiiiiits_close) \
+    X(timeline_fetch) \
+    X(channel_publish)
+
+enum trace_span {
+#define TRACE_SPAN_ENUM(name) TRACE_SPAN_##name,
+    TRACE_SPANS(TRACE_SPAN_ENUM)
+#undef TRACE_SPAN_ENUM
+    TRACE_SPAN_COUNT,
+};
+
+// Format du fichier de trace, partagé avec twiiiiiter-trace-dump
+#define TRACE_FILE_MAGIC "TWTRACE1"
+#define TRACE_NAME_LENGTH 32
+
+enum trace_phase {
+    TRACE_PHASE_BEGIN,
+    TRACE_PHASE_END,
+};
+
+typedef struct {
+    uint64_t timestamp; // En ticks, c.f. trace_file_header.ticks_per_us
+    uint16_t span;
+    uint8_t phase;
+    uint8_t padding[5];
+} trace_record;
+
+typedef struct {
+    char magic[8];
+    double ticks_per_us;
+    uint32_t span_count; // Suivi d'autant de noms de TRACE_NAME_LENGTH octets
+    uint32_t thread_count; // Suivi d'autant de blocs trace_file_thread
+} trace_file_header;
+
+typedef struct {
+    uint32_t thread_id;
+    uint32_t padding;
+    uint64_t record_count; // Suivi d'autant de trace_record, du plus ancien au plus récent
+} trace_file_thread;
+
+#ifdef TWIIIIITER_TRACING
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define trace_timestamp() __rdtsc()
+#else
+#include <time.h>
+static inline uint64_t trace_timestamp() {
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return tv.tv_sec * (uint64_t) 1000000000 + tv.tv_nsec;
+}
+#endif
+
+#ifdef TWIIIIITER_HAVE_SDT
+#include <sys/sdt.h>
+#define TRACE_PROBE(phase, span) DTRACE_PROBE1(twiiiiiter, phase, span)
+#else
+#define TRACE_PROBE(phase, span)
+#endif
+
+extern bool trace_enabled;
+
+void trace_append(uint16_t span, uint8_t phase);
+
+static inline uint16_t trace_scope_begin(uint16_t span) {
+    TRACE_PROBE(span__begin, span);
+    if (__builtin_expect(trace_enabled, 0)) trace_append(span, TRACE_PHASE_BEGIN);
+    return span;
+}
+
+static inline void trace_scope_end(const uint16_t* span) {
+    TRACE_PROBE(span__end, *span);
+    if (__builtin_expect(trace_enabled, 0)) trace_append(*span, TRACE_PHASE_END);
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/**
+ * Trace la portée courante, de cette ligne jusqu'à l'accolade fermante
+ */
+#define TRACE_SCOPE(name) \
+    __attribute__((cleanup(trace_scope_end), unused)) \
+    const uint16_t TRACE_CONCAT(trace_scope_, __LINE__) = trace_scope_begin(TRACE_SPAN_##name)
+
+/**
+ * Active la trace si TWIIIIITER_TRACE vaut 1
+ */
+void trace_initialize();
+
+/**
+ * Écrit le contenu des tampons de tous les threads dans TWIIIIITER_TRACE_FILE (par défaut "twiiiiiter.trace")
+ */
+void trace_dump();
+
+#else
+
+#define TRACE_SCOPE(name)
+
+static inline void trace_initialize() {}
+
+static inline void trace_dump() {}
+
+#endif
+
+#endif
@@ -23,6 +23,7 @@
               mkdir $out/bin
               mv client/twiiiiiter-client $out/bin
               mv server/twiiiiiter-server $out/bin
+              mv gateway/twiiiiiter-gateway $out/bin
             '';
           };
         }
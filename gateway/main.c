@@ -0,0 +1,370 @@
+/**
+ * Passerelle de connexions
+ *
+ * Garde les connexions des clients, et les multiplexe sur quelques connexions au serveur (c.f. "/common/mux.h") : le
+ * serveur ne voit que des sessions logiques, sans socket ni tampon par client. Plusieurs passerelles peuvent se
+ * partager un serveur, qui les écoute sur TWIIIIITER_GATEWAY_LISTEN.
+ *
+ * Les clients sont répartis sur les connexions au serveur, celle qui a le moins de sessions d'abord. Les trames vers le
+ * serveur sont accumulées et écrites une fois par tour de boucle, sans bloquer : ce que le noyau n'accepte pas attend
+ * EPOLLOUT, pour que le serveur et la passerelle ne puissent pas s'attendre l'un l'autre. Celles vers un client lui
+ * sont écrites sans attendre, et un client dont le tampon d'envoi est plein est déconnecté plutôt que de bloquer tous
+ * les autres.
+ *
+ * Usage : twiiiiiter-gateway UPSTREAM [PORT]
+ *
+ * UPSTREAM est une adresse du serveur de TWIIIIITER_GATEWAY_LISTEN (c.f. "/common/address.h"). Comme le serveur, la
+ * passerelle écoute les clients sur TWIIIIITER_LISTEN, ou à défaut sur le port PORT de toutes les interfaces.
+ */
+
+#define _GNU_SOURCE // accept4()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "address.h"
+#include "constants.h"
+#include "listener.h"
+#include "log.h"
+#include "mux.h"
+#include "twiiiiiter_assert.h"
+
+#define EPOLL_MAX_EVENTS 64
+#define DEFAULT_UPSTREAMS 4
+#define MAX_UPSTREAMS 64
+// Trames lues en une fois par connexion au serveur
+#define UPSTREAM_BUFFER_FRAMES 256
+#define UPSTREAM_BUFFER_SIZE (UPSTREAM_BUFFER_FRAMES * MUX_FRAME_SIZE)
+// Au-delà, le serveur ne lit plus nos trames : c'est une connexion perdue
+#define UPSTREAM_MAX_PENDING_SIZE ((1 << 20) * MUX_FRAME_SIZE)
+
+// État d'un identifiant de session, c.f. upstream::sessions
+#define SESSION_FREE -1
+#define SESSION_CLOSING -2 // Fermée par la passerelle, en attente de la confirmation du serveur
+
+typedef struct {
+    int fd;
+    char receive_buffer[UPSTREAM_BUFFER_SIZE];
+    size_t receive_len;
+    // Trames pas encore écrites, en attente de EPOLLOUT si `writable_watched`
+    char* send_buffer;
+    size_t send_len;
+    size_t send_cap;
+    bool writable_watched;
+
+    // Descripteur du client de chaque session, ou SESSION_FREE / SESSION_CLOSING
+    int* sessions;
+    uint32_t sessions_cap;
+    // Identifiants libérés, réutilisés avant d'en créer de nouveaux
+    uint32_t* free_sessions;
+    uint32_t free_len;
+    uint32_t open_count;
+} upstream;
+
+typedef struct {
+    bool open;
+    uint32_t upstream;
+    uint32_t session;
+    char frame_receive_buffer[IO_BUFFER_SIZE];
+    size_t frame_receive_buffer_len;
+} gateway_client;
+
+static int epoll;
+static upstream upstreams[MAX_UPSTREAMS];
+static size_t upstreams_len;
+// Clients indexés par leur descripteur
+static gateway_client* clients = NULL;
+static size_t clients_cap = 0;
+
+/**
+ * Écrit ce que le socket accepte des trames en attente, et attend EPOLLOUT pour le reste
+ */
+static void upstream_write(upstream* up) {
+    size_t written = 0;
+    while (written < up->send_len) {
+        ssize_t len = send(up->fd, up->send_buffer + written, up->send_len - written, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            log_error("Lost the connection to the server: %s", strerror(errno));
+            exit(1);
+        }
+        written += len;
+    }
+    memmove(up->send_buffer, up->send_buffer + written, up->send_len - written);
+    up->send_len -= written;
+
+    bool writable = up->send_len > 0;
+    if (writable == up->writable_watched) return;
+    struct epoll_event upstream_event = { .events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.fd = up->fd };
+    assert(epoll_ctl(epoll, EPOLL_CTL_MOD, up->fd, &upstream_event) == 0);
+    up->writable_watched = writable;
+}
+
+static void upstream_push(upstream* up, const mux_frame* frame) {
+    if (up->send_len + MUX_FRAME_SIZE > UPSTREAM_MAX_PENDING_SIZE) {
+        log_error("Lost the connection to the server: it isn't reading our frames");
+        exit(1);
+    }
+    if (up->send_len + MUX_FRAME_SIZE > up->send_cap) {
+        up->send_cap = up->send_cap ? up->send_cap * 2 : UPSTREAM_BUFFER_SIZE;
+        up->send_buffer = realloc(up->send_buffer, up->send_cap);
+        assert(up->send_buffer != NULL);
+    }
+    mux_encode(frame, up->send_buffer + up->send_len);
+    up->send_len += MUX_FRAME_SIZE;
+}
+
+static uint32_t upstream_session_open(upstream* up, int fd) {
+    uint32_t session;
+    if (up->free_len > 0) {
+        session = up->free_sessions[--up->free_len];
+    } else {
+        session = up->sessions_cap;
+        uint32_t cap = up->sessions_cap ? up->sessions_cap * 2 : 1024;
+        up->sessions = realloc(up->sessions, cap * sizeof *up->sessions);
+        up->free_sessions = realloc(up->free_sessions, cap * sizeof *up->free_sessions);
+        assert(up->sessions != NULL && up->free_sessions != NULL);
+        // Les nouveaux identifiants sont libres, et seront pris dans l'ordre croissant
+        for (uint32_t i = cap; i-- > session + 1;) {
+            up->sessions[i] = SESSION_FREE;
+            up->free_sessions[up->free_len++] = i;
+        }
+        up->sessions_cap = cap;
+    }
+
+    up->sessions[session] = fd;
+    up->open_count++;
+    return session;
+}
+
+static void upstream_session_free(upstream* up, uint32_t session) {
+    up->sessions[session] = SESSION_FREE;
+    up->free_sessions[up->free_len++] = session;
+    up->open_count--;
+}
+
+static void client_accept(int listener_fd) {
+    int fd = accept4(listener_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't accept a client: errno %d", errno);
+        return;
+    }
+
+    if ((size_t) fd >= clients_cap) {
+        size_t cap = clients_cap ?: 1024;
+        while (cap <= (size_t) fd) cap *= 2;
+        clients = realloc(clients, cap * sizeof *clients);
+        assert(clients != NULL);
+        memset(clients + clients_cap, 0, (cap - clients_cap) * sizeof *clients);
+        clients_cap = cap;
+    }
+
+    struct epoll_event client_epollin = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &client_epollin) != 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't add client to the epoll pool: errno %d", errno);
+        close(fd);
+        return;
+    }
+
+    size_t least_loaded = 0;
+    for (size_t i = 1; i < upstreams_len; i++) {
+        if (upstreams[i].open_count < upstreams[least_loaded].open_count) least_loaded = i;
+    }
+    upstream* up = &upstreams[least_loaded];
+
+    gateway_client* client = &clients[fd];
+    client->open = true;
+    client->upstream = least_loaded;
+    client->session = upstream_session_open(up, fd);
+    client->frame_receive_buffer_len = 0;
+    upstream_push(up, &(mux_frame) { .kind = MUX_OPEN, .session = client->session });
+    log_debug("%d is joining as session %u of upstream %zu", fd, client->session, least_loaded);
+}
+
+/**
+ * Ferme la connexion d'un client. Si c'est à son initiative, le serveur en est averti, et l'identifiant de session ne
+ * sera libéré qu'à sa confirmation.
+ */
+static void client_close(int fd, bool notify_server) {
+    gateway_client* client = &clients[fd];
+    upstream* up = &upstreams[client->upstream];
+    client->open = false;
+    epoll_ctl(epoll, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+
+    if (notify_server) {
+        up->sessions[client->session] = SESSION_CLOSING;
+        upstream_push(up, &(mux_frame) { .kind = MUX_CLOSE, .session = client->session });
+    } else {
+        upstream_session_free(up, client->session);
+    }
+    log_debug("%d is leaving", fd);
+}
+
+static void client_read(int fd) {
+    gateway_client* client = &clients[fd];
+    size_t already_read = client->frame_receive_buffer_len;
+    ssize_t bytes_read = read(fd, client->frame_receive_buffer + already_read, IO_BUFFER_SIZE - already_read);
+    if (bytes_read <= 0) {
+        client_close(fd, true);
+        return;
+    }
+
+    client->frame_receive_buffer_len += bytes_read;
+    if (client->frame_receive_buffer_len == IO_BUFFER_SIZE) {
+        client->frame_receive_buffer_len = 0;
+        // La trame est transmise telle quelle, c'est le serveur qui la décode
+        mux_frame frame = { .kind = MUX_DATA, .session = client->session };
+        memcpy(frame.payload, client->frame_receive_buffer, IO_BUFFER_SIZE);
+        upstream_push(&upstreams[client->upstream], &frame);
+    }
+}
+
+static void upstream_process_frame(upstream* up, const mux_frame* frame) {
+    int fd = frame->session < up->sessions_cap ? up->sessions[frame->session] : SESSION_FREE;
+    switch (frame->kind) {
+        case MUX_OPEN:
+            log_limited(LOG_LEVEL_WARNING, "The server opened session %u", frame->session);
+            return;
+        case MUX_DATA:
+            if (fd < 0) return; // Le client est déjà parti
+            // MSG_DONTWAIT : un client qui ne lit plus ne doit pas bloquer les autres sessions
+            if (send(fd, frame->payload, IO_BUFFER_SIZE, MSG_DONTWAIT | MSG_NOSIGNAL) != IO_BUFFER_SIZE) {
+                log_limited(LOG_LEVEL_WARNING, "Couldn't write to client %d, disconnecting it", fd);
+                client_close(fd, true);
+            }
+            return;
+        case MUX_CLOSE:
+            if (fd >= 0) client_close(fd, false); // Déconnexion décidée par le serveur
+            else if (fd == SESSION_CLOSING) upstream_session_free(up, frame->session);
+            return;
+    }
+}
+
+static void upstream_read(upstream* up) {
+    ssize_t bytes_read = read(up->fd, up->receive_buffer + up->receive_len, UPSTREAM_BUFFER_SIZE - up->receive_len);
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (bytes_read <= 0) {
+        // Les sessions de cette connexion n'existent plus côté serveur : les clients devront se reconnecter
+        log_error("Lost the connection to the server");
+        exit(1);
+    }
+    up->receive_len += bytes_read;
+
+    size_t offset = 0;
+    for (; offset + MUX_FRAME_SIZE <= up->receive_len; offset += MUX_FRAME_SIZE) {
+        mux_frame frame;
+        if (mux_decode(up->receive_buffer + offset, &frame)) upstream_process_frame(up, &frame);
+    }
+    memmove(up->receive_buffer, up->receive_buffer + offset, up->receive_len - offset);
+    up->receive_len -= offset;
+}
+
+static upstream* upstream_find(int fd) {
+    for (size_t i = 0; i < upstreams_len; i++) {
+        if (upstreams[i].fd == fd) return &upstreams[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        printf("Usage: %s UPSTREAM [PORT]\n", argv[0]);
+        return 1;
+    }
+    log_initialize();
+
+    char default_listen[8];
+    unsigned port = argc == 3 ? strtoul(argv[2], NULL, 10) : DEFAULT_PORT;
+    snprintf(default_listen, sizeof default_listen, "%u", port);
+    listener_set listeners;
+    listeners_open(&listeners, getenv("TWIIIIITER_LISTEN") ?: default_listen);
+
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    assert(epoll >= 0);
+
+    upstreams_len = strtoul(getenv("TWIIIIITER_GATEWAY_UPSTREAMS") ?: "", NULL, 10) ?: DEFAULT_UPSTREAMS;
+    if (upstreams_len > MAX_UPSTREAMS) upstreams_len = MAX_UPSTREAMS;
+    for (size_t i = 0; i < upstreams_len; i++) {
+        upstream* up = &upstreams[i];
+        memset(up, 0, sizeof *up);
+        up->fd = address_connect(argv[1], DEFAULT_PORT);
+        if (up->fd < 0) {
+            log_error("Can't connect to the server at %s: %s", argv[1], errno ? strerror(errno) : "unknown host");
+            return 1;
+        }
+        fcntl(up->fd, F_SETFL, fcntl(up->fd, F_GETFL) | O_NONBLOCK);
+        struct epoll_event upstream_epollin = { .events = EPOLLIN, .data.fd = up->fd };
+        assert(epoll_ctl(epoll, EPOLL_CTL_ADD, up->fd, &upstream_epollin) == 0);
+    }
+    log_info("Connected to the server at %s with %zu connections", argv[1], upstreams_len);
+
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    struct epoll_event signal_epollin = { .events = EPOLLIN, .data.fd = signal_fd };
+    assert(epoll_ctl(epoll, EPOLL_CTL_ADD, signal_fd, &signal_epollin) == 0);
+
+    listeners_register(&listeners, epoll, "Listening");
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    bool running = true;
+    while (running) {
+        int ready;
+        do {
+            ready = epoll_wait(epoll, events, EPOLL_MAX_EVENTS, -1);
+        } while (ready == -1 && errno == EINTR);
+        assert(ready >= 0);
+
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            upstream* up;
+            if (fd == signal_fd) {
+                running = false;
+            } else if (listeners_contains(&listeners, fd)) {
+                client_accept(fd);
+            } else if ((up = upstream_find(fd)) != NULL) {
+                if (events[i].events & EPOLLOUT) upstream_write(up);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) upstream_read(up);
+            } else if ((size_t) fd < clients_cap && clients[fd].open) {
+                client_read(fd);
+            }
+        }
+
+        // Une écriture par connexion au serveur pour toutes les trames de ce tour, sauf si elle attend EPOLLOUT
+        for (size_t i = 0; i < upstreams_len; i++) {
+            if (upstreams[i].send_len > 0 && !upstreams[i].writable_watched) upstream_write(&upstreams[i]);
+        }
+    }
+
+    log_info("Shutting down");
+    // Les sessions sont fermées par le serveur en même temps que nos connexions
+    for (size_t fd = 0; fd < clients_cap; fd++) {
+        if (clients[fd].open) close(fd);
+    }
+    for (size_t i = 0; i < upstreams_len; i++) {
+        close(upstreams[i].fd);
+        free(upstreams[i].send_buffer);
+        free(upstreams[i].sessions);
+        free(upstreams[i].free_sessions);
+    }
+    free(clients);
+    listeners_close(&listeners);
+    close(signal_fd);
+    close(epoll);
+    log_shutdown();
+
+    return 0;
+}
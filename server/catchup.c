@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "catchup.h"
+#include "clock.h"
+#include "database.h"
+#include "log.h"
+#include "read_pool.h"
+#include "stats.h"
+#include "trace.h"
+#include "twiiiiiter_assert.h"
+
+#define DEFAULT_CATCHUP_CONCURRENCY 64
+// Twiiiiits remis à un utilisateur avant de passer au suivant
+#define CATCHUP_QUANTUM 32
+// Twiiiiits lus à la fois par le thread lecteur d'un rattrapage
+#define CATCHUP_READ_BATCH 256
+
+typedef struct catchup_job_s {
+    read_task read; // Lecture du lot suivant, c.f. catchup_read()
+    user_list_node* user; // NULL si le rattrapage a été abandonné pendant une lecture
+    user_name user_name; // Pour le thread lecteur, `user` pouvant être libéré pendant la lecture
+    uint64_t after; // Dernier twiiiiit remis (ou curseur de départ)
+    uint64_t until; // Dernier twiiiiit lu par `twiiiiits`
+
+    // Tenus par le thread lecteur pendant une lecture
+    twiiiiit_iterator twiiiiits; // Ouvert à la première lecture, NULL une fois au bout
+    bool exhausted; // La requête est arrivée au bout
+    database_twiiiiit* batch; // Dernier lot lu, alloué quand le rattrapage commence
+    size_t batch_len;
+
+    size_t batch_next; // Prochain twiiiiit du lot à remettre
+    bool reading;
+    int64_t submitted; // Horloge monotone, c.f. monotonic_now()
+    size_t index; // Position dans `waiting` ou dans `active`
+} catchup_job;
+
+static size_t concurrency = DEFAULT_CATCHUP_CONCURRENCY;
+
+// Rattrapages en attente, en tas selon le curseur
+static catchup_job** waiting = NULL;
+static size_t waiting_len = 0;
+static size_t waiting_cap = 0;
+
+// Rattrapages en cours, avancés à tour de rôle à partir de `next_active`
+static catchup_job** active = NULL;
+static size_t active_len = 0;
+static size_t next_active = 0;
+// Rattrapages en cours qui attendent leur lecteur
+static size_t reading_len = 0;
+
+// Vague de rattrapages en cours : du premier rattrapage mis en file au moment où il n'en reste plus aucun
+static bool wave_open = false;
+static int64_t wave_started;
+static size_t wave_users;
+static size_t wave_twiiiiits;
+
+void catchup_initialize() {
+    concurrency = strtoull(getenv("TWIIIIITER_CATCHUP_CONCURRENCY") ?: "", NULL, 10) ?: DEFAULT_CATCHUP_CONCURRENCY;
+    active = malloc(concurrency * sizeof *active);
+    assert(active != NULL);
+}
+
+bool catchup_pending() {
+    return (waiting_len > 0 && active_len < concurrency) || active_len > reading_len;
+}
+
+static bool waiting_before(size_t a, size_t b) {
+    return waiting[a]->after > waiting[b]->after;
+}
+
+static void waiting_swap(size_t a, size_t b) {
+    catchup_job* job = waiting[a];
+    waiting[a] = waiting[b];
+    waiting[b] = job;
+    waiting[a]->index = a;
+    waiting[b]->index = b;
+}
+
+static void waiting_sift_up(size_t i) {
+    while (i > 0 && waiting_before(i, (i - 1) / 2)) {
+        waiting_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void waiting_sift_down(size_t i) {
+    while (true) {
+        size_t smallest = i;
+        if (2 * i + 1 < waiting_len && waiting_before(2 * i + 1, smallest)) smallest = 2 * i + 1;
+        if (2 * i + 2 < waiting_len && waiting_before(2 * i + 2, smallest)) smallest = 2 * i + 2;
+        if (smallest == i) return;
+        waiting_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void waiting_remove(size_t i) {
+    waiting_len--;
+    if (i == waiting_len) return;
+    waiting[i] = waiting[waiting_len];
+    waiting[i]->index = i;
+    waiting_sift_down(i);
+    waiting_sift_up(i);
+}
+
+static void active_remove(size_t i) {
+    active[i] = active[--active_len];
+    active[i]->index = i;
+}
+
+void catchup_submit(user_list_node* user, uint64_t after) {
+    assert(user->catchup == NULL);
+    if (!wave_open) {
+        wave_open = true;
+        wave_started = monotonic_now();
+        wave_users = 0;
+        wave_twiiiiits = 0;
+    }
+
+    catchup_job* job = malloc(sizeof(catchup_job));
+    assert(job != NULL);
+    *job = (catchup_job) {
+        .user = user,
+        .after = after,
+        .submitted = monotonic_now(),
+    };
+    memcpy(job->user_name, user->user_name, sizeof(user_name));
+    user->catchup = job;
+
+    if (waiting_len == waiting_cap) {
+        waiting_cap = waiting_cap ? waiting_cap * 2 : 64;
+        waiting = realloc(waiting, waiting_cap * sizeof *waiting);
+        assert(waiting != NULL);
+    }
+    job->index = waiting_len;
+    waiting[waiting_len++] = job;
+    waiting_sift_up(job->index);
+}
+
+/**
+ * Annonce la fin d'une vague de rattrapages, une fois la file vide
+ */
+static void catchup_end_wave() {
+    if (!wave_open || waiting_len > 0 || active_len > 0) return;
+    wave_open = false;
+    // La durée de la vague est le temps qu'a attendu le dernier servi
+    log_info(
+        "Caught up %zu users with %zu twiiiiits in %ld ms",
+        wave_users, wave_twiiiiits, (monotonic_now() - wave_started) / 1000
+    );
+}
+
+static void catchup_job_free(catchup_job* job) {
+    if (job->twiiiiits != NULL) database_twiiiiits_close(job->twiiiiits);
+    free(job->batch);
+    free(job);
+}
+
+/**
+ * Lit le lot suivant, sur le thread lecteur du rattrapage
+ */
+static void catchup_read(read_task* task) {
+    TRACE_SCOPE(catchup_read);
+    catchup_job* job = (catchup_job*) task;
+    if (job->twiiiiits == NULL) {
+        job->twiiiiits = database_list_missed_twiiiiits(job->user_name, job->after, job->until);
+    }
+
+    job->batch_len = 0;
+    while (job->batch_len < CATCHUP_READ_BATCH) {
+        if (!database_twiiiiits_next(job->twiiiiits, &job->batch[job->batch_len])) {
+            job->twiiiiits = NULL;
+            job->exhausted = true;
+            break;
+        }
+        job->batch_len++;
+    }
+}
+
+static void catchup_read_complete(read_task* task) {
+    catchup_job* job = (catchup_job*) task;
+    if (job->user == NULL) {
+        catchup_job_free(job);
+        return;
+    }
+
+    job->batch_next = 0;
+    job->reading = false;
+    reading_len--;
+}
+
+static void catchup_job_read(catchup_job* job) {
+    job->reading = true;
+    reading_len++;
+    read_pool_submit(&job->read);
+}
+
+bool catchup_cancel(user_list_node* user) {
+    catchup_job* job = user->catchup;
+    if (job == NULL) return false;
+
+    if (job->batch != NULL) active_remove(job->index);
+    else waiting_remove(job->index);
+    user->catchup = NULL;
+
+    if (job->reading) {
+        // Le lecteur a encore besoin du rattrapage, qui sera libéré par catchup_read_complete()
+        job->user = NULL;
+        reading_len--;
+    } else {
+        catchup_job_free(job);
+    }
+
+    catchup_end_wave();
+    return true;
+}
+
+/**
+ * Prépare la requête des twiiiiits publiés après le dernier remis, jusqu'au dernier publié. Elle sera ouverte par la
+ * prochaine lecture.
+ */
+static void catchup_job_open(catchup_job* job) {
+    job->until = database_last_seq();
+    job->exhausted = false;
+    job->batch_len = 0;
+    job->batch_next = 0;
+}
+
+/**
+ * Remet au plus CATCHUP_QUANTUM twiiiiits, ou demande le lot suivant à son lecteur. Renvoie true si le rattrapage est
+ * terminé.
+ *
+ * Arrivé au bout de la requête, le rattrapage continue avec les twiiiiits publiés depuis son ouverture, que les
+ * diffusions ont passés. Il se termine quand il n'y en a plus : les rattrapages n'avançant que quand il n'y a aucune
+ * diffusion en cours, les twiiiiits suivants seront remis en direct.
+ */
+static bool catchup_job_step(catchup_job* job) {
+    int sent = 0;
+    while (sent < CATCHUP_QUANTUM) {
+        if (job->batch_next == job->batch_len) {
+            if (job->exhausted) {
+                job->after = job->until;
+                if (database_last_seq() == job->until) return true;
+                catchup_job_open(job);
+            }
+            catchup_job_read(job);
+            // Sans thread lecteur, le lot est déjà lu
+            if (job->reading) return false;
+            continue;
+        }
+
+        const database_twiiiiit* twiiiiit = &job->batch[job->batch_next++];
+        message_s2c twiiiiit_msg = {
+            .tag = MESSAGE_S2C_RECEIVED_MESSAGE,
+            .received_message.date = twiiiiit->date,
+            .received_message.seq = twiiiiit->seq,
+        };
+        memcpy(twiiiiit_msg.received_message.author, twiiiiit->author, MAX_USERNAME_LENGTH);
+        memcpy(twiiiiit_msg.received_message.message, twiiiiit->message, MESSAGE_MAX_LENGTH);
+        send_message(job->user, twiiiiit_msg);
+        job->after = twiiiiit->seq;
+        sent++;
+        wave_twiiiiits++;
+    }
+    return false;
+}
+
+static void catchup_finish(catchup_job* job) {
+    stats_record_catchup(monotonic_now() - job->submitted);
+    wave_users++;
+
+    active_remove(job->index);
+    job->user->catchup = NULL;
+    catchup_job_free(job);
+}
+
+bool catchup_run(server_state* server) {
+    TRACE_SCOPE(catchup_run);
+    int64_t deadline = monotonic_now() + server->fanout_slice_us;
+
+    while (true) {
+        while (active_len < concurrency && waiting_len > 0) {
+            catchup_job* job = waiting[0];
+            waiting_remove(0);
+            job->read = (read_task) {
+                .run = catchup_read,
+                .complete = catchup_read_complete,
+                .reader = READ_POOL_ANY_READER,
+            };
+            job->batch = malloc(CATCHUP_READ_BATCH * sizeof(database_twiiiiit));
+            assert(job->batch != NULL);
+            catchup_job_open(job);
+            job->index = active_len;
+            active[active_len++] = job;
+        }
+        // Les lots arrivent par read_pool_handle_event()
+        if (active_len == reading_len) break;
+
+        if (next_active >= active_len) next_active = 0;
+        catchup_job* job = active[next_active];
+        if (job->reading) next_active++;
+        else if (catchup_job_step(job)) catchup_finish(job);
+        else next_active++;
+
+        if (monotonic_now() >= deadline) break;
+    }
+
+    catchup_end_wave();
+    return catchup_pending();
+}
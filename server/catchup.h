@@ -0,0 +1,57 @@
+#ifndef _CATCHUP_H_
+#define _CATCHUP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "server.h"
+
+/**
+ * Rattrapage des twiiiiits manqués pendant une déconnexion
+ *
+ * Une connexion est acceptée (LOGIN_STATUS_OK) sans attendre son rattrapage, qui est mis en file et avancé par la
+ * boucle d'évènements comme une diffusion (c.f. "fanout.h"), mais seulement une fois les diffusions terminées : le
+ * trafic en direct passe d'abord, et une vague de reconnexions ne retarde pas les connexions suivantes.
+ *
+ * Au plus TWIIIIITER_CATCHUP_CONCURRENCY rattrapages sont en cours à la fois, chacun avec sa requête ouverte. Ils
+ * avancent à tour de rôle par petits lots, si bien que les plus courts se terminent les premiers. Les autres attendent,
+ * par curseur décroissant, qui donne une idée de la taille de ce qu'il reste à rattraper.
+ *
+ * Les requêtes sont ouvertes et lues par les threads lecteurs (c.f. "read_pool.h"), chacune sur la connexion d'un
+ * lecteur, par lots qui reviennent à la boucle d'évènements : les rattrapages en cours lisent la base en parallèle, et
+ * la boucle ne fait plus que remettre les twiiiiits.
+ *
+ * Un rattrapage remet, par numéro de séquence croissant, tous les twiiiiits des abonnements publiés après le curseur de
+ * l'utilisateur (c.f. database_cursor()), y compris ceux publiés pendant le rattrapage : tant qu'il dure, les
+ * diffusions passent l'utilisateur, et il ne se termine qu'une fois arrivé au dernier twiiiiit publié. Chaque twiiiiit
+ * est donc reçu une seule fois, dans l'ordre, et le client peut acquitter (MESSAGE_C2S_ACK) le dernier reçu pour
+ * avancer son curseur.
+ */
+
+/**
+ * Lit la configuration dans l'environnement
+ */
+void catchup_initialize();
+
+/**
+ * Met en file le rattrapage des twiiiiits publiés pour `user` après le numéro de séquence `after`, son curseur
+ */
+void catchup_submit(user_list_node* user, uint64_t after);
+
+/**
+ * Abandonne le rattrapage de `user`, s'il en a un en cours. Renvoie true si c'était le cas.
+ */
+bool catchup_cancel(user_list_node* user);
+
+/**
+ * Indique s'il reste des rattrapages à avancer sans attendre de lecteur
+ */
+bool catchup_pending();
+
+/**
+ * Avance les rattrapages pendant au plus `server->fanout_slice_us` microsecondes. Renvoie true s'il reste du travail
+ * qui n'attend pas de lecteur.
+ */
+bool catchup_run(server_state* server);
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel.h"
+#include "cluster.h"
+#include "database.h"
+#include "fanout.h"
+#include "log.h"
+#include "trace.h"
+#include "twiiiiiter_assert.h"
+
+// Taille initiale de l'index, doublée dès qu'il a plus de canaux que d'alvéoles
+#define CHANNEL_INDEX_MIN_BUCKETS 256
+
+/**
+ * Membres d'un canal, dans l'alvéole de l'index correspondant au hachage de son nom
+ */
+typedef struct channel_entry_s {
+    user_name name;
+    user_name* members; // Dans le désordre
+    size_t members_len, members_cap;
+
+    struct channel_entry_s* next;
+} channel_entry;
+
+static channel_entry** channel_index = NULL;
+static size_t channel_index_mask = 0; // Nombre d'alvéoles moins un, c'est une puissance de deux
+static size_t channel_count = 0;
+static size_t membership_count = 0;
+
+static uint64_t channel_index_hash(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < MAX_USERNAME_LENGTH && name[i] != 0; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * Renvoie l'adresse du lien vers le canal `name` dans son alvéole, qui pointe vers NULL s'il n'a aucun membre
+ */
+static channel_entry** channel_index_find(const char* name) {
+    if (channel_index == NULL) {
+        channel_index_mask = CHANNEL_INDEX_MIN_BUCKETS - 1;
+        channel_index = calloc(CHANNEL_INDEX_MIN_BUCKETS, sizeof *channel_index);
+        assert(channel_index != NULL);
+    }
+
+    channel_entry** entry = &channel_index[channel_index_hash(name) & channel_index_mask];
+    while (*entry != NULL && strncmp((*entry)->name, name, MAX_USERNAME_LENGTH) != 0) entry = &(*entry)->next;
+    return entry;
+}
+
+static void channel_index_grow() {
+    size_t buckets = (channel_index_mask + 1) * 2;
+    channel_entry** grown = calloc(buckets, sizeof *grown);
+    assert(grown != NULL);
+    for (size_t i = 0; i <= channel_index_mask; i++) {
+        for (channel_entry* entry = channel_index[i], *next; entry != NULL; entry = next) {
+            next = entry->next;
+            size_t bucket = channel_index_hash(entry->name) & (buckets - 1);
+            entry->next = grown[bucket];
+            grown[bucket] = entry;
+        }
+    }
+
+    free(channel_index);
+    channel_index = grown;
+    channel_index_mask = buckets - 1;
+}
+
+static size_t channel_find_member(const channel_entry* channel, const char* member) {
+    for (size_t i = 0; i < channel->members_len; i++) {
+        if (strncmp(channel->members[i], member, MAX_USERNAME_LENGTH) == 0) return i;
+    }
+
+    return channel->members_len;
+}
+
+/**
+ * Ajoute `member` à l'index de `name`, s'il n'y est pas déjà
+ */
+static void channel_index_add(const char* name, const char* member) {
+    channel_entry** entry = channel_index_find(name);
+    if (*entry == NULL) {
+        channel_entry* created = malloc(sizeof(channel_entry));
+        assert(created != NULL);
+        *created = (channel_entry) { .members = NULL, .members_len = 0, .members_cap = 0, .next = NULL };
+        memset(created->name, 0, sizeof created->name);
+        strncpy(created->name, name, MAX_USERNAME_LENGTH);
+        *entry = created;
+        if (++channel_count > channel_index_mask + 1) channel_index_grow();
+        entry = channel_index_find(name);
+    }
+
+    channel_entry* channel = *entry;
+    if (channel_find_member(channel, member) < channel->members_len) return;
+    if (channel->members_len == channel->members_cap) {
+        channel->members_cap = channel->members_cap ? channel->members_cap * 2 : 4;
+        channel->members = realloc(channel->members, channel->members_cap * sizeof(user_name));
+        assert(channel->members != NULL);
+    }
+    memset(channel->members[channel->members_len], 0, sizeof(user_name));
+    strncpy(channel->members[channel->members_len++], member, MAX_USERNAME_LENGTH);
+    membership_count++;
+}
+
+/**
+ * Retire `member` de l'index de `name`, et le canal avec son dernier membre
+ */
+static void channel_index_remove(const char* name, const char* member) {
+    channel_entry** entry = channel_index_find(name);
+    channel_entry* channel = *entry;
+    if (channel == NULL) return;
+
+    size_t i = channel_find_member(channel, member);
+    if (i == channel->members_len) return;
+    memcpy(channel->members[i], channel->members[--channel->members_len], sizeof(user_name));
+    membership_count--;
+
+    if (channel->members_len == 0) {
+        *entry = channel->next;
+        free(channel->members);
+        free(channel);
+        channel_count--;
+    }
+}
+
+void channel_initialize() {
+    user_iterator channels = database_list_channels();
+    user_name name;
+    while (database_users_next(channels, name)) {
+        user_iterator members = database_list_channel_members(name);
+        user_name member;
+        while (database_users_next(members, member)) channel_index_add(name, member);
+    }
+
+    if (channel_count > 0) log_info("Loaded %zu channels with %zu members", channel_count, membership_count);
+}
+
+enum subscribe_result channel_join(const char* member, const char* channel) {
+    enum subscribe_result result = database_join_channel(member, channel);
+    if (result == SUBSCRIBE_RESULT_OK) {
+        channel_index_add(channel, member);
+        cluster_announce_channel(channel, member, true);
+    }
+    return result;
+}
+
+enum subscribe_result channel_leave(const char* member, const char* channel) {
+    enum subscribe_result result = database_leave_channel(member, channel);
+    if (result == SUBSCRIBE_RESULT_OK) {
+        channel_index_remove(channel, member);
+        cluster_announce_channel(channel, member, false);
+    }
+    return result;
+}
+
+/**
+ * Met en file la diffusion d'un message aux membres de son canal connecté·es à ce nœud
+ */
+static void channel_fanout(server_state* server, const message_s2c* message) {
+    channel_entry* channel = *channel_index_find(message->channel_message.channel);
+    if (channel == NULL) return;
+
+    // L'auteur·ice n'a pas d'écho à part : iel reçoit le message par la diffusion si iel est membre
+    fanout_start_channel(server, (const user_name*) channel->members, channel->members_len, message);
+}
+
+void channel_publish(server_state* server, const char* author, const char* channel, const char* message) {
+    TRACE_SCOPE(channel_publish);
+    message_s2c channel_msg = {
+        .tag = MESSAGE_S2C_CHANNEL_MESSAGE,
+        .channel_message.date = ts_now(),
+    };
+    strncpy(channel_msg.channel_message.channel, channel, MAX_USERNAME_LENGTH);
+    strncpy(channel_msg.channel_message.author, author, MAX_USERNAME_LENGTH);
+    strncpy(channel_msg.channel_message.message, message, MESSAGE_MAX_LENGTH);
+
+    channel_fanout(server, &channel_msg);
+    cluster_publish_channel(&channel_msg);
+}
+
+void channel_apply_remote(const char* member, const char* channel, bool joined) {
+    if (joined) channel_index_add(channel, member);
+    else channel_index_remove(channel, member);
+}
+
+void channel_deliver_remote(server_state* server, const message_s2c* message) {
+    channel_fanout(server, message);
+}
+
+channel_memory channel_memory_usage() {
+    channel_memory memory = {
+        .channels = channel_count,
+        .memberships = membership_count,
+        .index_bytes = channel_index != NULL ? (channel_index_mask + 1) * sizeof *channel_index : 0,
+    };
+    for (size_t i = 0; channel_index != NULL && i <= channel_index_mask; i++) {
+        for (const channel_entry* entry = channel_index[i]; entry != NULL; entry = entry->next) {
+            memory.index_bytes += sizeof(channel_entry) + entry->members_cap * sizeof(user_name);
+        }
+    }
+    return memory;
+}
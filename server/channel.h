@@ -0,0 +1,60 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "codec.h"
+#include "constants.h"
+#include "server.h"
+
+/**
+ * Canaux thématiques : des listes de diffusion nommées, que chacun·e peut rejoindre ou quitter, et dans lesquelles
+ * tout le monde peut publier
+ *
+ * Les adhésions sont enregistrées dans la base de données, mais chaque nœud en garde aussi un index inversé en
+ * mémoire (canal -> membres), chargé au démarrage puis tenu à jour par les adhésions et les départs, y compris ceux
+ * annoncés par les autres nœuds de la grappe. Une publication ne lit donc pas la base : les membres sont recopié·es dans une
+ * diffusion (c.f. "fanout.h"), avancée par tranches comme celle d'un twiiiiit, et leurs sessions sont trouvées dans
+ * l'index des noms connectés (c.f. user_list_sessions()).
+ *
+ * Les messages des canaux ne sont pas enregistrés : seul·es les membres connecté·es au moment de la publication les
+ * reçoivent.
+ */
+
+typedef struct {
+    size_t channels;
+    size_t memberships;
+    size_t index_bytes; // Alvéoles, canaux et tableaux de membres
+} channel_memory;
+
+/**
+ * Charge l'index des canaux depuis la base de données
+ */
+void channel_initialize();
+
+/**
+ * Fait rejoindre (resp. quitter) un canal à `member`, comme database_join_channel() (resp. database_leave_channel()),
+ * et tient à jour l'index de ce nœud et des autres
+ */
+enum subscribe_result channel_join(const char* member, const char* channel);
+enum subscribe_result channel_leave(const char* member, const char* channel);
+
+/**
+ * Diffuse un message aux membres de `channel`, sur ce nœud et sur les autres
+ */
+void channel_publish(server_state* server, const char* author, const char* channel, const char* message);
+
+/**
+ * Applique à l'index une adhésion (resp. un départ) annoncée par un autre nœud
+ */
+void channel_apply_remote(const char* member, const char* channel, bool joined);
+
+/**
+ * Diffuse aux membres connecté·es à ce nœud un message (MESSAGE_S2C_CHANNEL_MESSAGE) publié sur un autre
+ */
+void channel_deliver_remote(server_state* server, const message_s2c* message);
+
+channel_memory channel_memory_usage();
+
+#endif
@@ -0,0 +1,476 @@
+#include <byteswap.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "address.h"
+#include "channel.h"
+#include "cluster.h"
+#include "constants.h"
+#include "database.h"
+#include "log.h"
+#include "twiiiiiter_assert.h"
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define htonll(value) bswap_64(value)
+#else
+#define htonll(value) value
+#endif
+
+#define PRESENCE_BUCKETS 4096
+// Un peu plus qu'une trame client : un twiiiiit et son numéro de séquence, plus son destinataire
+#define CLUSTER_FRAME_SIZE 56
+// Au-delà, un nœud qui ne lit plus ses trames est considéré comme mort
+#define CLUSTER_MAX_PENDING_BYTES (CLUSTER_FRAME_SIZE << 16)
+
+/**
+ * Un message entre deux nœuds, encodé sur CLUSTER_FRAME_SIZE octets
+ */
+typedef struct {
+    enum {
+        CLUSTER_PRESENCE_JOIN,
+        CLUSTER_PRESENCE_LEAVE,
+        CLUSTER_DELIVER,
+        // Les suivants concernent le canal `name`, et `twiiiiit.author` est le membre (resp. l'auteur·ice)
+        CLUSTER_CHANNEL_JOIN,
+        CLUSTER_CHANNEL_LEAVE,
+        CLUSTER_CHANNEL_DELIVER,
+    } tag;
+    user_name name; // Utilisateur·ice concerné·e (destinataire pour CLUSTER_DELIVER), ou canal
+    received_message twiiiiit; // Pour CLUSTER_DELIVER et les messages de canaux
+} cluster_message;
+
+struct cluster_peer_s {
+    int fd;
+    char frame_receive_buffer[CLUSTER_FRAME_SIZE];
+    size_t frame_receive_buffer_len;
+
+    // Octets qui n'ont pas encore pu être écrits, envoyés sur EPOLLOUT. Le socket est non bloquant : un nœud lent ne
+    // doit pas bloquer la boucle d'évènements, ni les deux nœuds s'attendre l'un l'autre.
+    char* send_buffer;
+    size_t send_len;
+    size_t send_capacity;
+    bool dead; // Sa fermeture a été demandée, la lecture la constatera
+
+    struct cluster_peer_s* next;
+};
+
+typedef struct presence_entry_s {
+    user_name name;
+    cluster_peer* peer;
+
+    struct presence_entry_s* next;
+} presence_entry;
+
+static int cluster_socket = -1;
+static cluster_peer* peers = NULL;
+static presence_entry* presence[PRESENCE_BUCKETS];
+
+static size_t presence_bucket(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < MAX_USERNAME_LENGTH && name[i] != 0; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3;
+    }
+    return hash % PRESENCE_BUCKETS;
+}
+
+static void presence_remove(const char* name, cluster_peer* peer) {
+    for (presence_entry** entry = &presence[presence_bucket(name)]; *entry != NULL; entry = &(*entry)->next) {
+        if ((*entry)->peer == peer && strncmp((*entry)->name, name, MAX_USERNAME_LENGTH) == 0) {
+            presence_entry* to_free = *entry;
+            *entry = to_free->next;
+            free(to_free);
+            return;
+        }
+    }
+}
+
+static void presence_add(const char* name, cluster_peer* peer) {
+    presence_entry* entry = malloc(sizeof(presence_entry));
+    assert(entry != NULL);
+    memset(entry->name, 0, sizeof entry->name);
+    strncpy(entry->name, name, MAX_USERNAME_LENGTH);
+    entry->peer = peer;
+
+    size_t bucket = presence_bucket(name);
+    entry->next = presence[bucket];
+    presence[bucket] = entry;
+}
+
+cluster_peer* cluster_find_online(const char* name) {
+    for (presence_entry* entry = presence[presence_bucket(name)]; entry != NULL; entry = entry->next) {
+        if (strncmp(entry->name, name, MAX_USERNAME_LENGTH) == 0) return entry->peer;
+    }
+
+    return NULL;
+}
+
+static void cluster_encode(const cluster_message* msg, char* frame) {
+    memset(frame, 0, CLUSTER_FRAME_SIZE);
+    uint32_t n_tag = htonl(msg->tag);
+    memcpy(frame, &n_tag, sizeof n_tag);
+    frame += sizeof n_tag;
+    memcpy(frame, msg->name, MAX_USERNAME_LENGTH);
+    frame += MAX_USERNAME_LENGTH;
+
+    if (msg->tag >= CLUSTER_DELIVER) {
+        int64_t date = htonll(msg->twiiiiit.date);
+        memcpy(frame, &date, sizeof date);
+        frame += sizeof date;
+        memcpy(frame, msg->twiiiiit.author, MAX_USERNAME_LENGTH);
+        frame += MAX_USERNAME_LENGTH;
+        memcpy(frame, msg->twiiiiit.message, MESSAGE_MAX_LENGTH);
+        frame += MESSAGE_MAX_LENGTH;
+        uint64_t seq = htonll(msg->twiiiiit.seq);
+        memcpy(frame, &seq, sizeof seq);
+    }
+}
+
+static bool cluster_decode(const char* frame, cluster_message* msg) {
+    uint32_t tag;
+    memcpy(&tag, frame, sizeof tag);
+    tag = ntohl(tag);
+    if (tag > CLUSTER_CHANNEL_DELIVER) {
+        log_limited(LOG_LEVEL_ERROR, "Invalid cluster tag %d", tag);
+        return false;
+    }
+    frame += sizeof tag;
+
+    memset(msg, 0, sizeof *msg);
+    msg->tag = tag;
+    strncpy(msg->name, frame, MAX_USERNAME_LENGTH);
+    frame += MAX_USERNAME_LENGTH;
+
+    if (msg->tag >= CLUSTER_DELIVER) {
+        memcpy(&msg->twiiiiit.date, frame, sizeof(int64_t));
+        msg->twiiiiit.date = htonll(msg->twiiiiit.date);
+        frame += sizeof(int64_t);
+        strncpy(msg->twiiiiit.author, frame, MAX_USERNAME_LENGTH);
+        frame += MAX_USERNAME_LENGTH;
+        strncpy(msg->twiiiiit.message, frame, MESSAGE_MAX_LENGTH);
+        frame += MESSAGE_MAX_LENGTH;
+        memcpy(&msg->twiiiiit.seq, frame, sizeof(uint64_t));
+        msg->twiiiiit.seq = htonll(msg->twiiiiit.seq);
+    }
+
+    return true;
+}
+
+static int epoll_fd = -1;
+
+/**
+ * Inscrit ou désinscrit le lien à EPOLLOUT
+ */
+static void cluster_watch(cluster_peer* peer, bool writable) {
+    struct epoll_event event = { .events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.fd = peer->fd };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, peer->fd, &event) != 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't watch cluster peer %d for writing: errno %d", peer->fd, errno);
+    }
+}
+
+/**
+ * Abandonne un lien sur lequel on ne peut plus écrire. Il n'est pas retiré tout de suite, l'appelant pouvant être en
+ * train de parcourir les nœuds : la lecture verra la fin du flux et s'en chargera.
+ */
+static void cluster_peer_kill(cluster_peer* peer) {
+    peer->dead = true;
+    peer->send_len = 0;
+    shutdown(peer->fd, SHUT_RDWR);
+}
+
+/**
+ * Écrit ce que le socket accepte des octets en attente. Renvoie false si le lien est mort.
+ */
+static bool cluster_flush(cluster_peer* peer) {
+    size_t written_total = 0;
+    while (written_total < peer->send_len) {
+        // MSG_NOSIGNAL : un nœud disparu ne doit pas tuer les autres
+        ssize_t written = send(peer->fd, peer->send_buffer + written_total, peer->send_len - written_total,
+            MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            log_limited(LOG_LEVEL_WARNING, "Couldn't write to cluster peer %d: errno %d", peer->fd, errno);
+            cluster_peer_kill(peer);
+            return false;
+        }
+        written_total += written;
+    }
+
+    memmove(peer->send_buffer, peer->send_buffer + written_total, peer->send_len - written_total);
+    peer->send_len -= written_total;
+    return true;
+}
+
+static void cluster_send(cluster_peer* peer, const cluster_message* msg) {
+    if (peer->dead) return;
+
+    if (peer->send_len + CLUSTER_FRAME_SIZE > CLUSTER_MAX_PENDING_BYTES) {
+        log_limited(LOG_LEVEL_WARNING, "Cluster peer %d isn't reading its messages, disconnecting", peer->fd);
+        cluster_peer_kill(peer);
+        return;
+    }
+    if (peer->send_len + CLUSTER_FRAME_SIZE > peer->send_capacity) {
+        peer->send_capacity = peer->send_capacity == 0 ? CLUSTER_FRAME_SIZE * 64 : peer->send_capacity * 2;
+        peer->send_buffer = realloc(peer->send_buffer, peer->send_capacity);
+        assert(peer->send_buffer != NULL);
+    }
+
+    bool was_empty = peer->send_len == 0;
+    cluster_encode(msg, peer->send_buffer + peer->send_len);
+    peer->send_len += CLUSTER_FRAME_SIZE;
+    // Derrière des octets en attente, la trame attend EPOLLOUT pour ne pas s'intercaler
+    if (!was_empty) return;
+    if (cluster_flush(peer) && peer->send_len > 0) cluster_watch(peer, true);
+}
+
+static void cluster_broadcast(const cluster_message* msg) {
+    for (cluster_peer* peer = peers; peer != NULL; peer = peer->next) {
+        cluster_send(peer, msg);
+    }
+}
+
+void cluster_announce_join(const char* name) {
+    cluster_message msg = { .tag = CLUSTER_PRESENCE_JOIN };
+    strncpy(msg.name, name, MAX_USERNAME_LENGTH);
+    cluster_broadcast(&msg);
+}
+
+void cluster_announce_leave(const char* name) {
+    cluster_message msg = { .tag = CLUSTER_PRESENCE_LEAVE };
+    strncpy(msg.name, name, MAX_USERNAME_LENGTH);
+    cluster_broadcast(&msg);
+}
+
+void cluster_deliver(cluster_peer* peer, const char* follower, const received_message* twiiiiit) {
+    cluster_message msg = { .tag = CLUSTER_DELIVER, .twiiiiit = *twiiiiit };
+    strncpy(msg.name, follower, MAX_USERNAME_LENGTH);
+    cluster_send(peer, &msg);
+}
+
+void cluster_announce_channel(const char* channel, const char* member, bool joined) {
+    cluster_message msg = { .tag = joined ? CLUSTER_CHANNEL_JOIN : CLUSTER_CHANNEL_LEAVE };
+    strncpy(msg.name, channel, MAX_USERNAME_LENGTH);
+    strncpy(msg.twiiiiit.author, member, MAX_USERNAME_LENGTH);
+    cluster_broadcast(&msg);
+}
+
+void cluster_publish_channel(const message_s2c* message) {
+    cluster_message msg = {
+        .tag = CLUSTER_CHANNEL_DELIVER,
+        .twiiiiit.date = message->channel_message.date,
+    };
+    memcpy(msg.name, message->channel_message.channel, MAX_USERNAME_LENGTH);
+    memcpy(msg.twiiiiit.author, message->channel_message.author, MAX_USERNAME_LENGTH);
+    memcpy(msg.twiiiiit.message, message->channel_message.message, MESSAGE_MAX_LENGTH);
+    cluster_broadcast(&msg);
+}
+
+/**
+ * Ajoute un lien vers un autre nœud et lui envoie l'état de présence local
+ */
+static void cluster_peer_add(server_state* server, int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    cluster_peer* peer = malloc(sizeof(cluster_peer));
+    assert(peer != NULL);
+    peer->fd = fd;
+    peer->frame_receive_buffer_len = 0;
+    peer->send_buffer = NULL;
+    peer->send_len = 0;
+    peer->send_capacity = 0;
+    peer->dead = false;
+    peer->next = peers;
+    peers = peer;
+
+    struct epoll_event peer_epollin = { .events = EPOLLIN, .data.fd = fd };
+    assert(epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &peer_epollin) == 0);
+
+    cluster_message msg = { .tag = CLUSTER_PRESENCE_JOIN };
+    for (user_list_node* user = server->users; user != NULL; user = user->next) {
+        // Une seule fois par nom : seule sa plus ancienne session n'a pas de suivante
+        if (user->user_name[0] == 0 || user->next_session != NULL) continue;
+        strncpy(msg.name, user->user_name, MAX_USERNAME_LENGTH);
+        cluster_send(peer, &msg);
+    }
+}
+
+static void cluster_peer_remove(server_state* server, cluster_peer* peer) {
+    log_info("Cluster peer %d is leaving", peer->fd);
+
+    // Tous les utilisateur·ices de ce nœud sont désormais hors-ligne de notre point de vue
+    for (size_t bucket = 0; bucket < PRESENCE_BUCKETS; bucket++) {
+        for (presence_entry** entry = &presence[bucket]; *entry != NULL;) {
+            if ((*entry)->peer == peer) {
+                presence_entry* to_free = *entry;
+                *entry = to_free->next;
+                free(to_free);
+            } else {
+                entry = &(*entry)->next;
+            }
+        }
+    }
+
+    for (cluster_peer** node = &peers; *node != NULL; node = &(*node)->next) {
+        if (*node == peer) {
+            *node = peer->next;
+            break;
+        }
+    }
+
+    epoll_ctl(server->epoll, EPOLL_CTL_DEL, peer->fd, NULL);
+    close(peer->fd);
+    free(peer->send_buffer);
+    free(peer);
+}
+
+static void cluster_connect(server_state* server, char* peer_address) {
+    int fd = address_connect(peer_address, DEFAULT_PORT);
+    if (fd < 0) {
+        log_error("Can't connect to cluster peer %s: %s", peer_address, errno ? strerror(errno) : "unknown host");
+        exit(1);
+    }
+
+    log_info("Connected to cluster peer %s", peer_address);
+    cluster_peer_add(server, fd);
+}
+
+void cluster_initialize(server_state* server) {
+    const char* port = getenv("TWIIIIITER_CLUSTER_PORT");
+    if (port == NULL) return;
+    // Les nœuds ne s'échangent que les twiiiiits à remettre, les abonnements et les curseurs sont dans la base
+    if (!database_shared()) {
+        log_error("The cluster mode needs a database shared by the nodes, which this engine doesn't support");
+        exit(1);
+    }
+
+    epoll_fd = server->epoll;
+    cluster_socket = socket(AF_INET, SOCK_STREAM, 0);
+    assert(cluster_socket >= 0);
+    int reuse = 1;
+    setsockopt(cluster_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse);
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr = {
+            .s_addr = INADDR_ANY,
+        },
+        .sin_port = htons(strtoul(port, NULL, 10)),
+        .sin_zero = { 0 },
+    };
+
+    socklen_t address_len = sizeof address;
+    assert(bind(cluster_socket, (struct sockaddr*) &address, address_len) >= 0);
+    assert(listen(cluster_socket, 16) == 0);
+    assert(getsockname(cluster_socket, (struct sockaddr*) &address, &address_len) == 0);
+    log_info("Cluster listening on *:%d", ntohs(address.sin_port));
+
+    struct epoll_event cluster_socket_epollin = { .events = EPOLLIN, .data.fd = cluster_socket };
+    assert(epoll_ctl(server->epoll, EPOLL_CTL_ADD, cluster_socket, &cluster_socket_epollin) == 0);
+
+    const char* peer_list = getenv("TWIIIIITER_CLUSTER_PEERS");
+    if (peer_list == NULL) return;
+
+    char* peer_list_copy = strdup(peer_list);
+    char* saveptr;
+    for (char* peer = strtok_r(peer_list_copy, ",", &saveptr); peer != NULL; peer = strtok_r(NULL, ",", &saveptr)) {
+        cluster_connect(server, peer);
+    }
+    free(peer_list_copy);
+}
+
+static void cluster_process_message(server_state* server, cluster_peer* peer, const cluster_message* msg) {
+    switch (msg->tag) {
+        case CLUSTER_PRESENCE_JOIN:
+            presence_add(msg->name, peer);
+            return;
+        case CLUSTER_PRESENCE_LEAVE:
+            presence_remove(msg->name, peer);
+            return;
+        case CLUSTER_DELIVER:;
+            message_s2c twiiiiit_msg = {
+                .tag = MESSAGE_S2C_RECEIVED_MESSAGE,
+                .received_message = msg->twiiiiit,
+            };
+            // Sans session, iel s'est déconnecté·e entre-temps et rattrapera le twiiiiit plus tard
+            user_list_node* sessions = user_list_sessions(msg->name);
+            for (user_list_node* session = sessions; session != NULL; session = session->next_session) {
+                if (session->catchup == NULL) send_message(session, twiiiiit_msg); // Sinon, son rattrapage le remettra
+            }
+            return;
+        case CLUSTER_CHANNEL_JOIN:
+        case CLUSTER_CHANNEL_LEAVE:
+            channel_apply_remote(msg->twiiiiit.author, msg->name, msg->tag == CLUSTER_CHANNEL_JOIN);
+            return;
+        case CLUSTER_CHANNEL_DELIVER:;
+            message_s2c channel_msg = {
+                .tag = MESSAGE_S2C_CHANNEL_MESSAGE,
+                .channel_message.date = msg->twiiiiit.date,
+            };
+            memcpy(channel_msg.channel_message.channel, msg->name, MAX_USERNAME_LENGTH);
+            memcpy(channel_msg.channel_message.author, msg->twiiiiit.author, MAX_USERNAME_LENGTH);
+            memcpy(channel_msg.channel_message.message, msg->twiiiiit.message, MESSAGE_MAX_LENGTH);
+            channel_deliver_remote(server, &channel_msg);
+            return;
+    }
+}
+
+bool cluster_handle_event(server_state* server, struct epoll_event* event) {
+    if (cluster_socket < 0) return false;
+
+    if (event->data.fd == cluster_socket) {
+        int fd = accept(cluster_socket, NULL, NULL);
+        if (fd < 0) {
+            log_limited(LOG_LEVEL_WARNING, "Couldn't accept a cluster peer: errno %d", errno);
+        } else {
+            log_info("Cluster peer %d is joining", fd);
+            cluster_peer_add(server, fd);
+        }
+        return true;
+    }
+
+    cluster_peer* peer = peers;
+    while (peer != NULL && peer->fd != event->data.fd) peer = peer->next;
+    if (peer == NULL) return false;
+
+    if ((event->events & EPOLLOUT) && cluster_flush(peer) && peer->send_len == 0) cluster_watch(peer, false);
+    if (!(event->events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return true;
+
+    size_t already_read = peer->frame_receive_buffer_len;
+    ssize_t bytes_read = read(peer->fd, peer->frame_receive_buffer + already_read, CLUSTER_FRAME_SIZE - already_read);
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (bytes_read <= 0) {
+        cluster_peer_remove(server, peer);
+        return true;
+    }
+
+    peer->frame_receive_buffer_len += bytes_read;
+    if (peer->frame_receive_buffer_len == CLUSTER_FRAME_SIZE) {
+        peer->frame_receive_buffer_len = 0;
+        cluster_message msg;
+        if (cluster_decode(peer->frame_receive_buffer, &msg)) {
+            cluster_process_message(server, peer, &msg);
+        } else {
+            log_limited(LOG_LEVEL_WARNING, "Invalid message sent by cluster peer %d", peer->fd);
+        }
+    }
+
+    return true;
+}
+
+void cluster_shutdown() {
+    while (peers != NULL) {
+        cluster_peer* peer = peers;
+        peers = peer->next;
+        close(peer->fd);
+        free(peer->send_buffer);
+        free(peer);
+    }
+
+    if (cluster_socket >= 0) close(cluster_socket);
+}
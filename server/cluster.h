@@ -0,0 +1,59 @@
+#ifndef _CLUSTER_H_
+#define _CLUSTER_H_
+
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+#include "codec.h"
+#include "server.h"
+
+/**
+ * Mode grappe : plusieurs serveurs partagent la même base de données et s'échangent la présence de leurs utilisateurs
+ * ainsi que les twiiiiits à remettre, au travers de liens TCP entre chaque paire de nœuds.
+ *
+ * Chaque nœud garde une copie de l'annuaire de présence (qui est connecté·e, et sur quel nœud), ce qui permet de
+ * n'envoyer un twiiiiit qu'au nœud qui héberge effectivement l'abonné·e.
+ */
+
+typedef struct cluster_peer_s cluster_peer;
+
+/**
+ * Active le mode grappe si TWIIIIITER_CLUSTER_PORT est défini, et se connecte aux nœuds de TWIIIIITER_CLUSTER_PEERS
+ * (liste "hôte:port" séparée par des virgules)
+ */
+void cluster_initialize(server_state* server);
+
+/**
+ * Traite un évènement epoll s'il concerne un socket de la grappe. Renvoie false sinon.
+ */
+bool cluster_handle_event(server_state* server, struct epoll_event* event);
+
+/**
+ * Annonce aux autres nœuds qu'un·e utilisateur·ice vient de se connecter (resp. déconnecter) sur ce nœud
+ */
+void cluster_announce_join(const char* name);
+void cluster_announce_leave(const char* name);
+
+/**
+ * Renvoie le nœud sur lequel l'utilisateur·ice est connecté·e, ou NULL s'iel n'est connecté·e sur aucun autre nœud
+ */
+cluster_peer* cluster_find_online(const char* name);
+
+/**
+ * Demande à un autre nœud de remettre un twiiiiit à l'un de ses utilisateur·ices
+ */
+void cluster_deliver(cluster_peer* peer, const char* follower, const received_message* twiiiiit);
+
+/**
+ * Annonce aux autres nœuds que `member` a rejoint (resp. quitté) un canal, pour qu'ils tiennent à jour leur index
+ */
+void cluster_announce_channel(const char* channel, const char* member, bool joined);
+
+/**
+ * Envoie un message de canal (MESSAGE_S2C_CHANNEL_MESSAGE) aux autres nœuds, qui le diffusent à leurs membres
+ */
+void cluster_publish_channel(const message_s2c* message);
+
+void cluster_shutdown();
+
+#endif
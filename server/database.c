@@ -1,230 +1,207 @@
-#include <assert.h>
-#include <ctype.h>
-#include <sqlite3.h>
-#include <stdbool.h>
-#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "constants.h"
-#include "database.h"
+#include "database_engine.h"
+#include "log.h"
+#include "trace.h"
+#include "twiiiiiter_assert.h"
 
-// Le fichier "/server/init_db.sql" est embarqué dans le binaire, linké et accessibles au travers de ces
-// deux symboles (c.f. "/server/CMakeLists.txt" où l'étape de build se passe).
-extern const char _binary_init_db_sql_start[];
-extern const char _binary_init_db_sql_end;
+static const database_engine* const engines[] = {
+    &database_engine_sqlite,
+    &database_engine_log,
+};
 
-static sqlite3* db = NULL;
-static char* sqlite_error_message;
+// Moteur choisi par database_initialize()
+static const database_engine* engine = NULL;
 
-static bool is_only_whitespace(const char* string, const char* end) {
-    for (const char* c = string; c < end; c++) {
-        if (!isspace(*c)) return false;
+int64_t ts_now() {
+    struct timespec tv;
+    timespec_get(&tv,TIME_UTC);
+    return tv.tv_sec * (int64_t) 1000000 + tv.tv_nsec / 1000;
+}
+
+void database_initialize(const char* engine_name, const char* database_file) {
+    for (size_t i = 0; i < sizeof engines / sizeof *engines; i++) {
+        if (strcmp(engines[i]->name, engine_name) == 0) engine = engines[i];
     }
 
-    return true;
+    if (engine == NULL) {
+        log_error("Unknown database engine \"%s\"", engine_name);
+        exit(1);
+    }
+
+    log_info("Using the %s database engine", engine->name);
+    engine->initialize(database_file ?: engine->default_file);
 }
 
-int sqlite3_step_all(sqlite3_stmt* stmt) {
-    int step;
-    do step = sqlite3_step(stmt); while (step == SQLITE_ROW);
-    return step;
+void database_release() {
+    if (engine->release != NULL) engine->release();
 }
 
-int64_t ts_now() {
-    struct timespec tv;
-    timespec_get(&tv,TIME_UTC);
-    return tv.tv_sec * (int64_t) 1000000 + tv.tv_nsec / 1000;
+bool database_parallel_reads() {
+    return engine->open_reader != NULL;
 }
 
-static int database_initialize_callback(void* table_count, int column_count, char** row_values, char** columns) {
-    assert(column_count == 1);
-    *((size_t*) table_count) = strtoul(row_values[0], NULL, 10);
-    return 0;
-}
-
-void database_initialize(const char* database_file) {
-    assert(sqlite3_open_v2(database_file, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) == SQLITE_OK);
-    printf("[INFO] Using SQLite %s\n", sqlite3_libversion());
-
-    size_t table_count = -1;
-    // language=sqlite
-    int result = sqlite3_exec(
-        db,
-        "select count(*) from sqlite_master where type='table'",
-        database_initialize_callback,
-        &table_count,
-        &sqlite_error_message
-    );
-    assert(result == SQLITE_OK);
-
-    assert(table_count >= 0);
-    if (table_count == 0) {
-        printf("[INFO] Initializing the database");
-        long length = &_binary_init_db_sql_end - &_binary_init_db_sql_start[0];
-        for (const char* statement = _binary_init_db_sql_start; !is_only_whitespace(statement, &_binary_init_db_sql_end);) {
-            sqlite3_stmt* stmt;
-            result = sqlite3_prepare_v2(db, statement, (int) length, &stmt, &statement);
-            assert(result == SQLITE_OK);
-            assert(sqlite3_step_all(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
-        }
-        printf(". DONE\n");
-    } else if (table_count == 3) {
-        printf("[INFO] Found existing database in %s\n", database_file);
-    } else {
-        // Nombre de tables non conventionnel trouvé
-        assert(false);
-    }
+bool database_shared() {
+    return engine->shared;
+}
 
-    // On active les clés étrangères sans quoi SQLite ne les vérifie pas
+void database_open_reader() {
+    assert(engine->open_reader != NULL);
+    engine->open_reader();
+}
 
-    // language=sqlite
-    result = sqlite3_exec(db, "pragma foreign_keys = on", NULL, NULL, &sqlite_error_message);
-    assert(result == SQLITE_OK);
+void database_close_reader() {
+    engine->close_reader();
 }
 
 void database_update_user(const char* user, bool is_online) {
-    // language=sqlite
-    char* sql = "insert or ignore into users values (?1, ?2) on conflict (name) do update set last_online = ?2";
-
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    assert(result == SQLITE_OK);
-    sqlite3_bind_text(stmt, 1, user, (int) strnlen(user, MAX_USERNAME_LENGTH), SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 2, ts_now());
-    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-}
-
-/**
- * L'abonnement et le désabonnement se font de la même manière (à l'exception du code SQL), et sont donc effectués dans
- * cette fonction. Les points d'entrée publics sont les deux fonctions sous celle-ci.
- *
- * @see database_follow()
- * @see database_unfollow()
- */
-static enum subscribe_result database_follow_unfollow(const char* follower, const char* followee, const char* sql) {
-    int follower_len = (int) strnlen(follower, MAX_USERNAME_LENGTH);
-    int followee_len = (int) strnlen(followee, MAX_USERNAME_LENGTH);
-
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    assert(result == SQLITE_OK);
-    sqlite3_bind_text(stmt, 1, follower, follower_len, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, followee, followee_len, SQLITE_STATIC);
-
-    switch (sqlite3_step_all(stmt)) {
-        case SQLITE_DONE:
-            sqlite3_finalize(stmt);
-            break;
-        case SQLITE_CONSTRAINT:
-            sqlite3_finalize(stmt);
-            int ext_err = sqlite3_extended_errcode(db);
-            if (ext_err == SQLITE_CONSTRAINT_FOREIGNKEY) return SUBSCRIBE_RESULT_NOT_FOUND;
-            if (ext_err == SQLITE_CONSTRAINT_UNIQUE) return SUBSCRIBE_RESULT_UNCHANGED;
-            assert(false);
-        default:
-            assert(false);
-    }
+    TRACE_SCOPE(database_update_user);
+    engine->update_user(user, is_online);
+}
 
-    // S'il y a 0 changements, cela signifie qu'aucune ligne n'a été supprimée et que donc l'abonnement n'existait
-    // pas de base.
-    return sqlite3_changes(db) != 0 ? SUBSCRIBE_RESULT_OK : SUBSCRIBE_RESULT_UNCHANGED;
+int64_t database_cursor(const char* user) {
+    TRACE_SCOPE(database_cursor);
+    return engine->cursor(user);
+}
+
+void database_save_cursor(const char* user, uint64_t seq) {
+    TRACE_SCOPE(database_save_cursor);
+    engine->save_cursor(user, seq);
 }
 
 enum subscribe_result database_follow(const char* follower, const char* followee) {
+    TRACE_SCOPE(database_follow);
     // On ne peut pas s'abonner à soi-même.
     // Le message d'erreur n'est pas des plus descriptifs, mais c'est quelque chose que le client aurait pu détecter.
     if (strncmp(follower, followee, MAX_USERNAME_LENGTH) == 0) return SUBSCRIBE_RESULT_NOT_FOUND;
 
-    // language=sqlite
-    char* sql = "insert into followings values (?, ?)";
-    return database_follow_unfollow(follower, followee, sql);
+    return engine->follow(follower, followee);
 }
 
 enum subscribe_result database_unfollow(const char* follower, const char* followee) {
-    // language=sqlite
-    char* sql = "delete from followings where follower = ? and followee = ?";
-    return database_follow_unfollow(follower, followee, sql);
+    TRACE_SCOPE(database_unfollow);
+    return engine->unfollow(follower, followee);
+}
+
+void database_follow_batch(
+    const char* follower,
+    const user_name* followees,
+    size_t count,
+    bool unfollow,
+    enum subscribe_result* results
+) {
+    TRACE_SCOPE(database_follow_batch);
+    if (unfollow) {
+        engine->follow_batch(follower, followees, count, true, results);
+        return;
+    }
+
+    // Comme pour database_follow(), on écarte les abonnements à soi-même avant de passer le reste au moteur
+    user_name* others = malloc(count * sizeof(user_name));
+    size_t* other_indices = malloc(count * sizeof(size_t));
+    enum subscribe_result* other_results = malloc(count * sizeof(enum subscribe_result));
+    assert(count == 0 || (others != NULL && other_indices != NULL && other_results != NULL));
+
+    size_t other_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(follower, followees[i], MAX_USERNAME_LENGTH) == 0) {
+            results[i] = SUBSCRIBE_RESULT_NOT_FOUND;
+            continue;
+        }
+        memcpy(others[other_count], followees[i], sizeof(user_name));
+        other_indices[other_count++] = i;
+    }
+
+    engine->follow_batch(follower, (const user_name*) others, other_count, false, other_results);
+    for (size_t i = 0; i < other_count; i++) results[other_indices[i]] = other_results[i];
+
+    free(others);
+    free(other_indices);
+    free(other_results);
 }
 
 user_iterator database_list_followee(const char* follower) {
-    sqlite3_stmt* stmt;
-    // language=sqlite
-    int result = sqlite3_prepare_v2(db, "select followee from followings where follower = ?", -1, &stmt, NULL);
-    assert(result == SQLITE_OK);
-    sqlite3_bind_text(stmt, 1, follower, (int) strnlen(follower, MAX_USERNAME_LENGTH), SQLITE_STATIC);
-    return stmt;
+    TRACE_SCOPE(database_list_followee);
+    return engine->list_followee(follower);
 }
 
 user_iterator database_list_followers(const char* followee) {
-    sqlite3_stmt* stmt;
-    // language=sqlite
-    int result = sqlite3_prepare_v2(db, "select follower from followings where followee = ?", -1, &stmt, NULL);
-    assert(result == SQLITE_OK);
-    sqlite3_bind_text(stmt, 1, followee, (int) strnlen(followee, MAX_USERNAME_LENGTH), SQLITE_STATIC);
-    return stmt;
+    TRACE_SCOPE(database_list_followers);
+    return engine->list_followers(followee);
 }
 
 bool database_users_next(user_iterator restrict cursor, char* restrict out) {
-    switch (sqlite3_step(cursor)) {
-        case SQLITE_DONE:
-            sqlite3_finalize(cursor);
-            return false;
-        case SQLITE_ROW:
-            assert(sqlite3_column_count(cursor) == 1);
-            memset(out, 0, MAX_USERNAME_LENGTH);
-            strncpy(out, (char*) sqlite3_column_text(cursor, 0), MAX_USERNAME_LENGTH);
-            return true;
-        default:
-            assert(false);
-    }
+    TRACE_SCOPE(database_users_next);
+    return engine->users_next(cursor, out);
 }
 
-time_t database_save_twiiiiit(const char* author, const char* message) {
-    // language=sqlite
-    char* sql = "insert into twiiiiits values (?, ?, ?)";
+enum subscribe_result database_join_channel(const char* member, const char* channel) {
+    TRACE_SCOPE(database_join_channel);
+    if (channel[0] == 0) return SUBSCRIBE_RESULT_NOT_FOUND;
+    return engine->join_channel(member, channel);
+}
+
+enum subscribe_result database_leave_channel(const char* member, const char* channel) {
+    TRACE_SCOPE(database_leave_channel);
+    return engine->leave_channel(member, channel);
+}
 
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    assert(result == SQLITE_OK);
-    time_t now = ts_now();
-    sqlite3_bind_int64(stmt, 1, now);
-    sqlite3_bind_text(stmt, 2, author, (int) strnlen(author, MAX_USERNAME_LENGTH), SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, message, (int) strnlen(message, MESSAGE_MAX_LENGTH), SQLITE_STATIC);
-    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-    return now;
+user_iterator database_list_channels() {
+    TRACE_SCOPE(database_list_channels);
+    return engine->list_channels();
 }
 
-twiiiiit_iterator database_list_missed_twiiiiits(const char* follower) {
-    // C'est effrayant, mais ça permet de tout récupérer en une requête
-    // language=sqlite
-    char* sql = "select t.* from twiiiiits t inner join followings f on t.author = f.followee inner join users r on f.follower = r.name where f.follower = ? and t.date >= r.last_online order by t.date";
+user_iterator database_list_channel_members(const char* channel) {
+    TRACE_SCOPE(database_list_channel_members);
+    return engine->list_channel_members(channel);
+}
+
+void database_save_twiiiiit(const char* author, const char* message, database_twiiiiit* out) {
+    TRACE_SCOPE(database_save_twiiiiit);
+    engine->save_twiiiiit(author, message, out);
+}
 
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    assert(result == SQLITE_OK);
-    sqlite3_bind_text(stmt, 1, follower, (int) strnlen(follower, MAX_USERNAME_LENGTH), SQLITE_STATIC);
-    return stmt;
+uint64_t database_last_seq() {
+    TRACE_SCOPE(database_last_seq);
+    return engine->last_seq();
+}
+
+twiiiiit_iterator database_list_missed_twiiiiits(const char* follower, uint64_t after, uint64_t until) {
+    TRACE_SCOPE(database_list_missed_twiiiiits);
+    return engine->list_missed_twiiiiits(follower, after, until);
+}
+
+void database_index_search() {
+    if (engine->index_search == NULL) return;
+    TRACE_SCOPE(database_index_search);
+    engine->index_search();
+}
+
+twiiiiit_iterator database_search_twiiiiits(const char* query, uint64_t until, uint32_t offset, uint32_t limit) {
+    TRACE_SCOPE(database_search_twiiiiits);
+    return engine->search_twiiiiits(query, until, offset, limit);
+}
+
+twiiiiit_iterator database_list_author_twiiiiits(
+    const char* author,
+    int64_t before,
+    uint64_t before_seq,
+    uint32_t limit
+) {
+    TRACE_SCOPE(database_list_author_twiiiiits);
+    return engine->list_author_twiiiiits(author, before, before_seq, limit);
 }
 
 bool database_twiiiiits_next(twiiiiit_iterator restrict iterator, database_twiiiiit* restrict out) {
-    switch (sqlite3_step(iterator)) {
-        case SQLITE_DONE:
-            sqlite3_finalize(iterator);
-            return false;
-        case SQLITE_ROW:
-            assert(sqlite3_column_count(iterator) == 3);
-            memset(out, 0, sizeof(database_twiiiiit));
-            out->date = sqlite3_column_int64(iterator, 0);
-            strncpy(out->author, (char*) sqlite3_column_text(iterator, 1), MAX_USERNAME_LENGTH);
-            strncpy(out->message, (char*) sqlite3_column_text(iterator, 2), MESSAGE_MAX_LENGTH);
-            return true;
-        default:
-            assert(false);
-    }
+    TRACE_SCOPE(database_twiiiiits_next);
+    return engine->twiiiiits_next(iterator, out);
+}
+
+void database_twiiiiits_close(twiiiiit_iterator iterator) {
+    TRACE_SCOPE(database_twiiiiits_close);
+    engine->twiiiiits_close(iterator);
 }
@@ -1,3 +1,6 @@
+#ifndef _DATABASE_H_
+#define _DATABASE_H_
+
 #include <stdbool.h>
 #include <time.h>
 
@@ -5,6 +8,7 @@
 #include "constants.h"
 
 typedef struct {
+    uint64_t seq; // Numéro de séquence, c.f. database_save_twiiiiit()
     int64_t date;
     user_name author;
     char message[MESSAGE_MAX_LENGTH];
@@ -16,23 +20,81 @@ typedef void* twiiiiit_iterator;
 /**
  * Initialise la base de données
  *
- * Doit être appelé avant d'utiliser les fonctions ci-dessous
+ * Doit être appelé avant d'utiliser les fonctions ci-dessous. `engine` désigne le moteur de stockage ("sqlite" ou
+ * "log"), et `database_file` peut être NULL, auquel cas le fichier par défaut du moteur est utilisé.
+ */
+void database_initialize(const char* engine, const char* database_file);
+
+/**
+ * Libère la base pour qu'un autre processus puisse l'ouvrir, juste avant de se terminer : elle ne doit plus être
+ * utilisée ensuite
+ */
+void database_release();
+
+/**
+ * Indique si le moteur permet de lire la base depuis d'autres threads pendant que la boucle d'évènements écrit, c.f.
+ * database_open_reader()
+ */
+bool database_parallel_reads();
+
+/**
+ * Indique si d'autres processus peuvent utiliser la même base en même temps, comme les nœuds d'une grappe
+ */
+bool database_shared();
+
+/**
+ * Ouvre une connexion en lecture seule pour le thread appelant, qui ne doit pas être celui de la boucle d'évènements,
+ * et seulement si database_parallel_reads()
+ *
+ * Le thread peut ensuite appeler database_list_followee(), database_list_followers(), database_list_missed_twiiiiits(),
+ * database_list_author_twiiiiits() et database_search_twiiiiits(), en parallèle de la boucle et des autres lecteurs.
+ * Leurs itérateurs peuvent être parcourus ou libérés depuis n'importe quel thread, mais par un seul à la fois.
+ */
+void database_open_reader();
+
+/**
+ * Ferme la connexion ouverte par database_open_reader(), une fois libérés les itérateurs qu'elle a renvoyés
  */
-void database_initialize(const char* database_file);
+void database_close_reader();
 
 /**
  * Enregistre l'état d'un utilisateur dans la base de données (et le créé si besoin)
  *
  * Cette fonction devrait être appelée à la connexion de chaque utilisateur, sans quoi il risque d'être absent dans la
  * base de données s'il s'agit de sa promise connexion, ce qui lui empêche de faire la plupart des actions.
- * Cette fonction DOIT être appelée à la déconnexion de chaque utilisateur, afin d'enregistrer la date de déconnexion et
- * de permettre de rattraper les twiiiiits manqués ultérieurement.
+ * Un utilisateur créé ainsi a pour curseur database_last_seq() : il n'a rien à rattraper.
  */
 void database_update_user(const char* user, bool is_online);
 
+/**
+ * Renvoie le curseur d'un utilisateur, le numéro du dernier twiiiiit de ses abonnements qu'il a acquitté
+ * (MESSAGE_C2S_ACK), ou -1 s'il n'est pas encore enregistré
+ */
+int64_t database_cursor(const char* user);
+
+/**
+ * Enregistre le curseur d'un utilisateur, à appeler à sa déconnexion. Un curseur antérieur à celui déjà enregistré est
+ * ignoré.
+ */
+void database_save_cursor(const char* user, uint64_t seq);
+
 enum subscribe_result database_follow(const char* follower, const char* followee);
 enum subscribe_result database_unfollow(const char* follower, const char* followee);
 
+/**
+ * Abonne `follower` aux `count` comptes de `followees` (ou l'en désabonne si `unfollow` est vrai), et écrit le résultat
+ * de chacun dans `results`, comme l'auraient renvoyé database_follow() et database_unfollow()
+ *
+ * Tout le lot est appliqué dans une seule transaction, ce qui évite d'en payer une par abonnement.
+ */
+void database_follow_batch(
+    const char* follower,
+    const user_name* followees,
+    size_t count,
+    bool unfollow,
+    enum subscribe_result* results
+);
+
 /**
  * Renvoie la liste d'abonnements d'un utilisateur donné, sous forme d'itérateur. Ainsi, l'énumération se fait
  * progressivement, au besoin, sans allouer de mémoire.
@@ -56,23 +118,93 @@ user_iterator database_list_followers(const char* followee);
 bool database_users_next(user_iterator restrict cursor, char* restrict out);
 
 /**
- * Publie un twiiiiit dont `author` est l'auteur·ice
+ * Fait rejoindre (resp. quitter) un canal à `member`. Le canal est créé à l'arrivée de son premier membre et oublié au
+ * départ du dernier.
+ *
+ * Renvoie SUBSCRIBE_RESULT_UNCHANGED si `member` en était déjà (resp. n'en était pas) membre, et
+ * SUBSCRIBE_RESULT_NOT_FOUND si `member` n'est pas enregistré·e.
+ */
+enum subscribe_result database_join_channel(const char* member, const char* channel);
+enum subscribe_result database_leave_channel(const char* member, const char* channel);
+
+/**
+ * Renvoie la liste des canaux qui ont au moins un membre, sous forme d'itérateur, c.f. database_users_next()
+ */
+user_iterator database_list_channels();
+
+/**
+ * Renvoie la liste des membres d'un canal, sous forme d'itérateur, c.f. database_users_next()
+ *
+ * Ces deux itérateurs ne servent qu'à charger l'index des canaux au démarrage (c.f. "/server/channel.h") : la
+ * diffusion dans un canal ne lit pas la base.
+ */
+user_iterator database_list_channel_members(const char* channel);
+
+/**
+ * Publie un twiiiiit dont `author` est l'auteur·ice, et renvoie son numéro de séquence et sa date dans `out`
+ *
+ * Les numéros de séquence sont strictement croissants dans l'ordre de publication (pour tous les nœuds d'une grappe)
+ * et commencent à 1.
  *
  * Passer à cette fonction un auteur dont le nom n'est pas associé à un utilisateur est considéré comme une erreur, d'où
  * la nécessité de bien appeler database_update_user() lors de la connexion de n'importe qui.
  */
-time_t database_save_twiiiiit(const char* author, const char* message);
+void database_save_twiiiiit(const char* author, const char* message, database_twiiiiit* out);
+
+/**
+ * Renvoie le numéro de séquence du dernier twiiiiit publié, 0 s'il n'y en a aucun
+ */
+uint64_t database_last_seq();
+
+/**
+ * Renvoie un itérateur sur les twiiiiits des abonnements de `follower` dont le numéro de séquence est compris entre
+ * `after` (exclu) et `until` (inclus), du plus ancien au plus récent
+ *
+ * Ce sont les twiiiiits manqués quand `after` est le curseur renvoyé par database_cursor(). Il n'est pas illégal
+ * d'appeler cette fonction avec un `follower` qui n'est pas encore enregistré dans la BDD.
+ *
+ * @see database_twiiiiits_next()
+ */
+twiiiiit_iterator database_list_missed_twiiiiits(const char* follower, uint64_t after, uint64_t until);
+
+/**
+ * Ajoute à l'index de recherche les twiiiiits publiés depuis le dernier appel. L'index n'est pas mis à jour à la
+ * publication : seuls les twiiiiits indexés avant database_search_twiiiiits() sont trouvés.
+ */
+void database_index_search();
 
 /**
- * Renvoie un itérateur sur les twiiiiits manqués par un utilisateur donné, du plus ancien au plus récent
+ * Recherche plein texte : renvoie un itérateur sur au plus `limit` twiiiiits contenant tous les mots de `query`, du
+ * plus pertinent au moins pertinent, en sautant les `offset` premiers. Seuls les twiiiiits dont le numéro de séquence
+ * est inférieur ou égal à `until` sont classés, pour que les pages d'une même recherche ne soient pas décalées par les
+ * twiiiiits publiés entre-temps.
  *
- * Cette fonction devrait être appelée à la reconnexion, avant database_update_user(), sans quoi la dernière date de
- * déconnexion serait écrasée trop tôt. Il n'est pas illégal d'appeler cette fonction avec un `follower` qui n'est pas
- * encore enregistré dans la BDD, et cela est même voué à arriver à chaque première connexion.
+ * Contrairement au reste de cette API, cette fonction peut être appelée depuis un autre thread que celui de la boucle
+ * d'évènements (un seul à la fois), tout comme database_twiiiiits_next() sur l'itérateur qu'elle renvoie, même si le
+ * moteur ne permet pas les lecteurs de database_open_reader() (que ce thread doit sinon ouvrir). C'est ainsi qu'une
+ * recherche coûteuse ne retarde pas la remise des twiiiiits, c.f. "/server/search.h".
+ */
+twiiiiit_iterator database_search_twiiiiits(const char* query, uint64_t until, uint32_t offset, uint32_t limit);
+
+/**
+ * Renvoie un itérateur sur au plus `limit` twiiiiits de `author` antérieurs (strictement) à `before`, du plus récent
+ * au plus ancien. Les twiiiiits de même date sont ordonnés par numéro de séquence : ceux datés de `before` sont inclus
+ * si leur numéro est inférieur à `before_seq`.
  *
- * @see database_list_missed_twiiiiits_next()
+ * Les twiiiiits sont lus au fur et à mesure dans l'index par auteur·ice, sans tri : c'est la brique de base de la
+ * fusion de "/server/timeline.h".
  */
-twiiiiit_iterator database_list_missed_twiiiiits(const char* follower);
+twiiiiit_iterator database_list_author_twiiiiits(
+    const char* author,
+    int64_t before,
+    uint64_t before_seq,
+    uint32_t limit
+);
+
+/**
+ * Horodatage courant, en microsecondes depuis l'epoch, dans l'unité des dates des twiiiiits
+ */
+int64_t ts_now();
 
 /**
  * Avance dans un itérateur de twiiiiits et renvoie chaque twiiiiit par le second argument
@@ -80,3 +212,10 @@ twiiiiit_iterator database_list_missed_twiiiiits(const char* follower);
  * Les précautions sont les mêmes que database_users_next()
  */
 bool database_twiiiiits_next(twiiiiit_iterator restrict iterator, database_twiiiiit* restrict out);
+
+/**
+ * Libère un itérateur de twiiiiits qui n'a pas été parcouru jusqu'au bout
+ */
+void database_twiiiiits_close(twiiiiit_iterator iterator);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * Banc d'essai comparatif des moteurs de stockage
+ *
+ * Mesure le débit de publication (database_save_twiiiiit()), le temps d'indexer ces twiiiiits pour la recherche
+ * (database_index_search(), qui n'a pas lieu à la publication) puis le débit du rattrapage des twiiiiits manqués
+ * (database_list_missed_twiiiiits()) pour tous les utilisateurs, sur un graphe aléatoire mais reproductible. Si le
+ * moteur le permet, le rattrapage est mesuré une seconde fois, réparti entre READERS threads lecteurs (c.f.
+ * database_open_reader()).
+ *
+ * Usage : twiiiiiter-database-bench ENGINE FILE [USERS] [FOLLOWS_PER_USER] [TWIIIIITS] [READERS]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "database_engine.h"
+#include "twiiiiiter_assert.h"
+
+static double elapsed_seconds(int64_t since) {
+    return (double) (ts_now() - since) / 1e6;
+}
+
+static void user_name_of(unsigned int i, user_name out) {
+    memset(out, 0, sizeof(user_name));
+    snprintf(out, sizeof(user_name), "b%05u", i % 100000); // main() vérifie qu'il y en a moins
+}
+
+typedef struct {
+    unsigned int first_user; // Le lecteur rattrape un utilisateur sur `stride`
+    unsigned int stride;
+    unsigned int user_count;
+    uint64_t last_seq;
+    size_t caught_up;
+    pthread_t thread;
+} bench_reader;
+
+static void* bench_reader_run(void* arg) {
+    bench_reader* reader = arg;
+    database_open_reader();
+
+    user_name name;
+    database_twiiiiit twiiiiit;
+    for (unsigned int i = reader->first_user; i < reader->user_count; i += reader->stride) {
+        user_name_of(i, name);
+        // Le curseur est lu par la boucle d'évènements dans le serveur : ici, tous les curseurs sont à 0
+        twiiiiit_iterator it = database_list_missed_twiiiiits(name, 0, reader->last_seq);
+        while (database_twiiiiits_next(it, &twiiiiit)) reader->caught_up++;
+    }
+
+    database_close_reader();
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 7) {
+        printf("Usage: %s ENGINE FILE [USERS] [FOLLOWS_PER_USER] [TWIIIIITS] [READERS]\n", argv[0]);
+        return 1;
+    }
+
+    unsigned int user_count = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+    unsigned int follows_per_user = argc > 4 ? strtoul(argv[4], NULL, 10) : 20;
+    unsigned int twiiiiit_count = argc > 5 ? strtoul(argv[5], NULL, 10) : 100000;
+    unsigned int reader_count = argc > 6 ? strtoul(argv[6], NULL, 10) : 4;
+    assert(user_count > 1 && user_count < 100000);
+    assert(reader_count > 0);
+
+    database_initialize(argv[1], argv[2]);
+    srand(42);
+
+    user_name name, other;
+    for (unsigned int i = 0; i < user_count; i++) {
+        user_name_of(i, name);
+        database_update_user(name, true);
+    }
+
+    for (unsigned int i = 0; i < user_count; i++) {
+        user_name_of(i, name);
+        for (unsigned int j = 0; j < follows_per_user; j++) {
+            user_name_of(rand() % user_count, other);
+            database_follow(name, other);
+        }
+    }
+
+    // Tout le monde se déconnecte avant les publications, qui seront donc toutes à rattraper
+    for (unsigned int i = 0; i < user_count; i++) {
+        user_name_of(i, name);
+        database_update_user(name, false);
+    }
+
+    char message[MESSAGE_MAX_LENGTH];
+    database_twiiiiit twiiiiit;
+    int64_t start = ts_now();
+    for (unsigned int i = 0; i < twiiiiit_count; i++) {
+        user_name_of(rand() % user_count, name);
+        memset(message, 0, sizeof message);
+        snprintf(message, sizeof message, "twiiiiit %u", i);
+        database_save_twiiiiit(name, message, &twiiiiit);
+    }
+    double publish_seconds = elapsed_seconds(start);
+
+    start = ts_now();
+    database_index_search();
+    double index_seconds = elapsed_seconds(start);
+
+    size_t caught_up = 0;
+    uint64_t last_seq = database_last_seq();
+    start = ts_now();
+    for (unsigned int i = 0; i < user_count; i++) {
+        user_name_of(i, name);
+        twiiiiit_iterator it = database_list_missed_twiiiiits(name, database_cursor(name), last_seq);
+        while (database_twiiiiits_next(it, &twiiiiit)) caught_up++;
+    }
+    double catch_up_seconds = elapsed_seconds(start);
+
+    size_t parallel_caught_up = 0;
+    double parallel_seconds = 0;
+    if (database_parallel_reads()) {
+        bench_reader* readers = calloc(reader_count, sizeof(bench_reader));
+        assert(readers != NULL);
+        start = ts_now();
+        for (unsigned int i = 0; i < reader_count; i++) {
+            readers[i] = (bench_reader) {
+                .first_user = i,
+                .stride = reader_count,
+                .user_count = user_count,
+                .last_seq = last_seq,
+            };
+            assert(pthread_create(&readers[i].thread, NULL, bench_reader_run, &readers[i]) == 0);
+        }
+        for (unsigned int i = 0; i < reader_count; i++) {
+            pthread_join(readers[i].thread, NULL);
+            parallel_caught_up += readers[i].caught_up;
+        }
+        parallel_seconds = elapsed_seconds(start);
+        free(readers);
+    }
+
+    printf("[BENCH] engine=%s users=%u follows_per_user=%u\n", argv[1], user_count, follows_per_user);
+    printf("[BENCH] publish: %u twiiiiits in %.3fs (%.0f twiiiiits/s)\n",
+           twiiiiit_count, publish_seconds, twiiiiit_count / publish_seconds);
+    printf("[BENCH] search index: %u twiiiiits in %.3fs\n", twiiiiit_count, index_seconds);
+    printf("[BENCH] catch-up: %zu twiiiiits for %u users in %.3fs (%.0f twiiiiits/s)\n",
+           caught_up, user_count, catch_up_seconds, caught_up / catch_up_seconds);
+    if (parallel_seconds > 0) {
+        printf("[BENCH] catch-up with %u readers: %zu twiiiiits for %u users in %.3fs (%.0f twiiiiits/s)\n",
+               reader_count, parallel_caught_up, user_count, parallel_seconds, parallel_caught_up / parallel_seconds);
+    }
+
+    return 0;
+}
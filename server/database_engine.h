@@ -0,0 +1,63 @@
+#ifndef _DATABASE_ENGINE_H_
+#define _DATABASE_ENGINE_H_
+
+#include "database.h"
+
+/**
+ * Un moteur de stockage implémente l'API de "database.h"
+ *
+ * Le moteur est choisi une fois pour toutes dans database_initialize(). Les itérateurs renvoyés par un moteur ne sont
+ * jamais passés à un autre, chaque moteur est donc libre de leur donner la représentation qu'il souhaite.
+ */
+typedef struct {
+    const char* name;
+    const char* default_file; // Utilisé si TWIIIIITER_DATABASE_FILE n'est pas défini
+    bool shared; // Plusieurs processus peuvent utiliser la même base en même temps, c.f. database_shared()
+
+    void (*initialize)(const char* database_file);
+    // NULL si le moteur n'a rien à libérer pour qu'un autre processus ouvre la base, c.f. database_release()
+    void (*release)();
+    // NULL si le moteur ne permet pas de lire en parallèle de la boucle d'évènements
+    void (*open_reader)();
+    void (*close_reader)();
+    void (*update_user)(const char* user, bool is_online);
+    int64_t (*cursor)(const char* user);
+    void (*save_cursor)(const char* user, uint64_t seq);
+    enum subscribe_result (*follow)(const char* follower, const char* followee);
+    enum subscribe_result (*unfollow)(const char* follower, const char* followee);
+    void (*follow_batch)(
+        const char* follower,
+        const user_name* followees,
+        size_t count,
+        bool unfollow,
+        enum subscribe_result* results
+    );
+    user_iterator (*list_followee)(const char* follower);
+    user_iterator (*list_followers)(const char* followee);
+    bool (*users_next)(user_iterator restrict cursor, char* restrict out);
+    enum subscribe_result (*join_channel)(const char* member, const char* channel);
+    enum subscribe_result (*leave_channel)(const char* member, const char* channel);
+    user_iterator (*list_channels)();
+    user_iterator (*list_channel_members)(const char* channel);
+    void (*save_twiiiiit)(const char* author, const char* message, database_twiiiiit* out);
+    uint64_t (*last_seq)();
+    twiiiiit_iterator (*list_missed_twiiiiits)(const char* follower, uint64_t after, uint64_t until);
+    // NULL si le moteur n'a pas d'index de recherche à tenir à jour
+    void (*index_search)();
+    twiiiiit_iterator (*search_twiiiiits)(const char* query, uint64_t until, uint32_t offset, uint32_t limit);
+    twiiiiit_iterator (*list_author_twiiiiits)(const char* author, int64_t before, uint64_t before_seq, uint32_t limit);
+    bool (*twiiiiits_next)(twiiiiit_iterator restrict iterator, database_twiiiiit* restrict out);
+    void (*twiiiiits_close)(twiiiiit_iterator iterator);
+} database_engine;
+
+/**
+ * Moteur historique, c.f. "/server/database_sqlite.c"
+ */
+extern const database_engine database_engine_sqlite;
+
+/**
+ * Journal en ajout seul dans des segments projetés en mémoire, c.f. "/server/database_log.c"
+ */
+extern const database_engine database_engine_log;
+
+#endif
@@ -0,0 +1,997 @@
+/**
+ * Moteur de stockage en journal, sans SQLite
+ *
+ * Les twiiiiits sont des enregistrements de taille fixe ajoutés à la suite les uns des autres dans des segments
+ * projetés en mémoire ("twiiiiits-NNNNNN.seg"). Chaque auteur·ice possède en mémoire la liste ordonnée des positions
+ * de ses twiiiiits dans ces segments, ce qui permet de rattraper les twiiiiits manqués par recherche dichotomique sans
+ * jamais parcourir le journal entier.
+ *
+ * Le numéro de séquence d'un twiiiiit est sa position globale dans les segments, plus un.
+ *
+ * Les utilisateurs (avec leur curseur de rattrapage), le graphe d'abonnements et les membres des canaux sont gardés
+ * entièrement en mémoire. Ils sont persistés sous forme d'un instantané compact ("graph.snapshot") et d'un journal des
+ * modifications survenues depuis ("graph.log"). Quand ce dernier devient trop long, un nouvel instantané est écrit et
+ * le journal est vidé.
+ *
+ * Avec ":memory:" comme fichier, les segments sont anonymes et rien n'est persisté.
+ */
+
+#define _GNU_SOURCE // memfd_create()
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "database_engine.h"
+#include "log.h"
+#include "twiiiiiter_assert.h"
+
+// Nombre d'enregistrements par segment
+#define LOG_SEGMENT_RECORDS 65536
+// Nombre maximal de segments (soit 2^30 twiiiiits), pour que le tableau des segments ne soit jamais réalloué
+#define LOG_MAX_SEGMENTS 16384
+// Nombre d'entrées du journal du graphe au-delà duquel on écrit un nouvel instantané, par défaut (c.f.
+// TWIIIIITER_LOG_COMPACTION_ENTRIES)
+#define GRAPH_LOG_COMPACTION_THRESHOLD 65536
+
+#define LOG_SEGMENT_MAGIC "TWLOGSG1"
+#define GRAPH_SNAPSHOT_MAGIC "TWGRAPH3"
+// Instantanés écrits avant les canaux, qui n'en ont pas la section
+#define GRAPH_SNAPSHOT_MAGIC_V2 "TWGRAPH2"
+// Instantanés écrits avant les curseurs de rattrapage, c.f. log_derive_cursors()
+#define GRAPH_SNAPSHOT_MAGIC_V1 "TWGRAPH1"
+
+#define NO_USER UINT32_MAX
+#define NO_CHANNEL UINT32_MAX
+// Curseur pas encore connu, le temps du chargement
+#define NO_CURSOR UINT64_MAX
+
+#define VEC_PUSH(array, len, cap, value) do { \
+    if ((len) == (cap)) { \
+        (cap) = (cap) ? (cap) * 2 : 4; \
+        (array) = realloc((array), (cap) * sizeof *(array)); \
+        assert((array) != NULL); \
+    } \
+    (array)[(len)++] = (value); \
+} while (0)
+
+typedef struct {
+    int64_t date;
+    char author[MAX_USERNAME_LENGTH + 2];
+    char message[MESSAGE_MAX_LENGTH];
+    char padding[4];
+} log_record;
+
+_Static_assert(sizeof(log_record) == 40, "log_record must have a fixed on-disk size");
+
+typedef struct {
+    char magic[8];
+    uint32_t count;
+    char reserved[52];
+} log_segment_header;
+
+_Static_assert(sizeof(log_segment_header) == 64, "log_segment_header must have a fixed on-disk size");
+
+#define LOG_SEGMENT_SIZE (sizeof(log_segment_header) + LOG_SEGMENT_RECORDS * sizeof(log_record))
+
+typedef struct {
+    log_segment_header* header;
+    log_record* records;
+} log_segment;
+
+enum graph_op {
+    GRAPH_OP_UPDATE_USER,
+    GRAPH_OP_FOLLOW,
+    GRAPH_OP_UNFOLLOW,
+    GRAPH_OP_CURSOR, // Le numéro de séquence est dans `date`
+    GRAPH_OP_JOIN_CHANNEL, // `a` rejoint le canal `b`
+    GRAPH_OP_LEAVE_CHANNEL,
+};
+
+typedef struct {
+    uint32_t op;
+    uint32_t reserved;
+    char a[8];
+    char b[8];
+    int64_t date;
+} graph_log_entry;
+
+_Static_assert(sizeof(graph_log_entry) == 32, "graph_log_entry must have a fixed on-disk size");
+
+typedef struct {
+    char name[8];
+    int64_t last_online;
+} graph_snapshot_user_v1;
+
+typedef struct {
+    char name[8];
+    int64_t last_online;
+    uint64_t acked_seq;
+} graph_snapshot_user;
+
+typedef struct {
+    uint32_t follower;
+    uint32_t followee;
+} graph_snapshot_edge;
+
+typedef struct {
+    char magic[8];
+    uint32_t user_count;
+    uint32_t edge_count;
+} graph_snapshot_header;
+
+/**
+ * Après les arêtes, un uint32_t donne le nombre de canaux, chacun suivi des indices de ses `member_count` membres
+ */
+typedef struct {
+    char name[8];
+    uint32_t member_count;
+    uint32_t reserved;
+} graph_snapshot_channel;
+
+typedef struct {
+    user_name name;
+    int64_t last_online;
+    uint64_t acked_seq; // Curseur de rattrapage, c.f. database_cursor()
+
+    uint32_t* followees;
+    size_t followees_len, followees_cap;
+    uint32_t* followers;
+    size_t followers_len, followers_cap;
+
+    // Index des twiiiiits de l'utilisateur·ice : positions globales dans les segments, par date croissante
+    uint64_t* twiiiiits;
+    size_t twiiiiits_len, twiiiiits_cap;
+} log_user;
+
+typedef struct {
+    user_name name;
+    uint32_t* members; // Indices dans `users`, dans le désordre
+    size_t members_len, members_cap;
+} log_channel;
+
+typedef struct {
+    size_t len;
+    size_t position;
+    bool channels; // `users` contient des indices dans `channels`
+    uint32_t users[];
+} log_user_iterator;
+
+typedef struct {
+    size_t len;
+    size_t position;
+    uint64_t records[];
+} log_twiiiiit_iterator;
+
+static const char* directory = NULL; // NULL en mémoire seulement
+static int directory_lock = -1; // Verrou exclusif sur `directory`, c.f. log_store_initialize()
+
+// Lus sans verrou par database_search_twiiiiits() : `segments_len` n'augmente qu'une fois le segment prêt
+static log_segment segments[LOG_MAX_SEGMENTS];
+static size_t segments_len = 0;
+
+static log_user* users = NULL;
+static size_t users_len = 0, users_cap = 0;
+
+// Table de hachage à adressage ouvert, nom -> indice dans `users`
+static uint32_t* user_index = NULL;
+static size_t user_index_cap = 0;
+
+// Les canaux sont peu nombreux et ne sont cherchés qu'à l'adhésion et au départ : un simple tableau suffit. Un canal
+// sans membre y reste, mais n'est ni listé ni écrit dans l'instantané.
+static log_channel* channels = NULL;
+static size_t channels_len = 0, channels_cap = 0;
+
+static int graph_log_fd = -1;
+static size_t graph_log_entries = 0;
+static size_t graph_log_compaction_threshold = GRAPH_LOG_COMPACTION_THRESHOLD;
+
+static uint64_t hash_name(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < MAX_USERNAME_LENGTH && name[i] != 0; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+static void user_index_insert(uint32_t user) {
+    size_t mask = user_index_cap - 1;
+    size_t slot = hash_name(users[user].name) & mask;
+    while (user_index[slot] != NO_USER) slot = (slot + 1) & mask;
+    user_index[slot] = user;
+}
+
+static void user_index_grow() {
+    free(user_index);
+    user_index_cap = user_index_cap ? user_index_cap * 2 : 1024;
+    user_index = malloc(user_index_cap * sizeof *user_index);
+    assert(user_index != NULL);
+    memset(user_index, 0xff, user_index_cap * sizeof *user_index);
+    for (uint32_t user = 0; user < users_len; user++) user_index_insert(user);
+}
+
+static uint32_t log_user_find(const char* name) {
+    if (user_index_cap == 0) return NO_USER;
+
+    size_t mask = user_index_cap - 1;
+    for (size_t slot = hash_name(name) & mask; user_index[slot] != NO_USER; slot = (slot + 1) & mask) {
+        if (strncmp(users[user_index[slot]].name, name, MAX_USERNAME_LENGTH) == 0) return user_index[slot];
+    }
+
+    return NO_USER;
+}
+
+static uint32_t log_user_find_or_create(const char* name) {
+    uint32_t user = log_user_find(name);
+    if (user != NO_USER) return user;
+
+    log_user new = { .last_online = 0, .acked_seq = NO_CURSOR };
+    memset(new.name, 0, sizeof new.name);
+    strncpy(new.name, name, MAX_USERNAME_LENGTH);
+    VEC_PUSH(users, users_len, users_cap, new);
+
+    // Facteur de charge maximal de 1/2
+    if (users_len * 2 > user_index_cap) user_index_grow();
+    else user_index_insert(users_len - 1);
+
+    return users_len - 1;
+}
+
+static uint32_t log_channel_find(const char* name) {
+    for (uint32_t channel = 0; channel < channels_len; channel++) {
+        if (strncmp(channels[channel].name, name, MAX_USERNAME_LENGTH) == 0) return channel;
+    }
+
+    return NO_CHANNEL;
+}
+
+static uint32_t log_channel_find_or_create(const char* name) {
+    uint32_t channel = log_channel_find(name);
+    if (channel != NO_CHANNEL) return channel;
+
+    log_channel new = { .members = NULL, .members_len = 0, .members_cap = 0 };
+    memset(new.name, 0, sizeof new.name);
+    strncpy(new.name, name, MAX_USERNAME_LENGTH);
+    VEC_PUSH(channels, channels_len, channels_cap, new);
+    return channels_len - 1;
+}
+
+static bool log_channel_has_member(const log_channel* channel, uint32_t member) {
+    for (size_t i = 0; i < channel->members_len; i++) {
+        if (channel->members[i] == member) return true;
+    }
+
+    return false;
+}
+
+static bool log_user_follows(const log_user* user, uint32_t followee) {
+    for (size_t i = 0; i < user->followees_len; i++) {
+        if (user->followees[i] == followee) return true;
+    }
+
+    return false;
+}
+
+static void remove_from(uint32_t* array, size_t* len, uint32_t value) {
+    for (size_t i = 0; i < *len; i++) {
+        if (array[i] == value) {
+            array[i] = array[--*len];
+            return;
+        }
+    }
+}
+
+/**
+ * Applique une modification du graphe en mémoire. L'opération est idempotente, ce qui permet de rejouer sans risque un
+ * journal dont une partie est déjà contenue dans l'instantané.
+ */
+static void graph_apply(const graph_log_entry* entry) {
+    uint32_t a = log_user_find_or_create(entry->a);
+    switch (entry->op) {
+        case GRAPH_OP_UPDATE_USER:
+            users[a].last_online = entry->date;
+            return;
+        case GRAPH_OP_FOLLOW:;
+            uint32_t b = log_user_find_or_create(entry->b);
+            if (log_user_follows(&users[a], b)) return;
+            VEC_PUSH(users[a].followees, users[a].followees_len, users[a].followees_cap, b);
+            VEC_PUSH(users[b].followers, users[b].followers_len, users[b].followers_cap, a);
+            return;
+        case GRAPH_OP_UNFOLLOW:;
+            uint32_t c = log_user_find_or_create(entry->b);
+            remove_from(users[a].followees, &users[a].followees_len, c);
+            remove_from(users[c].followers, &users[c].followers_len, a);
+            return;
+        case GRAPH_OP_CURSOR:
+            users[a].acked_seq = entry->date;
+            return;
+        case GRAPH_OP_JOIN_CHANNEL:;
+            // `channels` peut être réalloué par log_channel_find_or_create(), d'où la variable intermédiaire
+            uint32_t joined_id = log_channel_find_or_create(entry->b);
+            log_channel* joined = &channels[joined_id];
+            if (log_channel_has_member(joined, a)) return;
+            VEC_PUSH(joined->members, joined->members_len, joined->members_cap, a);
+            return;
+        case GRAPH_OP_LEAVE_CHANNEL:;
+            uint32_t left_id = log_channel_find_or_create(entry->b);
+            remove_from(channels[left_id].members, &channels[left_id].members_len, a);
+            return;
+        default:
+            log_warning("Unknown graph log operation %u, ignoring", entry->op);
+    }
+}
+
+static void graph_path(char* out, size_t out_len, const char* file) {
+    snprintf(out, out_len, "%s/%s", directory, file);
+}
+
+static void write_all(int fd, const void* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        assert(written > 0);
+        data = (const char*) data + written;
+        len -= written;
+    }
+}
+
+/**
+ * Écrit un nouvel instantané du graphe et vide le journal
+ */
+static void graph_compact() {
+    char tmp_path[4096], path[4096];
+    graph_path(tmp_path, sizeof tmp_path, "graph.snapshot.tmp");
+    graph_path(path, sizeof path, "graph.snapshot");
+
+    FILE* file = fopen(tmp_path, "w");
+    assert(file != NULL);
+
+    graph_snapshot_header header = { .magic = GRAPH_SNAPSHOT_MAGIC, .user_count = users_len, .edge_count = 0 };
+    for (size_t i = 0; i < users_len; i++) header.edge_count += users[i].followees_len;
+    assert(fwrite(&header, sizeof header, 1, file) == 1);
+
+    for (size_t i = 0; i < users_len; i++) {
+        graph_snapshot_user user = { .last_online = users[i].last_online, .acked_seq = users[i].acked_seq };
+        memset(user.name, 0, sizeof user.name);
+        memcpy(user.name, users[i].name, MAX_USERNAME_LENGTH);
+        assert(fwrite(&user, sizeof user, 1, file) == 1);
+    }
+
+    for (uint32_t i = 0; i < users_len; i++) {
+        for (size_t j = 0; j < users[i].followees_len; j++) {
+            graph_snapshot_edge edge = { .follower = i, .followee = users[i].followees[j] };
+            assert(fwrite(&edge, sizeof edge, 1, file) == 1);
+        }
+    }
+
+    uint32_t channel_count = 0;
+    for (size_t i = 0; i < channels_len; i++) channel_count += channels[i].members_len > 0;
+    assert(fwrite(&channel_count, sizeof channel_count, 1, file) == 1);
+    for (size_t i = 0; i < channels_len; i++) {
+        if (channels[i].members_len == 0) continue;
+        graph_snapshot_channel channel = { .member_count = channels[i].members_len, .reserved = 0 };
+        memset(channel.name, 0, sizeof channel.name);
+        memcpy(channel.name, channels[i].name, MAX_USERNAME_LENGTH);
+        assert(fwrite(&channel, sizeof channel, 1, file) == 1);
+        assert(fwrite(channels[i].members, sizeof(uint32_t), channels[i].members_len, file) == channels[i].members_len);
+    }
+
+    assert(fflush(file) == 0);
+    assert(fsync(fileno(file)) == 0);
+    assert(fclose(file) == 0);
+    assert(rename(tmp_path, path) == 0);
+
+    // Le journal est ouvert en O_APPEND, les prochaines entrées seront donc écrites au début
+    assert(ftruncate(graph_log_fd, 0) == 0);
+    graph_log_entries = 0;
+}
+
+static graph_log_entry graph_entry(enum graph_op op, const char* a, const char* b, int64_t date) {
+    graph_log_entry entry = { .op = op, .reserved = 0, .date = date };
+    memset(entry.a, 0, sizeof entry.a);
+    memset(entry.b, 0, sizeof entry.b);
+    strncpy(entry.a, a, MAX_USERNAME_LENGTH);
+    if (b != NULL) strncpy(entry.b, b, MAX_USERNAME_LENGTH);
+    return entry;
+}
+
+/**
+ * Ajoute au journal des modifications déjà appliquées en mémoire, en une seule écriture
+ */
+static void graph_append(const graph_log_entry* entries, size_t count) {
+    if (graph_log_fd < 0 || count == 0) return;
+    write_all(graph_log_fd, entries, count * sizeof *entries);
+    graph_log_entries += count;
+    if (graph_log_entries >= graph_log_compaction_threshold) graph_compact();
+}
+
+/**
+ * Applique une modification au graphe en mémoire, puis l'ajoute au journal
+ */
+static void graph_record(enum graph_op op, const char* a, const char* b, int64_t date) {
+    graph_log_entry entry = graph_entry(op, a, b, date);
+    graph_apply(&entry);
+    graph_append(&entry, 1);
+}
+
+static void graph_load() {
+    char path[4096];
+    graph_path(path, sizeof path, "graph.snapshot");
+
+    FILE* snapshot = fopen(path, "r");
+    if (snapshot != NULL) {
+        graph_snapshot_header header;
+        assert(fread(&header, sizeof header, 1, snapshot) == 1);
+        bool is_v1 = memcmp(header.magic, GRAPH_SNAPSHOT_MAGIC_V1, sizeof header.magic) == 0;
+        bool is_v2 = memcmp(header.magic, GRAPH_SNAPSHOT_MAGIC_V2, sizeof header.magic) == 0;
+        assert(is_v1 || is_v2 || memcmp(header.magic, GRAPH_SNAPSHOT_MAGIC, sizeof header.magic) == 0);
+
+        for (uint32_t i = 0; i < header.user_count; i++) {
+            graph_snapshot_user user = { .acked_seq = NO_CURSOR };
+            if (is_v1) {
+                graph_snapshot_user_v1 user_v1;
+                assert(fread(&user_v1, sizeof user_v1, 1, snapshot) == 1);
+                memcpy(user.name, user_v1.name, sizeof user.name);
+                user.last_online = user_v1.last_online;
+            } else {
+                assert(fread(&user, sizeof user, 1, snapshot) == 1);
+            }
+            uint32_t id = log_user_find_or_create(user.name);
+            users[id].last_online = user.last_online;
+            users[id].acked_seq = user.acked_seq;
+        }
+
+        for (uint32_t i = 0; i < header.edge_count; i++) {
+            graph_snapshot_edge edge;
+            assert(fread(&edge, sizeof edge, 1, snapshot) == 1);
+            assert(edge.follower < users_len && edge.followee < users_len);
+            log_user* follower = &users[edge.follower];
+            log_user* followee = &users[edge.followee];
+            VEC_PUSH(follower->followees, follower->followees_len, follower->followees_cap, edge.followee);
+            VEC_PUSH(followee->followers, followee->followers_len, followee->followers_cap, edge.follower);
+        }
+
+        uint32_t channel_count = 0;
+        if (!is_v1 && !is_v2) assert(fread(&channel_count, sizeof channel_count, 1, snapshot) == 1);
+        for (uint32_t i = 0; i < channel_count; i++) {
+            graph_snapshot_channel snapshot_channel;
+            assert(fread(&snapshot_channel, sizeof snapshot_channel, 1, snapshot) == 1);
+            uint32_t channel_id = log_channel_find_or_create(snapshot_channel.name);
+            log_channel* channel = &channels[channel_id];
+            for (uint32_t j = 0; j < snapshot_channel.member_count; j++) {
+                uint32_t member;
+                assert(fread(&member, sizeof member, 1, snapshot) == 1);
+                assert(member < users_len);
+                VEC_PUSH(channel->members, channel->members_len, channel->members_cap, member);
+            }
+        }
+
+        fclose(snapshot);
+    }
+
+    graph_path(path, sizeof path, "graph.log");
+    graph_log_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    assert(graph_log_fd >= 0);
+
+    graph_log_entry entry;
+    ssize_t bytes_read;
+    while ((bytes_read = read(graph_log_fd, &entry, sizeof entry)) == sizeof entry) {
+        graph_apply(&entry);
+        graph_log_entries++;
+    }
+
+    if (bytes_read > 0) {
+        // Entrée incomplète en fin de journal (arrêt brutal pendant une écriture), on l'oublie
+        log_warning("Truncating an incomplete entry at the end of the graph log");
+        assert(ftruncate(graph_log_fd, graph_log_entries * sizeof entry) == 0);
+    }
+}
+
+static log_record* log_record_at(uint64_t position) {
+    return &segments[position / LOG_SEGMENT_RECORDS].records[position % LOG_SEGMENT_RECORDS];
+}
+
+/**
+ * Projette le segment numéro `segments_len` en mémoire. Renvoie false si le segment n'existe pas et que `create` est
+ * faux.
+ */
+static bool log_segment_open(bool create) {
+    int fd;
+    bool is_new = create;
+    if (directory == NULL) {
+        if (!create) return false;
+        fd = memfd_create("twiiiiiter-segment", 0);
+    } else {
+        char path[4096];
+        snprintf(path, sizeof path, "%s/twiiiiits-%06zu.seg", directory, segments_len);
+        fd = open(path, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+        if (fd < 0 && errno == ENOENT && !create) return false;
+    }
+    assert(fd >= 0);
+
+    if (is_new) assert(ftruncate(fd, LOG_SEGMENT_SIZE) == 0);
+    void* mapping = mmap(NULL, LOG_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(mapping != MAP_FAILED);
+    close(fd);
+
+    log_segment segment = {
+        .header = mapping,
+        .records = (log_record*) ((char*) mapping + sizeof(log_segment_header)),
+    };
+
+    if (is_new) {
+        memcpy(segment.header->magic, LOG_SEGMENT_MAGIC, sizeof segment.header->magic);
+        segment.header->count = 0;
+    } else {
+        assert(memcmp(segment.header->magic, LOG_SEGMENT_MAGIC, sizeof segment.header->magic) == 0);
+        assert(segment.header->count <= LOG_SEGMENT_RECORDS);
+    }
+
+    assert(segments_len < LOG_MAX_SEGMENTS);
+    segments[segments_len] = segment;
+    __atomic_store_n(&segments_len, segments_len + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static uint64_t log_last_seq() {
+    return (uint64_t) (segments_len - 1) * LOG_SEGMENT_RECORDS + segments[segments_len - 1].header->count;
+}
+
+/**
+ * Donne un curseur aux utilisateurs qui n'en ont pas encore, enregistrés avant l'existence des curseurs : ils
+ * rattrapaient les twiiiiits publiés depuis leur dernière (dé)connexion, le curseur est donc le dernier twiiiiit publié
+ * avant celle-ci. Les dates des enregistrements sont croissantes, d'où la recherche dichotomique.
+ */
+static void log_derive_cursors() {
+    size_t derived = 0;
+    for (size_t i = 0; i < users_len; i++) {
+        if (users[i].acked_seq != NO_CURSOR) continue;
+
+        uint64_t low = 0, high = log_last_seq();
+        while (low < high) {
+            uint64_t middle = low + (high - low) / 2;
+            if (log_record_at(middle)->date < users[i].last_online) low = middle + 1;
+            else high = middle;
+        }
+        // Les `low` premiers enregistrements sont antérieurs : le dernier d'entre eux a pour numéro `low`
+        graph_record(GRAPH_OP_CURSOR, users[i].name, NULL, (int64_t) low);
+        derived++;
+    }
+
+    if (derived > 0) log_info("Derived the catch-up cursor of %zu users from their last login", derived);
+}
+
+static void log_store_initialize(const char* database_file) {
+    if (strcmp(database_file, ":memory:") != 0) {
+        directory = database_file;
+        graph_log_compaction_threshold =
+            strtoull(getenv("TWIIIIITER_LOG_COMPACTION_ENTRIES") ?: "", NULL, 10) ?: GRAPH_LOG_COMPACTION_THRESHOLD;
+        assert(mkdir(directory, 0755) == 0 || errno == EEXIST);
+        // Chaque processus garde son propre graphe en mémoire : deux processus sur le même répertoire ne se verraient
+        // pas, et corrompraient les segments en y ajoutant tous deux. Le verrou est rendu à la fin du processus, ou
+        // avant par log_release().
+        directory_lock = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        assert(directory_lock >= 0);
+        if (flock(directory_lock, LOCK_EX | LOCK_NB) != 0) {
+            log_error("The log store %s is already used by another process", directory);
+            exit(1);
+        }
+        graph_load();
+    }
+
+    // Reconstruction de l'index par auteur·ice
+    size_t twiiiiit_count = 0;
+    while (log_segment_open(false)) {
+        log_segment* segment = &segments[segments_len - 1];
+        for (uint32_t i = 0; i < segment->header->count; i++) {
+            uint64_t position = (uint64_t) (segments_len - 1) * LOG_SEGMENT_RECORDS + i;
+            // `users` peut être réalloué par log_user_find_or_create(), d'où la variable intermédiaire
+            uint32_t author_id = log_user_find_or_create(segment->records[i].author);
+            log_user* author = &users[author_id];
+            VEC_PUSH(author->twiiiiits, author->twiiiiits_len, author->twiiiiits_cap, position);
+            twiiiiit_count++;
+        }
+    }
+
+    if (segments_len == 0) {
+        log_segment_open(true);
+        if (directory != NULL) log_info("Created a new log store in %s", directory);
+    } else {
+        log_info("Found existing log store in %s (%zu users, %zu twiiiiits)", directory, users_len, twiiiiit_count);
+    }
+    log_derive_cursors();
+}
+
+static void log_release() {
+    if (directory_lock >= 0) close(directory_lock);
+    directory_lock = -1;
+}
+
+static void log_update_user(const char* user, bool is_online) {
+    bool is_new = log_user_find(user) == NO_USER;
+    graph_record(GRAPH_OP_UPDATE_USER, user, NULL, ts_now());
+    if (is_new) graph_record(GRAPH_OP_CURSOR, user, NULL, (int64_t) log_last_seq());
+}
+
+static int64_t log_cursor(const char* user) {
+    uint32_t user_id = log_user_find(user);
+    return user_id == NO_USER ? -1 : (int64_t) users[user_id].acked_seq;
+}
+
+static void log_save_cursor(const char* user, uint64_t seq) {
+    uint32_t user_id = log_user_find(user);
+    if (user_id == NO_USER || users[user_id].acked_seq >= seq) return;
+    graph_record(GRAPH_OP_CURSOR, user, NULL, (int64_t) seq);
+}
+
+/**
+ * Vérifie un (dés)abonnement et, s'il change quelque chose, l'applique en mémoire et prépare son entrée de journal dans
+ * `entry`
+ */
+static enum subscribe_result log_follow_unfollow(
+    const char* follower,
+    const char* followee,
+    bool unfollow,
+    graph_log_entry* entry
+) {
+    uint32_t follower_id = log_user_find(follower);
+    uint32_t followee_id = log_user_find(followee);
+    // Comme avec SQLite, se désabonner de quelqu'un d'inexistant ne change simplement rien
+    if (follower_id == NO_USER || followee_id == NO_USER) {
+        return unfollow ? SUBSCRIBE_RESULT_UNCHANGED : SUBSCRIBE_RESULT_NOT_FOUND;
+    }
+    if (log_user_follows(&users[follower_id], followee_id) != unfollow) return SUBSCRIBE_RESULT_UNCHANGED;
+
+    *entry = graph_entry(unfollow ? GRAPH_OP_UNFOLLOW : GRAPH_OP_FOLLOW, follower, followee, ts_now());
+    graph_apply(entry);
+    return SUBSCRIBE_RESULT_OK;
+}
+
+static enum subscribe_result log_follow(const char* follower, const char* followee) {
+    graph_log_entry entry;
+    enum subscribe_result result = log_follow_unfollow(follower, followee, false, &entry);
+    if (result == SUBSCRIBE_RESULT_OK) graph_append(&entry, 1);
+    return result;
+}
+
+static enum subscribe_result log_unfollow(const char* follower, const char* followee) {
+    graph_log_entry entry;
+    enum subscribe_result result = log_follow_unfollow(follower, followee, true, &entry);
+    if (result == SUBSCRIBE_RESULT_OK) graph_append(&entry, 1);
+    return result;
+}
+
+/**
+ * Les modifications du lot sont ajoutées au journal en une seule écriture : après un arrêt brutal, seule la dernière
+ * entrée peut être incomplète, et elle est alors oubliée au chargement
+ */
+static void log_follow_batch(
+    const char* follower,
+    const user_name* followees,
+    size_t count,
+    bool unfollow,
+    enum subscribe_result* results
+) {
+    graph_log_entry* entries = malloc(count * sizeof *entries);
+    assert(count == 0 || entries != NULL);
+
+    size_t entry_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        results[i] = log_follow_unfollow(follower, followees[i], unfollow, &entries[entry_count]);
+        if (results[i] == SUBSCRIBE_RESULT_OK) entry_count++;
+    }
+
+    graph_append(entries, entry_count);
+    free(entries);
+}
+
+/**
+ * Copie une liste d'utilisateurs dans un itérateur, qui reste ainsi valide même si le graphe est modifié pendant
+ * l'énumération
+ */
+static user_iterator log_user_iterator_new(const uint32_t* list, size_t len) {
+    log_user_iterator* it = malloc(sizeof(log_user_iterator) + len * sizeof(uint32_t));
+    assert(it != NULL);
+    it->len = len;
+    it->position = 0;
+    it->channels = false;
+    if (len > 0) memcpy(it->users, list, len * sizeof(uint32_t));
+    return it;
+}
+
+static user_iterator log_list_followee(const char* follower) {
+    uint32_t user = log_user_find(follower);
+    if (user == NO_USER) return log_user_iterator_new(NULL, 0);
+    return log_user_iterator_new(users[user].followees, users[user].followees_len);
+}
+
+static user_iterator log_list_followers(const char* followee) {
+    uint32_t user = log_user_find(followee);
+    if (user == NO_USER) return log_user_iterator_new(NULL, 0);
+    return log_user_iterator_new(users[user].followers, users[user].followers_len);
+}
+
+static bool log_users_next(user_iterator restrict cursor, char* restrict out) {
+    log_user_iterator* it = cursor;
+    if (it->position == it->len) {
+        free(it);
+        return false;
+    }
+
+    uint32_t id = it->users[it->position++];
+    memset(out, 0, MAX_USERNAME_LENGTH);
+    strncpy(out, it->channels ? channels[id].name : users[id].name, MAX_USERNAME_LENGTH);
+    return true;
+}
+
+static enum subscribe_result log_join_leave_channel(const char* member, const char* channel, bool leave) {
+    uint32_t member_id = log_user_find(member);
+    if (member_id == NO_USER) return leave ? SUBSCRIBE_RESULT_UNCHANGED : SUBSCRIBE_RESULT_NOT_FOUND;
+    uint32_t channel_id = log_channel_find(channel);
+    bool is_member = channel_id != NO_CHANNEL && log_channel_has_member(&channels[channel_id], member_id);
+    if (is_member != leave) return SUBSCRIBE_RESULT_UNCHANGED;
+
+    graph_record(leave ? GRAPH_OP_LEAVE_CHANNEL : GRAPH_OP_JOIN_CHANNEL, member, channel, ts_now());
+    return SUBSCRIBE_RESULT_OK;
+}
+
+static enum subscribe_result log_join_channel(const char* member, const char* channel) {
+    return log_join_leave_channel(member, channel, false);
+}
+
+static enum subscribe_result log_leave_channel(const char* member, const char* channel) {
+    return log_join_leave_channel(member, channel, true);
+}
+
+static user_iterator log_list_channels() {
+    uint32_t* list = malloc(channels_len * sizeof(uint32_t));
+    assert(channels_len == 0 || list != NULL);
+    size_t len = 0;
+    for (uint32_t channel = 0; channel < channels_len; channel++) {
+        if (channels[channel].members_len > 0) list[len++] = channel;
+    }
+
+    log_user_iterator* it = log_user_iterator_new(list, len);
+    it->channels = true;
+    free(list);
+    return it;
+}
+
+static user_iterator log_list_channel_members(const char* channel) {
+    uint32_t channel_id = log_channel_find(channel);
+    if (channel_id == NO_CHANNEL) return log_user_iterator_new(NULL, 0);
+    return log_user_iterator_new(channels[channel_id].members, channels[channel_id].members_len);
+}
+
+static void log_save_twiiiiit(const char* author, const char* message, database_twiiiiit* out) {
+    uint32_t author_id = log_user_find(author);
+    assert(author_id != NO_USER);
+
+    log_segment* segment = &segments[segments_len - 1];
+    if (segment->header->count == LOG_SEGMENT_RECORDS) {
+        log_segment_open(true);
+        segment = &segments[segments_len - 1];
+    }
+
+    uint32_t offset = segment->header->count;
+    log_record* record = &segment->records[offset];
+    memset(record, 0, sizeof *record);
+    record->date = ts_now();
+    strncpy(record->author, author, MAX_USERNAME_LENGTH);
+    strncpy(record->message, message, MESSAGE_MAX_LENGTH);
+    // L'enregistrement n'est visible qu'une fois entièrement écrit
+    __atomic_store_n(&segment->header->count, offset + 1, __ATOMIC_RELEASE);
+
+    log_user* user = &users[author_id];
+    uint64_t position = (uint64_t) (segments_len - 1) * LOG_SEGMENT_RECORDS + offset;
+    VEC_PUSH(user->twiiiiits, user->twiiiiits_len, user->twiiiiits_cap, position);
+
+    memset(out, 0, sizeof(database_twiiiiit));
+    out->seq = position + 1;
+    out->date = record->date;
+    strncpy(out->author, author, MAX_USERNAME_LENGTH);
+    strncpy(out->message, message, MESSAGE_MAX_LENGTH);
+}
+
+/**
+ * Première position dans l'index de `user` dont le twiiiiit n'est pas antérieur à `date` et `seq`, c.f.
+ * database_list_author_twiiiiits(). L'index est dans l'ordre des numéros de séquence, et donc des dates.
+ */
+static size_t log_user_twiiiiits_since(const log_user* user, int64_t date, uint64_t seq) {
+    size_t low = 0, high = user->twiiiiits_len;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int64_t middle_date = log_record_at(user->twiiiiits[middle])->date;
+        // Le numéro de séquence d'un twiiiiit est sa position plus un, c.f. log_twiiiiits_next()
+        if (middle_date < date || (middle_date == date && user->twiiiiits[middle] + 1 < seq)) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+/**
+ * Première position dans l'index de `user` supérieure ou égale à `position`
+ */
+static size_t log_user_twiiiiits_from(const log_user* user, uint64_t position) {
+    size_t low = 0, high = user->twiiiiits_len;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (user->twiiiiits[middle] < position) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+static int compare_positions(const void* a, const void* b) {
+    uint64_t position_a = *(const uint64_t*) a, position_b = *(const uint64_t*) b;
+    return position_a < position_b ? -1 : position_a > position_b;
+}
+
+/**
+ * Les positions sont les numéros de séquence moins un : les twiiiiits manqués sont ceux des positions `after` (incluse)
+ * à `until` (exclue), trouvées dans l'index de chaque abonnement sans lire les enregistrements
+ */
+static twiiiiit_iterator log_list_missed_twiiiiits(const char* follower, uint64_t after, uint64_t until) {
+    uint32_t user_id = log_user_find(follower);
+    if (user_id == NO_USER) {
+        log_twiiiiit_iterator* empty = malloc(sizeof(log_twiiiiit_iterator));
+        assert(empty != NULL);
+        *empty = (log_twiiiiit_iterator) { .len = 0, .position = 0 };
+        return empty;
+    }
+
+    const log_user* user = &users[user_id];
+    size_t len = 0;
+    for (size_t i = 0; i < user->followees_len; i++) {
+        const log_user* followee = &users[user->followees[i]];
+        len += log_user_twiiiiits_from(followee, until) - log_user_twiiiiits_from(followee, after);
+    }
+
+    log_twiiiiit_iterator* it = malloc(sizeof(log_twiiiiit_iterator) + len * sizeof(uint64_t));
+    assert(it != NULL);
+    it->len = len;
+    it->position = 0;
+
+    size_t filled = 0;
+    for (size_t i = 0; i < user->followees_len; i++) {
+        const log_user* followee = &users[user->followees[i]];
+        size_t first = log_user_twiiiiits_from(followee, after);
+        size_t count = log_user_twiiiiits_from(followee, until) - first;
+        memcpy(&it->records[filled], &followee->twiiiiits[first], count * sizeof(uint64_t));
+        filled += count;
+    }
+
+    qsort(it->records, len, sizeof(uint64_t), compare_positions);
+    return it;
+}
+
+/**
+ * Indique si chacun des mots de `words` est le début d'un mot de `message`, sans tenir compte de la casse
+ */
+static bool log_message_matches(const char* message, char words[][MESSAGE_MAX_LENGTH + 1], size_t word_count) {
+    for (size_t w = 0; w < word_count; w++) {
+        size_t word_len = strlen(words[w]);
+        bool found = false;
+        for (size_t i = 0; i < MESSAGE_MAX_LENGTH && message[i] != 0 && !found; i++) {
+            bool word_start = i == 0 || !isalnum((unsigned char) message[i - 1]);
+            found = word_start
+                && i + word_len <= MESSAGE_MAX_LENGTH
+                && strncasecmp(&message[i], words[w], word_len) == 0;
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+/**
+ * Sans index plein texte, le journal est parcouru du plus récent au plus ancien : la pertinence est donc la récence.
+ * Seuls les segments et leurs enregistrements publiés sont lus, ce qui permet de chercher depuis un autre thread.
+ */
+static twiiiiit_iterator log_search_twiiiiits(const char* query, uint64_t until, uint32_t offset, uint32_t limit) {
+    char words[MESSAGE_MAX_LENGTH / 2][MESSAGE_MAX_LENGTH + 1];
+    size_t word_count = 0;
+    for (size_t i = 0; i < MESSAGE_MAX_LENGTH && query[i] != 0;) {
+        if (!isalnum((unsigned char) query[i])) {
+            i++;
+            continue;
+        }
+        size_t len = 0;
+        for (; i < MESSAGE_MAX_LENGTH && isalnum((unsigned char) query[i]); i++) words[word_count][len++] = query[i];
+        words[word_count++][len] = 0;
+    }
+
+    log_twiiiiit_iterator* it = malloc(sizeof(log_twiiiiit_iterator) + limit * sizeof(uint64_t));
+    assert(it != NULL);
+    it->len = 0;
+    it->position = 0;
+    if (word_count == 0) return it;
+
+    uint32_t skipped = 0;
+    for (size_t segment = __atomic_load_n(&segments_len, __ATOMIC_ACQUIRE); segment-- > 0 && it->len < limit;) {
+        uint32_t count = __atomic_load_n(&segments[segment].header->count, __ATOMIC_ACQUIRE);
+        for (uint32_t i = count; i-- > 0 && it->len < limit;) {
+            // Numéro de séquence : position + 1, c.f. log_twiiiiits_next()
+            if ((uint64_t) segment * LOG_SEGMENT_RECORDS + i >= until) continue;
+            if (!log_message_matches(segments[segment].records[i].message, words, word_count)) continue;
+            if (skipped < offset) {
+                skipped++;
+                continue;
+            }
+            it->records[it->len++] = (uint64_t) segment * LOG_SEGMENT_RECORDS + i;
+        }
+    }
+
+    return it;
+}
+
+static twiiiiit_iterator log_list_author_twiiiiits(
+    const char* author,
+    int64_t before,
+    uint64_t before_seq,
+    uint32_t limit
+) {
+    uint32_t user_id = log_user_find(author);
+    const log_user* user = user_id != NO_USER ? &users[user_id] : NULL;
+    size_t end = user != NULL ? log_user_twiiiiits_since(user, before, before_seq) : 0;
+    size_t len = end < limit ? end : limit;
+
+    log_twiiiiit_iterator* it = malloc(sizeof(log_twiiiiit_iterator) + len * sizeof(uint64_t));
+    assert(it != NULL);
+    it->len = len;
+    it->position = 0;
+    for (size_t i = 0; i < len; i++) it->records[i] = user->twiiiiits[end - 1 - i];
+    return it;
+}
+
+static bool log_twiiiiits_next(twiiiiit_iterator restrict iterator, database_twiiiiit* restrict out) {
+    log_twiiiiit_iterator* it = iterator;
+    if (it->position == it->len) {
+        free(it);
+        return false;
+    }
+
+    uint64_t position = it->records[it->position++];
+    const log_record* record = log_record_at(position);
+    memset(out, 0, sizeof(database_twiiiiit));
+    out->seq = position + 1;
+    out->date = record->date;
+    strncpy(out->author, record->author, MAX_USERNAME_LENGTH);
+    strncpy(out->message, record->message, MESSAGE_MAX_LENGTH);
+    return true;
+}
+
+const database_engine database_engine_log = {
+    .name = "log",
+    .default_file = "twiiiiiter.log.d",
+    .shared = false,
+    .initialize = log_store_initialize,
+    .release = log_release,
+    .update_user = log_update_user,
+    .cursor = log_cursor,
+    .save_cursor = log_save_cursor,
+    .follow = log_follow,
+    .unfollow = log_unfollow,
+    .follow_batch = log_follow_batch,
+    .list_followee = log_list_followee,
+    .list_followers = log_list_followers,
+    .users_next = log_users_next,
+    .join_channel = log_join_channel,
+    .leave_channel = log_leave_channel,
+    .list_channels = log_list_channels,
+    .list_channel_members = log_list_channel_members,
+    .save_twiiiiit = log_save_twiiiiit,
+    .last_seq = log_last_seq,
+    .list_missed_twiiiiits = log_list_missed_twiiiiits,
+    .search_twiiiiits = log_search_twiiiiits,
+    .list_author_twiiiiits = log_list_author_twiiiiits,
+    .twiiiiits_next = log_twiiiiits_next,
+    .twiiiiits_close = free,
+};
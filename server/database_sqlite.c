@@ -0,0 +1,696 @@
+#include <ctype.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "constants.h"
+#include "database_engine.h"
+#include "log.h"
+#include "twiiiiiter_assert.h"
+
+// Le fichier "/server/init_db.sql" est embarqué dans le binaire, linké et accessibles au travers de ces
+// deux symboles (c.f. "/server/CMakeLists.txt" où l'étape de build se passe).
+extern const char _binary_init_db_sql_start[];
+extern const char _binary_init_db_sql_end;
+
+static sqlite3* db = NULL;
+// Connexion en lecture seule du thread courant, c.f. sqlite_open_reader(). La boucle d'évènements lit avec `db`.
+static __thread sqlite3* reader_db = NULL;
+static char* sqlite_error_message;
+
+// Base en mémoire partagée entre toutes les connexions
+#define SQLITE_MEMORY_URI "file:twiiiiiter?mode=memory&cache=shared"
+
+// Ce qu'il faut pour ouvrir les lecteurs
+static char* database_uri = NULL;
+static bool database_in_memory = false;
+
+// Dernier twiiiiit indexé par ce nœud, c.f. sqlite_index_search()
+static int64_t search_indexed_seq = -1;
+
+/**
+ * Connexion des lectures du thread courant
+ */
+static sqlite3* sqlite_read_db() {
+    return reader_db ?: db;
+}
+
+/**
+ * Index plein texte des twiiiiits. Il n'est pas tenu à jour par un déclencheur, qui coûterait une écriture dans l'index
+ * à chaque publication : sqlite_index_search() y ajoute par lots les twiiiiits postérieurs à
+ * `twiiiiits_search_indexed`. Il est créé à part de "/server/init_db.sql" pour pouvoir être ajouté aux bases
+ * existantes.
+ */
+// language=sqlite
+static const char* const sqlite_search_schema =
+    "begin;"
+    "create virtual table twiiiiits_search using fts5(message, content = 'twiiiiits', content_rowid = 'rowid');"
+    "insert into twiiiiits_search (twiiiiits_search) values ('rebuild');"
+    "commit;";
+
+/**
+ * Numéro de séquence du dernier twiiiiit indexé. Les bases indexées par l'ancien déclencheur le sont entièrement.
+ */
+// language=sqlite
+static const char* const sqlite_search_indexed_schema =
+    "begin;"
+    "drop trigger if exists twiiiiits_search_insert;"
+    "drop trigger if exists twiiiiits_search_delete;"
+    "create table twiiiiits_search_indexed (seq long not null);"
+    "insert into twiiiiits_search_indexed select coalesce(max(rowid), 0) from twiiiiits;"
+    // Seuls les twiiiiits déjà indexés peuvent en être retirés
+    "create trigger twiiiiits_search_delete after delete on twiiiiits"
+    "    when old.rowid <= (select seq from twiiiiits_search_indexed) begin"
+    "    insert into twiiiiits_search (twiiiiits_search, rowid, message) values ('delete', old.rowid, old.message);"
+    "end;"
+    "commit;";
+
+/**
+ * Curseurs de rattrapage, ajoutés aux bases existantes. Les twiiiiits y étaient rattrapés à partir de la dernière
+ * (dé)connexion : le curseur initial est le dernier twiiiiit publié avant celle-ci.
+ */
+// language=sqlite
+static const char* const sqlite_cursor_schema =
+    "begin;"
+    "alter table users add column acked_seq long not null default 0;"
+    "update users set acked_seq = coalesce("
+    "    (select rowid from twiiiiits where date < users.last_online order by rowid desc limit 1), 0"
+    ");"
+    "commit;";
+
+/**
+ * Canaux et leurs membres, ajoutés aux bases existantes. Un canal n'a une ligne que tant qu'il a des membres.
+ */
+// language=sqlite
+static const char* const sqlite_channels_schema =
+    "create table if not exists channels ("
+    "    name text(6) not null primary key"
+    ");"
+    "create table if not exists channel_members ("
+    "    channel text(6) not null references channels (name) on delete cascade,"
+    "    member text(6) not null references users (name) on delete cascade,"
+    "    unique (channel, member)"
+    ");";
+
+static bool is_only_whitespace(const char* string, const char* end) {
+    for (const char* c = string; c < end; c++) {
+        if (!isspace(*c)) return false;
+    }
+
+    return true;
+}
+
+static int sqlite3_step_all(sqlite3_stmt* stmt) {
+    int step;
+    do step = sqlite3_step(stmt); while (step == SQLITE_ROW);
+    return step;
+}
+
+static int sqlite_initialize_callback(void* table_count, int column_count, char** row_values, char** columns) {
+    assert(column_count == 1);
+    *((size_t*) table_count) = strtoul(row_values[0], NULL, 10);
+    return 0;
+}
+
+static void sqlite_initialize(const char* database_file) {
+    database_in_memory = strcmp(database_file, ":memory:") == 0;
+    database_uri = strdup(database_in_memory ? SQLITE_MEMORY_URI : database_file);
+    assert(database_uri != NULL);
+    int flags = SQLITE_OPEN_URI | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    assert(sqlite3_open_v2(database_uri, &db, flags, NULL) == SQLITE_OK);
+    log_info("Using SQLite %s", sqlite3_libversion());
+
+    // En mode grappe, plusieurs serveurs écrivent dans le même fichier : on attend plutôt que d'échouer
+    sqlite3_busy_timeout(db, 5000);
+
+    size_t table_count = -1;
+    // language=sqlite
+    int result = sqlite3_exec(
+        db,
+        "select count(*) from sqlite_master where type='table' and name in ('users', 'followings', 'twiiiiits')",
+        sqlite_initialize_callback,
+        &table_count,
+        &sqlite_error_message
+    );
+    assert(result == SQLITE_OK);
+
+    assert(table_count >= 0);
+    if (table_count == 0) {
+        log_info("Initializing the database in %s", database_file);
+        long length = &_binary_init_db_sql_end - &_binary_init_db_sql_start[0];
+        for (const char* statement = _binary_init_db_sql_start; !is_only_whitespace(statement, &_binary_init_db_sql_end);) {
+            sqlite3_stmt* stmt;
+            result = sqlite3_prepare_v2(db, statement, (int) length, &stmt, &statement);
+            assert(result == SQLITE_OK);
+            assert(sqlite3_step_all(stmt) == SQLITE_DONE);
+            sqlite3_finalize(stmt);
+        }
+        log_info("Database initialized");
+    } else if (table_count == 3) {
+        log_info("Found existing database in %s", database_file);
+    } else {
+        // Nombre de tables non conventionnel trouvé
+        assert(false);
+    }
+
+    // On active les clés étrangères sans quoi SQLite ne les vérifie pas
+
+    // language=sqlite
+    result = sqlite3_exec(db, "pragma foreign_keys = on", NULL, NULL, &sqlite_error_message);
+    assert(result == SQLITE_OK);
+
+    size_t search_table_count = -1;
+    // language=sqlite
+    result = sqlite3_exec(
+        db,
+        "select count(*) from sqlite_master where type='table' and name = 'twiiiiits_search'",
+        sqlite_initialize_callback,
+        &search_table_count,
+        &sqlite_error_message
+    );
+    assert(result == SQLITE_OK);
+    if (search_table_count == 0) {
+        log_info("Building the search index");
+        assert(sqlite3_exec(db, sqlite_search_schema, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    }
+
+    size_t search_indexed_count = -1;
+    // language=sqlite
+    result = sqlite3_exec(
+        db,
+        "select count(*) from sqlite_master where type='table' and name = 'twiiiiits_search_indexed'",
+        sqlite_initialize_callback,
+        &search_indexed_count,
+        &sqlite_error_message
+    );
+    assert(result == SQLITE_OK);
+    if (search_indexed_count == 0) {
+        assert(sqlite3_exec(db, sqlite_search_indexed_schema, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    }
+
+    size_t cursor_column_count = -1;
+    // language=sqlite
+    result = sqlite3_exec(
+        db,
+        "select count(*) from pragma_table_info('users') where name = 'acked_seq'",
+        sqlite_initialize_callback,
+        &cursor_column_count,
+        &sqlite_error_message
+    );
+    assert(result == SQLITE_OK);
+    if (cursor_column_count == 0) {
+        log_info("Adding the catch-up cursors");
+        assert(sqlite3_exec(db, sqlite_cursor_schema, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    }
+
+    // Index des twiiiiits par auteur·ice, pour le fil d'actualité. Comme l'index de recherche, il est ajouté aux bases
+    // existantes.
+    // language=sqlite
+    result = sqlite3_exec(
+        db,
+        "create index if not exists twiiiiits_author_date on twiiiiits (author, date)",
+        NULL,
+        NULL,
+        &sqlite_error_message
+    );
+    assert(result == SQLITE_OK);
+
+    // Et par auteur·ice et numéro de séquence (le rowid, implicite à la fin de l'index), pour le rattrapage
+    // language=sqlite
+    result = sqlite3_exec(
+        db,
+        "create index if not exists twiiiiits_author_seq on twiiiiits (author)",
+        NULL,
+        NULL,
+        &sqlite_error_message
+    );
+    assert(result == SQLITE_OK);
+
+    assert(sqlite3_exec(db, sqlite_channels_schema, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+
+    // Les lecteurs lisent en parallèle des écritures de la boucle d'évènements, sans la bloquer : en WAL pour un
+    // fichier, et sans verrou de lecture pour la base en mémoire (qui ne connaît pas le WAL, c.f. sqlite_open_reader())
+    if (!database_in_memory) {
+        // language=sqlite
+        assert(sqlite3_exec(db, "pragma journal_mode = wal", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    }
+}
+
+/**
+ * Chaque thread lecteur a sa propre connexion : SQLite n'exécute qu'une requête à la fois par connexion, mais les
+ * connexions d'un même fichier en WAL lisent en parallèle
+ */
+static void sqlite_open_reader() {
+    assert(reader_db == NULL);
+    int result = sqlite3_open_v2(database_uri, &reader_db, SQLITE_OPEN_URI | SQLITE_OPEN_READONLY, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_busy_timeout(reader_db, 5000);
+    if (database_in_memory) {
+        // language=sqlite
+        assert(sqlite3_exec(reader_db, "pragma read_uncommitted = 1", NULL, NULL, NULL) == SQLITE_OK);
+    }
+}
+
+static void sqlite_close_reader() {
+    // Une requête libérée depuis un autre thread peut encore être en cours, la connexion sera alors fermée après elle
+    assert(sqlite3_close_v2(reader_db) == SQLITE_OK);
+    reader_db = NULL;
+}
+
+static void sqlite_update_user(const char* user, bool is_online) {
+    // language=sqlite
+    char* sql = "insert or ignore into users values (?1, ?2, (select coalesce(max(rowid), 0) from twiiiiits)) on conflict (name) do update set last_online = ?2";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, user, (int) strnlen(user, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, ts_now());
+    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+}
+
+static int64_t sqlite_cursor(const char* user) {
+    // language=sqlite
+    char* sql = "select acked_seq from users where name = ?";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, user, (int) strnlen(user, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    int64_t cursor = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+    sqlite3_finalize(stmt);
+    return cursor;
+}
+
+static void sqlite_save_cursor(const char* user, uint64_t seq) {
+    // language=sqlite
+    char* sql = "update users set acked_seq = max(acked_seq, ?2) where name = ?1";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, user, (int) strnlen(user, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (int64_t) seq);
+    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+}
+
+// language=sqlite
+static const char* const sqlite_follow_sql = "insert into followings values (?, ?)";
+// language=sqlite
+static const char* const sqlite_unfollow_sql = "delete from followings where follower = ? and followee = ?";
+
+/**
+ * L'abonnement et le désabonnement se font de la même manière (à l'exception du code SQL), et sont donc effectués dans
+ * cette fonction, sur une requête préparée qui est remise à zéro ensuite pour pouvoir être réutilisée. Les points
+ * d'entrée publics sont les trois fonctions sous celle-ci.
+ *
+ * @see sqlite_follow()
+ * @see sqlite_unfollow()
+ * @see sqlite_follow_batch()
+ */
+static enum subscribe_result sqlite_follow_unfollow(sqlite3_stmt* stmt, const char* follower, const char* followee) {
+    int follower_len = (int) strnlen(follower, MAX_USERNAME_LENGTH);
+    int followee_len = (int) strnlen(followee, MAX_USERNAME_LENGTH);
+
+    sqlite3_bind_text(stmt, 1, follower, follower_len, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, followee, followee_len, SQLITE_STATIC);
+
+    enum subscribe_result result;
+    switch (sqlite3_step_all(stmt)) {
+        case SQLITE_DONE:
+            // S'il y a 0 changements, cela signifie qu'aucune ligne n'a été supprimée et que donc l'abonnement
+            // n'existait pas de base.
+            result = sqlite3_changes(db) != 0 ? SUBSCRIBE_RESULT_OK : SUBSCRIBE_RESULT_UNCHANGED;
+            break;
+        case SQLITE_CONSTRAINT:;
+            int ext_err = sqlite3_extended_errcode(db);
+            if (ext_err == SQLITE_CONSTRAINT_FOREIGNKEY) result = SUBSCRIBE_RESULT_NOT_FOUND;
+            else if (ext_err == SQLITE_CONSTRAINT_UNIQUE) result = SUBSCRIBE_RESULT_UNCHANGED;
+            else assert(false);
+            break;
+        default:
+            assert(false);
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return result;
+}
+
+static enum subscribe_result sqlite_follow_unfollow_once(const char* follower, const char* followee, bool unfollow) {
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db, unfollow ? sqlite_unfollow_sql : sqlite_follow_sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    enum subscribe_result subscribe_result = sqlite_follow_unfollow(stmt, follower, followee);
+    sqlite3_finalize(stmt);
+    return subscribe_result;
+}
+
+static enum subscribe_result sqlite_follow(const char* follower, const char* followee) {
+    return sqlite_follow_unfollow_once(follower, followee, false);
+}
+
+static enum subscribe_result sqlite_unfollow(const char* follower, const char* followee) {
+    return sqlite_follow_unfollow_once(follower, followee, true);
+}
+
+/**
+ * Une seule requête préparée et une seule transaction pour tout le lot. La transaction prend immédiatement le verrou
+ * d'écriture, afin d'attendre (c.f. sqlite3_busy_timeout()) plutôt que d'échouer si un autre nœud de la grappe écrit.
+ */
+static void sqlite_follow_batch(
+    const char* follower,
+    const user_name* followees,
+    size_t count,
+    bool unfollow,
+    enum subscribe_result* results
+) {
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db, unfollow ? sqlite_unfollow_sql : sqlite_follow_sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+
+    // language=sqlite
+    assert(sqlite3_exec(db, "begin immediate", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    for (size_t i = 0; i < count; i++) results[i] = sqlite_follow_unfollow(stmt, follower, followees[i]);
+    // language=sqlite
+    assert(sqlite3_exec(db, "commit", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+
+    sqlite3_finalize(stmt);
+}
+
+static user_iterator sqlite_list_followee(const char* follower) {
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    int result = sqlite3_prepare_v2(
+        sqlite_read_db(), "select followee from followings where follower = ?", -1, &stmt, NULL
+    );
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, follower, (int) strnlen(follower, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    return stmt;
+}
+
+static user_iterator sqlite_list_followers(const char* followee) {
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    int result = sqlite3_prepare_v2(
+        sqlite_read_db(), "select follower from followings where followee = ?", -1, &stmt, NULL
+    );
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, followee, (int) strnlen(followee, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    return stmt;
+}
+
+static bool sqlite_users_next(user_iterator restrict cursor, char* restrict out) {
+    switch (sqlite3_step(cursor)) {
+        case SQLITE_DONE:
+            sqlite3_finalize(cursor);
+            return false;
+        case SQLITE_ROW:
+            assert(sqlite3_column_count(cursor) == 1);
+            memset(out, 0, MAX_USERNAME_LENGTH);
+            strncpy(out, (char*) sqlite3_column_text(cursor, 0), MAX_USERNAME_LENGTH);
+            return true;
+        default:
+            assert(false);
+    }
+}
+
+/**
+ * Le canal est créé au besoin, puis l'adhésion est ajoutée comme un abonnement (c.f. sqlite_follow_unfollow()), dans
+ * une même transaction
+ */
+static enum subscribe_result sqlite_join_channel(const char* member, const char* channel) {
+    // language=sqlite
+    assert(sqlite3_exec(db, "begin immediate", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    int result = sqlite3_prepare_v2(db, "insert or ignore into channels values (?)", -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, channel, (int) strnlen(channel, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+
+    // language=sqlite
+    result = sqlite3_prepare_v2(db, "insert into channel_members (member, channel) values (?, ?)", -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    enum subscribe_result subscribe_result = sqlite_follow_unfollow(stmt, member, channel);
+    sqlite3_finalize(stmt);
+
+    // Un membre inconnu ne doit pas laisser derrière lui un canal vide
+    const char* end = subscribe_result == SUBSCRIBE_RESULT_NOT_FOUND ? "rollback" : "commit";
+    assert(sqlite3_exec(db, end, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    return subscribe_result;
+}
+
+/**
+ * Le canal est supprimé avec son dernier membre
+ */
+static enum subscribe_result sqlite_leave_channel(const char* member, const char* channel) {
+    // language=sqlite
+    assert(sqlite3_exec(db, "begin immediate", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    char* sql = "delete from channel_members where member = ? and channel = ?";
+    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    enum subscribe_result subscribe_result = sqlite_follow_unfollow(stmt, member, channel);
+    sqlite3_finalize(stmt);
+
+    // language=sqlite
+    sql = "delete from channels where name = ?1 and not exists (select 1 from channel_members where channel = ?1)";
+    result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, channel, (int) strnlen(channel, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+
+    // language=sqlite
+    assert(sqlite3_exec(db, "commit", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    return subscribe_result;
+}
+
+static user_iterator sqlite_list_channels() {
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    int result = sqlite3_prepare_v2(db, "select name from channels", -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    return stmt;
+}
+
+static user_iterator sqlite_list_channel_members(const char* channel) {
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    int result = sqlite3_prepare_v2(db, "select member from channel_members where channel = ?", -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, channel, (int) strnlen(channel, MAX_USERNAME_LENGTH), SQLITE_TRANSIENT);
+    return stmt;
+}
+
+/**
+ * Le numéro de séquence d'un twiiiiit est son rowid. Sans `autoincrement`, SQLite prend le plus grand plus un, qui
+ * n'est jamais réutilisé puisque les twiiiiits ne sont supprimés qu'avec leur auteur·ice.
+ */
+static void sqlite_save_twiiiiit(const char* author, const char* message, database_twiiiiit* out) {
+    // language=sqlite
+    char* sql = "insert into twiiiiits values (?, ?, ?)";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    memset(out, 0, sizeof(database_twiiiiit));
+    out->date = ts_now();
+    strncpy(out->author, author, MAX_USERNAME_LENGTH);
+    strncpy(out->message, message, MESSAGE_MAX_LENGTH);
+    sqlite3_bind_int64(stmt, 1, out->date);
+    sqlite3_bind_text(stmt, 2, author, (int) strnlen(author, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, message, (int) strnlen(message, MESSAGE_MAX_LENGTH), SQLITE_STATIC);
+    assert(sqlite3_step_all(stmt) == SQLITE_DONE);
+    out->seq = sqlite3_last_insert_rowid(db);
+    sqlite3_finalize(stmt);
+}
+
+static uint64_t sqlite_last_seq() {
+    sqlite3_stmt* stmt;
+    // language=sqlite
+    int result = sqlite3_prepare_v2(db, "select coalesce(max(rowid), 0) from twiiiiits", -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    uint64_t last_seq = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return last_seq;
+}
+
+static twiiiiit_iterator sqlite_list_missed_twiiiiits(const char* follower, uint64_t after, uint64_t until) {
+    // language=sqlite
+    char* sql = "select t.rowid, t.date, t.author, t.message from followings f inner join twiiiiits t on t.author = f.followee where f.follower = ?1 and t.rowid > ?2 and t.rowid <= ?3 order by t.rowid";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(sqlite_read_db(), sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    // L'itérateur peut survivre au nom, qui est donc copié
+    sqlite3_bind_text(stmt, 1, follower, (int) strnlen(follower, MAX_USERNAME_LENGTH), SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, (int64_t) after);
+    sqlite3_bind_int64(stmt, 3, (int64_t) until);
+    return stmt;
+}
+
+/**
+ * Un seul parcours et une seule transaction pour tous les twiiiiits publiés depuis le lot précédent, ce qui coûte bien
+ * moins cher à FTS5 qu'une insertion par twiiiiit. En mode grappe, le numéro du dernier twiiiiit indexé est lu dans la
+ * transaction : chaque twiiiiit n'est indexé qu'une fois, quel que soit le nœud qui s'en charge.
+ */
+static void sqlite_index_search() {
+    // Rien de nouveau : on évite la transaction
+    if (search_indexed_seq == (int64_t) sqlite_last_seq()) return;
+
+    // language=sqlite
+    assert(sqlite3_exec(db, "begin immediate", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    // language=sqlite
+    char* sql = "insert into twiiiiits_search (rowid, message) select rowid, message from twiiiiits where rowid > (select seq from twiiiiits_search_indexed)";
+    assert(sqlite3_exec(db, sql, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    // language=sqlite
+    sql = "update twiiiiits_search_indexed set seq = (select coalesce(max(rowid), 0) from twiiiiits)";
+    assert(sqlite3_exec(db, sql, NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+    // language=sqlite
+    assert(sqlite3_exec(db, "commit", NULL, NULL, &sqlite_error_message) == SQLITE_OK);
+
+    search_indexed_seq = (int64_t) sqlite_last_seq();
+}
+
+/**
+ * Traduit les mots de la requête en expression FTS5 : chaque mot est cité (la syntaxe de FTS5 n'est donc pas exposée
+ * aux clients) et cherché comme préfixe, et tous doivent être présents. Renvoie false si la requête ne contient aucun
+ * mot.
+ */
+static bool sqlite_search_expression(const char* query, char* out, size_t out_size) {
+    size_t len = 0;
+    bool has_word = false;
+    for (size_t i = 0; i < MESSAGE_MAX_LENGTH && query[i] != 0;) {
+        if (isspace((unsigned char) query[i])) {
+            i++;
+            continue;
+        }
+
+        has_word = true;
+        assert(len + 2 < out_size);
+        out[len++] = '"';
+        for (; i < MESSAGE_MAX_LENGTH && query[i] != 0 && !isspace((unsigned char) query[i]); i++) {
+            assert(len + 4 < out_size);
+            if (query[i] == '"') out[len++] = '"';
+            out[len++] = query[i];
+        }
+        assert(len + 3 < out_size);
+        out[len++] = '"';
+        out[len++] = '*';
+        out[len++] = ' ';
+    }
+
+    out[len] = 0;
+    return has_word;
+}
+
+static twiiiiit_iterator sqlite_search_twiiiiits(const char* query, uint64_t until, uint32_t offset, uint32_t limit) {
+    // Au pire, chaque caractère est un guillemet doublé ou un mot d'une lettre (entouré de `"` et suivi de `* `)
+    char expression[MESSAGE_MAX_LENGTH * 5 + 1];
+    bool has_word = sqlite_search_expression(query, expression, sizeof expression);
+
+    // language=sqlite
+    char* sql = has_word
+        ? "select t.rowid, t.date, t.author, t.message from twiiiiits_search s inner join twiiiiits t on t.rowid = s.rowid where twiiiiits_search match ?1 and s.rowid <= ?4 order by s.rank, t.date desc limit ?2 offset ?3"
+        : "select rowid, date, author, message from twiiiiits where false";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(sqlite_read_db(), sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    if (has_word) {
+        sqlite3_bind_text(stmt, 1, expression, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, limit);
+        sqlite3_bind_int64(stmt, 3, offset);
+        sqlite3_bind_int64(stmt, 4, (int64_t) until);
+    }
+    return stmt;
+}
+
+/**
+ * L'index `twiiiiits (author, date)` se termine par le rowid : les twiiiiits de même date y sont déjà dans l'ordre de
+ * leur numéro de séquence, et la comparaison de `(date, rowid)` n'ajoute pas de tri
+ */
+static twiiiiit_iterator sqlite_list_author_twiiiiits(
+    const char* author,
+    int64_t before,
+    uint64_t before_seq,
+    uint32_t limit
+) {
+    // language=sqlite
+    char* sql = "select rowid, date, author, message from twiiiiits where author = ?1 and (date, rowid) < (?2, ?3) order by date desc, rowid desc limit ?4";
+
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(sqlite_read_db(), sql, -1, &stmt, NULL);
+    assert(result == SQLITE_OK);
+    // Copié : l'itérateur survit au tampon de l'appelant·e (c.f. "/server/timeline.c")
+    sqlite3_bind_text(stmt, 1, author, (int) strnlen(author, MAX_USERNAME_LENGTH), SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, before);
+    sqlite3_bind_int64(stmt, 3, (int64_t) before_seq);
+    sqlite3_bind_int64(stmt, 4, limit);
+    return stmt;
+}
+
+static bool sqlite_twiiiiits_next(twiiiiit_iterator restrict iterator, database_twiiiiit* restrict out) {
+    switch (sqlite3_step(iterator)) {
+        case SQLITE_DONE:
+            sqlite3_finalize(iterator);
+            return false;
+        case SQLITE_ROW:
+            assert(sqlite3_column_count(iterator) == 4);
+            memset(out, 0, sizeof(database_twiiiiit));
+            out->seq = sqlite3_column_int64(iterator, 0);
+            out->date = sqlite3_column_int64(iterator, 1);
+            strncpy(out->author, (char*) sqlite3_column_text(iterator, 2), MAX_USERNAME_LENGTH);
+            strncpy(out->message, (char*) sqlite3_column_text(iterator, 3), MESSAGE_MAX_LENGTH);
+            return true;
+        default:
+            assert(false);
+    }
+}
+
+static void sqlite_twiiiiits_close(twiiiiit_iterator iterator) {
+    sqlite3_finalize(iterator);
+}
+
+const database_engine database_engine_sqlite = {
+    .name = "sqlite",
+    .default_file = "twiiiiiter.sqlite",
+    .shared = true,
+    .initialize = sqlite_initialize,
+    .open_reader = sqlite_open_reader,
+    .close_reader = sqlite_close_reader,
+    .update_user = sqlite_update_user,
+    .cursor = sqlite_cursor,
+    .save_cursor = sqlite_save_cursor,
+    .follow = sqlite_follow,
+    .unfollow = sqlite_unfollow,
+    .follow_batch = sqlite_follow_batch,
+    .list_followee = sqlite_list_followee,
+    .list_followers = sqlite_list_followers,
+    .users_next = sqlite_users_next,
+    .join_channel = sqlite_join_channel,
+    .leave_channel = sqlite_leave_channel,
+    .list_channels = sqlite_list_channels,
+    .list_channel_members = sqlite_list_channel_members,
+    .save_twiiiiit = sqlite_save_twiiiiit,
+    .last_seq = sqlite_last_seq,
+    .list_missed_twiiiiits = sqlite_list_missed_twiiiiits,
+    .index_search = sqlite_index_search,
+    .search_twiiiiits = sqlite_search_twiiiiits,
+    .list_author_twiiiiits = sqlite_list_author_twiiiiits,
+    .twiiiiits_next = sqlite_twiiiiits_next,
+    .twiiiiits_close = sqlite_twiiiiits_close,
+};
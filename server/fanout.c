@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "cluster.h"
+#include "constants.h"
+#include "fanout.h"
+#include "stats.h"
+#include "trace.h"
+#include "twiiiiiter_assert.h"
+
+// Nombre d'abonné·es traité·es entre deux lectures de l'horloge
+#define FANOUT_CLOCK_INTERVAL 32
+
+static fanout_job* fanout_enqueue(server_state* server, const message_s2c* message) {
+    fanout_job* job = malloc(sizeof(fanout_job));
+    assert(job != NULL);
+    job->followers = NULL;
+    job->members = NULL;
+    job->members_len = 0;
+    job->message = *message;
+    job->frame = shared_frame_encode(message);
+    job->started = monotonic_now();
+    job->visited = 0;
+    job->next = NULL;
+
+    if (server->fanout_tail != NULL) server->fanout_tail->next = job;
+    else server->fanout_head = job;
+    server->fanout_tail = job;
+    stats.publishes++;
+    return job;
+}
+
+shared_frame* fanout_start(server_state* server, const char* author, const message_s2c* message) {
+    fanout_job* job = fanout_enqueue(server, message);
+    job->followers = database_list_followers(author);
+    return job->frame;
+}
+
+void fanout_start_channel(server_state* server, const user_name* members, size_t count, const message_s2c* message) {
+    fanout_job* job = fanout_enqueue(server, message);
+    job->members = malloc(count * sizeof(user_name));
+    assert(count == 0 || job->members != NULL);
+    if (count > 0) memcpy(job->members, members, count * sizeof(user_name));
+    job->members_len = count;
+}
+
+/**
+ * Écrit dans `name` le prochain nom à qui remettre le message, et renvoie false s'il n'y en a plus
+ */
+static bool fanout_next(fanout_job* job, char* name) {
+    if (job->followers != NULL) return database_users_next(job->followers, name);
+    if (job->visited == job->members_len) return false;
+    memcpy(name, job->members[job->visited], sizeof(user_name));
+    return true;
+}
+
+static void fanout_deliver(const char* follower_name, const fanout_job* job) {
+    user_list_node* sessions = user_list_sessions(follower_name);
+    if (job->followers == NULL) {
+        // Les messages de canaux ne sont pas rattrapés : ils sont remis même pendant un rattrapage
+        for (user_list_node* session = sessions; session != NULL; session = session->next_session) {
+            send_shared_frame(session, job->frame);
+        }
+    } else if (sessions != NULL) {
+        for (user_list_node* session = sessions; session != NULL; session = session->next_session) {
+            // Le rattrapage en cours de la session le remettra, dans l'ordre, c.f. "catchup.h"
+            if (session->catchup == NULL) send_shared_frame(session, job->frame);
+        }
+    } else {
+        // Peut-être connecté·e à un autre nœud de la grappe
+        cluster_peer* peer = cluster_find_online(follower_name);
+        if (peer != NULL) cluster_deliver(peer, follower_name, &job->message.received_message);
+    }
+}
+
+/**
+ * Avance une tâche jusqu'à `deadline`. Renvoie true si elle est terminée.
+ */
+static bool fanout_job_step(fanout_job* job, int64_t deadline) {
+    char follower_name[MAX_USERNAME_LENGTH + 1];
+    while (true) {
+        for (int i = 0; i < FANOUT_CLOCK_INTERVAL; i++) {
+            if (!fanout_next(job, follower_name)) return true;
+            job->visited++;
+            fanout_deliver(follower_name, job);
+        }
+
+        if (monotonic_now() >= deadline) return false;
+    }
+}
+
+bool fanout_run(server_state* server) {
+    TRACE_SCOPE(fanout_run);
+    int64_t deadline = monotonic_now() + server->fanout_slice_us;
+
+    while (server->fanout_head != NULL) {
+        fanout_job* job = server->fanout_head;
+        if (!fanout_job_step(job, deadline)) return true;
+
+        stats_record_fanout(job->visited, monotonic_now() - job->started);
+        server->fanout_head = job->next;
+        if (server->fanout_head == NULL) server->fanout_tail = NULL;
+        shared_frame_release(job->frame); // Encore référencée par les files des abonné·es en retard
+        free(job->members);
+        free(job);
+
+        if (monotonic_now() >= deadline) break;
+    }
+
+    return server->fanout_head != NULL;
+}
@@ -0,0 +1,58 @@
+#ifndef _FANOUT_H_
+#define _FANOUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "codec.h"
+#include "database.h"
+#include "outbound.h"
+#include "server.h"
+
+/**
+ * Diffusion d'un twiiiiit à tou·tes les abonné·es de son auteur·ice
+ *
+ * La diffusion est une tâche qui peut être interrompue puis reprise : la boucle d'évènements n'y consacre qu'une
+ * tranche de temps limitée entre deux appels à epoll_wait(), de sorte qu'un compte très suivi ne bloque pas les autres
+ * clients. Les tâches sont traitées dans l'ordre de publication, ce qui préserve l'ordre des twiiiiits pour chaque
+ * abonné·e.
+ *
+ * Le twiiiiit n'est encodé qu'une fois, dans une trame partagée par tou·tes les destinataires (c.f. "outbound.h").
+ *
+ * Les messages des canaux (c.f. "channel.h") passent par la même file, avec la liste de leurs membres à la place de
+ * l'itérateur sur les abonné·es.
+ */
+typedef struct fanout_job_s {
+    user_iterator followers; // NULL pour un canal
+    user_name* members; // Copie des membres du canal
+    size_t members_len;
+    message_s2c message; // Pour les abonné·es connecté·es à un autre nœud de la grappe
+    shared_frame* frame;
+    int64_t started; // Horloge monotone, c.f. monotonic_now()
+    size_t visited; // Nombre d'abonné·es déjà traité·es
+
+    struct fanout_job_s* next;
+} fanout_job;
+
+/**
+ * Met en file la diffusion d'un twiiiiit (MESSAGE_S2C_RECEIVED_MESSAGE) aux abonné·es de `author`, et renvoie sa trame
+ * encodée, à envoyer aussi à l'auteur·ice (elle appartient à la diffusion)
+ */
+shared_frame* fanout_start(server_state* server, const char* author, const message_s2c* message);
+
+/**
+ * Met en file la diffusion d'un message de canal (MESSAGE_S2C_CHANNEL_MESSAGE) aux sessions de ce nœud des `count`
+ * membres de `members`, qui sont recopié·es
+ *
+ * Les membres connecté·es à d'autres nœuds n'y sont pas cherché·es : chaque nœud diffuse le message à ses propres
+ * sessions, c.f. channel_deliver_remote().
+ */
+void fanout_start_channel(server_state* server, const user_name* members, size_t count, const message_s2c* message);
+
+/**
+ * Avance les diffusions en attente pendant au plus `server->fanout_slice_us` microsecondes. Renvoie true s'il reste
+ * du travail.
+ */
+bool fanout_run(server_state* server);
+
+#endif
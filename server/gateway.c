@@ -0,0 +1,353 @@
+#define _GNU_SOURCE // accept4()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "gateway.h"
+#include "handoff.h"
+#include "listener.h"
+#include "log.h"
+#include "low_latency.h"
+#include "mux.h"
+#include "record.h"
+#include "twiiiiiter_assert.h"
+
+// Trames lues en une fois par lien
+#define GATEWAY_BUFFER_FRAMES 256
+#define GATEWAY_BUFFER_SIZE (GATEWAY_BUFFER_FRAMES * MUX_FRAME_SIZE)
+// Au-delà, une passerelle qui ne lit plus ses trames est déconnectée, avec toutes ses sessions
+#define GATEWAY_MAX_PENDING_SIZE ((1 << 20) * MUX_FRAME_SIZE)
+// Les passerelles numérotent leurs sessions à partir de 0 en réutilisant les numéros libres
+#define GATEWAY_MAX_SESSIONS (1 << 20)
+
+struct gateway_link_s {
+    int fd;
+    bool closed; // Plus rien n'est envoyé pendant la déconnexion des sessions d'un lien fermé
+
+    char receive_buffer[GATEWAY_BUFFER_SIZE];
+    size_t receive_len;
+    // Trames pas encore écrites. Le socket est non bloquant : celles que le noyau n'accepte pas attendent EPOLLOUT
+    // (`writable_watched`), pour que le serveur et une passerelle ne puissent pas s'attendre l'un l'autre.
+    char* send_buffer;
+    size_t send_len;
+    size_t send_cap;
+    bool writable_watched;
+
+    // Sessions ouvertes, indexées par leur identifiant
+    user_list_node** sessions;
+    size_t sessions_cap;
+
+    int32_t handoff_index; // Rang du lien dans l'état transmis au redémarrage, c.f. "handoff.h"
+
+    struct gateway_link_s* next;
+};
+
+static listener_set gateway_listeners;
+static gateway_link* links = NULL;
+
+static void gateway_watch(server_state* server, gateway_link* link, bool writable) {
+    if (link->writable_watched == writable) return;
+
+    struct epoll_event event = { .events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.fd = link->fd };
+    if (epoll_ctl(server->epoll, EPOLL_CTL_MOD, link->fd, &event) != 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't watch gateway %d for writing: errno %d", link->fd, errno);
+        return;
+    }
+    link->writable_watched = writable;
+}
+
+/**
+ * Écrit ce que le socket accepte des trames en attente, et attend EPOLLOUT pour le reste. Renvoie false en cas
+ * d'erreur, le lien est alors à retirer.
+ */
+static bool gateway_write(server_state* server, gateway_link* link) {
+    size_t written = 0;
+    while (written < link->send_len) {
+        // MSG_NOSIGNAL : une passerelle disparue ne doit pas arrêter le serveur
+        ssize_t len = send(link->fd, link->send_buffer + written, link->send_len - written, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            log_limited(LOG_LEVEL_WARNING, "Couldn't write to gateway %d: errno %d", link->fd, errno);
+            return false;
+        }
+        written += len;
+    }
+
+    memmove(link->send_buffer, link->send_buffer + written, link->send_len - written);
+    link->send_len -= written;
+    gateway_watch(server, link, link->send_len > 0);
+    return true;
+}
+
+static bool gateway_push(gateway_link* link, const mux_frame* frame) {
+    if (link->closed) return false;
+
+    if (link->send_len + MUX_FRAME_SIZE > GATEWAY_MAX_PENDING_SIZE) {
+        log_limited(LOG_LEVEL_WARNING, "Gateway %d isn't reading its messages, disconnecting", link->fd);
+        // La lecture verra la fin du flux et retirera le lien, ce qui ne peut pas se faire pendant une diffusion
+        link->closed = true;
+        shutdown(link->fd, SHUT_RDWR);
+        return false;
+    }
+    if (link->send_len + MUX_FRAME_SIZE > link->send_cap) {
+        link->send_cap = link->send_cap ? link->send_cap * 2 : GATEWAY_BUFFER_SIZE;
+        link->send_buffer = realloc(link->send_buffer, link->send_cap);
+        assert(link->send_buffer != NULL);
+    }
+
+    mux_encode(frame, link->send_buffer + link->send_len);
+    link->send_len += MUX_FRAME_SIZE;
+    return true;
+}
+
+bool gateway_send(const user_list_node* user, const char data[IO_BUFFER_SIZE]) {
+    mux_frame frame = { .kind = MUX_DATA, .session = user->session };
+    memcpy(frame.payload, data, IO_BUFFER_SIZE);
+    return gateway_push(user->gateway, &frame);
+}
+
+void gateway_close_session(user_list_node* user) {
+    gateway_link* link = user->gateway;
+    log_info("Session %u of gateway %d is leaving", user->session, link->fd);
+    link->sessions[user->session] = NULL;
+    gateway_push(link, &(mux_frame) { .kind = MUX_CLOSE, .session = user->session });
+}
+
+static void gateway_link_remove(server_state* server, gateway_link* link);
+
+void gateway_flush(server_state* server) {
+    for (gateway_link* link = links, *next; link != NULL; link = next) {
+        next = link->next;
+        // Un lien qui attend EPOLLOUT n'accepterait rien de plus
+        if (link->send_len == 0 || link->writable_watched || link->closed) continue;
+        if (!gateway_write(server, link)) gateway_link_remove(server, link);
+    }
+}
+
+/**
+ * Écrit toutes les trames en attente d'un lien, en attendant au besoin jusqu'à `deadline` (c.f. monotonic_now())
+ */
+static bool gateway_write_all(server_state* server, gateway_link* link, int64_t deadline) {
+    while (link->send_len > 0) {
+        if (link->closed || !gateway_write(server, link)) return false;
+        if (link->send_len == 0) break;
+
+        int64_t remaining_us = deadline - monotonic_now();
+        struct pollfd writable = { .fd = link->fd, .events = POLLOUT };
+        if (remaining_us <= 0 || poll(&writable, 1, (remaining_us + 999) / 1000) <= 0) return false;
+    }
+    return true;
+}
+
+void gateway_drain(server_state* server, int64_t deadline) {
+    for (gateway_link* link = links, *next; link != NULL; link = next) {
+        next = link->next;
+        if (gateway_write_all(server, link, deadline)) continue;
+        // Le nouveau processus ne saurait pas où en est la trame interrompue
+        log_info("Gateway %d didn't read its messages in time", link->fd);
+        gateway_link_remove(server, link);
+    }
+}
+
+static void gateway_sessions_reserve(gateway_link* link, uint32_t session) {
+    if (session >= link->sessions_cap) {
+        size_t cap = link->sessions_cap ?: 1024;
+        while (cap <= session) cap *= 2;
+        link->sessions = realloc(link->sessions, cap * sizeof *link->sessions);
+        assert(link->sessions != NULL);
+        memset(link->sessions + link->sessions_cap, 0, (cap - link->sessions_cap) * sizeof *link->sessions);
+        link->sessions_cap = cap;
+    }
+}
+
+static void gateway_open_session(server_state* server, gateway_link* link, uint32_t session) {
+    if (session >= GATEWAY_MAX_SESSIONS || (session < link->sessions_cap && link->sessions[session] != NULL)) {
+        log_limited(LOG_LEVEL_WARNING, "Gateway %d opened invalid session %u", link->fd, session);
+        return;
+    }
+
+    gateway_sessions_reserve(link, session);
+    log_info("Session %u of gateway %d is joining", session, link->fd);
+    user_list_node* user = user_list_node_insert(&server->users, -1);
+    user->gateway = link;
+    user->session = session;
+    link->sessions[session] = user;
+    timer_schedule(&server->timers, &user->idle_timer, server->idle_timeout_ticks);
+    record_open(user);
+}
+
+static void gateway_process_frame(server_state* server, gateway_link* link, const mux_frame* frame) {
+    if (frame->kind == MUX_OPEN) {
+        gateway_open_session(server, link, frame->session);
+        return;
+    }
+
+    // Une session fermée par le serveur peut encore recevoir des trames déjà en route
+    user_list_node* user = frame->session < link->sessions_cap ? link->sessions[frame->session] : NULL;
+    if (user == NULL) return;
+
+    if (frame->kind == MUX_CLOSE) {
+        // kick_user() confirme la fermeture à la passerelle
+        kick_user(server, -1, user);
+    } else if (!handle_frame(server, user, frame->payload)) {
+        log_limited(LOG_LEVEL_WARNING, "Invalid message sent by session %u of gateway %d", user->session, link->fd);
+    }
+}
+
+static gateway_link* gateway_link_add(server_state* server, int fd) {
+    gateway_link* link = calloc(1, sizeof(gateway_link));
+    assert(link != NULL);
+    link->fd = fd;
+    link->next = links;
+    links = link;
+    // Les liens repris d'un redémarrage ne sont pas forcément non bloquants
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event link_epollin = { .events = EPOLLIN, .data.fd = fd };
+    assert(epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &link_epollin) == 0);
+    low_latency_configure_socket(fd);
+    return link;
+}
+
+static void gateway_link_remove(server_state* server, gateway_link* link) {
+    log_info("Gateway %d is leaving", link->fd);
+
+    link->closed = true;
+    for (size_t session = 0; session < link->sessions_cap; session++) {
+        if (link->sessions[session] != NULL) kick_user(server, -1, link->sessions[session]);
+    }
+
+    for (gateway_link** node = &links; *node != NULL; node = &(*node)->next) {
+        if (*node == link) {
+            *node = link->next;
+            break;
+        }
+    }
+
+    epoll_ctl(server->epoll, EPOLL_CTL_DEL, link->fd, NULL);
+    close(link->fd);
+    free(link->send_buffer);
+    free(link->sessions);
+    free(link);
+}
+
+void gateway_initialize(server_state* server) {
+    // Les sockets d'écoute peuvent venir de l'ancien processus, c.f. gateway_handoff_restore()
+    if (gateway_listeners.len == 0) {
+        const char* specs = getenv("TWIIIIITER_GATEWAY_LISTEN");
+        if (specs == NULL) return;
+        listeners_open(&gateway_listeners, specs);
+    }
+    listeners_register(&gateway_listeners, server->epoll, "Gateway listening");
+}
+
+bool gateway_handle_event(server_state* server, struct epoll_event* event) {
+    if (listeners_contains(&gateway_listeners, event->data.fd)) {
+        int fd = accept4(event->data.fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) {
+            log_limited(LOG_LEVEL_WARNING, "Couldn't accept a gateway: errno %d", errno);
+            return true;
+        }
+
+        gateway_link_add(server, fd);
+        log_info("Gateway %d is joining", fd);
+        return true;
+    }
+
+    gateway_link* link = links;
+    while (link != NULL && link->fd != event->data.fd) link = link->next;
+    if (link == NULL) return false;
+
+    if ((event->events & EPOLLOUT) && !link->closed && !gateway_write(server, link)) {
+        gateway_link_remove(server, link);
+        return true;
+    }
+    if (!(event->events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return true;
+
+    size_t free_space = GATEWAY_BUFFER_SIZE - link->receive_len;
+    ssize_t bytes_read = read(link->fd, link->receive_buffer + link->receive_len, free_space);
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (bytes_read <= 0) {
+        gateway_link_remove(server, link);
+        return true;
+    }
+    link->receive_len += bytes_read;
+
+    // Toutes les trames complètes d'une seule lecture, pour toutes les sessions
+    size_t offset = 0;
+    for (; offset + MUX_FRAME_SIZE <= link->receive_len; offset += MUX_FRAME_SIZE) {
+        mux_frame frame;
+        if (mux_decode(link->receive_buffer + offset, &frame)) gateway_process_frame(server, link, &frame);
+    }
+    memmove(link->receive_buffer, link->receive_buffer + offset, link->receive_len - offset);
+    link->receive_len -= offset;
+
+    return true;
+}
+
+void gateway_handoff_save(handoff_writer* writer) {
+    for (size_t i = 0; i < gateway_listeners.len; i++) {
+        handoff_record record = { .kind = HANDOFF_GATEWAY_LISTENER, .listener = gateway_listeners.listeners[i] };
+        handoff_write(writer, &record, record.listener.fd);
+    }
+
+    int32_t index = 0;
+    for (gateway_link* link = links; link != NULL; link = link->next) {
+        handoff_record record = { .kind = HANDOFF_GATEWAY_LINK, .gateway_link.receive_len = link->receive_len };
+        memcpy(record.gateway_link.receive_buffer, link->receive_buffer, link->receive_len);
+        handoff_write(writer, &record, link->fd);
+        link->handoff_index = index++;
+    }
+
+    for (gateway_link* link = links; link != NULL; link = link->next) {
+        for (size_t session = 0; session < link->sessions_cap; session++) {
+            user_list_node* user = link->sessions[session];
+            if (user != NULL) handoff_write_user(writer, user, link->handoff_index);
+        }
+    }
+}
+
+void gateway_handoff_restore(server_state* server, const handoff_record* record, int fd) {
+    if (record->kind == HANDOFF_GATEWAY_LISTENER) {
+        assert(gateway_listeners.len < MAX_LISTENERS);
+        listener* restored = &gateway_listeners.listeners[gateway_listeners.len++];
+        *restored = record->listener;
+        restored->fd = fd;
+    } else if (record->kind == HANDOFF_GATEWAY_LINK) {
+        // Les liens sont transmis avant leurs sessions, et dans l'ordre de leur rang
+        gateway_link* link = gateway_link_add(server, fd);
+        memcpy(link->receive_buffer, record->gateway_link.receive_buffer, record->gateway_link.receive_len);
+        link->receive_len = record->gateway_link.receive_len;
+        link->handoff_index = link->next != NULL ? link->next->handoff_index + 1 : 0;
+    } else {
+        gateway_link* link = links;
+        while (link != NULL && link->handoff_index != record->user.gateway_link) link = link->next;
+        assert(link != NULL);
+
+        gateway_sessions_reserve(link, record->user.session);
+        user_list_node* user = handoff_restore_user(server, record, -1);
+        user->gateway = link;
+        link->sessions[user->session] = user;
+    }
+}
+
+void gateway_shutdown(server_state* server, int64_t deadline) {
+    while (links != NULL) {
+        gateway_link* link = links;
+        links = link->next;
+        // Les passerelles qui lisent encore reçoivent la fermeture de leurs sessions
+        gateway_write_all(server, link, deadline);
+        close(link->fd);
+        free(link->send_buffer);
+        free(link->sessions);
+        free(link);
+    }
+
+    listeners_close(&gateway_listeners);
+}
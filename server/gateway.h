@@ -0,0 +1,74 @@
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+#include "codec.h"
+#include "handoff.h"
+#include "server.h"
+
+/**
+ * Liens avec les passerelles (c.f. "/gateway/main.c")
+ *
+ * Une passerelle garde les connexions des clients et les multiplexe sur quelques connexions au serveur (c.f.
+ * "/common/mux.h"). Chaque client y devient une session, qui a son propre user_list_node comme un client direct, mais
+ * pas de descripteur : ses trames passent par gateway_send(). Les trames sortantes sont accumulées par lien et
+ * écrites en une fois par gateway_flush(), ce qui remplace un write() par message et par client.
+ *
+ * Comme pour les clients directs (c.f. "outbound.h"), les liens sont non bloquants : ce que le noyau n'accepte pas
+ * attend EPOLLOUT. Une passerelle qui ne lit plus ses trames, ou dont le lien est en erreur, est déconnectée avec
+ * toutes ses sessions.
+ */
+
+typedef struct gateway_link_s gateway_link;
+
+/**
+ * Écoute les passerelles sur les adresses de TWIIIIITER_GATEWAY_LISTEN (même format que TWIIIIITER_LISTEN), s'il est
+ * défini
+ */
+void gateway_initialize(server_state* server);
+
+/**
+ * Traite un évènement epoll s'il concerne une passerelle. Renvoie false sinon.
+ */
+bool gateway_handle_event(server_state* server, struct epoll_event* event);
+
+/**
+ * Met en file une trame encodée pour une session. Elle n'est écrite qu'au prochain gateway_flush().
+ */
+bool gateway_send(const user_list_node* user, const char data[IO_BUFFER_SIZE]);
+
+/**
+ * Signale à la passerelle que la session est terminée, et l'oublie. Le nœud reste à libérer par l'appelant.
+ */
+void gateway_close_session(user_list_node* user);
+
+/**
+ * Écrit les trames en attente sur chaque lien, à appeler à chaque tour de la boucle d'évènements. Les liens en erreur
+ * sont retirés, et leurs sessions déconnectées.
+ */
+void gateway_flush(server_state* server);
+
+/**
+ * Écrit toutes les trames en attente, en attendant au besoin jusqu'à `deadline` (c.f. monotonic_now()). Les liens
+ * qui n'ont pas tout reçu à temps sont retirés.
+ */
+void gateway_drain(server_state* server, int64_t deadline);
+
+/**
+ * Transmet les sockets d'écoute des passerelles, les liens et leurs sessions au nouveau processus (c.f. "handoff.h")
+ */
+void gateway_handoff_save(handoff_writer* writer);
+
+/**
+ * Reprend un élément transmis par gateway_handoff_save(), avant gateway_initialize()
+ */
+void gateway_handoff_restore(server_state* server, const handoff_record* record, int fd);
+
+/**
+ * Ferme les liens, après leur avoir écrit les trames en attente s'ils les lisent avant `deadline`
+ */
+void gateway_shutdown(server_state* server, int64_t deadline);
+
+#endif
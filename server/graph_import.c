@@ -0,0 +1,119 @@
+/**
+ * Import en masse d'un graphe d'abonnements
+ *
+ * Lit des lignes "abonné·e abonnement" (noms séparés par des blancs) sur l'entrée standard ou dans un fichier, et les
+ * applique avec database_follow_batch(), un lot par abonné·e : c'est le même chemin que MESSAGE_C2S_SUBSCRIBE_BATCH,
+ * avec une seule transaction par lot. Les noms rencontrés sont enregistrés comme lors d'une connexion.
+ *
+ * Le serveur doit être arrêté pendant l'import si le moteur ne peut pas être partagé (c.f. "log").
+ *
+ * Usage : twiiiiiter-graph-import ENGINE FILE [EDGES]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "database_engine.h"
+#include "twiiiiiter_assert.h"
+
+// Nombre maximal d'abonnements appliqués par transaction
+#define IMPORT_BATCH_SIZE 1024
+
+typedef struct {
+    user_name follower;
+    user_name followee;
+} import_edge;
+
+static int compare_edges(const void* a, const void* b) {
+    return strcmp(((const import_edge*) a)->follower, ((const import_edge*) b)->follower);
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const user_name*) a, *(const user_name*) b);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s ENGINE FILE [EDGES]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* input = argc > 3 ? fopen(argv[3], "r") : stdin;
+    if (input == NULL) {
+        perror(argv[3]);
+        return 1;
+    }
+
+    import_edge* edges = NULL;
+    size_t edges_len = 0, edges_cap = 0;
+    size_t skipped = 0;
+    char line[256];
+    while (fgets(line, sizeof line, input) != NULL) {
+        char follower[sizeof line], followee[sizeof line];
+        if (sscanf(line, "%s %s", follower, followee) != 2) continue;
+        if (strlen(follower) > MAX_USERNAME_LENGTH || strlen(followee) > MAX_USERNAME_LENGTH) {
+            skipped++;
+            continue;
+        }
+
+        if (edges_len == edges_cap) {
+            edges_cap = edges_cap ? edges_cap * 2 : 1024;
+            edges = realloc(edges, edges_cap * sizeof *edges);
+            assert(edges != NULL);
+        }
+        import_edge* edge = &edges[edges_len++];
+        memset(edge, 0, sizeof *edge);
+        strcpy(edge->follower, follower);
+        strcpy(edge->followee, followee);
+    }
+    if (input != stdin) fclose(input);
+
+    database_initialize(argv[1], argv[2]);
+    int64_t start = ts_now();
+
+    // Chaque nom n'est enregistré qu'une fois
+    user_name* names = malloc(2 * edges_len * sizeof(user_name) + 1);
+    assert(names != NULL);
+    for (size_t i = 0; i < edges_len; i++) {
+        memcpy(names[2 * i], edges[i].follower, sizeof(user_name));
+        memcpy(names[2 * i + 1], edges[i].followee, sizeof(user_name));
+    }
+    qsort(names, 2 * edges_len, sizeof(user_name), compare_names);
+    size_t user_count = 0;
+    for (size_t i = 0; i < 2 * edges_len; i++) {
+        if (i > 0 && strcmp(names[i], names[i - 1]) == 0) continue;
+        database_update_user(names[i], false);
+        user_count++;
+    }
+    free(names);
+
+    qsort(edges, edges_len, sizeof *edges, compare_edges);
+
+    user_name followees[IMPORT_BATCH_SIZE];
+    enum subscribe_result results[IMPORT_BATCH_SIZE];
+    size_t result_counts[3] = { 0 };
+    size_t batch_count = 0;
+    for (size_t i = 0; i < edges_len;) {
+        size_t len = 0;
+        const char* follower = edges[i].follower;
+        while (i < edges_len && len < IMPORT_BATCH_SIZE && strcmp(edges[i].follower, follower) == 0) {
+            memcpy(followees[len++], edges[i++].followee, sizeof(user_name));
+        }
+
+        database_follow_batch(follower, (const user_name*) followees, len, false, results);
+        for (size_t j = 0; j < len; j++) result_counts[results[j]]++;
+        batch_count++;
+    }
+    double seconds = (double) (ts_now() - start) / 1e6;
+    free(edges);
+
+    printf("[IMPORT] %zu users, %zu follows in %zu batches in %.3fs (%.0f follows/s)\n",
+           user_count, edges_len, batch_count, seconds, edges_len / seconds);
+    printf("[IMPORT] added=%zu unchanged=%zu rejected=%zu skipped=%zu\n",
+           result_counts[SUBSCRIBE_RESULT_OK], result_counts[SUBSCRIBE_RESULT_UNCHANGED],
+           result_counts[SUBSCRIBE_RESULT_NOT_FOUND], skipped);
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+#define _GNU_SOURCE // accept4()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "catchup.h"
+#include "clock.h"
+#include "database.h"
+#include "fanout.h"
+#include "gateway.h"
+#include "handoff.h"
+#include "log.h"
+#include "low_latency.h"
+#include "read_pool.h"
+#include "record.h"
+#include "twiiiiiter_assert.h"
+
+#define HANDOFF_MAGIC 0x74776877
+// Éléments par message, et donc descripteurs au plus : le noyau en refuse plus de 253 (SCM_MAX_FD) par message
+#define HANDOFF_CHUNK_RECORDS 64
+// Temps laissé au nouveau processus pour confirmer la réception
+#define HANDOFF_ACK_TIMEOUT_S 5
+// Temps laissé aux clients directs pour lire leurs trames en attente
+#define HANDOFF_DRAIN_TIMEOUT_MS 1000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t record_size; // Deux versions dont les formats diffèrent ne peuvent pas se transmettre leur état
+    uint32_t count;
+    bool last;
+} handoff_header;
+
+struct handoff_writer_s {
+    int socket;
+    bool failed;
+
+    handoff_header header;
+    handoff_record records[HANDOFF_CHUNK_RECORDS];
+    int fds[HANDOFF_CHUNK_RECORDS];
+    size_t fd_count;
+};
+
+static struct sockaddr_un handoff_address = { .sun_family = AF_UNIX };
+static int handoff_fd = -1;
+
+// État reçu par handoff_receive(), en attente de handoff_restore()
+static handoff_record* received = NULL;
+static int* received_fds = NULL;
+static size_t received_len = 0;
+
+static bool handoff_has_fd(const handoff_record* record) {
+    return record->kind != HANDOFF_USER || record->user.gateway_link < 0;
+}
+
+/**
+ * Lit TWIIIIITER_HANDOFF_PATH dans `handoff_address`. Renvoie false s'il n'est pas défini.
+ */
+static bool handoff_address_from_env() {
+    const char* path = getenv("TWIIIIITER_HANDOFF_PATH");
+    if (path == NULL) return false;
+    if (strlen(path) == 0 || strlen(path) >= sizeof handoff_address.sun_path) {
+        log_error("Invalid TWIIIIITER_HANDOFF_PATH: %s", path);
+        exit(1);
+    }
+
+    strcpy(handoff_address.sun_path, path);
+    return true;
+}
+
+static void handoff_flush(handoff_writer* writer, bool last) {
+    if (writer->failed) return;
+
+    writer->header.magic = HANDOFF_MAGIC;
+    writer->header.record_size = sizeof(handoff_record);
+    writer->header.last = last;
+    struct iovec iov[2] = {
+        { .iov_base = &writer->header, .iov_len = sizeof writer->header },
+        { .iov_base = writer->records, .iov_len = writer->header.count * sizeof(handoff_record) },
+    };
+    union {
+        char buffer[CMSG_SPACE(sizeof writer->fds)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message = { .msg_iov = iov, .msg_iovlen = 2 };
+    if (writer->fd_count > 0) {
+        message.msg_control = control.buffer;
+        message.msg_controllen = CMSG_SPACE(writer->fd_count * sizeof(int));
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(writer->fd_count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), writer->fds, writer->fd_count * sizeof(int));
+    }
+
+    if (sendmsg(writer->socket, &message, MSG_NOSIGNAL) < 0) {
+        log_error("Couldn't hand off the state: errno %d", errno);
+        writer->failed = true;
+    }
+
+    writer->header.count = 0;
+    writer->fd_count = 0;
+}
+
+void handoff_write(handoff_writer* writer, const handoff_record* record, int fd) {
+    assert(handoff_has_fd(record) == (fd >= 0));
+    if (writer->header.count == HANDOFF_CHUNK_RECORDS) handoff_flush(writer, false);
+
+    writer->records[writer->header.count++] = *record;
+    if (fd >= 0) writer->fds[writer->fd_count++] = fd;
+}
+
+void handoff_write_user(handoff_writer* writer, const user_list_node* user, int32_t gateway_link) {
+    handoff_record record = {
+        .kind = HANDOFF_USER,
+        .user = {
+            .gateway_link = gateway_link,
+            .session = user->session,
+            .acked_seq = user->acked_seq,
+            .frame_receive_buffer_len = user->frame_receive_buffer_len,
+        },
+    };
+    memcpy(record.user.user_name, user->user_name, MAX_USERNAME_LENGTH);
+    if (user->frame_receive_buffer_len > 0) {
+        memcpy(record.user.frame_receive_buffer, user->frame_receive_buffer, user->frame_receive_buffer_len);
+    }
+    memcpy(record.user.rate_limits, user_list_node_rate_limits(user), sizeof record.user.rate_limits);
+    handoff_write(writer, &record, gateway_link < 0 ? user->fd : -1);
+}
+
+bool handoff_receive() {
+    if (!handoff_address_from_env()) return false;
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    assert(sock >= 0);
+    if (connect(sock, (struct sockaddr*) &handoff_address, sizeof handoff_address) != 0) {
+        // Personne à remplacer
+        close(sock);
+        return false;
+    }
+
+    log_info("Receiving the state of the running server");
+    static handoff_header header;
+    static handoff_record records[HANDOFF_CHUNK_RECORDS];
+    size_t cap = 0;
+    do {
+        struct iovec iov[2] = {
+            { .iov_base = &header, .iov_len = sizeof header },
+            { .iov_base = records, .iov_len = sizeof records },
+        };
+        union {
+            char buffer[CMSG_SPACE(HANDOFF_CHUNK_RECORDS * sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        struct msghdr message = {
+            .msg_iov = iov,
+            .msg_iovlen = 2,
+            .msg_control = control.buffer,
+            .msg_controllen = sizeof control.buffer,
+        };
+
+        ssize_t len = recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+        if (len < (ssize_t) sizeof header || message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+            log_error("Couldn't receive the state of the running server: errno %d", len < 0 ? errno : 0);
+            exit(1);
+        }
+        if (header.magic != HANDOFF_MAGIC || header.record_size != sizeof(handoff_record)) {
+            log_error("The running server is an incompatible version, it must be stopped first");
+            exit(1);
+        }
+        assert(len == (ssize_t) (sizeof header + header.count * sizeof(handoff_record)));
+
+        size_t fd_count = 0;
+        int* fds = NULL;
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            fds = (int*) CMSG_DATA(cmsg);
+            fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        }
+
+        if (received_len + header.count > cap) {
+            cap = (cap ?: HANDOFF_CHUNK_RECORDS) * 2;
+            received = realloc(received, cap * sizeof *received);
+            received_fds = realloc(received_fds, cap * sizeof *received_fds);
+            assert(received != NULL && received_fds != NULL);
+        }
+
+        size_t next_fd = 0;
+        for (size_t i = 0; i < header.count; i++) {
+            received[received_len] = records[i];
+            received_fds[received_len] = -1;
+            if (handoff_has_fd(&records[i])) {
+                assert(next_fd < fd_count);
+                memcpy(&received_fds[received_len], &fds[next_fd++], sizeof(int));
+            }
+            received_len++;
+        }
+    } while (!header.last);
+
+    // L'ancien processus s'arrête dès la confirmation reçue : la fin de la connexion signifie qu'il a libéré la base
+    char ack = 1;
+    assert(send(sock, &ack, 1, MSG_NOSIGNAL) == 1);
+    while (recv(sock, &ack, 1, 0) > 0);
+    close(sock);
+
+    log_info("Received %zu sockets and clients", received_len);
+    return true;
+}
+
+user_list_node* handoff_restore_user(server_state* server, const handoff_record* record, int fd) {
+    user_list_node* user = user_list_node_insert(&server->users, fd);
+    user->session = record->user.session;
+    user->acked_seq = record->user.acked_seq;
+    // Les sessions d'un même nom ont toutes été acceptées par l'ancien processus
+    if (record->user.user_name[0] != 0) user_list_node_attach(user, record->user.user_name, SIZE_MAX);
+    size_t partial_len = record->user.frame_receive_buffer_len;
+    if (partial_len > 0) user_list_node_hold_partial_frame(user, record->user.frame_receive_buffer, partial_len);
+    // Les sessions d'un même nom en ont chacune une copie, identique
+    memcpy(user_list_node_rate_limits(user), record->user.rate_limits, sizeof record->user.rate_limits);
+    record_open(user);
+
+    if (fd >= 0) {
+        // Au cas où l'ancienne version utilisait encore des sockets bloquants
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        low_latency_configure_socket(fd);
+        struct epoll_event socket_epollin = { .events = EPOLLIN, .data.fd = fd };
+        assert(epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &socket_epollin) == 0);
+    }
+    timer_schedule(&server->timers, &user->idle_timer, server->idle_timeout_ticks);
+    return user;
+}
+
+void handoff_restore(server_state* server) {
+    for (size_t i = 0; i < received_len; i++) {
+        const handoff_record* record = &received[i];
+        int fd = received_fds[i];
+
+        if (record->kind == HANDOFF_LISTENER) {
+            assert(server->listeners.len < MAX_LISTENERS);
+            listener* restored = &server->listeners.listeners[server->listeners.len++];
+            *restored = record->listener;
+            restored->fd = fd;
+        } else if (record->kind == HANDOFF_USER && record->user.gateway_link < 0) {
+            handoff_restore_user(server, record, fd);
+        } else {
+            gateway_handoff_restore(server, record, fd);
+        }
+    }
+
+    free(received);
+    free(received_fds);
+    received = NULL;
+    received_fds = NULL;
+    received_len = 0;
+}
+
+void handoff_initialize(server_state* server) {
+    if (!handoff_address_from_env()) return;
+    if (getenv("TWIIIIITER_CLUSTER_PORT") != NULL) {
+        log_warning("Restarting without downtime isn't supported in a cluster, ignoring TWIIIIITER_HANDOFF_PATH");
+        return;
+    }
+    // Le nouveau processus ne trouverait qu'une base vide
+    if (strcmp(getenv("TWIIIIITER_DATABASE_FILE") ?: "", ":memory:") == 0) {
+        log_warning("Restarting without downtime isn't supported in memory, ignoring TWIIIIITER_HANDOFF_PATH");
+        return;
+    }
+
+    // Le socket de l'ancien processus, s'il y en avait un, est déjà fermé
+    struct stat existing;
+    if (lstat(handoff_address.sun_path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(handoff_address.sun_path);
+    }
+
+    handoff_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    assert(handoff_fd >= 0);
+    if (bind(handoff_fd, (struct sockaddr*) &handoff_address, sizeof handoff_address) != 0 || listen(handoff_fd, 1)) {
+        log_error("Can't listen on %s: errno %d", handoff_address.sun_path, errno);
+        exit(1);
+    }
+
+    struct epoll_event handoff_epollin = { .events = EPOLLIN, .data.fd = handoff_fd };
+    assert(epoll_ctl(server->epoll, EPOLL_CTL_ADD, handoff_fd, &handoff_epollin) == 0);
+    log_info("Waiting for a new version on %s", handoff_address.sun_path);
+}
+
+/**
+ * Transmet tout l'état au processus connecté sur `sock`. Renvoie false s'il ne l'a pas entièrement reçu.
+ */
+static bool handoff_send(server_state* server, int sock) {
+    // Les diffusions, les rattrapages et les trames en attente ne sont pas transmis
+    while (fanout_run(server));
+    while (catchup_run(server) || read_pool_wait());
+    int64_t drain_deadline = monotonic_now() + HANDOFF_DRAIN_TIMEOUT_MS * 1000;
+    gateway_drain(server, drain_deadline);
+    for (user_list_node* user = server->users, *next; user != NULL; user = next) {
+        next = user->next;
+        if (user->gateway != NULL || outbound_drain(user, drain_deadline)) continue;
+        // Le nouveau processus ne saurait pas où en est la trame interrompue
+        log_info("%d didn't read its messages in time", user->fd);
+        kick_user(server, user->fd, user);
+    }
+
+    static handoff_writer writer;
+    writer = (handoff_writer) { .socket = sock };
+    for (size_t i = 0; i < server->listeners.len; i++) {
+        handoff_record record = { .kind = HANDOFF_LISTENER, .listener = server->listeners.listeners[i] };
+        handoff_write(&writer, &record, record.listener.fd);
+    }
+    gateway_handoff_save(&writer);
+    for (user_list_node* user = server->users; user != NULL; user = user->next) {
+        if (user->gateway == NULL) handoff_write_user(&writer, user, -1);
+    }
+    handoff_flush(&writer, true);
+    if (writer.failed) return false;
+
+    struct timeval timeout = { .tv_sec = HANDOFF_ACK_TIMEOUT_S };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    char ack;
+    return recv(sock, &ack, 1, 0) == 1;
+}
+
+bool handoff_handle_event(server_state* server, struct epoll_event* event) {
+    if (handoff_fd < 0 || event->data.fd != handoff_fd) return false;
+
+    int sock = accept4(handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't accept a new version: errno %d", errno);
+        return true;
+    }
+
+    log_info("A new version is taking over");
+    if (!handoff_send(server, sock)) {
+        // Le nouveau processus a pu recevoir une partie des sockets, mais ils restent ouverts ici
+        log_error("The new version didn't receive the state, resuming");
+        close(sock);
+        return true;
+    }
+
+    // Sans fermer les connexions ni supprimer les sockets Unix, qui appartiennent maintenant au nouveau processus
+    log_info("State handed off, exiting");
+    // Le nouveau processus ouvre la base dès qu'il voit le socket fermé, ce qu'exit() peut faire avant de rendre son
+    // verrou
+    database_release();
+    // Les derniers enregistrements sont encore dans le tampon du thread d'écriture
+    record_shutdown();
+    log_shutdown();
+    exit(0);
+}
+
+void handoff_shutdown() {
+    if (handoff_fd < 0) return;
+    close(handoff_fd);
+    unlink(handoff_address.sun_path);
+}
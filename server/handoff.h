@@ -0,0 +1,101 @@
+#ifndef _HANDOFF_H_
+#define _HANDOFF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include "codec.h"
+#include "listener.h"
+#include "mux.h"
+#include "server.h"
+
+/**
+ * Redémarrage sans coupure
+ *
+ * Avec TWIIIIITER_HANDOFF_PATH, le serveur attend sur ce socket Unix qu'une nouvelle version de lui-même démarre. Le
+ * nouveau processus s'y connecte avant toute autre chose, et l'ancien lui transmet alors ses sockets d'écoute et ses
+ * connexions (via SCM_RIGHTS), accompagnés de l'état de chaque client : nom, dernier twiiiiit acquitté, trame
+ * partiellement reçue et seaux à jetons. L'ancien processus s'arrête ensuite sans déconnecter personne, et le nouveau
+ * reprend là où il en était.
+ *
+ * Ne sont pas transmis : les recherches en cours (dont les résultats ne sont jamais envoyés), les sujets tendance, et
+ * le délai d'inactivité de chaque client, qui repart de zéro. Les grappes (c.f. "cluster.h") ne sont pas gérées.
+ */
+
+enum handoff_kind {
+    HANDOFF_LISTENER,
+    HANDOFF_GATEWAY_LISTENER,
+    HANDOFF_GATEWAY_LINK,
+    HANDOFF_USER,
+};
+
+/**
+ * Un élément de l'état transmis, accompagné d'un descripteur sauf pour les sessions d'une passerelle
+ */
+typedef struct {
+    enum handoff_kind kind;
+    union {
+        listener listener; // Le descripteur est remplacé par celui reçu
+        struct {
+            char receive_buffer[MUX_FRAME_SIZE]; // Trame partiellement reçue
+            size_t receive_len;
+        } gateway_link;
+        struct {
+            int32_t gateway_link; // Rang du lien parmi les HANDOFF_GATEWAY_LINK, -1 pour une connexion directe
+            uint32_t session;
+            user_name user_name;
+            uint64_t acked_seq;
+            char frame_receive_buffer[IO_BUFFER_SIZE];
+            size_t frame_receive_buffer_len;
+            token_bucket rate_limits[RATE_LIMIT_CLASS_COUNT];
+        } user;
+    };
+} handoff_record;
+
+typedef struct handoff_writer_s handoff_writer;
+
+/**
+ * Récupère l'état d'un serveur déjà lancé sur TWIIIIITER_HANDOFF_PATH, s'il y en a un. Renvoie false pour un démarrage
+ * normal.
+ *
+ * À appeler avant d'ouvrir la base de données : la fonction ne rend la main qu'une fois l'ancien processus arrêté.
+ */
+bool handoff_receive();
+
+/**
+ * Reprend l'état reçu par handoff_receive() : sockets d'écoute, passerelles et clients. Les sockets d'écoute sont
+ * seulement placés dans `server->listeners`, à annoncer avec listeners_register().
+ */
+void handoff_restore(server_state* server);
+
+/**
+ * Attend sur TWIIIIITER_HANDOFF_PATH le prochain processus, s'il est défini
+ */
+void handoff_initialize(server_state* server);
+
+/**
+ * Traite un évènement epoll s'il concerne le socket de transmission. Renvoie false sinon.
+ *
+ * Quand un nouveau processus se connecte, l'état lui est transmis et le processus courant s'arrête.
+ */
+bool handoff_handle_event(server_state* server, struct epoll_event* event);
+
+/**
+ * Ajoute un élément à l'état transmis, avec son descripteur (-1 s'il n'en a pas)
+ */
+void handoff_write(handoff_writer* writer, const handoff_record* record, int fd);
+
+/**
+ * Transmet un client, direct ou session d'une passerelle
+ */
+void handoff_write_user(handoff_writer* writer, const user_list_node* user, int32_t gateway_link);
+
+/**
+ * Recrée un client transmis. Une connexion directe (`fd` positif) est aussi ajoutée à epoll.
+ */
+user_list_node* handoff_restore_user(server_state* server, const handoff_record* record, int fd);
+
+void handoff_shutdown();
+
+#endif
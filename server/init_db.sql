@@ -1,3 +1,4 @@
+drop table if exists twiiiiits_search;
 drop table if exists twiiiiits;
 drop table if exists followings;
 drop table if exists users;
@@ -6,7 +7,8 @@ pragma foreign_keys = on;
 
 create table users (
     name text(6) not null primary key,
-    last_online long not null
+    last_online long not null,
+    acked_seq long not null default 0 -- Curseur de rattrapage, c.f. database_cursor()
 );
 
 create table followings (
@@ -0,0 +1,632 @@
+/**
+ * Génération, import et export en masse de bases SQLite
+ *
+ * Les lignes sont insérées directement dans le schéma de "/server/init_db.sql", sans passer par "/server/database.h" :
+ * requêtes préparées, transactions de LOADGEN_TRANSACTION_ROWS lignes, ni journal ni vérification des clés étrangères.
+ * Les index secondaires (recherche, rattrapage, fil d'actualité) ne sont construits qu'une fois tout chargé, par
+ * database_initialize(), comme pour une base existante qui ne les aurait pas encore.
+ *
+ * Usage :
+ *   twiiiiiter-loadgen generate FILE USERS FOLLOWS_PER_USER TWIIIIITS [DAYS] [SEED]
+ *   twiiiiiter-loadgen export FILE DUMP
+ *   twiiiiiter-loadgen import DUMP FILE
+ *
+ * `generate` crée une base synthétique. Les abonnements suivent une loi de puissance : la popularité des comptes suit
+ * une loi de Zipf, et le nombre d'abonnements de chacun une loi de Pareto de moyenne FOLLOWS_PER_USER. Les twiiiiits
+ * sont répartis sur les DAYS derniers jours avec un cycle quotidien, et leurs auteur·ices suivent aussi une loi de
+ * Zipf. Chaque utilisateur s'est déconnecté à un instant aléatoire, et a tout acquitté jusque-là.
+ *
+ * `export` et `import` passent par un format binaire compact (c.f. loadgen_export()), qui conserve les numéros de
+ * séquence et les curseurs. La base créée par `generate` ou `import` ne doit pas déjà exister.
+ */
+
+#include <math.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "database.h"
+#include "twiiiiiter_assert.h"
+
+// Lignes insérées par transaction
+#define LOADGEN_TRANSACTION_ROWS (1 << 20)
+#define LOADGEN_ZIPF_EXPONENT 1.0
+// Les noms générés sont "u" suivi de 5 chiffres en base 36
+#define LOADGEN_MAX_USERS (36 * 36 * 36 * 36 * 36)
+#define LOADGEN_DAY_US (86400 * (int64_t) 1000000)
+
+#define DUMP_MAGIC "TWDUMP01"
+
+extern const char _binary_init_db_sql_start[];
+extern const char _binary_init_db_sql_end;
+
+typedef struct {
+    char magic[8];
+    uint64_t user_count;
+    uint64_t follow_count;
+    uint64_t twiiiiit_count;
+} dump_header;
+
+static double elapsed_seconds(int64_t since) {
+    return (double) (ts_now() - since) / 1e6;
+}
+
+// xorshift64*, reproductible d'une plateforme à l'autre contrairement à rand()
+static uint64_t random_state = 42;
+
+static uint64_t random_next() {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Tirage uniforme dans [0, 1)
+ */
+static double random_unit() {
+    return (double) (random_next() >> 11) * 0x1.0p-53;
+}
+
+/**
+ * Loi de Zipf sur `len` utilisateurs, dont l'ordre de popularité est tiré au hasard
+ */
+typedef struct {
+    double* cumulative; // Poids cumulés par rang
+    uint32_t* users; // Utilisateur de chaque rang
+    size_t len;
+} zipf_table;
+
+static zipf_table zipf_new(size_t len) {
+    zipf_table table = { malloc(len * sizeof(double)), malloc(len * sizeof(uint32_t)), len };
+    assert(table.cumulative != NULL && table.users != NULL);
+
+    double total = 0;
+    for (size_t rank = 0; rank < len; rank++) {
+        total += 1 / pow((double) (rank + 1), LOADGEN_ZIPF_EXPONENT);
+        table.cumulative[rank] = total;
+        table.users[rank] = rank;
+    }
+    for (size_t i = len - 1; i > 0; i--) {
+        size_t j = random_next() % (i + 1);
+        uint32_t user = table.users[i];
+        table.users[i] = table.users[j];
+        table.users[j] = user;
+    }
+    return table;
+}
+
+static uint32_t zipf_draw(const zipf_table* table) {
+    double target = random_unit() * table->cumulative[table->len - 1];
+    size_t low = 0, high = table->len - 1;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (table->cumulative[middle] <= target) low = middle + 1;
+        else high = middle;
+    }
+    return table->users[low];
+}
+
+static void zipf_free(zipf_table* table) {
+    free(table->cumulative);
+    free(table->users);
+}
+
+/**
+ * Les noms sont dans l'ordre des indices, celui de SQLite comme celui de strcmp()
+ */
+static void loadgen_user_name(uint32_t i, user_name out) {
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    memset(out, 0, sizeof(user_name));
+    out[0] = 'u';
+    for (int position = MAX_USERNAME_LENGTH - 1; position > 0; position--) {
+        out[position] = digits[i % 36];
+        i /= 36;
+    }
+}
+
+/**
+ * Quelques mots, dont des #tags pour les tendances
+ */
+static void loadgen_message(char out[MESSAGE_MAX_LENGTH]) {
+    static const char* const words[] = {
+        "hello", "world", "cat", "dog", "coffee", "rain", "sun", "code", "bug", "fix", "lol", "ok", "yes", "no",
+        "today", "night", "train", "late", "food", "music", "#news", "#cats", "#c", "#sqlite", "#monday",
+    };
+    size_t word_count = sizeof words / sizeof *words;
+
+    memset(out, 0, MESSAGE_MAX_LENGTH);
+    size_t len = 0;
+    while (true) {
+        const char* word = words[random_next() % word_count];
+        size_t word_len = strlen(word);
+        if (len + (len > 0) + word_len > MESSAGE_MAX_LENGTH) break;
+        if (len > 0) out[len++] = ' ';
+        memcpy(out + len, word, word_len);
+        len += word_len;
+        if (random_next() % 3 == 0) break;
+    }
+}
+
+/**
+ * Chargement d'une nouvelle base, c.f. loader_open()
+ */
+typedef struct {
+    const char* file;
+    sqlite3* db;
+    sqlite3_stmt* insert_user;
+    sqlite3_stmt* insert_follow;
+    sqlite3_stmt* insert_twiiiiit;
+    size_t transaction_rows;
+    size_t users, follows, twiiiiits;
+    int64_t started;
+} bulk_loader;
+
+static void loader_exec(bulk_loader* loader, const char* sql) {
+    char* error = NULL;
+    if (sqlite3_exec(loader->db, sql, NULL, NULL, &error) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", loader->file, error);
+        exit(1);
+    }
+}
+
+static sqlite3_stmt* loader_prepare(bulk_loader* loader, const char* sql) {
+    sqlite3_stmt* stmt;
+    assert(sqlite3_prepare_v2(loader->db, sql, -1, &stmt, NULL) == SQLITE_OK);
+    return stmt;
+}
+
+static void loader_open(bulk_loader* loader, const char* file) {
+    if (access(file, F_OK) == 0) {
+        fprintf(stderr, "%s already exists\n", file);
+        exit(1);
+    }
+
+    *loader = (bulk_loader) { .file = file, .started = ts_now() };
+    assert(sqlite3_open(file, &loader->db) == SQLITE_OK);
+
+    size_t schema_len = &_binary_init_db_sql_end - &_binary_init_db_sql_start[0];
+    char* schema = malloc(schema_len + 1);
+    assert(schema != NULL);
+    memcpy(schema, _binary_init_db_sql_start, schema_len);
+    schema[schema_len] = 0;
+    loader_exec(loader, schema);
+    free(schema);
+
+    // Les données sont cohérentes par construction, et une base interrompue est à refaire de toute façon
+    // language=sqlite
+    loader_exec(loader, "pragma foreign_keys = off; pragma journal_mode = off; pragma synchronous = off;");
+    // language=sqlite
+    loader_exec(loader, "pragma cache_size = -262144; begin");
+
+    // language=sqlite
+    loader->insert_user = loader_prepare(loader, "insert into users values (?, ?, ?)");
+    // language=sqlite
+    loader->insert_follow = loader_prepare(loader, "insert into followings values (?, ?)");
+    // language=sqlite
+    loader->insert_twiiiiit = loader_prepare(
+        loader, "insert into twiiiiits (rowid, date, author, message) values (?, ?, ?, ?)"
+    );
+}
+
+static void loader_step(bulk_loader* loader, sqlite3_stmt* stmt) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        fprintf(stderr, "%s: %s\n", loader->file, sqlite3_errmsg(loader->db));
+        exit(1);
+    }
+    sqlite3_reset(stmt);
+
+    if (++loader->transaction_rows == LOADGEN_TRANSACTION_ROWS) {
+        // language=sqlite
+        loader_exec(loader, "commit; begin");
+        loader->transaction_rows = 0;
+    }
+}
+
+static void loader_user(bulk_loader* loader, const char* name, int64_t last_online, uint64_t acked_seq) {
+    sqlite3_bind_text(loader->insert_user, 1, name, (int) strnlen(name, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    sqlite3_bind_int64(loader->insert_user, 2, last_online);
+    sqlite3_bind_int64(loader->insert_user, 3, (int64_t) acked_seq);
+    loader_step(loader, loader->insert_user);
+    loader->users++;
+}
+
+/**
+ * Les abonnements sont à insérer dans l'ordre de (follower, followee), celui de leur index unique
+ */
+static void loader_follow(bulk_loader* loader, const char* follower, const char* followee) {
+    sqlite3_bind_text(loader->insert_follow, 1, follower, (int) strnlen(follower, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    sqlite3_bind_text(loader->insert_follow, 2, followee, (int) strnlen(followee, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    loader_step(loader, loader->insert_follow);
+    loader->follows++;
+}
+
+static void loader_twiiiiit(bulk_loader* loader, uint64_t seq, int64_t date, const char* author, const char* message) {
+    sqlite3_stmt* stmt = loader->insert_twiiiiit;
+    sqlite3_bind_int64(stmt, 1, (int64_t) seq);
+    sqlite3_bind_int64(stmt, 2, date);
+    sqlite3_bind_text(stmt, 3, author, (int) strnlen(author, MAX_USERNAME_LENGTH), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, message, (int) strnlen(message, MESSAGE_MAX_LENGTH), SQLITE_STATIC);
+    loader_step(loader, stmt);
+    loader->twiiiiits++;
+}
+
+/**
+ * Termine le chargement, puis construit les index et passe la base en WAL en l'ouvrant comme le serveur
+ */
+static void loader_close(bulk_loader* loader) {
+    sqlite3_finalize(loader->insert_user);
+    sqlite3_finalize(loader->insert_follow);
+    sqlite3_finalize(loader->insert_twiiiiit);
+    // language=sqlite
+    loader_exec(loader, "commit");
+    assert(sqlite3_close(loader->db) == SQLITE_OK);
+    double load_seconds = elapsed_seconds(loader->started);
+
+    int64_t indexing_started = ts_now();
+    database_initialize("sqlite", loader->file);
+    double index_seconds = elapsed_seconds(indexing_started);
+
+    size_t rows = loader->users + loader->follows + loader->twiiiiits;
+    printf("[LOADGEN] %zu users, %zu follows, %zu twiiiiits loaded in %.3fs (%.0f rows/s), indexed in %.3fs\n",
+           loader->users, loader->follows, loader->twiiiiits, load_seconds, rows / load_seconds, index_seconds);
+}
+
+static int compare_dates(const void* a, const void* b) {
+    int64_t date_a = *(const int64_t*) a, date_b = *(const int64_t*) b;
+    return date_a < date_b ? -1 : date_a > date_b;
+}
+
+static int compare_users(const void* a, const void* b) {
+    uint32_t user_a = *(const uint32_t*) a, user_b = *(const uint32_t*) b;
+    return user_a < user_b ? -1 : user_a > user_b;
+}
+
+/**
+ * Date dans la fenêtre [start, end), plus probable le soir que la nuit
+ */
+static int64_t loadgen_date(int64_t start, int64_t end) {
+    while (true) {
+        int64_t date = start + (int64_t) (random_unit() * (double) (end - start));
+        double hour = (double) (date % LOADGEN_DAY_US) / 3.6e9;
+        // Creux à 6h, pic à 18h
+        double density = (1 - cos((hour - 6) * M_PI / 12)) / 2;
+        if (random_unit() < 0.1 + 0.9 * density) return date;
+    }
+}
+
+/**
+ * Nombre de twiiiiits antérieurs à `date`, c'est-à-dire le numéro du dernier d'entre eux
+ */
+static uint64_t twiiiiits_before(const int64_t* dates, uint64_t count, int64_t date) {
+    uint64_t low = 0, high = count;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (dates[middle] < date) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+static void loadgen_generate(
+    const char* file,
+    uint32_t user_count,
+    uint32_t follows_per_user,
+    uint64_t twiiiiit_count,
+    uint32_t days
+) {
+    int64_t end = ts_now();
+    int64_t start = end - days * LOADGEN_DAY_US;
+
+    // Les numéros de séquence suivent l'ordre de publication
+    int64_t* dates = malloc(twiiiiit_count * sizeof(int64_t) + 1);
+    assert(dates != NULL);
+    for (uint64_t i = 0; i < twiiiiit_count; i++) dates[i] = loadgen_date(start, end);
+    qsort(dates, twiiiiit_count, sizeof(int64_t), compare_dates);
+
+    bulk_loader loader;
+    loader_open(&loader, file);
+
+    user_name name, other;
+    for (uint32_t i = 0; i < user_count; i++) {
+        loadgen_user_name(i, name);
+        int64_t last_online = start + (int64_t) (random_unit() * (double) (end - start));
+        loader_user(&loader, name, last_online, twiiiiits_before(dates, twiiiiit_count, last_online));
+    }
+
+    // Pareto d'exposant 2, de moyenne 2 * minimum
+    zipf_table popularity = zipf_new(user_count);
+    uint32_t* followees = malloc(user_count * sizeof(uint32_t));
+    assert(followees != NULL);
+    for (uint32_t i = 0; i < user_count; i++) {
+        double wanted = follows_per_user / 2.0 / sqrt(1 - random_unit());
+        size_t draws = wanted < user_count - 1 ? (size_t) wanted : user_count - 1;
+        for (size_t j = 0; j < draws; j++) followees[j] = zipf_draw(&popularity);
+        qsort(followees, draws, sizeof(uint32_t), compare_users);
+
+        // Les doublons et les abonnements à soi-même sont écartés, d'où un peu moins d'abonnements que tirés
+        loadgen_user_name(i, name);
+        for (size_t j = 0; j < draws; j++) {
+            if (followees[j] == i || (j > 0 && followees[j] == followees[j - 1])) continue;
+            loadgen_user_name(followees[j], other);
+            loader_follow(&loader, name, other);
+        }
+    }
+    free(followees);
+    zipf_free(&popularity);
+
+    zipf_table activity = zipf_new(user_count);
+    char message[MESSAGE_MAX_LENGTH];
+    for (uint64_t i = 0; i < twiiiiit_count; i++) {
+        loadgen_user_name(zipf_draw(&activity), name);
+        loadgen_message(message);
+        loader_twiiiiit(&loader, i + 1, dates[i], name, message);
+    }
+    zipf_free(&activity);
+    free(dates);
+
+    loader_close(&loader);
+}
+
+static void dump_corrupted() {
+    fprintf(stderr, "Truncated or corrupted dump\n");
+    exit(1);
+}
+
+static void dump_write_varint(FILE* out, uint64_t value) {
+    while (value >= 0x80) {
+        putc((int) (value & 0x7f) | 0x80, out);
+        value >>= 7;
+    }
+    putc((int) value, out);
+}
+
+static uint64_t dump_read_varint(FILE* in) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = getc(in);
+        if (byte == EOF) break;
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    dump_corrupted();
+    return 0;
+}
+
+// Les différences de dates peuvent être négatives, c.f. ZigZag dans Protocol Buffers
+static uint64_t zigzag_encode(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static void dump_write_string(FILE* out, const char* string, size_t max_len) {
+    size_t len = strnlen(string, max_len);
+    putc((int) len, out);
+    fwrite(string, 1, len, out);
+}
+
+static void dump_read_string(FILE* in, char* out, size_t max_len) {
+    size_t len = getc(in);
+    if (len > max_len || fread(out, 1, len, in) != len) dump_corrupted();
+    memset(out + len, 0, max_len - len);
+}
+
+static sqlite3_stmt* export_query(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt;
+    assert(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK);
+    return stmt;
+}
+
+static uint64_t export_count(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt = export_query(db, sql);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    uint64_t count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(a, b);
+}
+
+static uint32_t user_index(const user_name* names, uint64_t user_count, const char* name) {
+    user_name key;
+    memset(key, 0, sizeof key);
+    strncpy(key, name, MAX_USERNAME_LENGTH);
+    const user_name* found = bsearch(key, names, user_count, sizeof(user_name), compare_names);
+    assert(found != NULL);
+    return found - names;
+}
+
+/**
+ * Écrit une base dans le format compact, après un dump_header :
+ *
+ * - les utilisateurs par nom croissant : nom (longueur sur un octet puis caractères), date de dernière connexion et
+ *   curseur, en varints (7 bits par octet, le bit de poids fort indiquant une suite) ;
+ * - pour chaque utilisateur dans le même ordre, son nombre d'abonnements puis leurs indices, croissants et codés
+ *   par différence avec le précédent ;
+ * - les twiiiiits par numéro de séquence : écart avec le numéro précédent, écart de date (en ZigZag), indice de
+ *   l'auteur·ice, et message comme les noms.
+ */
+static void loadgen_export(const char* file, const char* dump_path) {
+    int64_t started = ts_now();
+    sqlite3* db;
+    if (sqlite3_open_v2(file, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", file, sqlite3_errmsg(db));
+        exit(1);
+    }
+    FILE* out = fopen(dump_path, "wb");
+    if (out == NULL) {
+        perror(dump_path);
+        exit(1);
+    }
+
+    dump_header header = {
+        .magic = DUMP_MAGIC,
+        // language=sqlite
+        .user_count = export_count(db, "select count(*) from users"),
+        // language=sqlite
+        .follow_count = export_count(db, "select count(*) from followings"),
+        // language=sqlite
+        .twiiiiit_count = export_count(db, "select count(*) from twiiiiits"),
+    };
+    assert(fwrite(&header, sizeof header, 1, out) == 1);
+
+    user_name* names = malloc(header.user_count * sizeof(user_name) + 1);
+    assert(names != NULL);
+    // language=sqlite
+    sqlite3_stmt* stmt = export_query(db, "select name, last_online, acked_seq from users order by name");
+    for (uint64_t i = 0; i < header.user_count; i++) {
+        assert(sqlite3_step(stmt) == SQLITE_ROW);
+        memset(names[i], 0, sizeof(user_name));
+        strncpy(names[i], (const char*) sqlite3_column_text(stmt, 0), MAX_USERNAME_LENGTH);
+        dump_write_string(out, names[i], MAX_USERNAME_LENGTH);
+        dump_write_varint(out, zigzag_encode(sqlite3_column_int64(stmt, 1)));
+        dump_write_varint(out, sqlite3_column_int64(stmt, 2));
+    }
+    sqlite3_finalize(stmt);
+
+    // Les abonnements d'un utilisateur sont regroupés avant d'être écrits, précédés de leur nombre
+    uint32_t* followees = malloc(header.user_count * sizeof(uint32_t) + 1);
+    assert(followees != NULL);
+    size_t followees_len = 0;
+    uint64_t next_follower = 0;
+    // language=sqlite
+    stmt = export_query(db, "select follower, followee from followings order by follower, followee");
+    while (true) {
+        bool row = sqlite3_step(stmt) == SQLITE_ROW;
+        const char* follower_name = row ? (const char*) sqlite3_column_text(stmt, 0) : NULL;
+        uint64_t follower = row ? user_index(names, header.user_count, follower_name) : 0;
+        if (!row || follower != next_follower) {
+            uint64_t last = row ? follower : header.user_count;
+            for (; next_follower < last; next_follower++) {
+                dump_write_varint(out, followees_len);
+                for (size_t i = 0; i < followees_len; i++) {
+                    dump_write_varint(out, followees[i] - (i > 0 ? followees[i - 1] : 0));
+                }
+                followees_len = 0;
+            }
+        }
+        if (!row) break;
+        const char* followee_name = (const char*) sqlite3_column_text(stmt, 1);
+        followees[followees_len++] = user_index(names, header.user_count, followee_name);
+    }
+    sqlite3_finalize(stmt);
+    free(followees);
+
+    uint64_t previous_seq = 0;
+    int64_t previous_date = 0;
+    // language=sqlite
+    stmt = export_query(db, "select rowid, date, author, message from twiiiiits order by rowid");
+    for (uint64_t i = 0; i < header.twiiiiit_count; i++) {
+        assert(sqlite3_step(stmt) == SQLITE_ROW);
+        uint64_t seq = sqlite3_column_int64(stmt, 0);
+        int64_t date = sqlite3_column_int64(stmt, 1);
+        dump_write_varint(out, seq - previous_seq);
+        dump_write_varint(out, zigzag_encode(date - previous_date));
+        dump_write_varint(out, user_index(names, header.user_count, (const char*) sqlite3_column_text(stmt, 2)));
+        dump_write_string(out, (const char*) sqlite3_column_text(stmt, 3), MESSAGE_MAX_LENGTH);
+        previous_seq = seq;
+        previous_date = date;
+    }
+    sqlite3_finalize(stmt);
+    free(names);
+    sqlite3_close(db);
+
+    long size = ftell(out);
+    if (fclose(out) != 0) {
+        perror(dump_path);
+        exit(1);
+    }
+    printf("[LOADGEN] %lu users, %lu follows, %lu twiiiiits exported in %.3fs (%ld bytes)\n",
+           header.user_count, header.follow_count, header.twiiiiit_count, elapsed_seconds(started), size);
+}
+
+static void loadgen_import(const char* dump_path, const char* file) {
+    FILE* in = fopen(dump_path, "rb");
+    if (in == NULL) {
+        perror(dump_path);
+        exit(1);
+    }
+
+    dump_header header;
+    if (fread(&header, sizeof header, 1, in) != 1 || memcmp(header.magic, DUMP_MAGIC, sizeof header.magic) != 0) {
+        fprintf(stderr, "%s isn't a dump\n", dump_path);
+        exit(1);
+    }
+
+    bulk_loader loader;
+    loader_open(&loader, file);
+
+    user_name* names = malloc(header.user_count * sizeof(user_name) + 1);
+    assert(names != NULL);
+    for (uint64_t i = 0; i < header.user_count; i++) {
+        dump_read_string(in, names[i], MAX_USERNAME_LENGTH);
+        int64_t last_online = zigzag_decode(dump_read_varint(in));
+        loader_user(&loader, names[i], last_online, dump_read_varint(in));
+    }
+
+    for (uint64_t i = 0; i < header.user_count; i++) {
+        uint64_t count = dump_read_varint(in);
+        uint64_t followee = 0;
+        for (uint64_t j = 0; j < count; j++) {
+            followee += dump_read_varint(in);
+            if (followee >= header.user_count) dump_corrupted();
+            loader_follow(&loader, names[i], names[followee]);
+        }
+    }
+
+    uint64_t seq = 0;
+    int64_t date = 0;
+    char message[MESSAGE_MAX_LENGTH + 1];
+    for (uint64_t i = 0; i < header.twiiiiit_count; i++) {
+        seq += dump_read_varint(in);
+        date += zigzag_decode(dump_read_varint(in));
+        uint64_t author = dump_read_varint(in);
+        if (author >= header.user_count) dump_corrupted();
+        dump_read_string(in, message, MESSAGE_MAX_LENGTH);
+        loader_twiiiiit(&loader, seq, date, names[author], message);
+    }
+    free(names);
+    fclose(in);
+
+    loader_close(&loader);
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 6 && argc <= 8 && strcmp(argv[1], "generate") == 0) {
+        uint32_t user_count = strtoul(argv[3], NULL, 10);
+        if (user_count < 2 || user_count > LOADGEN_MAX_USERS) {
+            fprintf(stderr, "USERS must be between 2 and %d\n", LOADGEN_MAX_USERS);
+            return 1;
+        }
+        random_state = argc > 7 ? strtoull(argv[7], NULL, 10) ?: 42 : 42;
+        loadgen_generate(
+            argv[2],
+            user_count,
+            strtoul(argv[4], NULL, 10),
+            strtoull(argv[5], NULL, 10),
+            argc > 6 ? strtoul(argv[6], NULL, 10) : 30
+        );
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "export") == 0) {
+        loadgen_export(argv[2], argv[3]);
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "import") == 0) {
+        loadgen_import(argv[2], argv[3]);
+        return 0;
+    }
+
+    printf("Usage: %s generate FILE USERS FOLLOWS_PER_USER TWIIIIITS [DAYS] [SEED]\n", argv[0]);
+    printf("       %s export FILE DUMP\n", argv[0]);
+    printf("       %s import DUMP FILE\n", argv[0]);
+    return 1;
+}
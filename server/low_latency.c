@@ -0,0 +1,75 @@
+#define _GNU_SOURCE // pthread_setaffinity_np()
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "log.h"
+#include "low_latency.h"
+
+#define DEFAULT_BUSY_POLL_US 50
+
+static bool enabled = false;
+static int busy_poll_us = DEFAULT_BUSY_POLL_US;
+static int cpu = -1;
+
+void low_latency_initialize() {
+    const char* profile = getenv("TWIIIIITER_LOW_LATENCY");
+    if (profile == NULL || strcmp(profile, "1") != 0) return;
+
+    enabled = true;
+    const char* busy_poll = getenv("TWIIIIITER_BUSY_POLL_US");
+    if (busy_poll != NULL) busy_poll_us = (int) strtol(busy_poll, NULL, 10);
+    const char* cpu_env = getenv("TWIIIIITER_CPU");
+    if (cpu_env != NULL) cpu = (int) strtol(cpu_env, NULL, 10);
+    log_info("Low latency profile: busy polling for %d us", busy_poll_us);
+}
+
+void low_latency_configure_socket(int fd) {
+    if (!enabled) return;
+
+    // Les sockets Unix n'ont ni Nagle ni carte réseau à sonder
+    struct sockaddr_storage address;
+    socklen_t address_len = sizeof address;
+    if (getsockname(fd, (struct sockaddr*) &address, &address_len) != 0 || address.ss_family == AF_UNIX) return;
+
+    int enable = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof enable) != 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't set TCP_NODELAY on %d: errno %d", fd, errno);
+    }
+    // Au-delà de net.core.busy_read, il faut CAP_NET_ADMIN
+    if (busy_poll_us > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof busy_poll_us) != 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't set SO_BUSY_POLL on %d: errno %d", fd, errno);
+    }
+}
+
+void low_latency_pin_thread() {
+    if (!enabled || cpu < 0) return;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+    if (error != 0) {
+        log_warning("Couldn't pin the event loop to CPU %d: errno %d", cpu, error);
+        return;
+    }
+    log_info("Event loop pinned to CPU %d", cpu);
+}
+
+int low_latency_epoll_wait(int epoll, struct epoll_event* events, int max_events, int timeout) {
+    if (enabled && timeout != 0 && busy_poll_us > 0) {
+        int64_t deadline = monotonic_now() + busy_poll_us;
+        do {
+            int ready = epoll_wait(epoll, events, max_events, 0);
+            if (ready != 0) return ready;
+        } while (monotonic_now() < deadline);
+    }
+    return epoll_wait(epoll, events, max_events, timeout);
+}
@@ -0,0 +1,41 @@
+#ifndef _LOW_LATENCY_H_
+#define _LOW_LATENCY_H_
+
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+/**
+ * Profil basse latence, activé par TWIIIIITER_LOW_LATENCY=1
+ *
+ * Les trames de 48 octets sont le cas d'école de l'algorithme de Nagle : une réponse de plusieurs trames (une liste
+ * d'abonnements, une page du fil, ...) est écrite trame par trame, et chacune après la première attend l'acquittement
+ * de la précédente, que le client peut retarder. Le profil désactive Nagle (TCP_NODELAY) sur les connexions des clients
+ * et des passerelles, et leur demande d'attendre les paquets en sondant la carte réseau (SO_BUSY_POLL) plutôt qu'en
+ * attendant son interruption.
+ *
+ * La boucle d'évènements sonde aussi epoll sans attendre pendant TWIIIIITER_BUSY_POLL_US microsecondes avant de
+ * s'endormir, ce qui évite le réveil du thread quand le prochain message arrive vite. Elle est enfin épinglée au cœur
+ * TWIIIIITER_CPU s'il est donné, les autres threads restant libres. Tout cela se paie en temps processeur.
+ */
+
+/**
+ * Lit la configuration dans l'environnement
+ */
+void low_latency_initialize();
+
+/**
+ * Règle les options d'un socket connecté à un client ou à une passerelle
+ */
+void low_latency_configure_socket(int fd);
+
+/**
+ * Épingle le thread appelant, celui de la boucle d'évènements, au cœur configuré
+ */
+void low_latency_pin_thread();
+
+/**
+ * epoll_wait(), qui sonde d'abord sans attendre si le profil est activé et que `timeout` n'est pas nul
+ */
+int low_latency_epoll_wait(int epoll, struct epoll_event* events, int max_events, int timeout);
+
+#endif
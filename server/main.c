@@ -1,5 +1,4 @@
 #include <errno.h>
-#include <netinet/in.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -8,229 +7,473 @@
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "catchup.h"
+#include "channel.h"
+#include "clock.h"
+#include "cluster.h"
 #include "constants.h"
 #include "database.h"
+#include "fanout.h"
+#include "gateway.h"
+#include "handoff.h"
+#include "log.h"
+#include "low_latency.h"
+#include "read_pool.h"
+#include "record.h"
 #include "server.h"
+#include "search.h"
+#include "stats.h"
+#include "trace.h"
+#include "timeline.h"
+#include "trending.h"
 #include "twiiiiiter_assert.h"
 
 // Maximum d'évènements retournés par epoll lors d'un appel système
 #define EPOLL_MAX_EVENTS 16
 
+// Période de la roue de minuteurs
+#define TIMER_TICK_MS 100
+#define DEFAULT_IDLE_TIMEOUT_MS 60000
+#define DEFAULT_PING_TIMEOUT_MS 10000
+// Temps maximal consacré aux diffusions entre deux appels à epoll_wait()
+#define DEFAULT_FANOUT_SLICE_US 2000
+// Sessions simultanées d'un même nom
+#define DEFAULT_MAX_SESSIONS 4
+// Durée de la fenêtre des sujets tendance
+#define DEFAULT_TRENDING_WINDOW_S 3600
+// Temps laissé à l'arrêt pour écrire les trames encore en attente
+#define SHUTDOWN_DRAIN_TIMEOUT_MS 1000
+
+static uint64_t timeout_ticks_from_env(const char* name, uint64_t default_ms) {
+    const char* value = getenv(name);
+    uint64_t ms = value != NULL ? strtoull(value, NULL, 10) : default_ms;
+    return ms / TIMER_TICK_MS ?: 1;
+}
+
 int main(int argc, char** argv) {
     assert(argc <= 2);
-    uint16_t port;
-    if (argc == 2) {
-        port = strtoul(argv[1], NULL, 10);
-    } else {
-        port = DEFAULT_PORT;
+    log_initialize();
+    trace_initialize();
+    // Lors d'un redémarrage sans coupure, les sockets d'écoute sont ceux de l'ancien processus (c.f. handoff_restore())
+    listener_set listeners = { .len = 0 };
+    bool taking_over = handoff_receive();
+    if (!taking_over) {
+        // Sans TWIIIIITER_LISTEN, le serveur écoute sur toutes les interfaces, au port donné en argument
+        char default_listen[8];
+        unsigned port = argc == 2 ? strtoul(argv[1], NULL, 10) : DEFAULT_PORT;
+        snprintf(default_listen, sizeof default_listen, "%u", port);
+        listeners_open(&listeners, getenv("TWIIIIITER_LISTEN") ?: default_listen);
     }
 
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    assert(server_socket != 0);
-
-    struct sockaddr_in address = {
-        .sin_family = AF_INET,
-        .sin_addr = {
-            .s_addr = INADDR_ANY,
-        },
-        .sin_port = htons(port),
-        .sin_zero = { 0 },
-    };
-
-    socklen_t address_len = sizeof address;
-    assert(bind(server_socket, (struct sockaddr*) &address, address_len) >= 0);
-    assert(listen(server_socket, 16) == 0);
-    assert(getsockname(server_socket, (struct sockaddr*) &address, &address_len) == 0);
-    printf("[INFO] Listening on *:%d\n", ntohs(address.sin_port));
-    fflush(stdout); // Important so the testing utility can connect to the correct server
-
-    database_initialize(getenv("TWIIIIITER_DATABASE_FILE") ?: "twiiiiiter.sqlite");
+    // La base doit être prête avant d'annoncer le port : les nœuds d'une grappe la partagent et l'initialiseraient
+    // sinon en même temps
+    database_initialize(getenv("TWIIIIITER_DATABASE_ENGINE") ?: "sqlite", getenv("TWIIIIITER_DATABASE_FILE"));
 
     int epoll = epoll_create1(0);
     assert (epoll > 0);
-    // EPOLLIN sur un socket d'écoute correspond à une connexion entrante
-    struct epoll_event server_socket_epollin = { .events = EPOLLIN, .data.fd = server_socket };
-    epoll_ctl(epoll, EPOLL_CTL_ADD, server_socket, &server_socket_epollin);
 
-    // Gestion de SIGINT via un descripteur de fichier
+    // Un client (ou la sortie standard) fermé doit se traduire par une erreur d'écriture, pas par l'arrêt du serveur
+    signal(SIGPIPE, SIG_IGN);
+
+    // Gestion de SIGINT, SIGUSR1 et SIGUSR2 via un descripteur de fichier
     sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
     sigprocmask(SIG_BLOCK, &mask, NULL);
     int signal_fd = signalfd(-1, &mask, 0);
     struct epoll_event signal_epollin = { .events = EPOLLIN, .data.fd = signal_fd };
     epoll_ctl(epoll, EPOLL_CTL_ADD, signal_fd, &signal_epollin);
 
+    // Un unique timerfd cadence la roue de minuteurs, quel que soit le nombre de connexions
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    assert(timer_fd >= 0);
+    struct itimerspec tick = {
+        .it_interval = { .tv_sec = 0, .tv_nsec = TIMER_TICK_MS * 1000000 },
+        .it_value = { .tv_sec = 0, .tv_nsec = TIMER_TICK_MS * 1000000 },
+    };
+    assert(timerfd_settime(timer_fd, 0, &tick, NULL) == 0);
+    struct epoll_event timer_epollin = { .events = EPOLLIN, .data.fd = timer_fd };
+    epoll_ctl(epoll, EPOLL_CTL_ADD, timer_fd, &timer_epollin);
+
     server_state server = {
-        .server_socket = server_socket,
+        .listeners = listeners,
         .epoll = epoll,
         .users = NULL,
+        .timer_fd = timer_fd,
+        .idle_timeout_ticks = timeout_ticks_from_env("TWIIIIITER_IDLE_TIMEOUT_MS", DEFAULT_IDLE_TIMEOUT_MS),
+        .ping_timeout_ticks = timeout_ticks_from_env("TWIIIIITER_PING_TIMEOUT_MS", DEFAULT_PING_TIMEOUT_MS),
+        .max_sessions = strtoull(getenv("TWIIIIITER_MAX_SESSIONS") ?: "", NULL, 10) ?: DEFAULT_MAX_SESSIONS,
+        .fanout_head = NULL,
+        .fanout_tail = NULL,
+        .fanout_slice_us = strtoll(getenv("TWIIIIITER_FANOUT_SLICE_US") ?: "", NULL, 10) ?: DEFAULT_FANOUT_SLICE_US,
+        .rate_limits = {
+            [RATE_LIMIT_PUBLISH] = rate_limit_config_from_env("TWIIIIITER_RATE_LIMIT_PUBLISH", (rate_limit_config) {
+                .rate = 10,
+                .burst = 20,
+            }),
+            [RATE_LIMIT_FOLLOW] = rate_limit_config_from_env("TWIIIIITER_RATE_LIMIT_FOLLOW", (rate_limit_config) {
+                .rate = 20,
+                .burst = 50,
+            }),
+            [RATE_LIMIT_LIST] = rate_limit_config_from_env("TWIIIIITER_RATE_LIMIT_LIST", (rate_limit_config) {
+                .rate = 5,
+                .burst = 10,
+            }),
+            [RATE_LIMIT_SEARCH] = rate_limit_config_from_env("TWIIIIITER_RATE_LIMIT_SEARCH", (rate_limit_config) {
+                .rate = 2,
+                .burst = 5,
+            }),
+        },
     };
+    timer_wheel_init(&server.timers);
+    trending_initialize(
+        (strtoll(getenv("TWIIIIITER_TRENDING_WINDOW_S") ?: "", NULL, 10) ?: DEFAULT_TRENDING_WINDOW_S) * 1000000
+    );
+    catchup_initialize();
+    channel_initialize();
+    low_latency_initialize();
+    outbound_initialize(epoll);
+    // Avant handoff_restore(), qui enregistre les connexions reprises
+    record_initialize(taking_over);
+    handoff_restore(&server);
+
+    cluster_initialize(&server);
+    read_pool_initialize(&server);
+    search_initialize(&server);
+    gateway_initialize(&server);
+    handoff_initialize(&server);
 
+    listeners_register(&server.listeners, epoll, "Listening");
+    fflush(stdout); // Important so the testing utility can connect to the correct server
+
+    low_latency_pin_thread();
     struct epoll_event events[EPOLL_MAX_EVENTS];
     while (true) {
+        // S'il reste des diffusions ou des rattrapages en cours, on ne fait que relever les évènements déjà prêts
+        int timeout = server.fanout_head != NULL || catchup_pending() ? 0 : -1;
         int remaining_events;
         do {
-            remaining_events = epoll_wait(epoll, events, EPOLL_MAX_EVENTS, -1);
+            remaining_events = low_latency_epoll_wait(epoll, events, EPOLL_MAX_EVENTS, timeout);
         } while (remaining_events == -1 && errno == EINTR); // Obligatoire pour que GDB fonctionne
-        assert(remaining_events > 0);
+        assert(remaining_events >= 0);
 
         for (int i = 0; i < remaining_events; i++) {
             struct epoll_event* event = &events[i];
-            if (event->data.fd == signal_fd) goto shutdown;
+            if (event->data.fd == signal_fd) {
+                struct signalfd_siginfo siginfo;
+                if (read(signal_fd, &siginfo, sizeof siginfo) != sizeof siginfo) continue;
+                if (siginfo.ssi_signo == SIGUSR1) {
+                    stats_dump();
+                    continue;
+                }
+                if (siginfo.ssi_signo == SIGUSR2) {
+                    trace_dump();
+                    continue;
+                }
+                goto shutdown;
+            }
+            if (event->data.fd == timer_fd) {
+                handle_timer_tick(&server);
+                continue;
+            }
+            if (cluster_handle_event(&server, event)) continue;
+            if (read_pool_handle_event(&server, event)) continue;
+            if (search_handle_event(&server, event)) continue;
+            if (gateway_handle_event(&server, event)) continue;
+            if (handoff_handle_event(&server, event)) continue;
             handle_event(&server, event);
         }
+
+        // Les rattrapages n'avancent qu'une fois les diffusions terminées
+        if (!fanout_run(&server)) catchup_run(&server);
+        gateway_flush(&server);
     }
 
     shutdown:
-    printf("[INFO] SIGINT received, shutting down\n");
+    log_info("SIGINT received, shutting down");
+    while (fanout_run(&server)); // On termine les diffusions avant de déconnecter tout le monde
+    stats_dump();
+    int64_t drain_deadline = monotonic_now() + SHUTDOWN_DRAIN_TIMEOUT_MS * 1000;
     for (user_list_node* user = server.users; user != NULL; user = server.users) {
+        // Les clients qui lisent encore reçoivent leurs dernières trames
+        if (user->gateway == NULL) outbound_drain(user, drain_deadline);
         kick_user(&server, user->fd, user);
     }
+    record_shutdown();
+    trace_dump();
+    read_pool_shutdown();
+    search_shutdown();
+    gateway_shutdown(&server, drain_deadline);
+    handoff_shutdown();
+    cluster_shutdown();
+    close(timer_fd);
     close(signal_fd);
-    close(server_socket);
+    listeners_close(&server.listeners);
     close(epoll);
+    log_shutdown();
 
     return 0;
 }
 
-#define SUCCESS_OR_RETURN(value, args...) if (value < 0) { printf("[WARNING] " args); return; }
+#define SUCCESS_OR_RETURN(value, args...) if (value < 0) { log_limited(LOG_LEVEL_WARNING, args); return; }
 
 void handle_event(server_state* server, struct epoll_event* event) {
-    if (event->data.fd == server->server_socket) { // Nouvelle connexion
+    TRACE_SCOPE(handle_event);
+    if (listeners_contains(&server->listeners, event->data.fd)) { // Nouvelle connexion
         if (event->events & EPOLLHUP || event->events & EPOLLERR) {
             int error = 0;
             socklen_t errlen = sizeof(error);
             if (getsockopt(event->data.fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen) == 0) {
-                printf("[ERROR] HUP/ERR: %s\n", strerror(error));
+                log_error("HUP/ERR: %s", strerror(error));
             }
 
-            close(server->server_socket);
+            listeners_close(&server->listeners);
             exit(1);
         }
 
         int fd = event->data.fd;
-        struct sockaddr address;
-        unsigned int addrlen = sizeof(address);
-        int sock = accept(fd, &address, &addrlen);
-        SUCCESS_OR_RETURN(sock, "Couldn't accept a client: errno %d\n", errno);
+        struct sockaddr_storage address;
+        socklen_t addrlen = sizeof(address);
+        int sock = accept(fd, (struct sockaddr*) &address, &addrlen);
+        SUCCESS_OR_RETURN(sock, "Couldn't accept a client: errno %d", errno);
 
-        // rend le nouveau socket non bloquant
+        // rend le nouveau socket non bloquant (les écritures en retard attendent dans sa file, c.f. "outbound.h")
         // et l'ajoute au contexte epoll
-        int flags = fcntl(fd, F_GETFL, NULL);
-        SUCCESS_OR_RETURN(flags, "Couldn't make incoming connection non-blocking: errno %d\n", errno);
-        SUCCESS_OR_RETURN(fcntl(fd, F_SETFL, flags | O_NONBLOCK), "fnctl SET failed: errno %d\n", errno);
+        int flags = fcntl(sock, F_GETFL, NULL);
+        SUCCESS_OR_RETURN(flags, "Couldn't make incoming connection non-blocking: errno %d", errno);
+        SUCCESS_OR_RETURN(fcntl(sock, F_SETFL, flags | O_NONBLOCK), "fnctl SET failed: errno %d", errno);
 
         struct epoll_event socket_epollin = { .events = EPOLLIN, .data.fd = sock };
         SUCCESS_OR_RETURN(
             epoll_ctl(server->epoll, EPOLL_CTL_ADD, sock, &socket_epollin),
-            "Couldn't add incoming connection to the epoll pool: errno %d\n", errno
+            "Couldn't add incoming connection to the epoll pool: errno %d", errno
         );
+        low_latency_configure_socket(sock);
 
-        printf("[INFO] %d is joining\n", sock);
-        user_list_node_insert(&server->users, sock);
-    } else if (event->events & EPOLLIN) { // Probablement un nouveau message sur un socket connecté à un client
+        log_info("%d is joining", sock);
+        user_list_node* user = user_list_node_insert(&server->users, sock);
+        timer_schedule(&server->timers, &user->idle_timer, server->idle_timeout_ticks);
+        record_open(user);
+    } else { // Un socket connecté à un client, qui a probablement envoyé un message ou peut recevoir la suite des siens
         int fd = event->data.fd;
-        user_list_node* user = user_list_node_find(server->users, fd);
+        user_list_node* user = user_list_node_find(fd);
         if (user == NULL) {
-            printf("[ERROR] Can't find file descriptor %d in the connected player list. Kicking them.\n", fd);
+            log_error("Can't find file descriptor %d in the connected player list. Kicking them.", fd);
             kick_user(server, fd, NULL);
             return;
         }
 
+        if (event->events & EPOLLOUT && !outbound_flush(user)) {
+            kick_user(server, fd, user);
+            return;
+        }
+        if (!(event->events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+
+        // Une trame lue d'un coup n'occupe aucun tampon propre à la connexion
+        static char frame_scratch[IO_BUFFER_SIZE];
         size_t already_read = user->frame_receive_buffer_len;
-        ssize_t bytes_read = read(fd, user->frame_receive_buffer + already_read, IO_BUFFER_SIZE - already_read);
+        char* frame = already_read > 0 ? user->frame_receive_buffer : frame_scratch;
+        ssize_t bytes_read = read(fd, frame + already_read, IO_BUFFER_SIZE - already_read);
         if (bytes_read > 0) {
-            user->frame_receive_buffer_len += bytes_read;
-            if (user->frame_receive_buffer_len == IO_BUFFER_SIZE) {
-                user->frame_receive_buffer_len = 0;
-                message_c2s message;
-                if (decode_c2s(user->frame_receive_buffer, &message)) {
-                    process_message(server, user, &message);
-                } else {
-                    printf("[WARNING] Invalid message sent by client %d\n", fd);
+            // N'importe quelle donnée reçue prouve que la connexion est toujours vivante
+            user->ping_sent = false;
+            timer_schedule(&server->timers, &user->idle_timer, server->idle_timeout_ticks);
+
+            if (already_read + bytes_read < IO_BUFFER_SIZE) {
+                user_list_node_hold_partial_frame(user, frame, already_read + bytes_read);
+            } else {
+                // handle_frame() peut libérer le nœud, dont le tampon est donc détaché avant
+                char* held = user_list_node_take_frame(user);
+                if (!handle_frame(server, user, frame)) {
+                    log_limited(LOG_LEVEL_WARNING, "Invalid message sent by client %d", fd);
                 }
+                user_list_release_frame(held);
             }
+        } else if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Rien à lire finalement
         } else {
             // EOF? => disconnect socket
             kick_user(server, fd, user);
         }
-    } else {
-        printf("[ERROR] Unhandled epoll event %d, ignoring\n", event->events);
     }
 }
 
+bool handle_frame(server_state* server, user_list_node* user, const char frame[IO_BUFFER_SIZE]) {
+    // Une connexion directe réarme son minuteur d'inactivité à chaque lecture, une session à chaque trame
+    if (user->gateway != NULL) {
+        user->ping_sent = false;
+        timer_schedule(&server->timers, &user->idle_timer, server->idle_timeout_ticks);
+    }
+
+    record_frame(user, frame);
+    message_c2s message;
+    if (!decode_c2s(frame, &message)) return false;
+    process_message(server, user, &message);
+    return true;
+}
+
+/**
+ * Nombre de noms d'un MESSAGE_C2S_SUBSCRIBE_BATCH ou MESSAGE_C2S_UNSUBSCRIBE_BATCH, jusqu'au premier nom vide
+ */
+static size_t subscribe_batch_len(const message_c2s* message) {
+    size_t len = 0;
+    while (len < SUBSCRIBE_BATCH_MAX && message->subscribe_batch[len][0] != 0) len++;
+    return len;
+}
+
+/**
+ * Prend un jeton dans le seau correspondant à la requête (un par nom pour les lots), ou répond MESSAGE_S2C_THROTTLED
+ * s'il n'y en a pas assez. Cela se fait avant tout accès à la base de données.
+ */
+static bool check_rate_limit(server_state* server, user_list_node* user, const message_c2s* message) {
+    enum rate_limit_class class;
+    double cost = 1;
+    switch (message->tag) {
+        case MESSAGE_C2S_PUBLISH:
+        case MESSAGE_C2S_PUBLISH_CHANNEL:
+            class = RATE_LIMIT_PUBLISH;
+            break;
+        case MESSAGE_C2S_SUBSCRIBE_TO:
+        case MESSAGE_C2S_UNSUBSCRIBE_TO:
+        case MESSAGE_C2S_JOIN_CHANNEL:
+        case MESSAGE_C2S_LEAVE_CHANNEL:
+            class = RATE_LIMIT_FOLLOW;
+            break;
+        case MESSAGE_C2S_SUBSCRIBE_BATCH:
+        case MESSAGE_C2S_UNSUBSCRIBE_BATCH:
+            class = RATE_LIMIT_FOLLOW;
+            cost = subscribe_batch_len(message) ?: 1;
+            break;
+        case MESSAGE_C2S_LIST_SUBSCRIPTIONS:
+        case MESSAGE_C2S_TRENDING:
+        case MESSAGE_C2S_FETCH_TIMELINE:
+            class = RATE_LIMIT_LIST;
+            break;
+        case MESSAGE_C2S_SEARCH:
+            class = RATE_LIMIT_SEARCH;
+            break;
+        default:
+            return true;
+    }
+
+    // Partagé par les sessions du même nom
+    token_bucket* bucket = &user_list_node_rate_limits(user)[class];
+    uint32_t retry_after_ms;
+    if (token_bucket_take(bucket, &server->rate_limits[class], cost, &retry_after_ms)) return true;
+
+    stats.throttled[class]++;
+    send_message(user, (message_s2c) {
+        .tag = MESSAGE_S2C_THROTTLED,
+        .throttled = {
+            .request = message->tag,
+            .retry_after_ms = retry_after_ms,
+        },
+    });
+    return false;
+}
+
 void process_message(server_state* server, user_list_node* user, const message_c2s* message) {
-    int fd = user->fd;
+    TRACE_SCOPE(process_message);
     char* username = user->user_name;
 
     if (message->tag == MESSAGE_C2S_JOIN_AS) {
         if (username[0] != 0) {
-            printf("[WARNING] User %.*s is trying to rename themselves, which is forbidden\n", MAX_USERNAME_LENGTH, username);
-            send_message_immediately(fd, (message_s2c) {
+            log_warning("User %.*s is trying to rename themselves, which is forbidden", MAX_USERNAME_LENGTH, username);
+            send_message(user, (message_s2c) {
                     .tag = MESSAGE_S2C_KICK,
                     .kick = KICK_REASON_PROTOCOL_ERROR,
             });
-            kick_user(server, fd, user);
+            kick_user(server, user->fd, user);
             return;
         } else {
             if (message->join_as[0] == 0) {
                 // Name can't be empty
-                send_message_immediately(fd, (message_s2c) {
+                send_message(user, (message_s2c) {
                     .tag = MESSAGE_S2C_LOGIN_STATUS,
                     .login_status = LOGIN_STATUS_ILLEGAL_NAME,
                 });
                 return;
-            } else if (user_list_node_find_by_name(server->users, message->join_as)) {
-                // Name can't be already online
-                send_message_immediately(fd, (message_s2c) {
+            } else if (
+                cluster_find_online(message->join_as) != NULL
+                || !user_list_node_attach(user, message->join_as, server->max_sessions)
+            ) {
+                // Name can't be online on another node, nor have all its sessions open on this one
+                send_message(user, (message_s2c) {
                     .tag = MESSAGE_S2C_LOGIN_STATUS,
                     .login_status = LOGIN_STATUS_ALREADY_USED,
                 });
                 return;
             } else {
-                // Attach the username to the current user node
-                strncpy(username, message->join_as, MAX_USERNAME_LENGTH);
-                send_message_immediately(fd, (message_s2c) {
+                // The username is now attached to the current user node, along with its other sessions.
+                // Le nom est enregistré avant de confirmer la connexion : un autre nœud doit le trouver dès que le
+                // client se sait connecté
+                int64_t cursor = database_cursor(username);
+                database_update_user(username, true);
+                if (cursor < 0) cursor = database_cursor(username); // Première connexion : rien à rattraper
+
+                send_message(user, (message_s2c) {
                     .tag = MESSAGE_S2C_LOGIN_STATUS,
                     .login_status = LOGIN_STATUS_OK,
                 });
+                // Les autres nœuds ne voient que le nom, en ligne dès sa première session
+                if (user->next_session == NULL) cluster_announce_join(username);
+
+                // Les twiiiiits manqués sont remis plus tard, c.f. "catchup.h". Chaque session a son propre
+                // rattrapage, à partir du curseur enregistré, que les autres sessions aient déjà reçu la suite ou non.
+                user->acked_seq = cursor;
+                if ((uint64_t) cursor < database_last_seq()) catchup_submit(user, cursor);
+                return;
             }
         }
     }
 
+    if (!check_rate_limit(server, user, message)) return;
+
     switch (message->tag) {
-        case MESSAGE_C2S_JOIN_AS:;
-            twiiiiit_iterator missed_it = database_list_missed_twiiiiits(username);
-            database_twiiiiit twiiiiit;
-            while (database_twiiiiits_next(missed_it, &twiiiiit)) {
-                message_s2c twiiiiit_msg = (message_s2c) {
-                    .tag = MESSAGE_S2C_RECEIVED_MESSAGE,
-                    .received_message.date = twiiiiit.date,
-                };
-                strncpy(twiiiiit_msg.received_message.author, twiiiiit.author, MAX_USERNAME_LENGTH);
-                strncpy(twiiiiit_msg.received_message.message, twiiiiit.message, MESSAGE_MAX_LENGTH);
-                send_message_immediately(fd, twiiiiit_msg);
-            }
-            database_update_user(username, true);
+        case MESSAGE_C2S_JOIN_AS:
+            // Traité ci-dessus
             return;
         case MESSAGE_C2S_SUBSCRIBE_TO:;
             enum subscribe_result result = database_follow(username, message->subscribe_to);
-            send_message_immediately(fd, (message_s2c) {
+            send_message(user, (message_s2c) {
                 .tag = MESSAGE_S2C_SUBSCRIBE_RESULT,
                 .subscribe_result = result,
             });
             return;
         case MESSAGE_C2S_UNSUBSCRIBE_TO:;
             enum subscribe_result u_result = database_unfollow(username, message->unsubscribe_to);
-            send_message_immediately(fd, (message_s2c) {
+            send_message(user, (message_s2c) {
                 .tag = MESSAGE_S2C_SUBSCRIBE_RESULT,
                 .subscribe_result = u_result,
             });
             return;
+        case MESSAGE_C2S_SUBSCRIBE_BATCH:
+        case MESSAGE_C2S_UNSUBSCRIBE_BATCH:;
+            size_t batch_len = subscribe_batch_len(message);
+            enum subscribe_result batch_results[SUBSCRIBE_BATCH_MAX];
+            database_follow_batch(
+                username,
+                message->subscribe_batch,
+                batch_len,
+                message->tag == MESSAGE_C2S_UNSUBSCRIBE_BATCH,
+                batch_results
+            );
+
+            message_s2c batch_msg = {
+                .tag = MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT,
+                .subscribe_batch_result = { .count = batch_len, .results = 0 },
+            };
+            for (size_t i = 0; i < batch_len; i++) {
+                SUBSCRIBE_BATCH_RESULT_SET(batch_msg.subscribe_batch_result.results, i, batch_results[i]);
+            }
+            send_message(user, batch_msg);
+            return;
         case MESSAGE_C2S_LIST_SUBSCRIPTIONS:;
             user_iterator it = database_list_followee(username);
             message_s2c subscription_entry = {
@@ -238,60 +481,171 @@ void process_message(server_state* server, user_list_node* user, const message_c
             };
 
             while (database_users_next(it, subscription_entry.subscription_entry)) {
-                send_message_immediately(fd, subscription_entry);
+                send_message(user, subscription_entry);
             }
 
             // We finish the list with a blank entry
             memset(subscription_entry.subscription_entry, 0, MAX_USERNAME_LENGTH);
-            send_message_immediately(fd, subscription_entry);
+            send_message(user, subscription_entry);
             return;
         case MESSAGE_C2S_PUBLISH:;
-            time_t twiiiiit_date = database_save_twiiiiit(username, message->publish);
+            database_twiiiiit twiiiiit;
+            database_save_twiiiiit(username, message->publish, &twiiiiit);
             message_s2c twiiiiit_msg = (message_s2c) {
                 .tag = MESSAGE_S2C_RECEIVED_MESSAGE,
-                .received_message.date = twiiiiit_date,
+                .received_message.date = twiiiiit.date,
+                .received_message.seq = twiiiiit.seq,
             };
-            strncpy(twiiiiit_msg.received_message.author, username, MAX_USERNAME_LENGTH);
-            strncpy(twiiiiit_msg.received_message.message, message->publish, MESSAGE_MAX_LENGTH);
-            // Send twiiiiit to self
-            send_message_immediately(fd, twiiiiit_msg);
-            // ... and broadcast twiiiiit
-            user_iterator followers_it = database_list_followers(username);
-            char follower_name[MAX_USERNAME_LENGTH + 1];
-            while (database_users_next(followers_it, follower_name)) {
-                user_list_node* follower_node = user_list_node_find_by_name(server->users, follower_name);
-                if (follower_node != NULL) {
-                    send_message_immediately(follower_node->fd, twiiiiit_msg);
-                }
+            memcpy(twiiiiit_msg.received_message.author, twiiiiit.author, MAX_USERNAME_LENGTH);
+            memcpy(twiiiiit_msg.received_message.message, twiiiiit.message, MESSAGE_MAX_LENGTH);
+            trending_record(message->publish);
+            // Broadcast twiiiiit, progressively, from the event loop, and send the same encoded frame to every session
+            // of the author
+            shared_frame* twiiiiit_frame = fanout_start(server, username, &twiiiiit_msg);
+            user_list_node* sessions = user_list_sessions(username);
+            for (user_list_node* session = sessions; session != NULL; session = session->next_session) {
+                send_shared_frame(session, twiiiiit_frame);
+            }
+            return;
+        case MESSAGE_C2S_PONG:
+            // Le minuteur d'inactivité a déjà été réarmé à la réception
+            return;
+        case MESSAGE_C2S_ACK:
+            // Sans réponse ni écriture : le curseur n'est enregistré qu'à la déconnexion. Un numéro pas encore publié
+            // est ramené au dernier : enregistré, il ferait sauter les twiiiiits suivants à tous les rattrapages, le
+            // curseur ne reculant jamais.
+            if (message->ack > user->acked_seq) {
+                uint64_t last_seq = database_last_seq();
+                user->acked_seq = message->ack < last_seq ? message->ack : last_seq;
+            }
+            return;
+        case MESSAGE_C2S_SEARCH:
+            // Les résultats sont envoyés par search_handle_event()
+            search_submit(user, message->search.query, message->search.cursor, message->search.snapshot);
+            return;
+        case MESSAGE_C2S_TRENDING:;
+            trending_entry entries[TRENDING_TOP];
+            size_t entry_count = trending_top(entries);
+            message_s2c trending_msg = { .tag = MESSAGE_S2C_TRENDING_ENTRY };
+            for (size_t i = 0; i < entry_count; i++) {
+                memcpy(trending_msg.trending_entry.tag, entries[i].tag, MESSAGE_MAX_LENGTH);
+                trending_msg.trending_entry.count = entries[i].count;
+                send_message(user, trending_msg);
+            }
+
+            // La liste se termine par une entrée vide
+            memset(&trending_msg.trending_entry, 0, sizeof trending_msg.trending_entry);
+            send_message(user, trending_msg);
+            return;
+        case MESSAGE_C2S_FETCH_TIMELINE:;
+            int64_t before = message->fetch_timeline.before ?: INT64_MAX;
+            uint64_t before_seq = message->fetch_timeline.before_seq;
+            size_t limit = message->fetch_timeline.limit;
+            if (limit == 0 || limit > TIMELINE_MAX_LIMIT) limit = TIMELINE_MAX_LIMIT;
+
+            // Un twiiiiit de plus que la page, pour savoir s'il en existe une suivante
+            database_twiiiiit timeline[TIMELINE_MAX_LIMIT + 1];
+            size_t timeline_len = timeline_fetch(username, before, before_seq, timeline, limit + 1);
+            message_s2c entry_msg = { .tag = MESSAGE_S2C_TIMELINE_ENTRY };
+            for (size_t i = 0; i < timeline_len && i < limit; i++) {
+                entry_msg.timeline_entry.date = timeline[i].date;
+                entry_msg.timeline_entry.seq = timeline[i].seq;
+                memcpy(entry_msg.timeline_entry.author, timeline[i].author, MAX_USERNAME_LENGTH);
+                memcpy(entry_msg.timeline_entry.message, timeline[i].message, MESSAGE_MAX_LENGTH);
+                send_message(user, entry_msg);
             }
+            send_message(user, (message_s2c) {
+                .tag = MESSAGE_S2C_TIMELINE_END,
+                // Le dernier twiiiiit de la page, pour que la suivante commence après lui même si d'autres ont sa date
+                .timeline_end.before = timeline_len > limit ? timeline[limit - 1].date : 0,
+                .timeline_end.before_seq = timeline_len > limit ? timeline[limit - 1].seq : 0,
+            });
+            return;
+        case MESSAGE_C2S_JOIN_CHANNEL:
+        case MESSAGE_C2S_LEAVE_CHANNEL:;
+            enum subscribe_result channel_result = message->tag == MESSAGE_C2S_JOIN_CHANNEL
+                ? channel_join(username, message->join_channel)
+                : channel_leave(username, message->leave_channel);
+            send_message(user, (message_s2c) {
+                .tag = MESSAGE_S2C_SUBSCRIBE_RESULT,
+                .subscribe_result = channel_result,
+            });
+            return;
+        case MESSAGE_C2S_PUBLISH_CHANNEL:
+            // Remis aux membres, auteur·ice compris·e, par la diffusion
+            channel_publish(server, username, message->publish_channel.channel, message->publish_channel.message);
             return;
     }
 }
 
-/**
- * In the future, we may want to send data using epoll too
- */
-bool send_message_immediately(int fd, message_s2c message) {
+bool send_message(user_list_node* user, message_s2c message) {
     char frame[IO_BUFFER_SIZE];
     memset(frame, 0, IO_BUFFER_SIZE);
     encode_s2c(&message, frame);
 
-    ssize_t remaining = IO_BUFFER_SIZE;
-    while (remaining > 0) {
-        ssize_t written = write(fd, frame + (IO_BUFFER_SIZE - remaining), remaining);
-        if (written < 0) {
-            return false;
-        }
-        remaining -= written;
-    }
+    if (user->gateway != NULL) return gateway_send(user, frame);
+    return outbound_send(user, frame, NULL);
+}
 
-    return true;
+bool send_shared_frame(user_list_node* user, shared_frame* frame) {
+    if (user->gateway != NULL) return gateway_send(user, frame->data);
+    return outbound_send(user, frame->data, frame);
 }
 
 void kick_user(server_state* server, int user_fd, user_list_node* user) {
-    printf("[INFO] %d is leaving\n", user_fd);
-    if (user != NULL) database_update_user(user->user_name, false);
+    if (user == NULL || user->gateway == NULL) log_info("%d is leaving", user_fd);
+    if (user != NULL) timer_cancel(&user->idle_timer);
+    if (user != NULL) record_close(user);
+    // Un rattrapage interrompu reprendra à la prochaine connexion, depuis le dernier twiiiiit acquitté
+    if (user != NULL) catchup_cancel(user);
+    if (user != NULL && user->user_name[0] != 0) {
+        // Le curseur enregistré ne recule pas : c'est le plus loin qu'ait acquitté une session
+        database_save_cursor(user->user_name, user->acked_seq);
+        // Le nom reste en ligne jusqu'à la fin de sa dernière session, qui est alors la seule de l'ensemble
+        if (user_list_sessions(user->user_name) == user && user->next_session == NULL) {
+            database_update_user(user->user_name, false);
+            cluster_announce_leave(user->user_name);
+        }
+    }
+    if (user != NULL && user->gateway == NULL) outbound_discard(user);
+    if (user != NULL && user->gateway != NULL) {
+        // Pas de socket à fermer : la passerelle s'en charge
+        gateway_close_session(user);
+        user_list_node_remove(&server->users, user);
+        return;
+    }
     user_list_node_delete(&server->users, user_fd);
     epoll_ctl(server->epoll, EPOLL_CTL_DEL, user_fd, NULL);
     close(user_fd);
 }
+
+static void handle_idle_timer(timer* t, void* context) {
+    server_state* server = context;
+    user_list_node* user = TIMER_CONTAINER(t, user_list_node, idle_timer);
+
+    if (!user->ping_sent) {
+        send_message(user, (message_s2c) { .tag = MESSAGE_S2C_PING });
+        user->ping_sent = true;
+        timer_schedule(&server->timers, &user->idle_timer, server->ping_timeout_ticks);
+    } else {
+        log_info("%d didn't answer the ping in time", user->fd);
+        send_message(user, (message_s2c) {
+            .tag = MESSAGE_S2C_KICK,
+            .kick = KICK_REASON_TIMEOUT,
+        });
+        kick_user(server, user->fd, user);
+    }
+}
+
+void handle_timer_tick(server_state* server) {
+    uint64_t expirations;
+    if (read(server->timer_fd, &expirations, sizeof expirations) != sizeof expirations) return;
+
+    // Si la boucle a pris du retard, on rattrape tous les ticks manqués
+    while (expirations-- > 0) {
+        timer_wheel_tick(&server->timers, handle_idle_timer, server);
+    }
+
+    // L'index de recherche suit les publications par lots, c.f. database_index_search()
+    database_index_search();
+}
@@ -0,0 +1,171 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "log.h"
+#include "outbound.h"
+#include "slab.h"
+#include "stats.h"
+#include "twiiiiiter_assert.h"
+
+// Trames écrites au plus par appel à writev()
+#define OUTBOUND_WRITE_BATCH 64
+
+typedef struct outbound_entry_s {
+    shared_frame* frame;
+    struct outbound_entry_s* next;
+} outbound_entry;
+
+struct outbound_queue_s {
+    outbound_entry* head;
+    outbound_entry* tail;
+    size_t len;
+    size_t offset; // Octets de la première trame déjà écrits
+};
+
+static slab frames = SLAB_INIT("shared_frame", sizeof(shared_frame));
+static slab entries = SLAB_INIT("outbound_entry", sizeof(outbound_entry));
+static slab queues = SLAB_INIT("outbound_queue", sizeof(outbound_queue));
+
+static int epoll_fd = -1;
+
+void outbound_initialize(int epoll) {
+    epoll_fd = epoll;
+}
+
+static shared_frame* shared_frame_alloc() {
+    shared_frame* frame = slab_alloc(&frames);
+    frame->refs = 1;
+    return frame;
+}
+
+shared_frame* shared_frame_encode(const message_s2c* message) {
+    shared_frame* frame = shared_frame_alloc();
+    memset(frame->data, 0, IO_BUFFER_SIZE);
+    encode_s2c(message, frame->data);
+    stats.publish_encodes++;
+    stats.publish_allocations++;
+    return frame;
+}
+
+void shared_frame_release(shared_frame* frame) {
+    assert(frame->refs > 0);
+    if (--frame->refs == 0) slab_free(&frames, frame);
+}
+
+/**
+ * Inscrit ou désinscrit la connexion à EPOLLOUT
+ */
+static void outbound_watch(int fd, bool writable) {
+    struct epoll_event event = { .events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0) {
+        log_limited(LOG_LEVEL_WARNING, "Couldn't watch %d for writing: errno %d", fd, errno);
+    }
+}
+
+static void outbound_pop(outbound_queue* queue) {
+    outbound_entry* entry = queue->head;
+    queue->head = entry->next;
+    if (queue->head == NULL) queue->tail = NULL;
+    queue->len--;
+    shared_frame_release(entry->frame);
+    slab_free(&entries, entry);
+}
+
+bool outbound_send(user_list_node* user, const char data[IO_BUFFER_SIZE], shared_frame* shared) {
+    if (user->outbound == NULL) {
+        ssize_t written = write(user->fd, data, IO_BUFFER_SIZE);
+        if (written == IO_BUFFER_SIZE) return true;
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return false;
+
+        // Le reste de la trame attendra que le client lise
+        user->outbound = slab_alloc(&queues);
+        *user->outbound = (outbound_queue) { .offset = written > 0 ? written : 0 };
+        outbound_watch(user->fd, true);
+    } else if (user->outbound->len >= OUTBOUND_MAX_FRAMES) {
+        log_limited(LOG_LEVEL_WARNING, "%d isn't reading its messages, disconnecting", user->fd);
+        stats.slow_clients++;
+        // La lecture verra la fin du flux et déconnectera le client, ce qui ne peut pas se faire pendant une diffusion
+        outbound_discard(user);
+        shutdown(user->fd, SHUT_RDWR);
+        return false;
+    }
+
+    shared_frame* frame;
+    if (shared != NULL) {
+        shared->refs++;
+        frame = shared;
+        stats.publish_allocations++; // L'entrée de la file
+    } else {
+        frame = shared_frame_alloc();
+        memcpy(frame->data, data, IO_BUFFER_SIZE);
+    }
+
+    outbound_entry* entry = slab_alloc(&entries);
+    *entry = (outbound_entry) { .frame = frame, .next = NULL };
+    outbound_queue* queue = user->outbound;
+    if (queue->tail != NULL) queue->tail->next = entry;
+    else queue->head = entry;
+    queue->tail = entry;
+    queue->len++;
+    stats.frames_queued++;
+    return true;
+}
+
+bool outbound_flush(user_list_node* user) {
+    outbound_queue* queue = user->outbound;
+    if (queue == NULL) return true;
+
+    while (queue->head != NULL) {
+        struct iovec iov[OUTBOUND_WRITE_BATCH];
+        int iov_len = 0;
+        outbound_entry* entry = queue->head;
+        for (; entry != NULL && iov_len < OUTBOUND_WRITE_BATCH; entry = entry->next) {
+            size_t skip = iov_len == 0 ? queue->offset : 0;
+            iov[iov_len++] = (struct iovec) { .iov_base = entry->frame->data + skip, .iov_len = IO_BUFFER_SIZE - skip };
+        }
+
+        ssize_t written = writev(user->fd, iov, iov_len);
+        if (written < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        written += queue->offset;
+        while (written >= IO_BUFFER_SIZE) {
+            outbound_pop(queue);
+            written -= IO_BUFFER_SIZE;
+        }
+        queue->offset = written;
+        if (queue->offset > 0) return true; // Le socket est plein
+    }
+
+    slab_free(&queues, queue);
+    user->outbound = NULL;
+    outbound_watch(user->fd, false);
+    return true;
+}
+
+bool outbound_drain(user_list_node* user, int64_t deadline) {
+    while (user->outbound != NULL) {
+        if (!outbound_flush(user)) return false;
+        if (user->outbound == NULL) break;
+
+        int64_t remaining_us = deadline - monotonic_now();
+        struct pollfd writable = { .fd = user->fd, .events = POLLOUT };
+        if (remaining_us <= 0 || poll(&writable, 1, (remaining_us + 999) / 1000) <= 0) return false;
+    }
+    return true;
+}
+
+void outbound_discard(user_list_node* user) {
+    outbound_queue* queue = user->outbound;
+    if (queue == NULL) return;
+
+    while (queue->head != NULL) outbound_pop(queue);
+    slab_free(&queues, queue);
+    user->outbound = NULL;
+    outbound_watch(user->fd, false);
+}
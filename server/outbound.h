@@ -0,0 +1,69 @@
+#ifndef _OUTBOUND_H_
+#define _OUTBOUND_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "codec.h"
+#include "user_list.h"
+
+/**
+ * Envoi des trames aux connexions directes
+ *
+ * Les sockets des clients sont non bloquants : une trame est écrite tout de suite si le noyau l'accepte, et sinon mise
+ * dans la file de la connexion, écrite quand epoll signale (EPOLLOUT) que le client lit de nouveau. Un client lent ne
+ * bloque donc plus la boucle d'évènements. Au-delà de OUTBOUND_MAX_FRAMES trames en attente, il est déconnecté.
+ *
+ * Une trame diffusée est encodée une seule fois, dans une shared_frame : les files de tou·tes les abonné·es qui ne
+ * l'ont pas reçue tout de suite pointent sur le même tampon, rendu après la dernière écriture.
+ */
+
+#define OUTBOUND_MAX_FRAMES 4096
+
+/**
+ * Trame encodée, partagée entre toutes les files qui la contiennent
+ */
+typedef struct shared_frame_s {
+    uint32_t refs;
+    char data[IO_BUFFER_SIZE];
+} shared_frame;
+
+typedef struct outbound_queue_s outbound_queue;
+
+/**
+ * Encode un message dans une trame partagée, avec une référence pour l'appelant
+ */
+shared_frame* shared_frame_encode(const message_s2c* message);
+
+void shared_frame_release(shared_frame* frame);
+
+/**
+ * Les files s'inscrivent à EPOLLOUT sur `epoll` le temps d'avoir des trames en attente
+ */
+void outbound_initialize(int epoll);
+
+/**
+ * Envoie une trame à une connexion directe, ou la met en file derrière celles en attente. `shared` est la trame
+ * partagée qui contient `data`, NULL si elle n'est destinée qu'à ce client (elle est alors copiée si besoin).
+ *
+ * Renvoie false si la connexion est fermée ou trop en retard, auquel cas la lecture constatera la déconnexion.
+ */
+bool outbound_send(user_list_node* user, const char data[IO_BUFFER_SIZE], shared_frame* shared);
+
+/**
+ * Écrit ce que le socket accepte de la file d'une connexion, à appeler sur EPOLLOUT. Renvoie false en cas d'erreur.
+ */
+bool outbound_flush(user_list_node* user);
+
+/**
+ * Écrit toute la file d'une connexion, en attendant au besoin jusqu'à `deadline` (c.f. monotonic_now()). Renvoie false
+ * si ce n'est pas possible.
+ */
+bool outbound_drain(user_list_node* user, int64_t deadline);
+
+/**
+ * Oublie les trames en attente d'une connexion, avant sa fermeture
+ */
+void outbound_discard(user_list_node* user);
+
+#endif
@@ -0,0 +1,45 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clock.h"
+#include "log.h"
+#include "rate_limit.h"
+
+rate_limit_config rate_limit_config_from_env(const char* name, rate_limit_config fallback) {
+    const char* value = getenv(name);
+    if (value == NULL) return fallback;
+
+    rate_limit_config config = { .rate = 0, .burst = 0 };
+    int parsed = sscanf(value, "%lf:%lf", &config.rate, &config.burst);
+    if (parsed < 1 || config.rate < 0 || (config.rate > 0 && (parsed != 2 || config.burst < 1))) {
+        log_error("Invalid rate limit %s=\"%s\", expected RATE:BURST or 0", name, value);
+        exit(1);
+    }
+
+    return config;
+}
+
+bool token_bucket_take(token_bucket* bucket, const rate_limit_config* config, double cost, uint32_t* retry_after_ms) {
+    if (config->rate == 0) return true;
+
+    int64_t now = monotonic_now();
+    if (bucket->last_refill == 0) {
+        bucket->tokens = config->burst;
+    } else {
+        bucket->tokens += (double) (now - bucket->last_refill) / 1e6 * config->rate;
+        if (bucket->tokens > config->burst) bucket->tokens = config->burst;
+    }
+    bucket->last_refill = now;
+
+    // Une requête plus coûteuse que la rafale autorisée ne pourrait jamais passer, elle prend alors tout le seau
+    if (cost > config->burst) cost = config->burst;
+
+    if (bucket->tokens >= cost) {
+        bucket->tokens -= cost;
+        return true;
+    }
+
+    *retry_after_ms = (uint32_t) ceil((cost - bucket->tokens) / config->rate * 1000);
+    return false;
+}
@@ -0,0 +1,45 @@
+#ifndef _RATE_LIMIT_H_
+#define _RATE_LIMIT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Familles de requêtes limitées séparément
+ */
+enum rate_limit_class {
+    RATE_LIMIT_PUBLISH, // MESSAGE_C2S_PUBLISH et MESSAGE_C2S_PUBLISH_CHANNEL
+    // MESSAGE_C2S_(UN)SUBSCRIBE_TO, MESSAGE_C2S_(JOIN|LEAVE)_CHANNEL, et MESSAGE_C2S_(UN)SUBSCRIBE_BATCH pour chacun de
+    // leurs noms
+    RATE_LIMIT_FOLLOW,
+    RATE_LIMIT_LIST, // MESSAGE_C2S_LIST_SUBSCRIPTIONS, MESSAGE_C2S_TRENDING et MESSAGE_C2S_FETCH_TIMELINE
+    RATE_LIMIT_SEARCH, // MESSAGE_C2S_SEARCH
+    RATE_LIMIT_CLASS_COUNT,
+};
+
+typedef struct {
+    double rate; // Jetons par seconde, 0 pour ne pas limiter
+    double burst; // Nombre maximal de jetons accumulés
+} rate_limit_config;
+
+/**
+ * Seau à jetons. Un seau dont `last_refill` vaut 0 est plein.
+ */
+typedef struct {
+    double tokens;
+    int64_t last_refill; // En microsecondes, horloge monotone
+} token_bucket;
+
+/**
+ * Lit la configuration d'une famille dans la variable d'environnement `name`, de la forme "RATE:BURST" (ou "0" pour
+ * désactiver la limite)
+ */
+rate_limit_config rate_limit_config_from_env(const char* name, rate_limit_config fallback);
+
+/**
+ * Tente de prendre `cost` jetons dans le seau. En cas d'échec, `retry_after_ms` reçoit le délai après lequel ils seront
+ * de nouveau disponibles.
+ */
+bool token_bucket_take(token_bucket* bucket, const rate_limit_config* config, double cost, uint32_t* retry_after_ms);
+
+#endif
@@ -0,0 +1,179 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "database.h"
+#include "log.h"
+#include "read_pool.h"
+#include "trace.h"
+#include "twiiiiiter_assert.h"
+
+typedef struct {
+    read_task* head;
+    read_task* tail;
+} read_queue;
+
+typedef struct {
+    pthread_t thread;
+    pthread_cond_t pending_available;
+    read_queue pending; // Protégée par `mutex`
+    size_t load; // Tâches confiées et pas encore rendues, tenu par la boucle d'évènements
+} reader;
+
+static reader* readers = NULL;
+static size_t reader_count = 0;
+// Tâches soumises et pas encore rendues, tenu par la boucle d'évènements
+static size_t in_flight = 0;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t completed_available = PTHREAD_COND_INITIALIZER;
+// Protégés par `mutex`
+static read_queue completed = { NULL, NULL };
+static bool stopping = false;
+
+// Signale à la boucle d'évènements que `completed` n'est pas vide
+static int completed_fd = -1;
+
+static void read_queue_push(read_queue* queue, read_task* task) {
+    task->next = NULL;
+    if (queue->tail != NULL) queue->tail->next = task;
+    else queue->head = task;
+    queue->tail = task;
+}
+
+static void* read_pool_worker(void* arg) {
+    reader* self = arg;
+    database_open_reader();
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        // La file est vidée avant l'arrêt, pour que toutes les tâches soient rendues
+        while (self->pending.head == NULL && !stopping) pthread_cond_wait(&self->pending_available, &mutex);
+        if (self->pending.head == NULL) break;
+
+        read_task* task = self->pending.head;
+        self->pending.head = task->next;
+        if (self->pending.head == NULL) self->pending.tail = NULL;
+        pthread_mutex_unlock(&mutex);
+
+        task->run(task);
+
+        pthread_mutex_lock(&mutex);
+        read_queue_push(&completed, task);
+        pthread_cond_signal(&completed_available);
+        uint64_t one = 1;
+        assert(write(completed_fd, &one, sizeof one) == sizeof one);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    database_close_reader();
+    return NULL;
+}
+
+void read_pool_initialize(server_state* server) {
+    const char* readers_env = getenv("TWIIIIITER_DATABASE_READERS");
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    reader_count = readers_env != NULL ? strtoull(readers_env, NULL, 10) : (cores > 0 ? cores : 1);
+    if (!database_parallel_reads()) reader_count = 0;
+    if (reader_count == 0) {
+        log_info("Reading the database on the event loop");
+        return;
+    }
+
+    completed_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(completed_fd >= 0);
+    struct epoll_event completed_epollin = { .events = EPOLLIN, .data.fd = completed_fd };
+    epoll_ctl(server->epoll, EPOLL_CTL_ADD, completed_fd, &completed_epollin);
+
+    readers = calloc(reader_count, sizeof(reader));
+    assert(readers != NULL);
+    for (size_t i = 0; i < reader_count; i++) {
+        assert(pthread_cond_init(&readers[i].pending_available, NULL) == 0);
+        assert(pthread_create(&readers[i].thread, NULL, read_pool_worker, &readers[i]) == 0);
+    }
+    log_info("Reading the database on %zu threads", reader_count);
+}
+
+void read_pool_submit(read_task* task) {
+    if (reader_count == 0) {
+        task->run(task);
+        task->complete(task);
+        return;
+    }
+
+    if (task->reader == READ_POOL_ANY_READER) {
+        task->reader = 0;
+        for (size_t i = 1; i < reader_count; i++) {
+            if (readers[i].load < readers[task->reader].load) task->reader = i;
+        }
+    }
+    reader* target = &readers[task->reader];
+    target->load++;
+    in_flight++;
+
+    pthread_mutex_lock(&mutex);
+    read_queue_push(&target->pending, task);
+    pthread_cond_signal(&target->pending_available);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Rend les tâches lues. Une tâche rendue peut être soumise de nouveau, elle n'est donc plus touchée après `complete`.
+ */
+static void read_pool_complete() {
+    TRACE_SCOPE(read_pool_complete);
+    pthread_mutex_lock(&mutex);
+    read_task* task = completed.head;
+    completed = (read_queue) { NULL, NULL };
+    pthread_mutex_unlock(&mutex);
+
+    while (task != NULL) {
+        read_task* next = task->next;
+        readers[task->reader].load--;
+        in_flight--;
+        task->complete(task);
+        task = next;
+    }
+}
+
+bool read_pool_handle_event(server_state* server, struct epoll_event* event) {
+    (void) server;
+    if (completed_fd < 0 || event->data.fd != completed_fd) return false;
+
+    uint64_t count;
+    if (read(completed_fd, &count, sizeof count) != sizeof count) return true;
+    read_pool_complete();
+    return true;
+}
+
+bool read_pool_wait() {
+    if (in_flight == 0) return false;
+
+    pthread_mutex_lock(&mutex);
+    while (completed.head == NULL) pthread_cond_wait(&completed_available, &mutex);
+    pthread_mutex_unlock(&mutex);
+    // L'eventfd reste signalé : la boucle d'évènements le videra sans trouver de tâche
+    read_pool_complete();
+    return true;
+}
+
+void read_pool_shutdown() {
+    if (reader_count == 0) return;
+
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    for (size_t i = 0; i < reader_count; i++) pthread_cond_signal(&readers[i].pending_available);
+    pthread_mutex_unlock(&mutex);
+    for (size_t i = 0; i < reader_count; i++) {
+        pthread_join(readers[i].thread, NULL);
+        pthread_cond_destroy(&readers[i].pending_available);
+    }
+
+    read_pool_complete();
+    free(readers);
+    readers = NULL;
+    reader_count = 0;
+    close(completed_fd);
+    completed_fd = -1;
+}
@@ -0,0 +1,59 @@
+#ifndef _READ_POOL_H_
+#define _READ_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include "server.h"
+
+/**
+ * Lectures de la base de données sur des threads lecteurs, en parallèle de la boucle d'évènements
+ *
+ * Chaque lecteur a sa propre connexion en lecture seule (c.f. database_open_reader()) et sa file de tâches. Une tâche
+ * est lue (`run`) par son lecteur, puis rendue (`complete`) à la boucle d'évènements au travers d'un eventfd, comme les
+ * résultats de recherche (c.f. "search.h"). Elle est confiée la première fois au lecteur le moins chargé, et y reste :
+ * un itérateur ouvert par une lecture peut ainsi être repris par la suivante, sur la même connexion.
+ *
+ * Sans lecteur (TWIIIIITER_DATABASE_READERS=0, ou un moteur qui ne permet pas de lire en parallèle), une tâche est lue
+ * et rendue sur-le-champ, dans read_pool_submit().
+ */
+
+#define READ_POOL_ANY_READER SIZE_MAX
+
+typedef struct read_task_s {
+    void (*run)(struct read_task_s* task); // Sur le thread lecteur
+    void (*complete)(struct read_task_s* task); // Sur la boucle d'évènements, qui peut alors libérer la tâche
+    size_t reader; // READ_POOL_ANY_READER avant la première soumission
+
+    struct read_task_s* next;
+} read_task;
+
+/**
+ * Démarre les lecteurs, autant que TWIIIIITER_DATABASE_READERS (par défaut, un par cœur)
+ */
+void read_pool_initialize(server_state* server);
+
+/**
+ * Met une tâche en file sur son lecteur. Ni la tâche ni ce qu'elle lit ne doivent être modifiés avant qu'elle ne soit
+ * rendue.
+ */
+void read_pool_submit(read_task* task);
+
+/**
+ * Traite un évènement epoll s'il concerne les lecteurs, et renvoie alors true
+ */
+bool read_pool_handle_event(server_state* server, struct epoll_event* event);
+
+/**
+ * Attend qu'au moins une tâche en cours soit lue, et rend celles qui le sont. Renvoie false s'il n'y en avait aucune.
+ */
+bool read_pool_wait();
+
+/**
+ * Arrête les lecteurs une fois leurs files vidées, et rend les dernières tâches
+ */
+void read_pool_shutdown();
+
+#endif
@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "clock.h"
+#include "database.h"
+#include "log.h"
+#include "record.h"
+
+#define RECORD_BUFFER_SIZE (1 << 20)
+// Nombre de cases (puissance de 2), environ 1,3 Mo
+#define RECORD_RING_CAPACITY 16384
+
+/**
+ * Une case du tampon circulaire, avec le même protocole que celles de "/common/log.c" : son numéro de séquence vaut la
+ * position d'écriture quand elle est libre, et la position + 1 quand elle contient un enregistrement prêt à être écrit.
+ */
+typedef struct {
+    atomic_size_t sequence;
+    capture_record record;
+} record_slot;
+
+static record_slot ring[RECORD_RING_CAPACITY];
+static size_t enqueue_position = 0; // Seul le thread principal y touche
+static size_t dequeue_position = 0; // Seul le thread d'écriture y touche
+
+// Remis à false quand l'enregistrement s'arrête, par record_shutdown() ou après une erreur
+static atomic_bool recording = false;
+static atomic_bool write_failed = false;
+static atomic_bool running = false;
+static atomic_bool writer_sleeping = false;
+static int wakeup_fd = -1;
+static pthread_t writer;
+
+static const char* record_path;
+static capture_file capture;
+static int64_t started; // Horloge monotone, c.f. monotonic_now()
+static size_t recorded_frames = 0;
+
+static bool record_ring_empty() {
+    record_slot* slot = &ring[dequeue_position & (RECORD_RING_CAPACITY - 1)];
+    return atomic_load(&slot->sequence) != dequeue_position + 1;
+}
+
+static void* record_writer(void* arg) {
+    (void) arg;
+
+    for (;;) {
+        record_slot* slot = &ring[dequeue_position & (RECORD_RING_CAPACITY - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == dequeue_position + 1) {
+            if (!atomic_load(&write_failed) && !capture_write(&capture, &slot->record)) {
+                // Un disque plein ne doit pas arrêter le serveur, seulement l'enregistrement
+                log_error("Can't write to the capture file %s, recording stopped", record_path);
+                atomic_store(&write_failed, true);
+                atomic_store(&recording, false);
+            }
+            atomic_store_explicit(&slot->sequence, dequeue_position + RECORD_RING_CAPACITY, memory_order_release);
+            dequeue_position++;
+            continue;
+        }
+
+        if (!atomic_load(&running)) return NULL;
+
+        // Même précaution que log_flusher() pour ne pas manquer un enregistrement ajouté entre-temps
+        atomic_store(&writer_sleeping, true);
+        if (!record_ring_empty() || !atomic_load(&running)) {
+            atomic_store(&writer_sleeping, false);
+            continue;
+        }
+
+        uint64_t value;
+        while (read(wakeup_fd, &value, sizeof value) < 0 && errno == EINTR);
+    }
+}
+
+static void record_wake_writer() {
+    if (atomic_exchange(&writer_sleeping, false)) {
+        uint64_t one = 1;
+        while (write(wakeup_fd, &one, sizeof one) < 0 && errno == EINTR);
+    }
+}
+
+/**
+ * Renomme la capture de l'ancien processus en "CHEMIN.N", avec le premier N libre, plutôt que de l'écraser
+ */
+static void record_keep_previous() {
+    char previous[4096];
+    for (unsigned n = 1;; n++) {
+        snprintf(previous, sizeof previous, "%s.%u", record_path, n);
+        if (access(previous, F_OK) != 0) break;
+    }
+
+    if (rename(record_path, previous) == 0) {
+        log_info("Kept the capture of the previous process as %s", previous);
+    } else if (errno != ENOENT) {
+        log_warning("Can't keep the capture of the previous process as %s: %s", previous, strerror(errno));
+    }
+}
+
+void record_initialize(bool taking_over) {
+    record_path = getenv("TWIIIIITER_RECORD_FILE");
+    if (record_path == NULL) return;
+    if (taking_over) record_keep_previous();
+
+    if (!capture_create(&capture, record_path, ts_now())) {
+        log_error("Can't create the capture file %s: %s", record_path, strerror(errno));
+        exit(1);
+    }
+    setvbuf(capture.file, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+
+    for (size_t i = 0; i < RECORD_RING_CAPACITY; i++) atomic_init(&ring[i].sequence, i);
+    wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd < 0) {
+        log_error("Can't create the eventfd of the capture writer: %s", strerror(errno));
+        exit(1);
+    }
+    atomic_store(&running, true);
+
+    // Les signaux sont pour le thread principal (c.f. son signalfd), le thread d'écriture les bloque tous
+    sigset_t all_signals, previous_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous_signals);
+    int created = pthread_create(&writer, NULL, record_writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+    if (created != 0) {
+        log_error("Can't start the capture writer: %s", strerror(created));
+        exit(1);
+    }
+
+    started = monotonic_now();
+    atomic_store(&recording, true);
+    log_info("Recording the incoming traffic to %s", record_path);
+}
+
+/**
+ * Passe l'enregistrement au thread d'écriture, et renvoie false s'il n'a pas été gardé
+ */
+static bool record_write(int kind, const user_list_node* user, const char* frame) {
+    if (!atomic_load_explicit(&recording, memory_order_relaxed)) return false;
+
+    record_slot* slot = &ring[enqueue_position & (RECORD_RING_CAPACITY - 1)];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != enqueue_position) {
+        // Une capture à laquelle il manque des trames fausserait le rejeu : elle s'arrête là, complète jusqu'ici
+        log_error("The capture file %s can't keep up with the traffic, recording stopped", record_path);
+        atomic_store(&recording, false);
+        return false;
+    }
+
+    slot->record.kind = kind;
+    slot->record.time_us = monotonic_now() - started;
+    slot->record.connection = user->id;
+    if (frame != NULL) memcpy(slot->record.frame, frame, IO_BUFFER_SIZE);
+
+    atomic_store_explicit(&slot->sequence, enqueue_position + 1, memory_order_release);
+    enqueue_position++;
+    atomic_thread_fence(memory_order_seq_cst);
+    record_wake_writer();
+    return true;
+}
+
+void record_open(const user_list_node* user) {
+    record_write(CAPTURE_OPEN, user, NULL);
+    if (user->user_name[0] == 0) return;
+
+    message_c2s join = { .tag = MESSAGE_C2S_JOIN_AS };
+    memcpy(join.join_as, user->user_name, sizeof(user_name));
+    char frame[IO_BUFFER_SIZE] = { 0 };
+    encode_c2s(&join, frame);
+    record_write(CAPTURE_FRAME, user, frame);
+}
+
+void record_frame(const user_list_node* user, const char frame[IO_BUFFER_SIZE]) {
+    if (record_write(CAPTURE_FRAME, user, frame)) recorded_frames++;
+}
+
+void record_close(const user_list_node* user) {
+    record_write(CAPTURE_CLOSE, user, NULL);
+}
+
+void record_shutdown() {
+    if (!atomic_exchange(&running, false)) return;
+
+    atomic_store(&recording, false);
+    atomic_store(&writer_sleeping, true);
+    record_wake_writer();
+    pthread_join(writer, NULL);
+    close(wakeup_fd);
+
+    if (!capture_close(&capture)) {
+        if (!atomic_load(&write_failed)) log_error("Can't write the end of the capture file %s", record_path);
+        return;
+    }
+    if (atomic_load(&write_failed)) return;
+    log_info("Recorded %zu frames to %s", recorded_frames, record_path);
+}
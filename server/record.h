@@ -0,0 +1,44 @@
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include "codec.h"
+#include "user_list.h"
+
+/**
+ * Enregistrement du trafic entrant, activé par TWIIIIITER_RECORD_FILE
+ *
+ * Les connexions acceptées, leurs trames (telles que reçues, avant décodage) et leurs fins sont écrites dans le fichier
+ * de capture (c.f. "/common/capture.h") avec le temps écoulé depuis le démarrage, pour que twiiiiiter-replay puisse
+ * rejouer la même charge contre un autre serveur. Les connexions sont identifiées par l'identifiant de leur nœud, et
+ * les sessions ouvertes au travers d'une passerelle sont enregistrées comme des connexions directes.
+ *
+ * Comme pour la journalisation (c.f. "/common/log.h"), la boucle d'évènements ne fait que déposer les enregistrements
+ * dans un tampon circulaire sans verrou, et un thread dédié les encode et les écrit : un disque lent ne la bloque
+ * jamais. Si ce thread prend trop de retard et que le tampon est plein, l'enregistrement s'arrête, plutôt que de
+ * perdre des trames au milieu de la capture. L'écriture passe aussi par un tampon de RECORD_BUFFER_SIZE octets, et la
+ * fin de la capture n'est complète qu'une fois le serveur arrêté ou la main passée. Chaque processus écrit sa propre
+ * capture : après un redémarrage sans coupure, les connexions reprises y apparaissent comme de nouvelles connexions, et
+ * celle de l'ancien processus est gardée à côté (c.f. record_initialize()).
+ */
+
+/**
+ * Crée le fichier de capture, si l'enregistrement est activé. Quand le processus prend la suite d'un autre
+ * (`taking_over`, c.f. handoff_receive()), la capture de celui-ci est d'abord renommée en "TWIIIIITER_RECORD_FILE.N",
+ * avec le premier N libre.
+ */
+void record_initialize(bool taking_over);
+
+/**
+ * Enregistre l'ouverture d'une connexion, suivie d'un MESSAGE_C2S_JOIN_AS si elle a déjà un nom (c'est le cas d'une
+ * connexion reprise d'un redémarrage sans coupure)
+ */
+void record_open(const user_list_node* user);
+void record_frame(const user_list_node* user, const char frame[IO_BUFFER_SIZE]);
+void record_close(const user_list_node* user);
+
+/**
+ * Termine l'écriture de la capture
+ */
+void record_shutdown();
+
+#endif
@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "database.h"
+#include "log.h"
+#include "search.h"
+#include "twiiiiiter_assert.h"
+
+typedef struct search_request_s {
+    // Le descripteur peut être réutilisé par une nouvelle connexion avant la fin de la recherche, d'où l'identifiant
+    uint64_t connection_id;
+    char query[MESSAGE_MAX_LENGTH];
+    uint32_t cursor;
+    uint64_t snapshot;
+
+    // Remplis par le thread de recherche
+    database_twiiiiit results[SEARCH_PAGE_SIZE];
+    size_t result_count;
+    uint32_t next_cursor;
+
+    struct search_request_s* next;
+} search_request;
+
+typedef struct {
+    search_request* head;
+    search_request* tail;
+} search_queue;
+
+static pthread_t worker;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_available = PTHREAD_COND_INITIALIZER;
+// Protégés par `mutex`
+static search_queue pending = { NULL, NULL };
+static search_queue completed = { NULL, NULL };
+static bool stopping = false;
+
+// Signale à la boucle d'évènements que `completed` n'est pas vide
+static int completed_fd = -1;
+
+static void search_queue_push(search_queue* queue, search_request* request) {
+    request->next = NULL;
+    if (queue->tail != NULL) queue->tail->next = request;
+    else queue->head = request;
+    queue->tail = request;
+}
+
+static void search_run(search_request* request) {
+    // Un résultat de plus que la page, pour savoir s'il en existe une suivante
+    twiiiiit_iterator it = database_search_twiiiiits(
+        request->query,
+        request->snapshot,
+        request->cursor,
+        SEARCH_PAGE_SIZE + 1
+    );
+    database_twiiiiit twiiiiit;
+    size_t found = 0;
+    while (database_twiiiiits_next(it, &twiiiiit)) {
+        if (found < SEARCH_PAGE_SIZE) request->results[found] = twiiiiit;
+        found++;
+    }
+
+    request->result_count = found < SEARCH_PAGE_SIZE ? found : SEARCH_PAGE_SIZE;
+    bool has_next = found > SEARCH_PAGE_SIZE && request->cursor <= UINT32_MAX - SEARCH_PAGE_SIZE;
+    request->next_cursor = has_next ? request->cursor + SEARCH_PAGE_SIZE : 0;
+}
+
+static void* search_worker(void* arg) {
+    (void) arg;
+    bool reader = database_parallel_reads();
+    if (reader) database_open_reader();
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (pending.head == NULL && !stopping) pthread_cond_wait(&pending_available, &mutex);
+        if (stopping) break;
+
+        search_request* request = pending.head;
+        pending.head = request->next;
+        if (pending.head == NULL) pending.tail = NULL;
+        pthread_mutex_unlock(&mutex);
+
+        search_run(request);
+
+        pthread_mutex_lock(&mutex);
+        search_queue_push(&completed, request);
+        uint64_t one = 1;
+        assert(write(completed_fd, &one, sizeof one) == sizeof one);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (reader) database_close_reader();
+    return NULL;
+}
+
+void search_initialize(server_state* server) {
+    completed_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(completed_fd >= 0);
+    struct epoll_event completed_epollin = { .events = EPOLLIN, .data.fd = completed_fd };
+    epoll_ctl(server->epoll, EPOLL_CTL_ADD, completed_fd, &completed_epollin);
+
+    assert(pthread_create(&worker, NULL, search_worker, NULL) == 0);
+}
+
+void search_submit(const user_list_node* user, const char* query, uint32_t cursor, uint64_t snapshot) {
+    // Lu avant l'indexation, qui ajoute au moins tous les twiiiiits jusqu'à celui-ci (y compris ceux d'autres nœuds)
+    if (snapshot == 0) snapshot = database_last_seq();
+    // La recherche trouve ainsi tout ce qui a été publié jusque-là
+    database_index_search();
+
+    search_request* request = malloc(sizeof(search_request));
+    assert(request != NULL);
+    request->connection_id = user->id;
+    memcpy(request->query, query, MESSAGE_MAX_LENGTH);
+    request->cursor = cursor;
+    request->snapshot = snapshot;
+
+    pthread_mutex_lock(&mutex);
+    search_queue_push(&pending, request);
+    pthread_cond_signal(&pending_available);
+    pthread_mutex_unlock(&mutex);
+}
+
+bool search_handle_event(server_state* server, struct epoll_event* event) {
+    (void) server;
+    if (event->data.fd != completed_fd) return false;
+
+    uint64_t count;
+    if (read(completed_fd, &count, sizeof count) != sizeof count) return true;
+
+    pthread_mutex_lock(&mutex);
+    search_request* request = completed.head;
+    completed = (search_queue) { NULL, NULL };
+    pthread_mutex_unlock(&mutex);
+
+    while (request != NULL) {
+        search_request* next = request->next;
+
+        user_list_node* user = user_list_node_find_by_id(request->connection_id);
+        if (user != NULL) {
+            message_s2c result = { .tag = MESSAGE_S2C_SEARCH_RESULT };
+            for (size_t i = 0; i < request->result_count; i++) {
+                result.search_result.date = request->results[i].date;
+                result.search_result.seq = request->results[i].seq;
+                memcpy(result.search_result.author, request->results[i].author, MAX_USERNAME_LENGTH);
+                memcpy(result.search_result.message, request->results[i].message, MESSAGE_MAX_LENGTH);
+                send_message(user, result);
+            }
+            send_message(user, (message_s2c) {
+                .tag = MESSAGE_S2C_SEARCH_END,
+                .search_end = { .cursor = request->next_cursor, .snapshot = request->snapshot },
+            });
+        }
+
+        free(request);
+        request = next;
+    }
+
+    return true;
+}
+
+void search_shutdown() {
+    if (completed_fd < 0) return;
+
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_signal(&pending_available);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(worker, NULL);
+
+    search_queue queues[] = { pending, completed };
+    for (size_t i = 0; i < sizeof queues / sizeof *queues; i++) {
+        for (search_request* request = queues[i].head; request != NULL;) {
+            search_request* next = request->next;
+            free(request);
+            request = next;
+        }
+    }
+
+    close(completed_fd);
+}
@@ -0,0 +1,38 @@
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include "server.h"
+
+// Nombre de résultats par page
+#define SEARCH_PAGE_SIZE 10
+
+/**
+ * Recherche plein texte (MESSAGE_C2S_SEARCH) hors de la boucle d'évènements
+ *
+ * Les requêtes sont transmises à un thread dédié qui interroge la base de données. Les pages de résultats reviennent à
+ * la boucle d'évènements par un eventfd, et sont envoyées au client s'il est toujours connecté : une recherche lente
+ * ne retarde ainsi jamais la remise des twiiiiits.
+ */
+void search_initialize(server_state* server);
+
+/**
+ * Traite un évènement epoll s'il concerne la recherche, et renvoie alors true
+ */
+bool search_handle_event(server_state* server, struct epoll_event* event);
+
+/**
+ * Met en file une recherche pour le compte de `user`. Un `snapshot` nul (première page) est remplacé par le numéro de
+ * séquence du dernier twiiiiit publié, que les pages suivantes reprennent, c.f. MESSAGE_S2C_SEARCH_END.
+ */
+void search_submit(const user_list_node* user, const char* query, uint32_t cursor, uint64_t snapshot);
+
+/**
+ * Arrête le thread de recherche. Les résultats qui n'ont pas encore été envoyés sont abandonnés.
+ */
+void search_shutdown();
+
+#endif
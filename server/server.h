@@ -1,17 +1,52 @@
 #ifndef _SERVER_H_
 #define _SERVER_H_
 
+#include <sys/epoll.h>
+
+#include "listener.h"
+#include "outbound.h"
 #include "user_list.h"
 
+struct fanout_job_s;
+
 typedef struct {
-    int server_socket;
+    listener_set listeners; // Sockets d'écoute des clients
     int epoll;
     user_list_node* users;
+
+    int timer_fd;
+    timer_wheel timers;
+    uint64_t idle_timeout_ticks; // Délai d'inactivité avant l'envoi d'un MESSAGE_S2C_PING
+    uint64_t ping_timeout_ticks; // Délai laissé pour y répondre avant d'être déconnecté
+    size_t max_sessions; // Sessions ouvertes en même temps sous un même nom, c.f. user_list_node_attach()
+
+    rate_limit_config rate_limits[RATE_LIMIT_CLASS_COUNT];
+
+    // File des diffusions en cours, c.f. "fanout.h"
+    struct fanout_job_s* fanout_head;
+    struct fanout_job_s* fanout_tail;
+    int64_t fanout_slice_us;
 } server_state;
 
 void handle_event(server_state* server, struct epoll_event* event);
 void process_message(server_state* server, user_list_node* user, const message_c2s* message);
-bool send_message_immediately(int fd, message_s2c message);
+
+/**
+ * Traite une trame complète reçue de `user`, directement ou au travers d'une passerelle. Renvoie false si elle n'a pas
+ * pu être décodée.
+ */
+bool handle_frame(server_state* server, user_list_node* user, const char frame[IO_BUFFER_SIZE]);
+
+/**
+ * Envoie un message à `user`, sur sa connexion ou au travers de sa passerelle
+ */
+bool send_message(user_list_node* user, message_s2c message);
+
+/**
+ * Envoie une trame déjà encodée, partagée entre plusieurs destinataires, sans la recopier pour une connexion directe
+ */
+bool send_shared_frame(user_list_node* user, shared_frame* frame);
 void kick_user(server_state* server, int user_fd, user_list_node* user);
+void handle_timer_tick(server_state* server);
 
 #endif
@@ -0,0 +1,68 @@
+#include <stdalign.h>
+#include <stdlib.h>
+
+#include "slab.h"
+#include "twiiiiiter_assert.h"
+
+typedef struct slab_chunk_s {
+    struct slab_chunk_s* next;
+    alignas(max_align_t) char objects[];
+} slab_chunk;
+
+static slab* slabs = NULL;
+
+/**
+ * Taille réelle d'un objet : de quoi y chaîner un objet libre, et un multiple de l'alignement d'un pointeur
+ */
+static size_t slab_stride(const slab* slab) {
+    size_t size = slab->object_size < sizeof(void*) ? sizeof(void*) : slab->object_size;
+    return (size + alignof(void*) - 1) & ~(alignof(void*) - 1);
+}
+
+static void slab_grow(slab* slab) {
+    if (slab->chunk_count == 0) {
+        slab->next = slabs;
+        slabs = slab;
+    }
+
+    slab_chunk* chunk = malloc(SLAB_CHUNK_SIZE);
+    assert(chunk != NULL);
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->chunk_count++;
+
+    size_t stride = slab_stride(slab);
+    size_t count = (SLAB_CHUNK_SIZE - sizeof(slab_chunk)) / stride;
+    assert(count > 0);
+    // Chaînés à l'envers, pour que les premiers objets alloués soient au début du bloc
+    for (size_t i = count; i-- > 0;) {
+        void** object = (void**) (chunk->objects + i * stride);
+        *object = slab->free_list;
+        slab->free_list = object;
+    }
+}
+
+void* slab_alloc(slab* slab) {
+    if (slab->free_list == NULL) slab_grow(slab);
+
+    void** object = slab->free_list;
+    slab->free_list = *object;
+    slab->in_use++;
+    return object;
+}
+
+void slab_free(slab* slab, void* object) {
+    if (object == NULL) return;
+
+    *(void**) object = slab->free_list;
+    slab->free_list = object;
+    slab->in_use--;
+}
+
+size_t slab_reserved_bytes(const slab* slab) {
+    return slab->chunk_count * SLAB_CHUNK_SIZE;
+}
+
+const slab* slab_list() {
+    return slabs;
+}
@@ -0,0 +1,51 @@
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+
+/**
+ * Allocateur d'objets de taille fixe
+ *
+ * Les objets sont découpés dans des blocs de SLAB_CHUNK_SIZE octets, et ceux libérés sont chaînés pour être réutilisés
+ * en priorité. Contrairement à malloc(), il n'y a ni en-tête ni arrondi par objet, et les objets d'un même type restent
+ * groupés en mémoire. Les blocs ne sont jamais rendus au système : une pointe de connexions est amortie pour les
+ * suivantes.
+ *
+ * Un slab d'objets de IO_BUFFER_SIZE octets (ou plus) sert aussi de réserve de tampons, qui ne sont rattachés à une
+ * connexion que le temps où elle a des données en cours.
+ */
+
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+typedef struct slab_s {
+    const char* name; // Pour le rapport de mémoire, c.f. stats_dump()
+    size_t object_size;
+
+    void* free_list;
+    struct slab_chunk_s* chunks;
+    size_t chunk_count;
+    size_t in_use;
+
+    struct slab_s* next; // Tous les slabs, pour le rapport de mémoire
+} slab;
+
+#define SLAB_INIT(slab_name, size) { .name = (slab_name), .object_size = (size) }
+
+void* slab_alloc(slab* slab);
+
+/**
+ * Rend un objet alloué par slab_alloc() sur le même slab. `object` peut être NULL.
+ */
+void slab_free(slab* slab, void* object);
+
+/**
+ * Octets réservés par le slab, objets libres et en-têtes de blocs compris
+ */
+size_t slab_reserved_bytes(const slab* slab);
+
+/**
+ * Premier slab ayant déjà alloué, les suivants étant chaînés par `next`
+ */
+const slab* slab_list();
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdio.h>
+
+#include "channel.h"
+#include "log.h"
+#include "slab.h"
+#include "stats.h"
+#include "user_list.h"
+
+server_stats stats = { 0 };
+
+static const char* const rate_limit_class_names[RATE_LIMIT_CLASS_COUNT] = {
+    [RATE_LIMIT_PUBLISH] = "publish",
+    [RATE_LIMIT_FOLLOW] = "follow",
+    [RATE_LIMIT_LIST] = "list",
+    [RATE_LIMIT_SEARCH] = "search",
+};
+
+static void latency_bucket_record(latency_bucket* bucket, uint64_t latency_us) {
+    bucket->count++;
+    bucket->total_us += latency_us;
+    if (latency_us > bucket->max_us) bucket->max_us = latency_us;
+}
+
+void stats_record_fanout(size_t followers, int64_t latency_us) {
+    size_t bucket = 0;
+    while (followers > 0 && bucket < FANOUT_SIZE_BUCKETS - 1) {
+        followers >>= 1;
+        bucket++;
+    }
+    latency_bucket_record(&stats.fanout_latency[bucket], latency_us);
+}
+
+void stats_record_catchup(int64_t latency_us) {
+    latency_bucket_record(&stats.catchup_latency, latency_us);
+}
+
+/**
+ * Mémoire allouée dans les slabs, et ce qu'elle représente par connexion inactive : un nœud, arrondi à la part de
+ * bloc de slab qu'il occupe (les tampons ne sont attachés qu'aux connexions ayant une trame en cours)
+ */
+static void stats_dump_memory() {
+    for (const slab* slab = slab_list(); slab != NULL; slab = slab->next) {
+        log_stats(
+            "memory_slab{%s} objects=%zu object_bytes=%zu reserved_bytes=%zu",
+            slab->name, slab->in_use, slab->object_size, slab_reserved_bytes(slab)
+        );
+    }
+
+    user_list_memory memory = user_list_memory_usage();
+    log_stats("memory_connections %zu", memory.connections);
+    log_stats("memory_users %zu", memory.users);
+    log_stats("memory_session_index_bytes %zu", memory.index_bytes);
+    log_stats("memory_connection_index_bytes %zu", memory.connection_index_bytes);
+    log_stats("memory_receive_buffers_in_use %zu", memory.receive_buffers);
+    if (memory.connections > 0) log_stats("memory_idle_connection_bytes %zu", memory.node_bytes / memory.connections);
+
+    channel_memory channels = channel_memory_usage();
+    log_stats(
+        "memory_channels count=%zu members=%zu index_bytes=%zu",
+        channels.channels, channels.memberships, channels.index_bytes
+    );
+}
+
+void stats_dump() {
+    for (int i = 0; i < RATE_LIMIT_CLASS_COUNT; i++) {
+        log_stats("throttled_%s %lu", rate_limit_class_names[i], stats.throttled[i]);
+    }
+
+    for (int i = 0; i < FANOUT_SIZE_BUCKETS; i++) {
+        const latency_bucket* bucket = &stats.fanout_latency[i];
+        if (bucket->count == 0) continue;
+        char upper_bound[24] = "inf";
+        if (i < FANOUT_SIZE_BUCKETS - 1) snprintf(upper_bound, sizeof upper_bound, "%lu", 1ul << i);
+        log_stats(
+            "fanout_latency_us{followers<%s} count=%lu avg=%lu max=%lu",
+            upper_bound, bucket->count, bucket->total_us / bucket->count, bucket->max_us
+        );
+    }
+
+    if (stats.publishes > 0) {
+        log_stats(
+            "publish count=%lu encodes_per_publish=%.2f allocations_per_publish=%.2f",
+            stats.publishes,
+            (double) stats.publish_encodes / stats.publishes,
+            (double) stats.publish_allocations / stats.publishes
+        );
+    }
+    log_stats("outbound_frames_queued %lu", stats.frames_queued);
+    log_stats("outbound_slow_clients %lu", stats.slow_clients);
+
+    stats_dump_memory();
+
+    const latency_bucket* catchup = &stats.catchup_latency;
+    if (catchup->count > 0) {
+        log_stats(
+            "catchup_latency_us count=%lu avg=%lu max=%lu",
+            catchup->count, catchup->total_us / catchup->count, catchup->max_us
+        );
+    }
+}
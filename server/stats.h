@@ -0,0 +1,42 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rate_limit.h"
+
+/**
+ * Compteurs du serveur, exportés sur la sortie standard à la réception de SIGUSR1 et à l'arrêt
+ */
+// Les diffusions sont regroupées par nombre d'abonné·es : 0, 1, 2-3, 4-7, ..., 2^19 et plus
+#define FANOUT_SIZE_BUCKETS 21
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+} latency_bucket;
+
+typedef struct {
+    uint64_t throttled[RATE_LIMIT_CLASS_COUNT];
+    latency_bucket fanout_latency[FANOUT_SIZE_BUCKETS]; // De la publication à la remise au dernier abonné
+    latency_bucket catchup_latency; // De la connexion à la remise du dernier twiiiiit manqué
+
+    // Coût des diffusions, c.f. "outbound.h"
+    uint64_t publishes;
+    uint64_t publish_encodes; // Trames encodées
+    uint64_t publish_allocations; // Trames partagées et entrées des files où elles attendent
+    uint64_t frames_queued; // Trames qui n'ont pas pu être écrites tout de suite, diffusées ou non
+    uint64_t slow_clients; // Clients déconnectés pour avoir trop de trames en attente
+} server_stats;
+
+extern server_stats stats;
+
+void stats_dump();
+
+void stats_record_fanout(size_t followers, int64_t latency_us);
+
+void stats_record_catchup(int64_t latency_us);
+
+#endif
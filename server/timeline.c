@@ -0,0 +1,85 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "timeline.h"
+#include "trace.h"
+#include "twiiiiiter_assert.h"
+
+/**
+ * Tête de lecture dans les twiiiiits d'un abonnement : `head` est son prochain twiiiiit, le plus récent non encore
+ * fusionné
+ */
+typedef struct {
+    twiiiiit_iterator iterator;
+    database_twiiiiit head;
+} timeline_cursor;
+
+typedef struct {
+    timeline_cursor* cursors;
+    size_t len, cap;
+} timeline_heap;
+
+/**
+ * Les twiiiiits de même date sont départagés par leur numéro de séquence, comme dans database_list_author_twiiiiits()
+ */
+static bool timeline_cursor_newer(const timeline_cursor* a, const timeline_cursor* b) {
+    return a->head.date > b->head.date || (a->head.date == b->head.date && a->head.seq > b->head.seq);
+}
+
+static void timeline_heap_swap(timeline_heap* heap, size_t a, size_t b) {
+    timeline_cursor temp = heap->cursors[a];
+    heap->cursors[a] = heap->cursors[b];
+    heap->cursors[b] = temp;
+}
+
+// Tas max sur la date (puis le numéro de séquence) de la tête : la racine est le prochain twiiiiit du fil
+static void timeline_heap_sift_down(timeline_heap* heap, size_t i) {
+    while (true) {
+        size_t newest = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap->len; child++) {
+            if (timeline_cursor_newer(&heap->cursors[child], &heap->cursors[newest])) newest = child;
+        }
+        if (newest == i) return;
+        timeline_heap_swap(heap, i, newest);
+        i = newest;
+    }
+}
+
+size_t timeline_fetch(const char* user, int64_t before, uint64_t before_seq, database_twiiiiit* out, size_t limit) {
+    TRACE_SCOPE(timeline_fetch);
+    timeline_heap heap = { NULL, 0, 0 };
+
+    // Une tête de lecture par abonnement qui a au moins un twiiiiit dans la fenêtre demandée
+    user_iterator followees = database_list_followee(user);
+    user_name followee;
+    while (database_users_next(followees, followee)) {
+        timeline_cursor cursor = { .iterator = database_list_author_twiiiiits(followee, before, before_seq, limit) };
+        if (!database_twiiiiits_next(cursor.iterator, &cursor.head)) continue;
+
+        if (heap.len == heap.cap) {
+            heap.cap = heap.cap ? heap.cap * 2 : 16;
+            heap.cursors = realloc(heap.cursors, heap.cap * sizeof *heap.cursors);
+            assert(heap.cursors != NULL);
+        }
+        heap.cursors[heap.len++] = cursor;
+    }
+
+    for (size_t i = heap.len / 2; i-- > 0;) timeline_heap_sift_down(&heap, i);
+
+    size_t len = 0;
+    while (len < limit && heap.len > 0) {
+        timeline_cursor* newest = &heap.cursors[0];
+        out[len++] = newest->head;
+
+        // L'itérateur se libère de lui-même une fois épuisé
+        if (!database_twiiiiits_next(newest->iterator, &newest->head)) {
+            heap.cursors[0] = heap.cursors[--heap.len];
+        }
+        timeline_heap_sift_down(&heap, 0);
+    }
+
+    for (size_t i = 0; i < heap.len; i++) database_twiiiiits_close(heap.cursors[i].iterator);
+    free(heap.cursors);
+
+    return len;
+}
@@ -0,0 +1,22 @@
+#ifndef _TIMELINE_H_
+#define _TIMELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "database.h"
+
+// Nombre maximal de twiiiiits par page de MESSAGE_C2S_FETCH_TIMELINE
+#define TIMELINE_MAX_LIMIT 50
+
+/**
+ * Fil d'actualité : écrit dans `out` les `limit` twiiiiits les plus récents des abonnements de `user` antérieurs
+ * (strictement) à `before` et `before_seq` (c.f. database_list_author_twiiiiits()), du plus récent au plus ancien, et
+ * renvoie leur nombre
+ *
+ * Le fil est une fusion à k voies des twiiiiits de chaque abonnement, lus dans l'ordre de l'index par auteur·ice : au
+ * plus `limit` + k twiiiiits sont lus, quel que soit le nombre de twiiiiits des abonnements, et rien n'est trié.
+ */
+size_t timeline_fetch(const char* user, int64_t before, uint64_t before_seq, database_twiiiiit* out, size_t limit);
+
+#endif
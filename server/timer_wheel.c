@@ -0,0 +1,84 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_SLOT_BITS)
+
+void timer_wheel_init(timer_wheel* wheel) {
+    memset(wheel, 0, sizeof *wheel);
+}
+
+void timer_init(timer* t) {
+    t->deadline = 0;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+static void timer_insert(timer_wheel* wheel, timer* t) {
+    // On cherche le niveau le plus fin dont la case cible n'a pas encore été dépassée
+    int level = 0;
+    while (
+        level < TIMER_WHEEL_LEVELS - 1
+        && (t->deadline >> LEVEL_SHIFT(level)) - (wheel->now >> LEVEL_SHIFT(level)) >= TIMER_WHEEL_SLOTS
+    ) {
+        level++;
+    }
+
+    timer** slot = &wheel->slots[level][(t->deadline >> LEVEL_SHIFT(level)) & (TIMER_WHEEL_SLOTS - 1)];
+    t->next = *slot;
+    if (*slot != NULL) (*slot)->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+}
+
+void timer_schedule(timer_wheel* wheel, timer* t, uint64_t ticks) {
+    timer_cancel(t);
+
+    // Au-delà de ce que couvre le dernier niveau, le minuteur expire un peu plus tôt que demandé
+    uint64_t max_ticks = ((uint64_t) 1 << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1;
+    if (ticks == 0) ticks = 1;
+    if (ticks > max_ticks) ticks = max_ticks;
+
+    t->deadline = wheel->now + ticks;
+    timer_insert(wheel, t);
+}
+
+void timer_cancel(timer* t) {
+    if (t->pprev == NULL) return;
+
+    *t->pprev = t->next;
+    if (t->next != NULL) t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/**
+ * Redistribue le contenu d'une case vers les niveaux inférieurs
+ */
+static void timer_wheel_cascade(timer_wheel* wheel, int level) {
+    timer** slot = &wheel->slots[level][(wheel->now >> LEVEL_SHIFT(level)) & (TIMER_WHEEL_SLOTS - 1)];
+    timer* list = *slot;
+    *slot = NULL;
+
+    while (list != NULL) {
+        timer* next = list->next;
+        timer_insert(wheel, list);
+        list = next;
+    }
+}
+
+void timer_wheel_tick(timer_wheel* wheel, void (*expired)(timer* t, void* context), void* context) {
+    wheel->now++;
+
+    for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+        if ((wheel->now & (((uint64_t) 1 << LEVEL_SHIFT(level)) - 1)) == 0) timer_wheel_cascade(wheel, level);
+    }
+
+    timer** slot = &wheel->slots[0][wheel->now & (TIMER_WHEEL_SLOTS - 1)];
+    while (*slot != NULL) {
+        timer* t = *slot;
+        timer_cancel(t);
+        expired(t, context);
+    }
+}
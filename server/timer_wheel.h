@@ -0,0 +1,56 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+/**
+ * Minuteur intrusif, à inclure dans la structure qu'il concerne (c.f. TIMER_CONTAINER())
+ */
+typedef struct timer_s {
+    uint64_t deadline; // En ticks
+    struct timer_s* next;
+    struct timer_s** pprev; // NULL si le minuteur n'est pas armé
+} timer;
+
+/**
+ * Roue de minuteurs hiérarchique
+ *
+ * Chaque niveau compte TIMER_WHEEL_SLOTS cases, et une case du niveau `n` couvre autant de ticks que tout le niveau
+ * `n - 1`. Armer, désarmer ou faire expirer un minuteur se fait en temps constant, et les minuteurs lointains ne sont
+ * redistribués vers les niveaux inférieurs qu'une fois par tour du niveau qui les contient.
+ */
+typedef struct {
+    uint64_t now;
+    timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel;
+
+#define TIMER_CONTAINER(pointer, type, member) ((type*) ((char*) (pointer) - offsetof(type, member)))
+
+void timer_wheel_init(timer_wheel* wheel);
+
+void timer_init(timer* t);
+
+/**
+ * (Ré)arme un minuteur pour qu'il expire dans `ticks` ticks (au moins 1)
+ */
+void timer_schedule(timer_wheel* wheel, timer* t, uint64_t ticks);
+
+void timer_cancel(timer* t);
+
+static inline bool timer_is_scheduled(const timer* t) {
+    return t->pprev != NULL;
+}
+
+/**
+ * Avance la roue d'un tick, et appelle `expired` pour chacun des minuteurs arrivés à échéance. Ceux-ci sont désarmés
+ * avant l'appel, qui peut donc les réarmer.
+ */
+void timer_wheel_tick(timer_wheel* wheel, void (*expired)(timer* t, void* context), void* context);
+
+#endif
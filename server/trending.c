@@ -0,0 +1,191 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "trending.h"
+
+// Dimensions du count-min sketch (la largeur est une puissance de 2)
+#define SKETCH_DEPTH 4
+#define SKETCH_WIDTH 2048
+// La fenêtre avance par tranches : un sujet disparaît une tranche après être sorti de la fenêtre, au plus tard
+#define WINDOW_SLICES 12
+// Candidats suivis par le tas, plus que TRENDING_TOP pour que le classement reste stable en bas de liste
+#define HEAP_CAPACITY 64
+
+typedef uint32_t sketch[SKETCH_DEPTH][SKETCH_WIDTH];
+
+// Les occurrences de chaque tranche, et leur somme sur la fenêtre
+static sketch slices[WINDOW_SLICES];
+static sketch window;
+static int64_t slice_us = 1;
+static int64_t current_slice; // Numéro de la tranche en cours, c.f. monotonic_now() / slice_us
+
+// Tas min sur `count`, la racine est le candidat le moins fréquent
+static trending_entry heap[HEAP_CAPACITY];
+static size_t heap_len = 0;
+
+static void sketch_columns(const char tag[MESSAGE_MAX_LENGTH], size_t columns[SKETCH_DEPTH]) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < MESSAGE_MAX_LENGTH && tag[i] != 0; i++) {
+        hash = (hash ^ (unsigned char) tag[i]) * 0x100000001b3;
+    }
+
+    // Double hachage : les lignes utilisent h1 + i * h2, ce qui suffit pour un count-min sketch
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        columns[row] = (h1 + row * h2) & (SKETCH_WIDTH - 1);
+    }
+}
+
+static uint32_t sketch_estimate(const char tag[MESSAGE_MAX_LENGTH]) {
+    size_t columns[SKETCH_DEPTH];
+    sketch_columns(tag, columns);
+
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        if (window[row][columns[row]] < estimate) estimate = window[row][columns[row]];
+    }
+    return estimate;
+}
+
+static void heap_swap(size_t a, size_t b) {
+    trending_entry temp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = temp;
+}
+
+static void heap_sift_up(size_t i) {
+    while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_sift_down(size_t i) {
+    while (true) {
+        size_t smallest = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap_len; child++) {
+            if (heap[child].count < heap[smallest].count) smallest = child;
+        }
+        if (smallest == i) return;
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+/**
+ * Fait glisser la fenêtre jusqu'à `now` : les tranches sorties sont retirées de la somme, puis les candidats du tas
+ * sont réévalués
+ */
+static void trending_advance(int64_t now) {
+    int64_t slice = now / slice_us;
+    if (slice <= current_slice) return;
+
+    int64_t expired = slice - current_slice < WINDOW_SLICES ? slice - current_slice : WINDOW_SLICES;
+    for (int64_t i = 1; i <= expired; i++) {
+        // La tranche réutilisée est la plus ancienne de la fenêtre
+        uint32_t (*old)[SKETCH_WIDTH] = slices[(current_slice + i) % WINDOW_SLICES];
+        for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+            for (size_t column = 0; column < SKETCH_WIDTH; column++) window[row][column] -= old[row][column];
+        }
+        memset(old, 0, sizeof(sketch));
+    }
+    current_slice = slice;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < heap_len; i++) {
+        heap[i].count = sketch_estimate(heap[i].tag);
+        if (heap[i].count > 0) heap[kept++] = heap[i];
+    }
+    heap_len = kept;
+    for (size_t i = heap_len / 2; i-- > 0;) heap_sift_down(i);
+}
+
+static void trending_count(const char tag[MESSAGE_MAX_LENGTH]) {
+    size_t columns[SKETCH_DEPTH];
+    sketch_columns(tag, columns);
+    uint32_t (*slice)[SKETCH_WIDTH] = slices[current_slice % WINDOW_SLICES];
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        slice[row][columns[row]]++;
+        window[row][columns[row]]++;
+    }
+    uint32_t count = sketch_estimate(tag);
+
+    for (size_t i = 0; i < heap_len; i++) {
+        if (memcmp(heap[i].tag, tag, MESSAGE_MAX_LENGTH) == 0) {
+            heap[i].count = count;
+            heap_sift_down(i);
+            return;
+        }
+    }
+
+    if (heap_len < HEAP_CAPACITY) {
+        memcpy(heap[heap_len].tag, tag, MESSAGE_MAX_LENGTH);
+        heap[heap_len].count = count;
+        heap_sift_up(heap_len++);
+    } else if (count > heap[0].count) {
+        memcpy(heap[0].tag, tag, MESSAGE_MAX_LENGTH);
+        heap[0].count = count;
+        heap_sift_down(0);
+    }
+}
+
+void trending_initialize(int64_t window_us) {
+    slice_us = window_us / WINDOW_SLICES ?: 1;
+    current_slice = monotonic_now() / slice_us;
+}
+
+static bool is_tag_char(char c) {
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+void trending_record(const char message[MESSAGE_MAX_LENGTH]) {
+    trending_advance(monotonic_now());
+
+    // Un sujet répété dans le même twiiiiit n'est compté qu'une fois
+    char seen[MESSAGE_MAX_LENGTH / 2][MESSAGE_MAX_LENGTH];
+    size_t seen_len = 0;
+
+    size_t i = 0;
+    while (i < MESSAGE_MAX_LENGTH && message[i] != 0) {
+        bool tag_start = (message[i] == '#' || message[i] == '@') && (i == 0 || !is_tag_char(message[i - 1]));
+        size_t end = i + 1;
+        while (tag_start && end < MESSAGE_MAX_LENGTH && is_tag_char(message[end])) end++;
+        if (!tag_start || end == i + 1) {
+            i++;
+            continue;
+        }
+
+        char tag[MESSAGE_MAX_LENGTH] = { 0 };
+        for (size_t j = i; j < end; j++) tag[j - i] = tolower((unsigned char) message[j]);
+        i = end;
+
+        bool duplicate = false;
+        for (size_t s = 0; s < seen_len; s++) duplicate |= memcmp(seen[s], tag, MESSAGE_MAX_LENGTH) == 0;
+        if (duplicate) continue;
+        memcpy(seen[seen_len++], tag, MESSAGE_MAX_LENGTH);
+
+        trending_count(tag);
+    }
+}
+
+static int trending_entry_compare(const void* a, const void* b) {
+    const trending_entry* left = a;
+    const trending_entry* right = b;
+    if (left->count != right->count) return left->count < right->count ? 1 : -1;
+    return memcmp(left->tag, right->tag, MESSAGE_MAX_LENGTH);
+}
+
+size_t trending_top(trending_entry entries[TRENDING_TOP]) {
+    trending_advance(monotonic_now());
+
+    trending_entry sorted[HEAP_CAPACITY];
+    memcpy(sorted, heap, heap_len * sizeof(trending_entry));
+    qsort(sorted, heap_len, sizeof(trending_entry), trending_entry_compare);
+
+    size_t len = heap_len < TRENDING_TOP ? heap_len : TRENDING_TOP;
+    memcpy(entries, sorted, len * sizeof(trending_entry));
+    return len;
+}
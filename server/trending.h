@@ -0,0 +1,36 @@
+#ifndef _TRENDING_H_
+#define _TRENDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+// Nombre de sujets renvoyés par MESSAGE_C2S_TRENDING
+#define TRENDING_TOP 10
+
+typedef struct {
+    char tag[MESSAGE_MAX_LENGTH]; // "#sujet" ou "@nom", en minuscules, complété par des 0
+    uint32_t count;
+} trending_entry;
+
+/**
+ * Sujets tendance (#tags et @mentions) sur une fenêtre glissante
+ *
+ * Les occurrences sont comptées par un count-min sketch par tranche de la fenêtre, et un tas garde les sujets les plus
+ * fréquents : la mémoire utilisée est fixe quel que soit le nombre de sujets distincts, et les comptes sont mis à jour à
+ * chaque publication, sans jamais relire les twiiiiits. Les comptes peuvent être surestimés, jamais sous-estimés.
+ */
+void trending_initialize(int64_t window_us);
+
+/**
+ * Compte les #tags et @mentions d'un twiiiiit publié maintenant
+ */
+void trending_record(const char message[MESSAGE_MAX_LENGTH]);
+
+/**
+ * Remplit `entries` avec au plus TRENDING_TOP sujets, par nombre d'occurrences décroissant, et renvoie leur nombre
+ */
+size_t trending_top(trending_entry entries[TRENDING_TOP]);
+
+#endif
@@ -1,47 +1,273 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "slab.h"
+#include "twiiiiiter_assert.h"
 #include "user_list.h"
 
+// Taille initiale de la table des sessions, doublée dès qu'elle a plus de noms que d'alvéoles
+#define SESSION_INDEX_MIN_BUCKETS 1024
+// Même chose pour l'index par identifiant, avec les nœuds
+#define ID_INDEX_MIN_BUCKETS 1024
+
+/**
+ * Sessions d'un nom connecté, dans l'alvéole de la table correspondant à son hachage
+ */
+typedef struct user_sessions_s {
+    user_name name;
+    user_list_node* sessions; // Chaînées par `next_session`, la plus récente en tête
+    size_t count;
+    // Partagés par les sessions, pour qu'en ouvrir d'autres ne multiplie pas le débit permis
+    token_bucket rate_limits[RATE_LIMIT_CLASS_COUNT];
+
+    struct user_sessions_s* next;
+} user_sessions;
+
+static uint64_t next_id = 1;
+
+// Partagés par les connexions qui n'ont pas encore de nom, comme si c'était le même
+static token_bucket anonymous_rate_limits[RATE_LIMIT_CLASS_COUNT];
+
+static slab nodes = SLAB_INIT("user_list_node", sizeof(user_list_node));
+static slab frame_buffers = SLAB_INIT("receive_buffer", IO_BUFFER_SIZE);
+static slab session_sets = SLAB_INIT("user_sessions", sizeof(user_sessions));
+
+static user_sessions** session_index = NULL;
+static size_t session_index_mask = 0; // Nombre d'alvéoles moins un, c'est une puissance de deux
+
+// Nœuds des connexions directes, indexés par leur descripteur
+static user_list_node** fd_index = NULL;
+static size_t fd_index_cap = 0;
+
+// Nœuds indexés par leur identifiant, chaînés par `next_by_id`. Les identifiants sont consécutifs : leurs bits de
+// poids faible suffisent à les répartir.
+static user_list_node** id_index = NULL;
+static size_t id_index_mask = 0;
+
+static uint64_t session_index_hash(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < MAX_USERNAME_LENGTH && name[i] != 0; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * Renvoie l'adresse du lien vers les sessions de `name` dans son alvéole, qui pointe vers NULL s'il n'en a aucune
+ */
+static user_sessions** session_index_find(const char* name) {
+    if (session_index == NULL) {
+        session_index_mask = SESSION_INDEX_MIN_BUCKETS - 1;
+        session_index = calloc(SESSION_INDEX_MIN_BUCKETS, sizeof *session_index);
+        assert(session_index != NULL);
+    }
+
+    user_sessions** entry = &session_index[session_index_hash(name) & session_index_mask];
+    while (*entry != NULL && strncmp((*entry)->name, name, MAX_USERNAME_LENGTH) != 0) entry = &(*entry)->next;
+    return entry;
+}
+
+static void session_index_grow() {
+    size_t buckets = (session_index_mask + 1) * 2;
+    user_sessions** grown = calloc(buckets, sizeof *grown);
+    assert(grown != NULL);
+    for (size_t i = 0; i <= session_index_mask; i++) {
+        for (user_sessions* entry = session_index[i], *next; entry != NULL; entry = next) {
+            next = entry->next;
+            size_t bucket = session_index_hash(entry->name) & (buckets - 1);
+            entry->next = grown[bucket];
+            grown[bucket] = entry;
+        }
+    }
+
+    free(session_index);
+    session_index = grown;
+    session_index_mask = buckets - 1;
+}
+
+bool user_list_node_attach(user_list_node* node, const user_name name, size_t max_sessions) {
+    assert(node->user_name[0] == 0);
+    user_sessions** entry = session_index_find(name);
+    if (*entry == NULL) {
+        if (max_sessions == 0) return false;
+        user_sessions* created = slab_alloc(&session_sets);
+        memcpy(created->name, name, MAX_USERNAME_LENGTH);
+        created->sessions = NULL;
+        created->count = 0;
+        memset(created->rate_limits, 0, sizeof created->rate_limits);
+        created->next = NULL;
+        *entry = created;
+    } else if ((*entry)->count >= max_sessions) {
+        return false;
+    }
+
+    user_sessions* set = *entry;
+    memcpy(node->user_name, name, MAX_USERNAME_LENGTH);
+    node->next_session = set->sessions;
+    node->name_sessions = set;
+    set->sessions = node;
+    set->count++;
+    if (set->count == 1 && session_sets.in_use > session_index_mask + 1) session_index_grow();
+    return true;
+}
+
+static void user_list_node_detach(user_list_node* node) {
+    if (node->user_name[0] == 0) return;
+
+    user_sessions** entry = session_index_find(node->user_name);
+    user_sessions* set = *entry;
+    assert(set != NULL && set == node->name_sessions);
+    for (user_list_node** session = &set->sessions; *session != NULL; session = &(*session)->next_session) {
+        if (*session == node) {
+            *session = node->next_session;
+            set->count--;
+            break;
+        }
+    }
+
+    if (set->count == 0) {
+        *entry = set->next;
+        slab_free(&session_sets, set);
+    }
+}
+
+user_list_node* user_list_sessions(const user_name name) {
+    user_sessions* set = *session_index_find(name);
+    return set != NULL ? set->sessions : NULL;
+}
+
+token_bucket* user_list_node_rate_limits(const user_list_node* node) {
+    return node->name_sessions != NULL ? node->name_sessions->rate_limits : anonymous_rate_limits;
+}
+
+static void fd_index_set(int fd, user_list_node* node) {
+    if (fd < 0) return;
+    if ((size_t) fd >= fd_index_cap) {
+        size_t cap = fd_index_cap ?: 1024;
+        while (cap <= (size_t) fd) cap *= 2;
+        fd_index = realloc(fd_index, cap * sizeof *fd_index);
+        assert(fd_index != NULL);
+        memset(fd_index + fd_index_cap, 0, (cap - fd_index_cap) * sizeof *fd_index);
+        fd_index_cap = cap;
+    }
+    fd_index[fd] = node;
+}
+
+static void id_index_grow() {
+    size_t buckets = id_index != NULL ? (id_index_mask + 1) * 2 : ID_INDEX_MIN_BUCKETS;
+    user_list_node** grown = calloc(buckets, sizeof *grown);
+    assert(grown != NULL);
+    for (size_t i = 0; id_index != NULL && i <= id_index_mask; i++) {
+        for (user_list_node* node = id_index[i], *next; node != NULL; node = next) {
+            next = node->next_by_id;
+            node->next_by_id = grown[node->id & (buckets - 1)];
+            grown[node->id & (buckets - 1)] = node;
+        }
+    }
+
+    free(id_index);
+    id_index = grown;
+    id_index_mask = buckets - 1;
+}
+
+static void id_index_remove(user_list_node* node) {
+    user_list_node** entry = &id_index[node->id & id_index_mask];
+    while (*entry != node) entry = &(*entry)->next_by_id;
+    *entry = node->next_by_id;
+}
+
+static void user_list_node_free(user_list_node** list, user_list_node* node) {
+    if (node->prev != NULL) node->prev->next = node->next;
+    else *list = node->next;
+    if (node->next != NULL) node->next->prev = node->prev;
+
+    if (node->fd >= 0) fd_index_set(node->fd, NULL);
+    id_index_remove(node);
+    user_list_node_detach(node);
+    slab_free(&frame_buffers, node->frame_receive_buffer);
+    slab_free(&nodes, node);
+}
+
 user_list_node* user_list_node_insert(user_list_node** list, int fd) {
     user_list_node* next = *list;
-    user_list_node* new = malloc(sizeof(user_list_node));
+    user_list_node* new = slab_alloc(&nodes);
     new->fd = fd;
+    new->gateway = NULL;
+    new->session = 0;
+    new->id = next_id++;
+    new->acked_seq = 0;
     memset(new->user_name, 0, MAX_USERNAME_LENGTH);
+    new->frame_receive_buffer = NULL;
     new->frame_receive_buffer_len = 0;
+    timer_init(&new->idle_timer);
+    new->ping_sent = false;
+    new->catchup = NULL;
+    new->outbound = NULL;
     new->next = next;
+    new->prev = NULL;
+    if (next != NULL) next->prev = new;
+    new->next_session = NULL;
+    new->name_sessions = NULL;
+
+    fd_index_set(fd, new);
+    if (id_index == NULL || nodes.in_use > id_index_mask + 1) id_index_grow();
+    new->next_by_id = id_index[new->id & id_index_mask];
+    id_index[new->id & id_index_mask] = new;
     return *list = new;
 }
 
-user_list_node* user_list_node_find(user_list_node* list, int fd) {
-    for (user_list_node* node = list; node != NULL; node = node->next) {
-        if (node->fd == fd) {
-            return node;
-        }
-    }
-
-    return NULL;
+user_list_node* user_list_node_find(int fd) {
+    return fd >= 0 && (size_t) fd < fd_index_cap ? fd_index[fd] : NULL;
 }
 
-user_list_node* user_list_node_find_by_name(user_list_node* list, const user_name name) {
-    for (user_list_node* node = list; node != NULL; node = node->next) {
-        if (strncmp(node->user_name, name, MAX_USERNAME_LENGTH) == 0) {
-            return node;
-        }
-    }
+user_list_node* user_list_node_find_by_id(uint64_t id) {
+    if (id_index == NULL) return NULL;
 
-    return NULL;
+    user_list_node* node = id_index[id & id_index_mask];
+    while (node != NULL && node->id != id) node = node->next_by_id;
+    return node;
 }
 
 bool user_list_node_delete(user_list_node** list, int fd) {
-    for (user_list_node** node = list; *node != NULL; node = &(*node)->next) {
-        if ((*node)->fd == fd) {
-            void* to_free = *node;
-            *node = (*node)->next;
-            free(to_free);
-            return true;
-        }
-    }
+    user_list_node* node = user_list_node_find(fd);
+    if (node == NULL) return false;
+
+    user_list_node_free(list, node);
+    return true;
+}
+
+void user_list_node_remove(user_list_node** list, user_list_node* node) {
+    user_list_node_free(list, node);
+}
+
+void user_list_node_hold_partial_frame(user_list_node* node, const char* data, size_t len) {
+    assert(len < IO_BUFFER_SIZE);
+    if (node->frame_receive_buffer == NULL) node->frame_receive_buffer = slab_alloc(&frame_buffers);
+    if (data != node->frame_receive_buffer) memcpy(node->frame_receive_buffer, data, len);
+    node->frame_receive_buffer_len = len;
+}
+
+char* user_list_node_take_frame(user_list_node* node) {
+    char* frame = node->frame_receive_buffer;
+    node->frame_receive_buffer = NULL;
+    node->frame_receive_buffer_len = 0;
+    return frame;
+}
+
+void user_list_release_frame(char* frame) {
+    slab_free(&frame_buffers, frame);
+}
 
-    return false;
+user_list_memory user_list_memory_usage() {
+    return (user_list_memory) {
+        .connections = nodes.in_use,
+        .users = session_sets.in_use,
+        .index_bytes = (session_index != NULL ? (session_index_mask + 1) * sizeof *session_index : 0)
+            + slab_reserved_bytes(&session_sets),
+        .connection_index_bytes = fd_index_cap * sizeof *fd_index
+            + (id_index != NULL ? (id_index_mask + 1) * sizeof *id_index : 0),
+        .node_bytes = slab_reserved_bytes(&nodes),
+        .receive_buffers = frame_buffers.in_use,
+        .receive_buffer_bytes = slab_reserved_bytes(&frame_buffers),
+    };
 }
@@ -5,19 +5,62 @@
 #include <stddef.h>
 
 #include "codec.h"
+#include "rate_limit.h"
+#include "timer_wheel.h"
 
 /**
  * Linked relational table of username <-> fd <-> receive buffer
+ *
+ * Les nœuds sont alloués dans un slab (c.f. "slab.h"), et les champs sont ordonnés pour limiter le remplissage : un
+ * client connecté mais inactif ne coûte que sizeof(user_list_node) octets.
+ *
+ * Un·e utilisateur·ice peut avoir plusieurs sessions (un téléphone et un ordinateur, ...), chacune avec son nœud. Une
+ * table de hachage associe chaque nom connecté à l'ensemble de ses sessions (c.f. user_list_sessions()), pour que la
+ * diffusion d'un twiiiiit ne coûte que le nombre de sessions de ses destinataires, quel que soit le nombre de clients.
+ *
+ * Les nœuds sont aussi indexés par descripteur (une table, les descripteurs étant petits et réutilisés) et par
+ * identifiant (une table de hachage), et la liste est doublement chaînée : les trouver ou les supprimer ne dépend pas
+ * du nombre de connexions.
  */
 typedef struct user_list_node_s {
-    int fd;
+    uint64_t id; // Unique, contrairement au descripteur qui est réutilisé après la déconnexion
+    uint64_t acked_seq; // Dernier twiiiiit acquitté par le client (MESSAGE_C2S_ACK), c.f. database_cursor()
+    struct gateway_link_s* gateway; // Passerelle de la session, NULL pour une connexion directe
+    struct catchup_job_s* catchup; // Rattrapage des twiiiiits manqués en cours, c.f. "catchup.h"
+    // Trame partiellement reçue, tampon pris dans une réserve commune seulement le temps de la recevoir (c.f.
+    // user_list_node_hold_partial_frame()), NULL sinon
+    char* frame_receive_buffer;
+    struct outbound_queue_s* outbound; // Trames en attente d'écriture, NULL si aucune, c.f. "outbound.h"
+
+    // Expire quand la connexion est restée inactive trop longtemps, c.f. handle_idle_timer()
+    timer idle_timer;
+
+    int fd; // -1 pour une session ouverte au travers d'une passerelle
+    uint32_t session; // Identifiant de la session sur sa passerelle
     user_name user_name;
-    char frame_receive_buffer[IO_BUFFER_SIZE];
-    size_t frame_receive_buffer_len;
+    uint8_t frame_receive_buffer_len;
+    bool ping_sent;
 
     struct user_list_node_s* next;
+    struct user_list_node_s* prev;
+    struct user_list_node_s* next_session; // Session suivante du même nom, c.f. user_list_sessions()
+    struct user_sessions_s* name_sessions; // Ensemble des sessions de son nom, NULL tant qu'il n'en a pas
+    struct user_list_node_s* next_by_id; // Nœud suivant de la même alvéole de l'index par identifiant
 } user_list_node;
 
+/**
+ * Mémoire des connexions, pour le rapport de stats_dump()
+ */
+typedef struct {
+    size_t connections;
+    size_t users; // Noms ayant au moins une session
+    size_t index_bytes; // Réservés par la table des sessions
+    size_t connection_index_bytes; // Réservés par les index par descripteur et par identifiant
+    size_t node_bytes; // Réservés par le slab des nœuds
+    size_t receive_buffers; // Tampons de trames partielles en cours d'utilisation
+    size_t receive_buffer_bytes; // Réservés par la réserve de tampons
+} user_list_memory;
+
 /**
  * Inserts a file descriptor in the list and returns its associated new node
  *
@@ -25,13 +68,51 @@ typedef struct user_list_node_s {
  */
 user_list_node* user_list_node_insert(user_list_node** list, int fd);
 
-user_list_node* user_list_node_find(user_list_node* list, int fd);
+user_list_node* user_list_node_find(int fd);
+
+/**
+ * Rattache un nœud sans nom aux sessions de `name`, et lui donne ce nom. Renvoie false, sans rien changer, si `name` a
+ * déjà `max_sessions` sessions. Le nœud est détaché quand il est supprimé de la liste.
+ */
+bool user_list_node_attach(user_list_node* node, const user_name name, size_t max_sessions);
+
+/**
+ * Renvoie la première session de `name`, les suivantes étant chaînées par `next_session`, ou NULL s'il n'en a aucune
+ */
+user_list_node* user_list_sessions(const user_name name);
+
+/**
+ * Renvoie les seaux à jetons du nœud (c.f. check_rate_limit()), indexés par enum rate_limit_class. Ils sont partagés
+ * par toutes les sessions de son nom, et recommencent pleins quand la dernière se termine. Les connexions sans nom
+ * partagent les leurs.
+ */
+token_bucket* user_list_node_rate_limits(const user_list_node* node);
 
-user_list_node* user_list_node_find_by_name(user_list_node* list, const user_name name);
+user_list_node* user_list_node_find_by_id(uint64_t id);
 
 /**
  * Tries to remove a node from its file descriptor in the list. Returns true if the removal is successful.
  */
 bool user_list_node_delete(user_list_node** list, int fd);
 
+/**
+ * Removes a node from the list, for sessions that don't have their own file descriptor
+ */
+void user_list_node_remove(user_list_node** list, user_list_node* node);
+
+/**
+ * Conserve les `len` premiers octets d'une trame (moins de IO_BUFFER_SIZE) jusqu'à la lecture de la suite, dans un
+ * tampon rattaché au nœud s'il n'en a pas déjà un
+ */
+void user_list_node_hold_partial_frame(user_list_node* node, const char* data, size_t len);
+
+/**
+ * Détache le tampon de la trame partielle d'un nœud, à rendre avec user_list_release_frame()
+ */
+char* user_list_node_take_frame(user_list_node* node);
+
+void user_list_release_frame(char* frame);
+
+user_list_memory user_list_memory_usage();
+
 #endif
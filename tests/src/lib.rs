@@ -13,6 +13,10 @@ use std::time::Duration;
 /// Définis des clients connectés à un même serveur, dans la portée d'invocation, ainsi qu'un buffer
 /// pour la reception
 macro_rules! clients {
+    ($server_name:ident in $engine:ident: $($client_name:ident)*) => {
+        let $server_name = $crate::test_server::TestServer::start_with_engine($engine);
+        $(#[allow(unused_mut)] let mut $client_name = $server_name.connect().unwrap();)*
+    };
     ($server_name:ident: $($client_name:ident)*) => {
         let $server_name = $crate::test_server::TestServer::start();
         $(#[allow(unused_mut)] let mut $client_name = $server_name.connect().unwrap();)*
@@ -22,6 +26,30 @@ macro_rules! clients {
     };
 }
 
+/// Déclare, pour chacune des fonctions données, un test par moteur de stockage (`sqlite::test_...` et
+/// `log::test_...`), qui lui passe le nom du moteur
+macro_rules! engine_tests {
+    ($($test:ident),* $(,)?) => {
+        mod sqlite {
+            $(#[test] fn $test() { super::$test("sqlite") })*
+        }
+        mod log {
+            $(#[test] fn $test() { super::$test("log") })*
+        }
+    };
+}
+
+engine_tests!(
+    test_subscribe_ok,
+    test_unsubscribe_ok,
+    test_twiiiiit_live_subscriptions,
+    test_twiiiiit_follower_offline_catches_up,
+    test_catchup_resumes_after_ack,
+    test_catchup_ignores_unpublished_ack,
+    test_timeline_merge,
+    test_search_pages_ignore_newer_twiiiiits,
+);
+
 macro_rules! assert_twiiiiit_eq {
     ($twiiiiit:expr, $author:expr, $message:expr) => {
         let twiiiiit: $crate::network::ReceivedMessage = $twiiiiit;
@@ -44,9 +72,59 @@ fn test_join_longest_username_ok() {
 
 #[test]
 fn test_join_same_username() {
-    clients!(bob1 bob2);
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_MAX_SESSIONS", "2")]);
+    let mut bob1 = server.connect().unwrap();
+    let mut bob2 = server.connect().unwrap();
+    let mut bob3 = server.connect().unwrap();
     assert_eq!(bob1.join_as(b"Bob").unwrap(), LoginStatus::Ok);
-    assert_eq!(bob2.join_as(b"Bob").unwrap(), LoginStatus::AlreadyUsed);
+    assert_eq!(bob2.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob3.join_as(b"Bob").unwrap(), LoginStatus::AlreadyUsed);
+
+    // A session that leaves makes room for another one
+    bob1.shutdown(Shutdown::Both).unwrap();
+    drop(bob1);
+    std::thread::sleep(Duration::from_millis(5));
+    let mut bob4 = server.connect().unwrap();
+    assert_eq!(bob4.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+}
+
+#[test]
+fn test_multiple_sessions() {
+    clients!(server: alice desktop phone);
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(desktop.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(phone.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(phone.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+
+    // Every session receives the twiiiiits of Bob's subscriptions, and his own
+    alice.publish(b"Hello Bob").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Hello Bob");
+    assert_twiiiiit_eq!(desktop.receive().unwrap(), b"Alice", b"Hello Bob");
+    let hello = phone.receive().unwrap();
+    let hello_seq = hello.seq;
+    assert_twiiiiit_eq!(hello, b"Alice", b"Hello Bob");
+    phone.publish(b"From my phone").unwrap();
+    assert_twiiiiit_eq!(phone.receive().unwrap(), b"Bob", b"From my phone");
+    assert_twiiiiit_eq!(desktop.receive().unwrap(), b"Bob", b"From my phone");
+
+    // The phone leaves, and misses a twiiiiit that the desktop receives live
+    phone.ack(hello_seq).unwrap();
+    phone.shutdown(Shutdown::Both).unwrap();
+    drop(phone);
+    std::thread::sleep(Duration::from_millis(20));
+    alice.publish(b"Missed").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Missed");
+    assert_twiiiiit_eq!(desktop.receive().unwrap(), b"Alice", b"Missed");
+
+    // Back online, the phone catches up on its own
+    let mut phone = server.connect().unwrap();
+    assert_eq!(phone.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_twiiiiit_eq!(phone.receive().unwrap(), b"Alice", b"Missed");
+
+    alice.publish(b"Live").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Live");
+    assert_twiiiiit_eq!(desktop.receive().unwrap(), b"Alice", b"Live");
+    assert_twiiiiit_eq!(phone.receive().unwrap(), b"Alice", b"Live");
 }
 
 #[test]
@@ -91,9 +169,8 @@ fn test_twiiiiit_longest() {
     assert_twiiiiit_eq!(stream.receive().unwrap(), b"Edgar", twiiiiit);
 }
 
-#[test]
-fn test_subscribe_ok() {
-    clients!(alice bob);
+fn test_subscribe_ok(engine: &str) {
+    clients!(_server in engine: alice bob);
     assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
     assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
 
@@ -135,9 +212,8 @@ fn test_subscribe_unchanged() {
     );
 }
 
-#[test]
-fn test_unsubscribe_ok() {
-    clients!(alice bob);
+fn test_unsubscribe_ok(engine: &str) {
+    clients!(_server in engine: alice bob);
     assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
     assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
 
@@ -173,9 +249,8 @@ fn test_unsubscribe_unchanged() {
     );
 }
 
-#[test]
-fn test_twiiiiit_live_subscriptions() {
-    clients!(alice bob);
+fn test_twiiiiit_live_subscriptions(engine: &str) {
+    clients!(_server in engine: alice bob);
     assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
     assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
 
@@ -197,9 +272,8 @@ fn test_twiiiiit_live_subscriptions() {
     assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Why don't you answer");
 }
 
-#[test]
-fn test_twiiiiit_follower_offline_catches_up() {
-    clients!(server: alice bob);
+fn test_twiiiiit_follower_offline_catches_up(engine: &str) {
+    clients!(server in engine: alice bob);
 
     // Everyone joins
     assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
@@ -223,3 +297,887 @@ fn test_twiiiiit_follower_offline_catches_up() {
     assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
     assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"I like chocolate");
 }
+
+fn test_catchup_resumes_after_ack(engine: &str) {
+    clients!(server in engine: alice bob);
+
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+
+    let mut seqs = Vec::new();
+    for message in [b"One", b"Two", b"Six"] {
+        alice.publish(message).unwrap();
+        assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", message);
+        let twiiiiit = bob.receive().unwrap();
+        assert_twiiiiit_eq!(twiiiiit, b"Alice", message);
+        seqs.push(twiiiiit.seq);
+    }
+    assert!(seqs.windows(2).all(|pair| pair[0] < pair[1]));
+
+    // Bob only acknowledges the first two before leaving
+    bob.ack(seqs[1]).unwrap();
+    bob.shutdown(Shutdown::Both).unwrap();
+    drop(bob);
+    std::thread::sleep(Duration::from_millis(20));
+
+    alice.publish(b"Ten").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Ten");
+
+    // The unacknowledged twiiiiit and the missed one come back exactly once, in order, and then live ones
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    let six = bob.receive().unwrap();
+    assert_twiiiiit_eq!(six, b"Alice", b"Six");
+    assert_eq!(six.seq, seqs[2]);
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Ten");
+
+    alice.publish(b"Live").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Live");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Live");
+}
+
+fn test_catchup_ignores_unpublished_ack(engine: &str) {
+    clients!(server in engine: alice bob);
+
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    alice.publish(b"One").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"One");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"One");
+
+    // Bob acknowledges twiiiiits that don't exist yet, up to the largest number
+    bob.ack(u64::MAX).unwrap();
+    bob.shutdown(Shutdown::Both).unwrap();
+    drop(bob);
+    std::thread::sleep(Duration::from_millis(20));
+
+    alice.publish(b"Two").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Two");
+
+    // He still catches up with the twiiiiits published after the last one
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Two");
+}
+
+#[test]
+fn test_log_engine_restart() {
+    let database = test_server::DatabaseFile::temporary("log");
+    // A snapshot every 8 changes: the three logins (two changes each) and the first two subscriptions end up in the
+    // snapshot, the unsubscription and Bob's cursor in the change log
+    let envs = [
+        ("TWIIIIITER_DATABASE_ENGINE", "log"),
+        ("TWIIIIITER_DATABASE_FILE", database.path()),
+        ("TWIIIIITER_LOG_COMPACTION_ENTRIES", "8"),
+    ];
+
+    let server = test_server::TestServer::start_with_env(&envs);
+    let mut alice = server.connect().unwrap();
+    let mut bob = server.connect().unwrap();
+    let mut carol = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(carol.join_as(b"Carol").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    assert_eq!(carol.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    assert_eq!(carol.unsubscribe_from(b"Alice").unwrap(), SubscribeResult::Ok);
+    alice.publish(b"Seen").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Seen");
+    let seen = bob.receive().unwrap();
+    let seen_seq = seen.seq;
+    assert_twiiiiit_eq!(seen, b"Alice", b"Seen");
+
+    // Bob leaves after acknowledging the first twiiiiit, and misses the second
+    bob.ack(seen_seq).unwrap();
+    bob.shutdown(Shutdown::Both).unwrap();
+    drop(bob);
+    std::thread::sleep(Duration::from_millis(20));
+    alice.publish(b"Missed").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Missed");
+    drop((alice, carol));
+    drop(server);
+
+    let graph_file = |name: &str| std::fs::metadata(format!("{}/{name}", database.path())).unwrap().len();
+    assert!(graph_file("graph.snapshot") > 0);
+    assert!(graph_file("graph.log") > 0);
+
+    // The new server finds the subscriptions, the cursor and the twiiiiits
+    let server = test_server::TestServer::start_with_env(&envs);
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Missed");
+    let subscriptions = bob.list_subscriptions().unwrap().collect::<Vec<_>>();
+    assert_eq!(subscriptions.len(), 1);
+    assert_eq!(subscriptions[0].as_ref().unwrap().as_ref(), b"Alice");
+    let mut carol = server.connect().unwrap();
+    assert_eq!(carol.join_as(b"Carol").unwrap(), LoginStatus::Ok);
+    assert_eq!(carol.list_subscriptions().unwrap().count(), 0);
+
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    let (timeline, _) = bob.fetch_timeline((0, 0), 10).unwrap();
+    let messages = timeline.iter().map(|twiiiiit| twiiiiit.message).collect::<Vec<_>>();
+    assert_eq!(messages, [&b"Missed"[..], b"Seen"]);
+    alice.publish(b"Live").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Live");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Live");
+}
+
+#[test]
+fn test_cluster_twiiiiit_across_nodes() {
+    let nodes = test_server::TestServer::start_cluster(2);
+    let mut alice = nodes[0].connect().unwrap();
+    let mut bob = nodes[1].connect().unwrap();
+
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+
+    // Bob, on the second node, subscribes to Alice, on the first one
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+
+    // Leave some time for Bob's presence to reach the first node
+    std::thread::sleep(Duration::from_millis(5));
+
+    alice.publish(b"Hello other node").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Hello other node");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Hello other node");
+}
+
+#[test]
+fn test_cluster_join_same_username_across_nodes() {
+    let nodes = test_server::TestServer::start_cluster(3);
+    let mut bob1 = nodes[0].connect().unwrap();
+    let mut bob2 = nodes[2].connect().unwrap();
+
+    assert_eq!(bob1.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    std::thread::sleep(Duration::from_millis(5));
+    assert_eq!(bob2.join_as(b"Bob").unwrap(), LoginStatus::AlreadyUsed);
+}
+
+#[test]
+fn test_idle_connection_pinged_then_kicked() {
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_IDLE_TIMEOUT_MS", "200"),
+        ("TWIIIIITER_PING_TIMEOUT_MS", "200"),
+    ]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+
+    let mut frame = EMPTY_FRAME;
+    assert_eq!(network::ReadExt::read_s2c(&mut alice, &mut frame).unwrap(), MessageS2C::Ping);
+    // Alice doesn't answer
+    assert_eq!(
+        network::ReadExt::read_s2c(&mut alice, &mut frame).unwrap(),
+        MessageS2C::Kick(KickReason::Timeout)
+    );
+
+    // Her name is available again
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+}
+
+#[test]
+fn test_idle_connection_kept_alive_by_pong() {
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_IDLE_TIMEOUT_MS", "200"),
+        ("TWIIIIITER_PING_TIMEOUT_MS", "200"),
+    ]);
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+
+    let mut frame = EMPTY_FRAME;
+    for _ in 0..3 {
+        assert_eq!(network::ReadExt::read_s2c(&mut bob, &mut frame).unwrap(), MessageS2C::Ping);
+        network::WriteExt::pong(&mut bob).unwrap();
+    }
+
+    // Still connected
+    bob.publish(b"Still there").unwrap();
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Bob", b"Still there");
+}
+
+#[test]
+fn test_publish_throttled() {
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_RATE_LIMIT_PUBLISH", "1:2")]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+
+    // The burst allows two twiiiiits
+    alice.publish(b"One").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"One");
+    alice.publish(b"Two").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Two");
+
+    // The third one is refused
+    alice.publish(b"Three").unwrap();
+    let mut frame = EMPTY_FRAME;
+    match network::ReadExt::read_s2c(&mut alice, &mut frame).unwrap() {
+        MessageS2C::Throttled { request, retry_after_ms } => {
+            assert_eq!(request, 4);
+            assert!(retry_after_ms > 0 && retry_after_ms <= 1000);
+        }
+        other => panic!("expected throttled, found {other:?}"),
+    }
+
+    // Other requests have their own bucket
+    assert_eq!(alice.list_subscriptions().unwrap().count(), 0);
+}
+
+#[test]
+fn test_throttled_across_sessions() {
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_RATE_LIMIT_PUBLISH", "1:2")]);
+    let mut desktop = server.connect().unwrap();
+    let mut phone = server.connect().unwrap();
+    let mut bob = server.connect().unwrap();
+    assert_eq!(desktop.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(phone.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+
+    // The desktop uses the whole burst
+    for message in [&b"One"[..], b"Two"] {
+        desktop.publish(message).unwrap();
+        assert_twiiiiit_eq!(desktop.receive().unwrap(), b"Alice", message);
+        assert_twiiiiit_eq!(phone.receive().unwrap(), b"Alice", message);
+    }
+
+    // Another session of the same name doesn't get a budget of its own
+    phone.publish(b"Three").unwrap();
+    let mut frame = EMPTY_FRAME;
+    match network::ReadExt::read_s2c(&mut phone, &mut frame).unwrap() {
+        MessageS2C::Throttled { request, .. } => assert_eq!(request, 4),
+        other => panic!("expected throttled, found {other:?}"),
+    }
+
+    // Other names still have theirs
+    bob.publish(b"Hi").unwrap();
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Bob", b"Hi");
+}
+
+#[test]
+fn test_twiiiiit_fanout_sliced() {
+    // With a 1µs time slice, the fan-out is interrupted after every batch of followers
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_FANOUT_SLICE_US", "1")]);
+    let mut star = server.connect().unwrap();
+    assert_eq!(star.join_as(b"Star").unwrap(), LoginStatus::Ok);
+
+    let mut fans = (0..50)
+        .map(|i| {
+            let mut fan = server.connect().unwrap();
+            assert_eq!(fan.join_as(format!("fan{i}").as_bytes()).unwrap(), LoginStatus::Ok);
+            assert_eq!(fan.subscribe_to(b"Star").unwrap(), SubscribeResult::Ok);
+            fan
+        })
+        .collect::<Vec<_>>();
+
+    star.publish(b"First").unwrap();
+    star.publish(b"Second").unwrap();
+    assert_twiiiiit_eq!(star.receive().unwrap(), b"Star", b"First");
+    assert_twiiiiit_eq!(star.receive().unwrap(), b"Star", b"Second");
+
+    // Everyone receives both twiiiiits, in order
+    for fan in &mut fans {
+        assert_twiiiiit_eq!(fan.receive().unwrap(), b"Star", b"First");
+        assert_twiiiiit_eq!(fan.receive().unwrap(), b"Star", b"Second");
+    }
+}
+
+#[test]
+fn test_catchup_after_reconnect_storm() {
+    // One catch-up at a time, interrupted after every batch of twiiiiits
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_CATCHUP_CONCURRENCY", "1"),
+        ("TWIIIIITER_FANOUT_SLICE_US", "1"),
+        ("TWIIIIITER_RATE_LIMIT_PUBLISH", "0"),
+    ]);
+    let mut star = server.connect().unwrap();
+    assert_eq!(star.join_as(b"Star").unwrap(), LoginStatus::Ok);
+
+    for i in 0..10 {
+        let mut fan = server.connect().unwrap();
+        assert_eq!(fan.join_as(format!("fan{i}").as_bytes()).unwrap(), LoginStatus::Ok);
+        assert_eq!(fan.subscribe_to(b"Star").unwrap(), SubscribeResult::Ok);
+        fan.shutdown(Shutdown::Both).unwrap();
+    }
+    std::thread::sleep(Duration::from_millis(20));
+
+    let messages = (0..100).map(|i| format!("Missed {i}")).collect::<Vec<_>>();
+    for message in &messages {
+        star.publish(message.as_bytes()).unwrap();
+        assert_twiiiiit_eq!(star.receive().unwrap(), b"Star", message.as_bytes());
+    }
+
+    // Everyone is let in right away, and catches up afterwards, in order
+    let mut fans = (0..10)
+        .map(|i| {
+            let mut fan = server.connect().unwrap();
+            assert_eq!(fan.join_as(format!("fan{i}").as_bytes()).unwrap(), LoginStatus::Ok);
+            fan
+        })
+        .collect::<Vec<_>>();
+    for fan in &mut fans {
+        for message in &messages {
+            assert_twiiiiit_eq!(fan.receive().unwrap(), b"Star", message.as_bytes());
+        }
+    }
+
+    // Once caught up, nothing is missed anymore
+    star.publish(b"Live").unwrap();
+    assert_twiiiiit_eq!(star.receive().unwrap(), b"Star", b"Live");
+    for fan in &mut fans {
+        assert_twiiiiit_eq!(fan.receive().unwrap(), b"Star", b"Live");
+    }
+}
+
+#[test]
+fn test_search_paged() {
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_RATE_LIMIT_PUBLISH", "0")]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+
+    for i in 0..12 {
+        alice.publish(format!("Cat picture {i}").as_bytes()).unwrap();
+        alice.receive().unwrap();
+    }
+    alice.publish(b"Dog picture").unwrap();
+    alice.receive().unwrap();
+
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+
+    // Every word must match, case insensitively, as a word prefix
+    let (dogs, next) = bob.search(b"dog PIC", (0, 0)).unwrap();
+    assert_eq!(next.0, 0);
+    assert_eq!(dogs.len(), 1);
+    assert_twiiiiit_eq!(dogs[0], b"Alice", b"Dog picture");
+
+    let (ones, _) = bob.search(b"cat 1", (0, 0)).unwrap();
+    let mut ones = ones.iter().map(|twiiiiit| twiiiiit.message).collect::<Vec<_>>();
+    ones.sort();
+    assert_eq!(ones, [&b"Cat picture 1"[..], b"Cat picture 10", b"Cat picture 11"]);
+
+    // Twelve cats fit in two pages
+    let (first_page, next) = bob.search(b"cat", (0, 0)).unwrap();
+    assert_eq!(first_page.len(), 10);
+    assert_ne!(next.0, 0);
+    let (second_page, next) = bob.search(b"cat", next).unwrap();
+    assert_eq!(second_page.len(), 2);
+    assert_eq!(next.0, 0);
+
+    let mut all = first_page.iter().chain(&second_page).map(|twiiiiit| twiiiiit.message).collect::<Vec<_>>();
+    all.sort();
+    all.dedup();
+    assert_eq!(all.len(), 12);
+
+    assert_eq!(bob.search(b"nothing", (0, 0)).unwrap(), (vec![], (0, 13)));
+}
+
+fn test_search_pages_ignore_newer_twiiiiits(engine: &str) {
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_DATABASE_ENGINE", engine),
+        ("TWIIIIITER_RATE_LIMIT_PUBLISH", "0"),
+        ("TWIIIIITER_RATE_LIMIT_SEARCH", "0"),
+    ]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    for i in 0..12 {
+        alice.publish(format!("Cat picture {i}").as_bytes()).unwrap();
+        alice.receive().unwrap();
+    }
+
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    let (first_page, next) = bob.search(b"cat", (0, 0)).unwrap();
+    assert_eq!(first_page.len(), 10);
+    // The pages rank the twiiiiits published up to the first one
+    assert_eq!(next.1, 12);
+
+    // Matching twiiiiits published between the pages would shift a plain offset
+    for i in 0..5 {
+        alice.publish(format!("Cat news {i}").as_bytes()).unwrap();
+        alice.receive().unwrap();
+    }
+
+    let (second_page, next) = bob.search(b"cat", next).unwrap();
+    assert_eq!(second_page.len(), 2);
+    assert_eq!(next.0, 0);
+    let mut all = first_page.iter().chain(&second_page).map(|twiiiiit| twiiiiit.message).collect::<Vec<_>>();
+    all.sort();
+    all.dedup();
+    assert_eq!(all.len(), 12);
+    assert!(all.iter().all(|message| message.starts_with(b"Cat picture")));
+
+    // A new search sees them
+    let (first_page, next) = bob.search(b"cat", (0, 0)).unwrap();
+    let (second_page, _) = bob.search(b"cat", next).unwrap();
+    assert_eq!(first_page.len() + second_page.len(), 17);
+}
+
+#[test]
+fn test_trending_window() {
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_RATE_LIMIT_PUBLISH", "0"),
+        ("TWIIIIITER_RATE_LIMIT_LIST", "0"),
+        ("TWIIIIITER_TRENDING_WINDOW_S", "1"),
+    ]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+
+    // Tags are case-insensitive, and only counted once per twiiiiit
+    for twiiiiit in [&b"#Cats are great"[..], b"more #cats #cats", b"#dogs @Bob #cats", b"a#b @bob!"] {
+        alice.publish(twiiiiit).unwrap();
+        alice.receive().unwrap();
+    }
+
+    let trending = alice.trending().unwrap();
+    let trending = trending.iter().map(|(tag, count)| (&tag[..], *count)).collect::<Vec<_>>();
+    assert_eq!(trending, [(&b"#cats"[..], 3), (b"@bob", 2), (b"#dogs", 1)]);
+
+    // Everything leaves the window
+    std::thread::sleep(std::time::Duration::from_millis(1200));
+    assert!(alice.trending().unwrap().is_empty());
+}
+
+fn test_timeline_merge(engine: &str) {
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_DATABASE_ENGINE", engine),
+        ("TWIIIIITER_RATE_LIMIT_PUBLISH", "0"),
+        ("TWIIIIITER_RATE_LIMIT_LIST", "0"),
+    ]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    let mut bob = server.connect().unwrap();
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    let mut carol = server.connect().unwrap();
+    assert_eq!(carol.join_as(b"Carol").unwrap(), LoginStatus::Ok);
+    assert_eq!(carol.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    assert_eq!(carol.subscribe_to(b"Bob").unwrap(), SubscribeResult::Ok);
+
+    // Interleaved twiiiiits, plus one of Carol's own that isn't part of her timeline
+    for i in 0..5 {
+        alice.publish(format!("alice {i}").as_bytes()).unwrap();
+        alice.receive().unwrap();
+        carol.receive().unwrap();
+        bob.publish(format!("bob {i}").as_bytes()).unwrap();
+        bob.receive().unwrap();
+        carol.receive().unwrap();
+    }
+    carol.publish(b"carol").unwrap();
+    carol.receive().unwrap();
+
+    let mut timeline = Vec::new();
+    let mut before = (0, 0);
+    loop {
+        let (page, next) = carol.fetch_timeline(before, 4).unwrap();
+        assert!(page.len() <= 4);
+        timeline.extend(page);
+        if next.0 == 0 {
+            break;
+        }
+        before = next;
+    }
+
+    let messages = timeline.iter().map(|twiiiiit| twiiiiit.message).collect::<Vec<_>>();
+    let expected = (0..5).rev()
+        .flat_map(|i| [format!("bob {i}"), format!("alice {i}")])
+        .collect::<Vec<_>>();
+    assert_eq!(messages, expected.iter().map(|m| m.as_bytes()).collect::<Vec<_>>());
+
+    assert_eq!(alice.fetch_timeline((0, 0), 10).unwrap(), (vec![], (0, 0)));
+}
+
+#[test]
+fn test_subscribe_batch() {
+    let server = test_server::TestServer::start();
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    let mut others = Vec::new();
+    for name in [&b"Bob"[..], b"Carol", b"Dave"] {
+        let mut other = server.connect().unwrap();
+        assert_eq!(other.join_as(name).unwrap(), LoginStatus::Ok);
+        others.push(other);
+    }
+    assert_eq!(alice.subscribe_to(b"Dave").unwrap(), SubscribeResult::Ok);
+
+    use SubscribeResult::*;
+    let names = [&b"Bob"[..], b"Nobody", b"Carol", b"Alice", b"Dave"];
+    assert_eq!(alice.subscribe_batch(&names, false).unwrap(), [Ok, NotFound, Ok, NotFound, Unchanged]);
+
+    let mut subscriptions = alice.list_subscriptions().unwrap().map(Result::unwrap).collect::<Vec<_>>();
+    subscriptions.sort();
+    assert_eq!(subscriptions, [&b"Bob"[..], b"Carol", b"Dave"].map(Box::from));
+
+    assert_eq!(alice.subscribe_batch(&[b"Bob", b"Nobody", b"Dave"], true).unwrap(), [Ok, Unchanged, Ok]);
+    let subscriptions = alice.list_subscriptions().unwrap().map(Result::unwrap).collect::<Vec<_>>();
+    assert_eq!(subscriptions, [Box::from(&b"Carol"[..])]);
+}
+
+#[test]
+fn test_unix_socket_listener() {
+    static SOCKET_COUNT: std::sync::atomic::AtomicUsize = std::sync::atomic::AtomicUsize::new(0);
+    let socket_path = std::env::temp_dir().join(format!(
+        "twiiiiiter-{}-{}.sock",
+        std::process::id(),
+        SOCKET_COUNT.fetch_add(1, std::sync::atomic::Ordering::Relaxed),
+    ));
+    let listen = format!("0,unix:{}", socket_path.to_str().unwrap());
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_LISTEN", &listen)]);
+
+    // Alice is on the Unix socket, Bob on TCP: both end up in the same server
+    let mut alice = std::os::unix::net::UnixStream::connect(&socket_path).unwrap();
+    let mut bob = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+
+    alice.publish(b"Hi from unix").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Hi from unix");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Hi from unix");
+
+    // The socket file is removed when the server stops
+    drop(server);
+    assert!(!socket_path.exists());
+}
+
+#[test]
+fn test_gateway_sessions() {
+    let socket_path = std::env::temp_dir().join(format!("twiiiiiter-gateway-{}.sock", std::process::id()));
+    let upstream = format!("unix:{}", socket_path.to_str().unwrap());
+    // One session per name, to check that names taken directly are taken for the gateway too
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_GATEWAY_LISTEN", &upstream),
+        ("TWIIIIITER_MAX_SESSIONS", "1"),
+    ]);
+    let gateway = test_server::TestGateway::start(&upstream);
+
+    // Alice and Carol go through the gateway, Bob connects directly
+    let mut alice = gateway.connect().unwrap();
+    let mut bob = server.connect().unwrap();
+    let mut carol = gateway.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(carol.join_as(b"Carol").unwrap(), LoginStatus::Ok);
+
+    // Sessions share the server's user list with direct connections
+    let mut other_bob = gateway.connect().unwrap();
+    assert_eq!(other_bob.join_as(b"Bob").unwrap(), LoginStatus::AlreadyUsed);
+
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    assert_eq!(carol.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    alice.publish(b"Through the gateway").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Through the gateway");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Through the gateway");
+    assert_twiiiiit_eq!(carol.receive().unwrap(), b"Alice", b"Through the gateway");
+
+    // Closing the client connection ends the session on the server
+    alice.shutdown(Shutdown::Both).unwrap();
+    drop(alice);
+    std::thread::sleep(Duration::from_millis(20));
+    let mut alice = gateway.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+}
+
+#[test]
+fn test_hot_restart() {
+    use std::io::Write;
+
+    let prefix = std::env::temp_dir().join(format!("twiiiiiter-handoff-{}", std::process::id()));
+    let prefix = prefix.to_str().unwrap();
+    let (database, handoff, upstream) =
+        (format!("{prefix}.db"), format!("{prefix}.sock"), format!("unix:{prefix}-gateway.sock"));
+    // The new process has to find the same database
+    let envs = [
+        ("TWIIIIITER_DATABASE_FILE", database.as_str()),
+        ("TWIIIIITER_HANDOFF_PATH", handoff.as_str()),
+        ("TWIIIIITER_GATEWAY_LISTEN", upstream.as_str()),
+        ("TWIIIIITER_MAX_SESSIONS", "1"),
+    ];
+    let old_server = test_server::TestServer::start_with_env(&envs);
+    let gateway = test_server::TestGateway::start(&upstream);
+
+    // Alice is connected directly, Bob through the gateway
+    let mut alice = old_server.connect().unwrap();
+    let mut bob = gateway.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+
+    // Half a frame is received by the old process, the rest by the new one
+    let frame = network::MessageC2S::Publish(b"Across the restart").encode().unwrap();
+    alice.write_all(&frame[..20]).unwrap();
+    std::thread::sleep(Duration::from_millis(20));
+
+    let new_server = test_server::TestServer::start_with_env(&envs);
+    alice.write_all(&frame[20..]).unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Across the restart");
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Across the restart");
+
+    // Names are still taken, and the listening socket is the same
+    let mut other_alice = new_server.connect().unwrap();
+    assert_eq!(other_alice.join_as(b"Alice").unwrap(), LoginStatus::AlreadyUsed);
+    let mut other_bob = old_server.connect().unwrap();
+    assert_eq!(other_bob.join_as(b"Bob").unwrap(), LoginStatus::AlreadyUsed);
+
+    drop(gateway);
+    drop(old_server);
+    drop(new_server);
+    let _ = std::fs::remove_file(&database).or_else(|_| std::fs::remove_dir_all(&database));
+    let _ = std::fs::remove_file(format!("{database}-wal"));
+    let _ = std::fs::remove_file(format!("{database}-shm"));
+}
+
+#[test]
+fn test_slow_reader() {
+    use std::io::Write;
+
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_RATE_LIMIT_PUBLISH", "0"),
+        ("TWIIIIITER_RATE_LIMIT_LIST", "0"),
+    ]);
+    let mut star = server.connect().unwrap();
+    let mut fan = server.connect().unwrap();
+    let mut slow = server.connect().unwrap();
+    assert_eq!(star.join_as(b"Star").unwrap(), LoginStatus::Ok);
+    assert_eq!(fan.join_as(b"Fan").unwrap(), LoginStatus::Ok);
+    assert_eq!(slow.join_as(b"Slow").unwrap(), LoginStatus::Ok);
+    assert_eq!(fan.subscribe_to(b"Star").unwrap(), SubscribeResult::Ok);
+    assert_eq!(slow.subscribe_to(b"Star").unwrap(), SubscribeResult::Ok);
+
+    // Slow asks for far more than the socket buffers can hold, and never reads the answers
+    let flood = std::thread::spawn(move || {
+        let requests = network::MessageC2S::Trending.encode().unwrap().repeat(1000);
+        for _ in 0..1000 {
+            if slow.write_all(&requests).is_err() {
+                return true;
+            }
+        }
+        false
+    });
+
+    // Meanwhile, everyone else is served, from the same twiiiiit frames that wait for Slow
+    for i in 0..100 {
+        let message = format!("Still there {i}");
+        star.publish(message.as_bytes()).unwrap();
+        assert_twiiiiit_eq!(star.receive().unwrap(), b"Star", message.as_bytes());
+        assert_twiiiiit_eq!(fan.receive().unwrap(), b"Star", message.as_bytes());
+    }
+
+    // Until Slow is disconnected
+    assert!(flood.join().unwrap());
+}
+
+#[test]
+fn test_low_latency_profile() {
+    let server = test_server::TestServer::start_with_env(&[
+        ("TWIIIIITER_LOW_LATENCY", "1"),
+        ("TWIIIIITER_BUSY_POLL_US", "20"),
+        ("TWIIIIITER_CPU", "0"),
+        ("TWIIIIITER_RATE_LIMIT_PUBLISH", "0"),
+        ("TWIIIIITER_RATE_LIMIT_LIST", "0"),
+    ]);
+    let mut alice = server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    for tag in [&b"#one"[..], b"#two", b"#three", b"#four"] {
+        alice.publish(tag).unwrap();
+        alice.receive().unwrap();
+    }
+
+    // Without TCP_NODELAY, every answer of several frames would wait for a delayed ACK (40 ms on Linux)
+    let start = std::time::Instant::now();
+    for _ in 0..20 {
+        assert_eq!(alice.trending().unwrap().len(), 4);
+    }
+    assert!(start.elapsed() < Duration::from_millis(400));
+}
+
+#[test]
+fn test_channels() {
+    let database = std::env::temp_dir().join(format!("twiiiiiter-channels-{}", std::process::id()));
+    let database = database.to_str().unwrap();
+    let envs = [("TWIIIIITER_DATABASE_FILE", database)];
+
+    {
+        let server = test_server::TestServer::start_with_env(&envs);
+        let (mut alice, mut desktop) = (server.connect().unwrap(), server.connect().unwrap());
+        let (mut phone, mut carol) = (server.connect().unwrap(), server.connect().unwrap());
+        assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+        assert_eq!(desktop.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+        assert_eq!(phone.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+        assert_eq!(carol.join_as(b"Carol").unwrap(), LoginStatus::Ok);
+
+        assert_eq!(alice.join_channel(b"events").unwrap(), SubscribeResult::Ok);
+        assert_eq!(alice.join_channel(b"events").unwrap(), SubscribeResult::Unchanged);
+        assert_eq!(desktop.join_channel(b"events").unwrap(), SubscribeResult::Ok);
+        assert_eq!(carol.join_channel(b"").unwrap(), SubscribeResult::NotFound);
+
+        // Anyone can publish, only the members receive, on every session
+        carol.publish_channel(b"events", b"Party at 8").unwrap();
+        for member in [&mut alice, &mut desktop, &mut phone] {
+            let (channel, author, message) = member.receive_channel().unwrap();
+            assert_eq!((&*channel, &*author, &*message), (&b"events"[..], &b"Carol"[..], &b"Party at 8"[..]));
+        }
+        // Carol isn't a member: her own twiiiiit is the next thing she receives
+        carol.publish(b"Hello").unwrap();
+        assert_twiiiiit_eq!(carol.receive().unwrap(), b"Carol", b"Hello");
+
+        assert_eq!(phone.leave_channel(b"events").unwrap(), SubscribeResult::Ok);
+        assert_eq!(desktop.leave_channel(b"events").unwrap(), SubscribeResult::Unchanged);
+        alice.publish_channel(b"events", b"Bob left").unwrap();
+        assert_eq!(&*alice.receive_channel().unwrap().2, b"Bob left");
+        desktop.publish(b"Still here").unwrap();
+        assert_twiiiiit_eq!(desktop.receive().unwrap(), b"Bob", b"Still here");
+    }
+
+    // The members are loaded back from the database
+    let server = test_server::TestServer::start_with_env(&envs);
+    let (mut alice, mut carol) = (server.connect().unwrap(), server.connect().unwrap());
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(carol.join_as(b"Carol").unwrap(), LoginStatus::Ok);
+    carol.publish_channel(b"events", b"After restart").unwrap();
+    assert_eq!(&*alice.receive_channel().unwrap().2, b"After restart");
+    assert_eq!(alice.leave_channel(b"events").unwrap(), SubscribeResult::Ok);
+    assert_eq!(alice.join_channel(b"events").unwrap(), SubscribeResult::Ok);
+
+    drop(server);
+    let _ = std::fs::remove_file(database).or_else(|_| std::fs::remove_dir_all(database));
+    let _ = std::fs::remove_file(format!("{database}-wal"));
+    let _ = std::fs::remove_file(format!("{database}-shm"));
+}
+
+#[test]
+fn test_cluster_channel_across_nodes() {
+    let nodes = test_server::TestServer::start_cluster(2);
+    let mut alice = nodes[0].connect().unwrap();
+    let mut bob = nodes[1].connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+
+    // Each node learns about the other's members, and delivers to its own
+    assert_eq!(alice.join_channel(b"events").unwrap(), SubscribeResult::Ok);
+    assert_eq!(bob.join_channel(b"events").unwrap(), SubscribeResult::Ok);
+    std::thread::sleep(Duration::from_millis(5));
+
+    bob.publish_channel(b"events", b"From node 1").unwrap();
+    assert_eq!(&*bob.receive_channel().unwrap().2, b"From node 1");
+    assert_eq!(&*alice.receive_channel().unwrap().2, b"From node 1");
+}
+
+/// Reads a capture file (see `common/capture.h`): the frames of each connection, sorted, and the number of opened and
+/// closed connections
+fn read_capture(path: &std::path::Path) -> (Vec<Vec<Vec<u8>>>, usize, usize) {
+    use std::collections::HashMap;
+
+    let data = std::fs::read(path).unwrap();
+    assert_eq!(&data[..8], b"TWCAPTR1");
+    fn read_varint(data: &[u8], position: &mut usize) -> u64 {
+        let mut value = 0u64;
+        for shift in (0..64).step_by(7) {
+            let byte = data[*position];
+            *position += 1;
+            value |= u64::from(byte & 0x7f) << shift;
+            if byte & 0x80 == 0 {
+                return value;
+            }
+        }
+        panic!("invalid varint");
+    }
+
+    // Frames of each connection, which must be opened and closed exactly once
+    let mut frames = HashMap::<u64, Vec<Vec<u8>>>::new();
+    let (mut opened, mut closed) = (0, 0);
+    let mut position = 16;
+    while position < data.len() {
+        let kind = data[position];
+        position += 1;
+        let _delta_us = read_varint(&data, &mut position);
+        let connection = read_varint(&data, &mut position);
+        match kind {
+            0 => {
+                opened += 1;
+                assert!(frames.insert(connection, Vec::new()).is_none());
+            }
+            1 => {
+                let frame_len = usize::from(data[position]);
+                let mut frame = data[position + 1..][..frame_len].to_vec();
+                frame.resize(48, 0);
+                frames.get_mut(&connection).unwrap().push(frame);
+                position += 1 + frame_len;
+            }
+            2 => closed += 1,
+            _ => panic!("invalid record kind {kind}"),
+        }
+    }
+
+    let mut recorded = frames.into_values().collect::<Vec<_>>();
+    recorded.sort();
+    (recorded, opened, closed)
+}
+
+#[test]
+fn test_record_traffic() {
+    use crate::network::MessageC2S;
+
+    let capture = std::env::temp_dir().join(format!("twiiiiiter-capture-{}", std::process::id()));
+    let server = test_server::TestServer::start_with_env(&[("TWIIIIITER_RECORD_FILE", capture.to_str().unwrap())]);
+    let (mut alice, mut bob) = (server.connect().unwrap(), server.connect().unwrap());
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.join_as(b"Bob").unwrap(), LoginStatus::Ok);
+    assert_eq!(bob.subscribe_to(b"Alice").unwrap(), SubscribeResult::Ok);
+    alice.publish(b"Hello").unwrap();
+    assert_twiiiiit_eq!(bob.receive().unwrap(), b"Alice", b"Hello");
+    drop((alice, bob));
+    // The end of the capture is written when the server stops
+    drop(server);
+
+    let (recorded, opened, closed) = read_capture(&capture);
+    let _ = std::fs::remove_file(&capture);
+    assert_eq!((opened, closed), (2, 2));
+
+    let encode = |message: MessageC2S| message.encode().unwrap().to_vec();
+    let mut expected = vec![
+        vec![encode(MessageC2S::JoinAs(b"Alice")), encode(MessageC2S::Publish(b"Hello"))],
+        vec![encode(MessageC2S::JoinAs(b"Bob")), encode(MessageC2S::SubscribeTo(b"Alice"))],
+    ];
+    expected.sort();
+    assert_eq!(recorded, expected);
+}
+
+#[test]
+fn test_record_across_hot_restart() {
+    use crate::network::MessageC2S;
+
+    let database = test_server::DatabaseFile::temporary("record-handoff");
+    let capture = std::env::temp_dir().join(format!("twiiiiiter-capture-handoff-{}", std::process::id()));
+    let previous_capture = capture.with_extension("1");
+    let handoff = format!("{}.sock", database.path());
+    let envs = [
+        ("TWIIIIITER_DATABASE_FILE", database.path()),
+        ("TWIIIIITER_HANDOFF_PATH", handoff.as_str()),
+        ("TWIIIIITER_RECORD_FILE", capture.to_str().unwrap()),
+    ];
+    let old_server = test_server::TestServer::start_with_env(&envs);
+    let mut alice = old_server.connect().unwrap();
+    assert_eq!(alice.join_as(b"Alice").unwrap(), LoginStatus::Ok);
+    alice.publish(b"Before").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"Before");
+
+    // The old process ends its capture before exiting, and the new one keeps it next to its own
+    let new_server = test_server::TestServer::start_with_env(&envs);
+    drop(old_server);
+    alice.publish(b"After").unwrap();
+    assert_twiiiiit_eq!(alice.receive().unwrap(), b"Alice", b"After");
+    drop(alice);
+    drop(new_server);
+
+    let encode = |message: MessageC2S| message.encode().unwrap().to_vec();
+    let (recorded, opened, closed) = read_capture(&previous_capture);
+    assert_eq!((opened, closed), (1, 0));
+    assert_eq!(recorded, [[encode(MessageC2S::JoinAs(b"Alice")), encode(MessageC2S::Publish(b"Before"))]]);
+    let (recorded, opened, closed) = read_capture(&capture);
+    assert_eq!((opened, closed), (1, 1));
+    assert_eq!(recorded, [[encode(MessageC2S::JoinAs(b"Alice")), encode(MessageC2S::Publish(b"After"))]]);
+    let _ = std::fs::remove_file(&capture);
+    let _ = std::fs::remove_file(&previous_capture);
+    let _ = std::fs::remove_file(&handoff);
+}
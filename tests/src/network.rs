@@ -6,10 +6,17 @@ use std::io::{Cursor, ErrorKind, Read, Seek, SeekFrom, Write};
 pub const IO_BUFFER_SIZE: usize = 48;
 pub const USERNAME_MAX_LENGTH: usize = 6;
 pub const MESSAGE_MAX_LENGTH: usize = 20;
+pub const SUBSCRIBE_BATCH_MAX: usize = 7;
 
 pub type Frame = [u8; IO_BUFFER_SIZE];
 pub const EMPTY_FRAME: Frame = [0; IO_BUFFER_SIZE];
 
+/// Date and sequence number before which a timeline page starts
+pub type TimelineCursor = (i64, u64);
+
+/// Offset of a search page, and the last sequence number ranked by the search ((0, 0) for the first page)
+pub type SearchCursor = (u32, u64);
+
 macro_rules! match_variant {
     ($reader:ident {
         $($int_val:literal => $maps_to:expr,)*
@@ -42,6 +49,7 @@ pub struct ReceivedMessage<'a> {
     pub date: i64,
     pub author: &'a [u8],
     pub message: &'a [u8],
+    pub seq: u64,
 }
 
 impl<'a> Debug for ReceivedMessage<'a> {
@@ -59,6 +67,7 @@ impl<'a> Debug for ReceivedMessage<'a> {
             Err(_) => stru.field("message", &format_args!("{:?}", self.message)),
         };
 
+        stru.field("seq", &self.seq);
         stru.finish()
     }
 }
@@ -74,6 +83,7 @@ pub enum SubscribeResult {
 pub enum KickReason {
     Closing,
     ProtocolError,
+    Timeout,
 }
 
 #[derive(Clone, Copy, Debug, Hash, Eq, PartialEq)]
@@ -83,6 +93,15 @@ pub enum MessageS2C<'a> {
     SubscribeResult(SubscribeResult),
     SubscriptionEntry(&'a [u8]),
     Kick(KickReason),
+    Ping,
+    Throttled { request: u32, retry_after_ms: u32 },
+    SearchResult(ReceivedMessage<'a>),
+    SearchEnd(SearchCursor),
+    TrendingEntry(&'a [u8], u32),
+    TimelineEntry(ReceivedMessage<'a>),
+    TimelineEnd(TimelineCursor),
+    SubscribeBatchResult { count: u32, results: u32 },
+    ChannelMessage { date: i64, channel: &'a [u8], author: &'a [u8], message: &'a [u8] },
 }
 
 impl<'a> MessageS2C<'a> {
@@ -98,6 +117,7 @@ impl<'a> MessageS2C<'a> {
                 date: cursor.read_i64::<BE>()?,
                 author: read_str0::<USERNAME_MAX_LENGTH>(&mut cursor),
                 message: read_str0::<MESSAGE_MAX_LENGTH>(&mut cursor),
+                seq: cursor.read_u64::<BE>()?,
             }),
             2 => Self::SubscribeResult(match_variant!(cursor {
                 0 => SubscribeResult::Ok,
@@ -108,7 +128,38 @@ impl<'a> MessageS2C<'a> {
             4 => Self::Kick(match_variant!(cursor {
                 0 => KickReason::Closing,
                 1 => KickReason::ProtocolError,
-            } "subscribe result")),
+                2 => KickReason::Timeout,
+            } "kick reason")),
+            5 => Self::Ping,
+            6 => Self::Throttled {
+                request: cursor.read_u32::<BE>()?,
+                retry_after_ms: cursor.read_u32::<BE>()?,
+            },
+            7 => Self::SearchResult(ReceivedMessage {
+                date: cursor.read_i64::<BE>()?,
+                author: read_str0::<USERNAME_MAX_LENGTH>(&mut cursor),
+                message: read_str0::<MESSAGE_MAX_LENGTH>(&mut cursor),
+                seq: cursor.read_u64::<BE>()?,
+            }),
+            8 => Self::SearchEnd((cursor.read_u32::<BE>()?, cursor.read_u64::<BE>()?)),
+            9 => Self::TrendingEntry(read_str0::<MESSAGE_MAX_LENGTH>(&mut cursor), cursor.read_u32::<BE>()?),
+            10 => Self::TimelineEntry(ReceivedMessage {
+                date: cursor.read_i64::<BE>()?,
+                author: read_str0::<USERNAME_MAX_LENGTH>(&mut cursor),
+                message: read_str0::<MESSAGE_MAX_LENGTH>(&mut cursor),
+                seq: cursor.read_u64::<BE>()?,
+            }),
+            11 => Self::TimelineEnd((cursor.read_i64::<BE>()?, cursor.read_u64::<BE>()?)),
+            12 => Self::SubscribeBatchResult {
+                count: cursor.read_u32::<BE>()?,
+                results: cursor.read_u32::<BE>()?,
+            },
+            13 => Self::ChannelMessage {
+                date: cursor.read_i64::<BE>()?,
+                channel: read_str0::<USERNAME_MAX_LENGTH>(&mut cursor),
+                author: read_str0::<USERNAME_MAX_LENGTH>(&mut cursor),
+                message: read_str0::<MESSAGE_MAX_LENGTH>(&mut cursor),
+            },
         } "tag"))
     }
 }
@@ -120,6 +171,16 @@ pub enum MessageC2S<'a> {
     UnsubscribeFrom(&'a [u8]),
     ListSubscription,
     Publish(&'a [u8]),
+    Pong,
+    Search(&'a [u8], SearchCursor),
+    Trending,
+    FetchTimeline { before: TimelineCursor, limit: u32 },
+    SubscribeBatch(&'a [&'a [u8]]),
+    UnsubscribeBatch(&'a [&'a [u8]]),
+    Ack(u64),
+    JoinChannel(&'a [u8]),
+    LeaveChannel(&'a [u8]),
+    PublishChannel(&'a [u8], &'a [u8]),
 }
 
 impl<'a> MessageC2S<'a> {
@@ -132,6 +193,16 @@ impl<'a> MessageC2S<'a> {
             Self::UnsubscribeFrom(str) => (2, *str, USERNAME_MAX_LENGTH),
             Self::ListSubscription => (3, Default::default(), 0),
             Self::Publish(str) => (4, *str, MESSAGE_MAX_LENGTH),
+            Self::Pong => (5, Default::default(), 0),
+            Self::Search(str, _) => (6, *str, MESSAGE_MAX_LENGTH),
+            Self::Trending => (7, Default::default(), 0),
+            Self::FetchTimeline { .. } => (8, Default::default(), 0),
+            Self::SubscribeBatch(_) => (9, Default::default(), 0),
+            Self::UnsubscribeBatch(_) => (10, Default::default(), 0),
+            Self::Ack(_) => (11, Default::default(), 0),
+            Self::JoinChannel(str) => (12, *str, USERNAME_MAX_LENGTH),
+            Self::LeaveChannel(str) => (13, *str, USERNAME_MAX_LENGTH),
+            Self::PublishChannel(str, _) => (14, *str, USERNAME_MAX_LENGTH),
         };
 
         frame.write_u32::<BE>(tag)?;
@@ -141,6 +212,35 @@ impl<'a> MessageC2S<'a> {
         } else {
             frame.clone().into_inner()[frame.position() as usize..][..max_len].fill(0);
             frame.write_all(str)?;
+            if let Self::Search(_, (search_cursor, snapshot)) = self {
+                frame.set_position((4 + MESSAGE_MAX_LENGTH) as u64);
+                frame.write_u32::<BE>(*search_cursor)?;
+                frame.write_u64::<BE>(*snapshot)?;
+            }
+            if let Self::FetchTimeline { before: (before, before_seq), limit } = self {
+                frame.write_i64::<BE>(*before)?;
+                frame.write_u32::<BE>(*limit)?;
+                frame.write_u64::<BE>(*before_seq)?;
+            }
+            if let Self::Ack(seq) = self {
+                frame.write_u64::<BE>(*seq)?;
+            }
+            if let Self::PublishChannel(_, message) = self {
+                if message.len() > MESSAGE_MAX_LENGTH {
+                    return Err(io::Error::new(ErrorKind::InvalidData, "str too long"));
+                }
+                frame.set_position((4 + USERNAME_MAX_LENGTH) as u64);
+                frame.write_all(message)?;
+            }
+            if let Self::SubscribeBatch(names) | Self::UnsubscribeBatch(names) = self {
+                if names.len() > SUBSCRIBE_BATCH_MAX || names.iter().any(|name| name.len() > USERNAME_MAX_LENGTH) {
+                    return Err(io::Error::new(ErrorKind::InvalidData, "batch too long"));
+                }
+                for (i, name) in names.iter().enumerate() {
+                    frame.set_position((4 + i * USERNAME_MAX_LENGTH) as u64);
+                    frame.write_all(name)?;
+                }
+            }
             Ok(frame.into_inner())
         }
     }
@@ -198,6 +298,45 @@ pub trait WriteExt: Write {
     fn publish(&mut self, twiiiiit: &[u8]) -> io::Result<()> {
         self.write_c2s(MessageC2S::Publish(twiiiiit))
     }
+
+    fn pong(&mut self) -> io::Result<()> {
+        self.write_c2s(MessageC2S::Pong)
+    }
+
+    fn search(&mut self, query: &[u8], cursor: SearchCursor) -> io::Result<()> {
+        self.write_c2s(MessageC2S::Search(query, cursor))
+    }
+
+    fn trending(&mut self) -> io::Result<()> {
+        self.write_c2s(MessageC2S::Trending)
+    }
+
+    fn fetch_timeline(&mut self, before: TimelineCursor, limit: u32) -> io::Result<()> {
+        self.write_c2s(MessageC2S::FetchTimeline { before, limit })
+    }
+
+    fn subscribe_batch(&mut self, names: &[&[u8]], unsubscribe: bool) -> io::Result<()> {
+        self.write_c2s(match unsubscribe {
+            false => MessageC2S::SubscribeBatch(names),
+            true => MessageC2S::UnsubscribeBatch(names),
+        })
+    }
+
+    fn ack(&mut self, seq: u64) -> io::Result<()> {
+        self.write_c2s(MessageC2S::Ack(seq))
+    }
+
+    fn join_channel(&mut self, channel: &[u8]) -> io::Result<()> {
+        self.write_c2s(MessageC2S::JoinChannel(channel))
+    }
+
+    fn leave_channel(&mut self, channel: &[u8]) -> io::Result<()> {
+        self.write_c2s(MessageC2S::LeaveChannel(channel))
+    }
+
+    fn publish_channel(&mut self, channel: &[u8], message: &[u8]) -> io::Result<()> {
+        self.write_c2s(MessageC2S::PublishChannel(channel, message))
+    }
 }
 
 impl<W: Write> WriteExt for W {
@@ -220,6 +359,33 @@ pub trait ReadWriteExt {
     fn publish(&mut self, twiiiiit: &[u8]) -> io::Result<()>;
 
     fn receive(&mut self) -> io::Result<ReceivedMessage>;
+
+    /// Acknowledges the twiiiiits of the followed accounts up to `seq`, there is no answer
+    fn ack(&mut self, seq: u64) -> io::Result<()>;
+
+    /// Returns a page of results, and the cursor of the next one (with a 0 offset if it is the last)
+    fn search(&mut self, query: &[u8], cursor: SearchCursor)
+        -> io::Result<(Vec<ReceivedMessage<'static>>, SearchCursor)>;
+
+    /// Returns the trending tags and their counts, most frequent first
+    fn trending(&mut self) -> io::Result<Vec<(Box<[u8]>, u32)>>;
+
+    /// Returns a page of the timeline, newest first, and the `before` of the next one ((0, 0) if it is the last)
+    fn fetch_timeline(&mut self, before: TimelineCursor, limit: u32)
+        -> io::Result<(Vec<ReceivedMessage<'static>>, TimelineCursor)>;
+
+    /// Returns the result of each name of the batch
+    fn subscribe_batch(&mut self, names: &[&[u8]], unsubscribe: bool) -> io::Result<Vec<SubscribeResult>>;
+
+    fn join_channel(&mut self, channel: &[u8]) -> io::Result<SubscribeResult>;
+
+    fn leave_channel(&mut self, channel: &[u8]) -> io::Result<SubscribeResult>;
+
+    /// Publishes in a channel, there is no answer
+    fn publish_channel(&mut self, channel: &[u8], message: &[u8]) -> io::Result<()>;
+
+    /// Returns the channel, author and message of the next channel message
+    fn receive_channel(&mut self) -> io::Result<(Box<[u8]>, Box<[u8]>, Box<[u8]>)>;
 }
 
 fn unexpected_s2c(message: MessageS2C) -> ! {
@@ -277,4 +443,106 @@ impl<RW: ReadExt + WriteExt> ReadWriteExt for RW {
             other => unexpected_s2c(other),
         }
     }
+
+    fn ack(&mut self, seq: u64) -> io::Result<()> {
+        WriteExt::ack(self, seq)
+    }
+
+    /// Leaks the messages
+    fn search(&mut self, query: &[u8], cursor: SearchCursor)
+        -> io::Result<(Vec<ReceivedMessage<'static>>, SearchCursor)> {
+        WriteExt::search(self, query, cursor)?;
+        let mut results = Vec::new();
+        loop {
+            let mut frame = EMPTY_FRAME;
+            match ReadExt::read_s2c(self, &mut frame)? {
+                MessageS2C::SearchResult(msg) => results.push(ReceivedMessage {
+                    author: Box::leak(Vec::from(msg.author).into_boxed_slice()),
+                    message: Box::leak(Vec::from(msg.message).into_boxed_slice()),
+                    ..msg
+                }),
+                MessageS2C::SearchEnd(next) => return Ok((results, next)),
+                other => unexpected_s2c(other),
+            }
+        }
+    }
+
+    fn trending(&mut self) -> io::Result<Vec<(Box<[u8]>, u32)>> {
+        WriteExt::trending(self)?;
+        let mut entries = Vec::new();
+        loop {
+            let mut frame = EMPTY_FRAME;
+            match ReadExt::read_s2c(self, &mut frame)? {
+                MessageS2C::TrendingEntry(b"", _) => return Ok(entries),
+                MessageS2C::TrendingEntry(tag, count) => entries.push((tag.into(), count)),
+                other => unexpected_s2c(other),
+            }
+        }
+    }
+
+    /// Leaks the messages
+    fn fetch_timeline(&mut self, before: TimelineCursor, limit: u32)
+        -> io::Result<(Vec<ReceivedMessage<'static>>, TimelineCursor)> {
+        WriteExt::fetch_timeline(self, before, limit)?;
+        let mut entries = Vec::new();
+        loop {
+            let mut frame = EMPTY_FRAME;
+            match ReadExt::read_s2c(self, &mut frame)? {
+                MessageS2C::TimelineEntry(msg) => entries.push(ReceivedMessage {
+                    author: Box::leak(Vec::from(msg.author).into_boxed_slice()),
+                    message: Box::leak(Vec::from(msg.message).into_boxed_slice()),
+                    ..msg
+                }),
+                MessageS2C::TimelineEnd(next) => return Ok((entries, next)),
+                other => unexpected_s2c(other),
+            }
+        }
+    }
+
+    fn subscribe_batch(&mut self, names: &[&[u8]], unsubscribe: bool) -> io::Result<Vec<SubscribeResult>> {
+        let mut frame = EMPTY_FRAME;
+        WriteExt::subscribe_batch(self, names, unsubscribe)?;
+        match ReadExt::read_s2c(self, &mut frame)? {
+            MessageS2C::SubscribeBatchResult { count, results } => Ok((0..count)
+                .map(|i| match (results >> (2 * i)) & 3 {
+                    0 => SubscribeResult::Ok,
+                    1 => SubscribeResult::NotFound,
+                    _ => SubscribeResult::Unchanged,
+                })
+                .collect()),
+            other => unexpected_s2c(other),
+        }
+    }
+
+    fn join_channel(&mut self, channel: &[u8]) -> io::Result<SubscribeResult> {
+        let mut frame = EMPTY_FRAME;
+        WriteExt::join_channel(self, channel)?;
+        match ReadExt::read_s2c(self, &mut frame)? {
+            MessageS2C::SubscribeResult(res) => Ok(res),
+            other => unexpected_s2c(other),
+        }
+    }
+
+    fn leave_channel(&mut self, channel: &[u8]) -> io::Result<SubscribeResult> {
+        let mut frame = EMPTY_FRAME;
+        WriteExt::leave_channel(self, channel)?;
+        match ReadExt::read_s2c(self, &mut frame)? {
+            MessageS2C::SubscribeResult(res) => Ok(res),
+            other => unexpected_s2c(other),
+        }
+    }
+
+    fn publish_channel(&mut self, channel: &[u8], message: &[u8]) -> io::Result<()> {
+        WriteExt::publish_channel(self, channel, message)
+    }
+
+    fn receive_channel(&mut self) -> io::Result<(Box<[u8]>, Box<[u8]>, Box<[u8]>)> {
+        let mut frame = EMPTY_FRAME;
+        match ReadExt::read_s2c(self, &mut frame)? {
+            MessageS2C::ChannelMessage { channel, author, message, .. } => {
+                Ok((channel.into(), author.into(), message.into()))
+            }
+            other => unexpected_s2c(other),
+        }
+    }
 }
@@ -1,11 +1,52 @@
 use signal_child::Signalable;
 use std::io::{BufRead, BufReader, Write};
 use std::net::TcpStream;
+use std::path::PathBuf;
 use std::process::{Child, Command, Stdio};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
 
 pub struct TestServer {
     server: Option<Child>,
     port: u16,
+    cluster_port: Option<u16>,
+    database_file: Option<Arc<DatabaseFile>>,
+}
+
+/// A temporary database file (or directory, for the log engine), removed once every server using it has stopped
+pub struct DatabaseFile(PathBuf);
+
+impl DatabaseFile {
+    /// A new path in the temporary directory, with nothing there yet
+    pub fn temporary(kind: &str) -> Self {
+        static DATABASE_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+        let path = std::env::temp_dir().join(format!(
+            "twiiiiiter-{kind}-{}-{}",
+            std::process::id(),
+            DATABASE_COUNT.fetch_add(1, Ordering::Relaxed),
+        ));
+        let _ = std::fs::remove_file(&path);
+        let _ = std::fs::remove_dir_all(&path);
+        Self(path)
+    }
+
+    pub fn path(&self) -> &str {
+        self.0.to_str().unwrap()
+    }
+}
+
+impl Drop for DatabaseFile {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_file(&self.0);
+        let _ = std::fs::remove_dir_all(&self.0);
+        // SQLite leaves its journals next to the database
+        for suffix in ["-wal", "-shm", "-journal"] {
+            let mut path = self.0.clone().into_os_string();
+            path.push(suffix);
+            let _ = std::fs::remove_file(path);
+        }
+    }
 }
 
 impl TestServer {
@@ -14,12 +55,57 @@ impl TestServer {
             return Self {
                 server: None,
                 port: port.parse().expect("can't parse SERVER_PORT_OVERRIDE"),
+                cluster_port: None,
+                database_file: None,
             };
         }
 
+        Self::spawn(&[("TWIIIIITER_DATABASE_FILE", ":memory:".into())])
+    }
+
+    /// Starts a server with an in-memory database and extra environment variables
+    pub fn start_with_env(envs: &[(&str, &str)]) -> Self {
+        let mut all_envs = vec![("TWIIIIITER_DATABASE_FILE", ":memory:".to_string())];
+        all_envs.extend(envs.iter().map(|(key, value)| (*key, value.to_string())));
+        Self::spawn(&all_envs)
+    }
+
+    /// Starts a server with an in-memory database on the given storage engine, whatever
+    /// `TWIIIIITER_DATABASE_ENGINE` the tests run with
+    pub fn start_with_engine(engine: &str) -> Self {
+        Self::start_with_env(&[("TWIIIIITER_DATABASE_ENGINE", engine)])
+    }
+
+    /// Starts `nodes` servers sharing a temporary database and linked together in a cluster
+    pub fn start_cluster(nodes: usize) -> Vec<Self> {
+        let database_file = Arc::new(DatabaseFile::temporary("cluster"));
+
+        let mut servers = Vec::<Self>::with_capacity(nodes);
+        for _ in 0..nodes {
+            let peers = servers
+                .iter()
+                .map(|server| format!("127.0.0.1:{}", server.cluster_port.unwrap()))
+                .collect::<Vec<_>>()
+                .join(",");
+
+            // The log engine keeps its indexes in memory, so only SQLite can be shared between nodes
+            let mut server = Self::spawn(&[
+                ("TWIIIIITER_DATABASE_ENGINE", "sqlite".into()),
+                ("TWIIIIITER_DATABASE_FILE", database_file.path().into()),
+                ("TWIIIIITER_CLUSTER_PORT", "0".into()),
+                ("TWIIIIITER_CLUSTER_PEERS", peers),
+            ]);
+            server.database_file = Some(database_file.clone());
+            servers.push(server);
+        }
+
+        servers
+    }
+
+    fn spawn(envs: &[(&str, String)]) -> Self {
         let mut server = Command::new(env!("SERVER_PATH"))
             .arg("0")
-            .env("TWIIIIITER_DATABASE_FILE", ":memory:")
+            .envs(envs.iter().map(|(key, value)| (key, value)))
             .stdout(Stdio::piped())
             .stdin(Stdio::null())
             .spawn()
@@ -27,10 +113,14 @@ impl TestServer {
 
         let stdout = BufReader::new(server.stdout.take().unwrap());
 
+        let mut cluster_port = None;
         let port = stdout
             .lines()
             .map(|line| line.unwrap())
             .filter_map(|line| {
+                if let Some(port) = line.strip_prefix("[INFO] Cluster listening on *:") {
+                    cluster_port = Some(port.parse::<u16>().expect("invalid cluster port"));
+                }
                 line.strip_prefix("[INFO] Listening on *:")
                     .map(|port| port.parse::<u16>().expect("invalid port"))
             })
@@ -44,6 +134,8 @@ impl TestServer {
         Self {
             server: Some(server),
             port,
+            cluster_port,
+            database_file: None,
         }
     }
 
@@ -52,6 +144,55 @@ impl TestServer {
     }
 }
 
+/// A gateway in front of a [TestServer], see `gateway/main.c`
+pub struct TestGateway {
+    gateway: Child,
+    port: u16,
+}
+
+impl TestGateway {
+    /// Starts a gateway connected to `upstream`, an address the server listens to for gateways
+    pub fn start(upstream: &str) -> Self {
+        // The gateway is built next to the server
+        let path = option_env!("GATEWAY_PATH").map(PathBuf::from).unwrap_or_else(|| {
+            PathBuf::from(env!("SERVER_PATH"))
+                .parent()
+                .and_then(|server_dir| server_dir.parent())
+                .expect("invalid SERVER_PATH")
+                .join("gateway/twiiiiiter-gateway")
+        });
+
+        let mut gateway = Command::new(path)
+            .args([upstream, "0"])
+            .stdout(Stdio::piped())
+            .stdin(Stdio::null())
+            .spawn()
+            .expect("can't start gateway");
+
+        let port = BufReader::new(gateway.stdout.take().unwrap())
+            .lines()
+            .map(|line| line.unwrap())
+            .find_map(|line| {
+                line.strip_prefix("[INFO] Listening on *:")
+                    .map(|port| port.parse::<u16>().expect("invalid port"))
+            })
+            .expect("gateway exited without providing its port");
+
+        Self { gateway, port }
+    }
+
+    pub fn connect(&self) -> std::io::Result<TcpStream> {
+        TcpStream::connect(("localhost", self.port))
+    }
+}
+
+impl Drop for TestGateway {
+    fn drop(&mut self) {
+        self.gateway.interrupt().unwrap();
+        self.gateway.wait().unwrap();
+    }
+}
+
 impl Drop for TestServer {
     fn drop(&mut self) {
         if let Some(server) = &mut self.server {
@@ -0,0 +1,130 @@
+/**
+ * Mesure la latence aller-retour d'un serveur, pour comparer les transports (TCP en boucle locale, socket Unix, ...)
+ *
+ * Usage : twiiiiiter-latency-bench ADDRESS [ROUNDS] [TAGS]
+ *
+ * Se connecte à ADDRESS (c.f. "/common/address.h"), puis envoie ROUNDS requêtes MESSAGE_C2S_TRENDING l'une après
+ * l'autre, en attendant à chaque fois la fin de la réponse. C'est la requête la plus légère qui a une réponse : sans
+ * sujet tendance, elle n'en comporte qu'une trame. Le serveur doit être lancé avec TWIIIIITER_RATE_LIMIT_LIST=0.
+ *
+ * Avec TAGS, le banc publie d'abord autant de sujets (au plus TRENDING_TOP, c.f. "/server/trending.h") pour que chaque
+ * réponse comporte TAGS + 1 trames, écrites une à une par le serveur : c'est là que Nagle et les acquittements
+ * retardés se font sentir, c.f. TWIIIIITER_LOW_LATENCY.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "address.h"
+#include "codec.h"
+#include "constants.h"
+
+#define DEFAULT_ROUNDS 10000
+// Les premiers allers-retours (connexion, caches froids) ne sont pas mesurés
+#define WARMUP_ROUNDS 100
+// Sujets tendance rendus par le serveur, c.f. TRENDING_TOP
+#define MAX_TAGS 10
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void send_frame(int fd, const message_c2s* message) {
+    char frame[IO_BUFFER_SIZE] = { 0 };
+    encode_c2s(message, frame);
+    for (size_t sent = 0; sent < IO_BUFFER_SIZE;) {
+        ssize_t len = send(fd, frame + sent, IO_BUFFER_SIZE - sent, 0);
+        if (len <= 0) {
+            perror("send");
+            exit(1);
+        }
+        sent += len;
+    }
+}
+
+static void receive_frame(int fd, message_s2c* message) {
+    char frame[IO_BUFFER_SIZE];
+    for (size_t received = 0; received < IO_BUFFER_SIZE;) {
+        ssize_t len = recv(fd, frame + received, IO_BUFFER_SIZE - received, 0);
+        if (len <= 0) {
+            fprintf(stderr, "Connection closed by the server\n");
+            exit(1);
+        }
+        received += len;
+    }
+    if (!decode_s2c(frame, message)) {
+        fprintf(stderr, "Invalid frame from the server\n");
+        exit(1);
+    }
+}
+
+static int compare_durations(const void* a, const void* b) {
+    int64_t left = *(const int64_t*) a, right = *(const int64_t*) b;
+    return (left > right) - (left < right);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 4) {
+        printf("Usage: %s ADDRESS [ROUNDS] [TAGS]\n", argv[0]);
+        return 1;
+    }
+    size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_ROUNDS;
+    if (rounds == 0) rounds = DEFAULT_ROUNDS;
+    size_t tags = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+    if (tags > MAX_TAGS) tags = MAX_TAGS;
+
+    int fd = address_connect(argv[1], DEFAULT_PORT);
+    if (fd < 0) {
+        fprintf(stderr, "Can't connect to %s: %s\n", argv[1], errno ? strerror(errno) : "unknown host");
+        return 1;
+    }
+
+    message_c2s join = { .tag = MESSAGE_C2S_JOIN_AS };
+    snprintf(join.join_as, sizeof join.join_as, "lat%03u", (unsigned) getpid() % 1000);
+    send_frame(fd, &join);
+    message_s2c reply;
+    do receive_frame(fd, &reply); while (reply.tag != MESSAGE_S2C_LOGIN_STATUS);
+
+    // Chaque twiiiiit est renvoyé à son auteur, ce qui confirme sa publication
+    for (size_t i = 0; i < tags; i++) {
+        message_c2s publish = { .tag = MESSAGE_C2S_PUBLISH };
+        snprintf(publish.publish, sizeof publish.publish, "#latency%zu", i);
+        send_frame(fd, &publish);
+        do receive_frame(fd, &reply); while (reply.tag != MESSAGE_S2C_RECEIVED_MESSAGE);
+    }
+
+    int64_t* durations = malloc(rounds * sizeof *durations);
+    if (durations == NULL) return 1;
+    message_c2s request = { .tag = MESSAGE_C2S_TRENDING };
+    for (size_t i = 0; i < WARMUP_ROUNDS + rounds; i++) {
+        int64_t start = now_ns();
+        send_frame(fd, &request);
+        // La liste se termine par une entrée vide ; un refus du limiteur arrêterait la mesure
+        do {
+            receive_frame(fd, &reply);
+            if (reply.tag == MESSAGE_S2C_THROTTLED) {
+                fprintf(stderr, "Throttled by the server, set TWIIIIITER_RATE_LIMIT_LIST=0\n");
+                return 1;
+            }
+        } while (reply.tag != MESSAGE_S2C_TRENDING_ENTRY || reply.trending_entry.tag[0] != 0);
+        if (i >= WARMUP_ROUNDS) durations[i - WARMUP_ROUNDS] = now_ns() - start;
+    }
+    close(fd);
+
+    double total = 0;
+    for (size_t i = 0; i < rounds; i++) total += durations[i];
+    qsort(durations, rounds, sizeof *durations, compare_durations);
+    printf("[LATENCY] %s: %zu round trips of %zu frames, mean %.1fus, p50 %.1fus, p99 %.1fus, max %.1fus\n",
+           argv[1], rounds, tags + 1, total / rounds / 1e3, durations[rounds / 2] / 1e3,
+           durations[rounds * 99 / 100] / 1e3, durations[rounds - 1] / 1e3);
+    free(durations);
+
+    return 0;
+}
@@ -0,0 +1,351 @@
+/**
+ * Rejoue une capture du trafic d'un serveur (c.f. "/common/capture.h") contre un autre, et en mesure le débit et les
+ * latences
+ *
+ * Usage : twiiiiiter-replay ADDRESS CAPTURE [SPEED]
+ *
+ * Chaque connexion de la capture est rouverte vers ADDRESS (c.f. "/common/address.h"), et les trames sont renvoyées
+ * dans l'ordre de la capture, en respectant leurs intervalles divisés par SPEED : 1 (par défaut) rejoue la charge telle
+ * qu'enregistrée, 10 dix fois plus vite, et 0 aussi vite que possible. Le serveur rejoué devrait partir d'une base vide
+ * (TWIIIIITER_DATABASE_FILE=:memory:) et avoir la même configuration que celui qui a enregistré, limites de débit
+ * comprises, pour recevoir les mêmes requêtes dans le même état.
+ *
+ * Les réponses sont lues au fil de l'eau. La latence d'une requête va de son envoi à la fin de sa réponse : l'écho
+ * d'une publication, la dernière entrée d'une liste, ... Les requêtes refusées par le limiteur de débit sont comptées à
+ * part, et celles qui n'attendent pas de réponse (MESSAGE_C2S_PONG, MESSAGE_C2S_ACK, MESSAGE_C2S_PUBLISH_CHANNEL) ne
+ * sont pas mesurées. Une connexion fermée dans la capture ne l'est qu'une fois ses requêtes servies.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "address.h"
+#include "capture.h"
+#include "codec.h"
+#include "constants.h"
+
+#define CONNECTION_BUCKETS 4096
+// Requêtes suivies par connexion : au-delà, la plus ancienne est comptée sans réponse
+#define MAX_PENDING 64
+// Trames envoyées d'affilée avant de relever les réponses, quand le rejeu a du retard ou va aussi vite que possible
+#define SEND_BURST 64
+#define EPOLL_MAX_EVENTS 64
+// Temps laissé aux dernières requêtes pour recevoir leur réponse
+#define DRAIN_TIMEOUT_MS 5000
+
+typedef struct {
+    int64_t sent; // c.f. now_ns()
+    uint32_t tag;
+} pending_request;
+
+typedef struct replay_connection_s {
+    uint64_t id; // Dans la capture
+    int fd; // -1 une fois fermée par le serveur
+    user_name name; // Du dernier MESSAGE_C2S_JOIN_AS, pour reconnaître l'écho de ses publications
+    char frame[IO_BUFFER_SIZE]; // Trame en cours de réception
+    size_t frame_len;
+    pending_request pending[MAX_PENDING]; // Dans l'ordre d'envoi
+    size_t pending_len;
+    bool closing; // Fermée dans la capture, mais des requêtes attendent encore leur réponse
+
+    struct replay_connection_s* next; // Dans l'alvéole de `id`
+} replay_connection;
+
+static replay_connection* connections[CONNECTION_BUCKETS];
+static int epoll;
+
+static size_t connections_opened = 0;
+static size_t frames_sent = 0;
+static size_t frames_skipped = 0; // Trames de connexions déjà fermées par le serveur
+static size_t frames_received = 0;
+static int64_t last_reply = 0; // c.f. now_ns()
+static size_t pending_total = 0;
+static size_t throttled = 0;
+static size_t unanswered = 0;
+
+static int64_t* latencies = NULL;
+static size_t latencies_len = 0, latencies_cap = 0;
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static replay_connection** connection_find(uint64_t id) {
+    replay_connection** connection = &connections[id % CONNECTION_BUCKETS];
+    while (*connection != NULL && (*connection)->id != id) connection = &(*connection)->next;
+    return connection;
+}
+
+static replay_connection* connection_open(const char* address, uint64_t id) {
+    replay_connection** slot = connection_find(id);
+    if (*slot != NULL) return *slot;
+
+    int fd = address_connect(address, DEFAULT_PORT);
+    if (fd < 0) {
+        fprintf(stderr, "Can't connect to %s: %s\n", address, errno ? strerror(errno) : "unknown host");
+        exit(1);
+    }
+    replay_connection* connection = malloc(sizeof(replay_connection));
+    if (connection == NULL) exit(1);
+    *connection = (replay_connection) { .id = id, .fd = fd };
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    connections_opened++;
+    *slot = connection;
+    return connection;
+}
+
+static void connection_disconnect(replay_connection* connection) {
+    if (connection->fd < 0) return;
+    epoll_ctl(epoll, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    unanswered += connection->pending_len;
+    pending_total -= connection->pending_len;
+    connection->pending_len = 0;
+}
+
+/**
+ * Ferme une connexion, une fois ses requêtes en attente servies : sans quoi un rejeu plus rapide que la capture
+ * fermerait les connexions avant que leurs réponses n'arrivent
+ */
+static void connection_close(uint64_t id) {
+    replay_connection** slot = connection_find(id);
+    replay_connection* connection = *slot;
+    if (connection == NULL) return;
+    if (connection->pending_len > 0 && connection->fd >= 0) {
+        connection->closing = true;
+        return;
+    }
+
+    connection_disconnect(connection);
+    *slot = connection->next;
+    free(connection);
+}
+
+static void pending_remove(replay_connection* connection, size_t i) {
+    memmove(&connection->pending[i], &connection->pending[i + 1],
+            (connection->pending_len - i - 1) * sizeof(pending_request));
+    connection->pending_len--;
+    pending_total--;
+}
+
+static bool expects_reply(uint32_t tag) {
+    return tag != MESSAGE_C2S_PONG && tag != MESSAGE_C2S_ACK && tag != MESSAGE_C2S_PUBLISH_CHANNEL;
+}
+
+static void send_frame(replay_connection* connection, const char frame[IO_BUFFER_SIZE]) {
+    if (connection->fd < 0) {
+        frames_skipped++;
+        return;
+    }
+
+    message_c2s message;
+    bool tracked = decode_c2s(frame, &message) && expects_reply(message.tag);
+    if (tracked && message.tag == MESSAGE_C2S_JOIN_AS) memcpy(connection->name, message.join_as, sizeof(user_name));
+    if (tracked) {
+        if (connection->pending_len == MAX_PENDING) {
+            pending_remove(connection, 0);
+            unanswered++;
+        }
+        connection->pending[connection->pending_len++] = (pending_request) { .sent = now_ns(), .tag = message.tag };
+        pending_total++;
+    }
+
+    for (size_t sent = 0; sent < IO_BUFFER_SIZE;) {
+        ssize_t len = send(connection->fd, frame + sent, IO_BUFFER_SIZE - sent, MSG_NOSIGNAL);
+        if (len <= 0) {
+            // Déconnexion par le serveur, que la lecture n'a pas encore vue
+            connection_disconnect(connection);
+            return;
+        }
+        sent += len;
+    }
+    frames_sent++;
+}
+
+/**
+ * Renvoie true si `reply` termine la réponse à une requête de type `tag`, envoyée par `connection`
+ */
+static bool completes(const replay_connection* connection, uint32_t tag, const message_s2c* reply) {
+    switch (reply->tag) {
+        case MESSAGE_S2C_LOGIN_STATUS:
+            return tag == MESSAGE_C2S_JOIN_AS;
+        case MESSAGE_S2C_SUBSCRIBE_RESULT:
+            return tag == MESSAGE_C2S_SUBSCRIBE_TO || tag == MESSAGE_C2S_UNSUBSCRIBE_TO
+                || tag == MESSAGE_C2S_JOIN_CHANNEL || tag == MESSAGE_C2S_LEAVE_CHANNEL;
+        case MESSAGE_S2C_SUBSCRIBE_BATCH_RESULT:
+            return tag == MESSAGE_C2S_SUBSCRIBE_BATCH || tag == MESSAGE_C2S_UNSUBSCRIBE_BATCH;
+        case MESSAGE_S2C_SUBSCRIPTION_ENTRY:
+            return tag == MESSAGE_C2S_LIST_SUBSCRIPTIONS && reply->subscription_entry[0] == 0;
+        case MESSAGE_S2C_RECEIVED_MESSAGE:
+            // L'écho d'une publication, que l'on distingue des twiiiiits des comptes suivis par son auteur·ice
+            return tag == MESSAGE_C2S_PUBLISH
+                && strncmp(reply->received_message.author, connection->name, MAX_USERNAME_LENGTH) == 0;
+        case MESSAGE_S2C_SEARCH_END:
+            return tag == MESSAGE_C2S_SEARCH;
+        case MESSAGE_S2C_TRENDING_ENTRY:
+            return tag == MESSAGE_C2S_TRENDING && reply->trending_entry.tag[0] == 0;
+        case MESSAGE_S2C_TIMELINE_END:
+            return tag == MESSAGE_C2S_FETCH_TIMELINE;
+        case MESSAGE_S2C_THROTTLED:
+            return tag == reply->throttled.request;
+        default:
+            return false;
+    }
+}
+
+static void handle_reply(replay_connection* connection, const message_s2c* reply) {
+    frames_received++;
+    last_reply = now_ns();
+    for (size_t i = 0; i < connection->pending_len; i++) {
+        if (!completes(connection, connection->pending[i].tag, reply)) continue;
+
+        if (reply->tag == MESSAGE_S2C_THROTTLED) {
+            throttled++;
+        } else {
+            if (latencies_len == latencies_cap) {
+                latencies_cap = latencies_cap ? latencies_cap * 2 : 4096;
+                latencies = realloc(latencies, latencies_cap * sizeof *latencies);
+                if (latencies == NULL) exit(1);
+            }
+            latencies[latencies_len++] = now_ns() - connection->pending[i].sent;
+        }
+        pending_remove(connection, i);
+        return;
+    }
+}
+
+static void receive_replies(replay_connection* connection) {
+    while (connection->fd >= 0) {
+        ssize_t len = recv(connection->fd, connection->frame + connection->frame_len,
+                           IO_BUFFER_SIZE - connection->frame_len, MSG_DONTWAIT);
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (len <= 0) {
+            connection_disconnect(connection);
+            return;
+        }
+
+        connection->frame_len += len;
+        if (connection->frame_len < IO_BUFFER_SIZE) continue;
+        connection->frame_len = 0;
+        message_s2c reply;
+        if (decode_s2c(connection->frame, &reply)) handle_reply(connection, &reply);
+        if (connection->closing && connection->pending_len == 0) {
+            connection_close(connection->id);
+            return;
+        }
+    }
+}
+
+static void poll_replies(int timeout_ms) {
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int count;
+    do count = epoll_wait(epoll, events, EPOLL_MAX_EVENTS, timeout_ms); while (count < 0 && errno == EINTR);
+    for (int i = 0; i < count; i++) receive_replies(events[i].data.ptr);
+}
+
+static int compare_durations(const void* a, const void* b) {
+    int64_t left = *(const int64_t*) a, right = *(const int64_t*) b;
+    return (left > right) - (left < right);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s ADDRESS CAPTURE [SPEED]\n", argv[0]);
+        return 1;
+    }
+    const char* address = argv[1];
+    double speed = argc > 3 ? strtod(argv[3], NULL) : 1;
+    if (speed < 0) speed = 0;
+
+    capture_file capture;
+    capture_file_header header;
+    if (!capture_open(&capture, argv[2], &header)) {
+        fprintf(stderr, "Can't read the capture %s\n", argv[2]);
+        return 1;
+    }
+    epoll = epoll_create1(0);
+    if (epoll < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    capture_record record;
+    bool more = capture_read(&capture, &record);
+    int64_t started = now_ns();
+    int64_t max_lag = 0;
+    while (more) {
+        for (size_t burst = 0; more && burst < SEND_BURST; burst++) {
+            if (speed > 0) {
+                int64_t due = started + (int64_t) (record.time_us * 1000 / speed);
+                int64_t lag = now_ns() - due;
+                if (lag < 0) break;
+                if (lag > max_lag) max_lag = lag;
+            }
+
+            if (record.kind == CAPTURE_CLOSE) connection_close(record.connection);
+            else {
+                replay_connection* connection = connection_open(address, record.connection);
+                if (record.kind == CAPTURE_FRAME) send_frame(connection, record.frame);
+            }
+            more = capture_read(&capture, &record);
+        }
+
+        // On relève les réponses en attendant la trame suivante, sans attendre si elle est déjà due
+        int timeout_ms = 0;
+        if (more && speed > 0) {
+            int64_t wait = started + (int64_t) (record.time_us * 1000 / speed) - now_ns();
+            if (wait > 0) timeout_ms = (int) ((wait + 999999) / 1000000);
+        }
+        poll_replies(timeout_ms);
+    }
+    double sent_s = (now_ns() - started) / 1e9;
+    if (capture.corrupted) fprintf(stderr, "The capture is truncated, replaying what could be read\n");
+    capture_close(&capture);
+
+    int64_t drain_deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    while (pending_total > 0 && now_ns() < drain_deadline) poll_replies(10);
+    // Les requêtes encore en attente sont comptées sans réponse
+    for (size_t i = 0; i < CONNECTION_BUCKETS; i++) {
+        for (replay_connection* connection = connections[i], *next; connection != NULL; connection = next) {
+            next = connection->next;
+            connection_disconnect(connection);
+            free(connection);
+        }
+    }
+    close(epoll);
+    // Le débit compte jusqu'à la dernière réponse, le serveur pouvant être en retard sur un rejeu rapide
+    double elapsed_s = (last_reply - started) / 1e9;
+    if (elapsed_s < sent_s) elapsed_s = sent_s;
+
+    printf("[REPLAY] %zu connections, %zu frames sent in %.3f s, answered in %.3f s (%.0f frames/s), %zu replies",
+           connections_opened, frames_sent, sent_s, elapsed_s, frames_sent / (elapsed_s > 0 ? elapsed_s : 1),
+           frames_received);
+    if (speed > 0) printf(", max lag %.1f ms", max_lag / 1e6);
+    printf("\n");
+    if (latencies_len > 0) {
+        double total = 0;
+        for (size_t i = 0; i < latencies_len; i++) total += latencies[i];
+        qsort(latencies, latencies_len, sizeof *latencies, compare_durations);
+        printf("[REPLAY] %zu requests answered: mean %.1fus, p50 %.1fus, p99 %.1fus, max %.1fus\n",
+               latencies_len, total / latencies_len / 1e3, latencies[latencies_len / 2] / 1e3,
+               latencies[latencies_len * 99 / 100] / 1e3, latencies[latencies_len - 1] / 1e3);
+    }
+    printf("[REPLAY] %zu throttled, %zu unanswered, %zu frames skipped after a disconnection\n",
+           throttled, unanswered, frames_skipped);
+    free(latencies);
+
+    return 0;
+}
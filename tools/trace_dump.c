@@ -0,0 +1,154 @@
+/**
+ * Convertit un fichier de trace du serveur (c.f. "/common/trace.h")
+ *
+ * Usage : twiiiiiter-trace-dump --chrome|--folded FILE
+ *
+ * --chrome produit un JSON à ouvrir dans chrome://tracing ou https://ui.perfetto.dev, et --folded des piles repliées
+ * ("a;b;c durée_propre_us") à passer à flamegraph.pl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define MAX_DEPTH 64
+
+typedef struct {
+    char stack[MAX_DEPTH * TRACE_NAME_LENGTH];
+    double self_us;
+} folded_entry;
+
+static folded_entry* folded = NULL;
+static size_t folded_len = 0, folded_cap = 0;
+
+static void folded_add(const char* stack, double self_us) {
+    for (size_t i = 0; i < folded_len; i++) {
+        if (strcmp(folded[i].stack, stack) == 0) {
+            folded[i].self_us += self_us;
+            return;
+        }
+    }
+
+    if (folded_len == folded_cap) {
+        folded_cap = folded_cap ? folded_cap * 2 : 64;
+        folded = realloc(folded, folded_cap * sizeof *folded);
+    }
+    strcpy(folded[folded_len].stack, stack);
+    folded[folded_len++].self_us = self_us;
+}
+
+typedef struct {
+    uint16_t span;
+    uint64_t start;
+    double children_us;
+} open_span;
+
+/**
+ * Reconstitue les piles d'un thread. Les fins de portée dont le début a été écrasé par le tampon circulaire sont
+ * ignorées.
+ */
+static void fold_thread(const trace_file_header* header, char names[][TRACE_NAME_LENGTH],
+                        const trace_record* records, uint64_t count) {
+    open_span stack[MAX_DEPTH];
+    int depth = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        const trace_record* record = &records[i];
+        if (record->span >= header->span_count) continue;
+        if (record->phase == TRACE_PHASE_BEGIN) {
+            if (depth == MAX_DEPTH) continue;
+            stack[depth++] = (open_span) { .span = record->span, .start = record->timestamp, .children_us = 0 };
+        } else if (depth > 0 && stack[depth - 1].span == record->span) {
+            open_span* span = &stack[--depth];
+            double total_us = (double) (record->timestamp - span->start) / header->ticks_per_us;
+
+            char path[MAX_DEPTH * TRACE_NAME_LENGTH] = "";
+            for (int j = 0; j <= depth; j++) {
+                if (j > 0) strcat(path, ";");
+                strcat(path, names[stack[j].span]);
+            }
+            folded_add(path, total_us - span->children_us);
+
+            if (depth > 0) stack[depth - 1].children_us += total_us;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3 || (strcmp(argv[1], "--chrome") != 0 && strcmp(argv[1], "--folded") != 0)) {
+        printf("Usage: %s --chrome|--folded FILE\n", argv[0]);
+        return 1;
+    }
+    bool chrome = strcmp(argv[1], "--chrome") == 0;
+
+    FILE* file = fopen(argv[2], "r");
+    if (file == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    trace_file_header header;
+    if (fread(&header, sizeof header, 1, file) != 1 || memcmp(header.magic, TRACE_FILE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s is not a twiiiiiter trace\n", argv[2]);
+        return 1;
+    }
+
+    char (*names)[TRACE_NAME_LENGTH] = calloc(header.span_count, TRACE_NAME_LENGTH);
+    if (fread(names, TRACE_NAME_LENGTH, header.span_count, file) != header.span_count) return 1;
+
+    // Les horodatages sont rendus relatifs au plus ancien enregistrement, tous threads confondus
+    long records_start = ftell(file);
+    uint64_t origin = UINT64_MAX;
+    for (uint32_t t = 0; t < header.thread_count; t++) {
+        trace_file_thread thread;
+        if (fread(&thread, sizeof thread, 1, file) != 1) return 1;
+        trace_record first;
+        if (thread.record_count > 0 && fread(&first, sizeof first, 1, file) == 1 && first.timestamp < origin) {
+            origin = first.timestamp;
+        }
+        fseek(file, (long) (thread.record_count - (thread.record_count > 0)) * (long) sizeof(trace_record), SEEK_CUR);
+    }
+    fseek(file, records_start, SEEK_SET);
+
+    if (chrome) printf("{\"traceEvents\":[\n");
+    bool first_event = true;
+
+    for (uint32_t t = 0; t < header.thread_count; t++) {
+        trace_file_thread thread;
+        if (fread(&thread, sizeof thread, 1, file) != 1) return 1;
+        trace_record* records = malloc(thread.record_count * sizeof(trace_record) + 1);
+        if (fread(records, sizeof(trace_record), thread.record_count, file) != thread.record_count) return 1;
+
+        if (chrome) {
+            for (uint64_t i = 0; i < thread.record_count; i++) {
+                if (records[i].span >= header.span_count) continue;
+                printf(
+                    "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                    first_event ? "" : ",\n",
+                    names[records[i].span],
+                    records[i].phase == TRACE_PHASE_BEGIN ? "B" : "E",
+                    (double) (records[i].timestamp - origin) / header.ticks_per_us,
+                    thread.thread_id
+                );
+                first_event = false;
+            }
+        } else {
+            fold_thread(&header, names, records, thread.record_count);
+        }
+
+        free(records);
+    }
+
+    if (chrome) {
+        printf("\n]}\n");
+    } else {
+        for (size_t i = 0; i < folded_len; i++) {
+            printf("%s %.0f\n", folded[i].stack, folded[i].self_us);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}